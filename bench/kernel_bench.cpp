@@ -0,0 +1,423 @@
+// Per format timings of the pixel conversions: every IMAGE_FORMATS entry decoded to RGBA8888 and encoded from it,
+// the HDR formats also to and from RGBA32323232F. Each case runs at several sizes and thread counts and reports ns/pixel
+// and how well it scales. On the way every result is checked twice: the SIMD kernels against the scalar ones bit for bit,
+// and the scalar ones against VTFLib::CVTFFile::Convert, which is what the viewer used before and what the table has to agree with.
+//
+//   vtfe_kernel_bench [--sizes 64,256,1024,4096,8192] [--threads 1,2,4] [--formats DXT5,P8] [--min-time 0.2] [--output results.json]
+
+#include "../src/PixelConversion.h"
+#include "../src/flagsandformats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchSettings
+{
+	std::vector<vlUInt> sizes = { 64, 256, 1024, 4096, 8192 };
+	std::vector<std::size_t> threads;
+	std::vector<std::string> formats;
+	double minTime = 0.2;
+	std::string output;
+};
+
+struct ThreadTiming
+{
+	std::size_t threads;
+	double nsPerPixel;
+	double efficiency;
+};
+
+struct CaseResult
+{
+	const char *op;
+	const char *source;
+	const char *dest;
+	vlUInt size;
+	bool supported;
+	bool matchesScalar;
+	bool matchesVTFLib;
+	std::vector<ThreadTiming> timings;
+};
+
+static const char *FormatName( VTFImageFormat format )
+{
+	for ( const auto &entry : IMAGE_FORMATS )
+		if ( entry.format == format )
+			return entry.name;
+	return "Unknown";
+}
+
+static std::vector<std::string> SplitList( const char *text )
+{
+	std::vector<std::string> items;
+	std::string item;
+	for ( const char *c = text;; c++ )
+	{
+		if ( *c == ',' || *c == '\0' )
+		{
+			if ( !item.empty() )
+				items.push_back( item );
+			item.clear();
+			if ( *c == '\0' )
+				break;
+		}
+		else
+			item += *c;
+	}
+	return items;
+}
+
+// Whole string has to be a number, anything else is a usage error instead of an exception
+static bool ParseUnsigned( const std::string &text, unsigned long &value )
+{
+	if ( text.empty() || text[0] == '-' )
+		return false;
+	char *pEnd;
+	value = std::strtoul( text.c_str(), &pEnd, 10 );
+	return *pEnd == '\0';
+}
+
+static bool ParseArguments( int argc, char **argv, BenchSettings &settings )
+{
+	for ( int i = 1; i < argc; i++ )
+	{
+		const std::string argument = argv[i];
+		if ( i + 1 >= argc )
+			return false;
+
+		const char *value = argv[++i];
+		if ( argument == "--sizes" )
+		{
+			settings.sizes.clear();
+			for ( const auto &item : SplitList( value ) )
+			{
+				unsigned long size;
+				if ( !ParseUnsigned( item, size ) || size > 65536 )
+					return false;
+				settings.sizes.push_back( std::max( 4ul, size ) );
+			}
+		}
+		else if ( argument == "--threads" )
+		{
+			settings.threads.clear();
+			for ( const auto &item : SplitList( value ) )
+			{
+				unsigned long threads;
+				if ( !ParseUnsigned( item, threads ) )
+					return false;
+				settings.threads.push_back( std::max( 1ul, threads ) );
+			}
+		}
+		else if ( argument == "--formats" )
+			settings.formats = SplitList( value );
+		else if ( argument == "--min-time" )
+		{
+			char *pEnd;
+			settings.minTime = std::strtod( value, &pEnd );
+			if ( *pEnd != '\0' || !( settings.minTime >= 0 ) )
+				return false;
+		}
+		else if ( argument == "--output" )
+			settings.output = value;
+		else
+			return false;
+	}
+
+	// 1, 2, 4 .. up to every hardware thread
+	if ( settings.threads.empty() )
+	{
+		const std::size_t hardwareThreads = std::max( 1u, std::thread::hardware_concurrency() );
+		for ( std::size_t threads = 1; threads < hardwareThreads; threads *= 2 )
+			settings.threads.push_back( threads );
+		settings.threads.push_back( hardwareThreads );
+	}
+
+	// Efficiency is relative to the single thread run, which has to go first
+	settings.threads.erase( std::remove( settings.threads.begin(), settings.threads.end(), 1 ), settings.threads.end() );
+	settings.threads.insert( settings.threads.begin(), 1 );
+	return true;
+}
+
+// Something with gradients, edges and noise, so the block compressors have real work to do
+static void FillPattern( vlByte *rgba, vlUInt size )
+{
+	uint32_t seed = 0x9E3779B9u;
+	for ( vlUInt y = 0; y < size; y++ )
+	{
+		for ( vlUInt x = 0; x < size; x++, rgba += 4 )
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const vlByte noise = static_cast<vlByte>( seed >> 28 );
+			rgba[0] = static_cast<vlByte>( x * 255 / size ) ^ noise;
+			rgba[1] = static_cast<vlByte>( y * 255 / size );
+			rgba[2] = ( ( x / 16 + y / 16 ) & 1 ) ? 220 : 30;
+			rgba[3] = static_cast<vlByte>( 255 - ( x + y ) * 127 / size );
+		}
+	}
+}
+
+// The same as floats, with values above 1 so the HDR paths see them
+static void FillPattern( float *rgba, vlUInt size )
+{
+	for ( vlUInt y = 0; y < size; y++ )
+	{
+		for ( vlUInt x = 0; x < size; x++, rgba += 4 )
+		{
+			rgba[0] = std::exp2( x * 16.0f / size - 8.0f );
+			rgba[1] = static_cast<float>( y ) / size;
+			rgba[2] = ( ( x / 16 + y / 16 ) & 1 ) ? 4.0f : 0.125f;
+			rgba[3] = 1.0f - static_cast<float>( x + y ) / ( 2 * size );
+		}
+	}
+}
+
+// Formats that can't be encoded ( P8 ) are benchmarked on noise
+static void FillNoise( std::vector<vlByte> &data )
+{
+	uint32_t seed = 0x12345678u;
+	for ( auto &byte : data )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		byte = static_cast<vlByte>( seed >> 24 );
+	}
+}
+
+static uint64_t HashBytes( const std::vector<vlByte> &data )
+{
+	uint64_t hash = 14695981039346656037ull;
+	for ( const vlByte byte : data )
+		hash = ( hash ^ byte ) * 1099511628211ull;
+	return hash;
+}
+
+// How far apart two surfaces of the same uncompressed format are, in units of the format's channel type:
+// 8 and 16 bit channels by integer step, float channels relative to the value
+static double MaxChannelError( const std::vector<vlByte> &a, const std::vector<vlByte> &b, VTFImageFormat format )
+{
+	double maxError = 0;
+	switch ( format )
+	{
+		case IMAGE_FORMAT_RGBA32323232F:
+		case IMAGE_FORMAT_RGB323232F:
+		case IMAGE_FORMAT_R32F:
+			for ( std::size_t i = 0; i + 4 <= a.size(); i += 4 )
+			{
+				float x, y;
+				std::memcpy( &x, a.data() + i, 4 );
+				std::memcpy( &y, b.data() + i, 4 );
+				maxError = std::max( maxError, std::abs( static_cast<double>( x ) - y ) / std::max( 1.0, std::abs( static_cast<double>( y ) ) ) );
+			}
+			return maxError;
+		case IMAGE_FORMAT_RGBA16161616F:
+		case IMAGE_FORMAT_RGBA16161616:
+			for ( std::size_t i = 0; i + 2 <= a.size(); i += 2 )
+			{
+				uint16_t x, y;
+				std::memcpy( &x, a.data() + i, 2 );
+				std::memcpy( &y, b.data() + i, 2 );
+				maxError = std::max( maxError, std::abs( static_cast<double>( x ) - y ) );
+			}
+			return maxError;
+		default:
+			for ( std::size_t i = 0; i < a.size(); i++ )
+				maxError = std::max( maxError, std::abs( static_cast<double>( a[i] ) - b[i] ) );
+			return maxError;
+	}
+}
+
+// Rounding may differ by a step, a wrong channel order or scale never stays that close
+static bool MatchesVTFLib( const std::vector<vlByte> &source, const std::vector<vlByte> &converted, vlUInt size, VTFImageFormat sourceFormat, VTFImageFormat destFormat )
+{
+	// Block encoders are allowed to pick different endpoints, the decode side of those formats is checked instead
+	if ( VTFLib::CVTFFile::GetImageFormatInfo( destFormat ).bIsCompressed )
+		return true;
+
+	std::vector<vlByte> reference( converted.size() );
+	std::vector<vlByte> sourceCopy( source );
+	if ( !VTFLib::CVTFFile::Convert( sourceCopy.data(), reference.data(), size, size, sourceFormat, destFormat ) )
+		return true;
+
+	const bool bFloat = destFormat == IMAGE_FORMAT_RGBA32323232F || destFormat == IMAGE_FORMAT_RGB323232F || destFormat == IMAGE_FORMAT_R32F;
+	return MaxChannelError( converted, reference, destFormat ) <= ( bFloat ? 1e-3 : 1.0 );
+}
+
+static std::size_t SurfaceSize( vlUInt size, VTFImageFormat format )
+{
+	return VTFLib::CVTFFile::ComputeImageSize( size, size, 1, format );
+}
+
+// Seconds per run, the median of as many runs as fit in minTime after one warm up run
+static double TimeConversion( const std::vector<vlByte> &source, std::vector<vlByte> &dest, vlUInt size, VTFImageFormat sourceFormat, VTFImageFormat destFormat, double minTime )
+{
+	using Clock = std::chrono::steady_clock;
+
+	PixelConversion::Convert( source.data(), dest.data(), size, size, sourceFormat, destFormat );
+
+	std::vector<double> runs;
+	double total = 0;
+	while ( total < minTime && runs.size() < 1000 )
+	{
+		const auto start = Clock::now();
+		PixelConversion::Convert( source.data(), dest.data(), size, size, sourceFormat, destFormat );
+		const double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+		runs.push_back( seconds );
+		total += seconds;
+	}
+
+	std::sort( runs.begin(), runs.end() );
+	return runs[runs.size() / 2];
+}
+
+static CaseResult RunCase( const BenchSettings &settings, const char *op, VTFImageFormat sourceFormat, VTFImageFormat destFormat, VTFImageFormat patternFormat, vlUInt size )
+{
+	CaseResult result { op, FormatName( sourceFormat ), FormatName( destFormat ), size, false, true, true, {} };
+	if ( SurfaceSize( size, sourceFormat ) == 0 || SurfaceSize( size, destFormat ) == 0 )
+		return result;
+
+	// Build the source from the pattern, noise when there's no way to encode it
+	std::vector<vlByte> source( SurfaceSize( size, sourceFormat ) );
+	{
+		std::vector<vlByte> pattern( SurfaceSize( size, patternFormat ) );
+		if ( patternFormat == IMAGE_FORMAT_RGBA32323232F )
+			FillPattern( reinterpret_cast<float *>( pattern.data() ), size );
+		else
+			FillPattern( pattern.data(), size );
+
+		PixelConversion::SetLimits( 0, 0 );
+		if ( sourceFormat == patternFormat )
+			source = std::move( pattern );
+		else if ( !PixelConversion::Convert( pattern.data(), source.data(), size, size, patternFormat, sourceFormat ) )
+			FillNoise( source );
+	}
+
+	std::vector<vlByte> dest( SurfaceSize( size, destFormat ) );
+
+	// The scalar output is the reference, nothing else may differ from it by a single bit
+	result.supported = PixelConversion::Convert( source.data(), dest.data(), size, size, sourceFormat, destFormat );
+	if ( !result.supported )
+		return result;
+	const uint64_t reference = HashBytes( dest );
+	result.matchesVTFLib = MatchesVTFLib( source, dest, size, sourceFormat, destFormat );
+
+	const double pixels = static_cast<double>( size ) * size;
+	std::vector<double> seconds;
+	for ( const std::size_t threads : settings.threads )
+	{
+		PixelConversion::SetLimits( 2, threads );
+		seconds.push_back( TimeConversion( source, dest, size, sourceFormat, destFormat, settings.minTime ) );
+		result.matchesScalar = result.matchesScalar && HashBytes( dest ) == reference;
+	}
+
+	// Settings put the single thread run first. 1.0 is perfect scaling, formats VTFLib converts stay on one thread and drop off as 1 / threads.
+	for ( std::size_t i = 0; i < seconds.size(); i++ )
+		result.timings.push_back( { settings.threads[i], seconds[i] * 1e9 / pixels, seconds[0] / ( settings.threads[i] * seconds[i] ) } );
+	return result;
+}
+
+static bool IsWanted( const BenchSettings &settings, VTFImageFormat format )
+{
+	return settings.formats.empty() || std::find( settings.formats.begin(), settings.formats.end(), FormatName( format ) ) != settings.formats.end();
+}
+
+static bool IsHDR( VTFImageFormat format )
+{
+	switch ( format )
+	{
+		case IMAGE_FORMAT_RGBA16161616F:
+		case IMAGE_FORMAT_RGBA16161616:
+		case IMAGE_FORMAT_R32F:
+		case IMAGE_FORMAT_RGB323232F:
+		case IMAGE_FORMAT_RGBA32323232F:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void WriteJSON( FILE *file, const std::vector<CaseResult> &results, int simdLevel )
+{
+	std::fprintf( file, "{\n\t\"simdLevel\": %d,\n\t\"hardwareThreads\": %u,\n\t\"results\": [", simdLevel, std::thread::hardware_concurrency() );
+	for ( std::size_t i = 0; i < results.size(); i++ )
+	{
+		const auto &result = results[i];
+		std::fprintf( file, "%s\n\t\t{ \"op\": \"%s\", \"source\": \"%s\", \"dest\": \"%s\", \"size\": %u, \"supported\": %s, \"matchesScalar\": %s, \"matchesVTFLib\": %s, \"timings\": [",
+					  i ? "," : "", result.op, result.source, result.dest, result.size, result.supported ? "true" : "false", result.matchesScalar ? "true" : "false",
+					  result.matchesVTFLib ? "true" : "false" );
+		for ( std::size_t t = 0; t < result.timings.size(); t++ )
+		{
+			const auto &timing = result.timings[t];
+			std::fprintf( file, "%s { \"threads\": %zu, \"nsPerPixel\": %.4f, \"efficiency\": %.3f }", t ? "," : "", timing.threads, timing.nsPerPixel, timing.efficiency );
+		}
+		std::fprintf( file, " ] }" );
+	}
+	std::fprintf( file, "\n\t]\n}\n" );
+}
+
+int main( int argc, char **argv )
+{
+	BenchSettings settings;
+	if ( !ParseArguments( argc, argv, settings ) )
+	{
+		std::fprintf( stderr, "Usage: %s [--sizes 64,256,1024,4096,8192] [--threads 1,2,4] [--formats DXT5,P8] [--min-time seconds] [--output file]\n", argv[0] );
+		return 2;
+	}
+
+	const int simdLevel = PixelConversion::ActiveSIMDLevel();
+
+	std::vector<CaseResult> results;
+	auto run = [&]( const char *op, VTFImageFormat sourceFormat, VTFImageFormat destFormat, VTFImageFormat patternFormat )
+	{
+		for ( const vlUInt size : settings.sizes )
+		{
+			results.push_back( RunCase( settings, op, sourceFormat, destFormat, patternFormat, size ) );
+
+			const auto &result = results.back();
+			std::fprintf( stderr, "%-7s %-18s -> %-18s %5u: ", op, result.source, result.dest, size );
+			if ( !result.supported )
+				std::fprintf( stderr, "unsupported\n" );
+			else
+				std::fprintf( stderr, "%8.3f ns/px%s%s\n", result.timings.front().nsPerPixel, result.matchesScalar ? "" : "  SIMD MISMATCH", result.matchesVTFLib ? "" : "  VTFLIB MISMATCH" );
+		}
+	};
+
+	for ( const auto &entry : IMAGE_FORMATS )
+	{
+		if ( !IsWanted( settings, entry.format ) )
+			continue;
+
+		run( "decode", entry.format, IMAGE_FORMAT_RGBA8888, IMAGE_FORMAT_RGBA8888 );
+		if ( entry.format != IMAGE_FORMAT_RGBA8888 )
+			run( "encode", IMAGE_FORMAT_RGBA8888, entry.format, IMAGE_FORMAT_RGBA8888 );
+
+		if ( IsHDR( entry.format ) && entry.format != IMAGE_FORMAT_RGBA32323232F )
+		{
+			run( "decode", entry.format, IMAGE_FORMAT_RGBA32323232F, IMAGE_FORMAT_RGBA32323232F );
+			run( "encode", IMAGE_FORMAT_RGBA32323232F, entry.format, IMAGE_FORMAT_RGBA32323232F );
+		}
+	}
+
+	PixelConversion::SetLimits( 2, 0 );
+
+	FILE *file = settings.output.empty() ? stdout : std::fopen( settings.output.c_str(), "w" );
+	if ( !file )
+	{
+		std::fprintf( stderr, "Could not write %s\n", settings.output.c_str() );
+		return 1;
+	}
+	WriteJSON( file, results, simdLevel );
+	if ( file != stdout )
+		std::fclose( file );
+
+	// A kernel that disagrees with the scalar one or with VTFLib is a bug, not a slow format
+	const bool allMatch = std::all_of( results.begin(), results.end(), []( const CaseResult &result )
+									   { return result.matchesScalar && result.matchesVTFLib; } );
+	return allMatch ? 0 : 3;
+}
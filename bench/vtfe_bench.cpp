@@ -0,0 +1,791 @@
+// End to end timings of the code paths the editor runs: decoding through AddImage, GenerateVTF with a few option sets,
+// Save / Load, the RGBA8888 conversion and the Folders to VTF batch loop. Results go out as JSON.
+// The image readers are timed on their own too, on files built in memory so every variant is covered.
+//
+//   vtfe_bench [--iterations N] [--filter text] [--output results.json]
+
+#include "../libs/stb/stb_image.h"
+#include "../src/ImageWriters.h"
+#include "../src/Options.h"
+#include "../src/PixelConversion.h"
+#include "../src/VTFEImport.h"
+#include "../src/supported_formats/TGASupport.h"
+#include "../src/supported_formats/TiffSupport.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// The peak of the whole process so far, it never goes down
+static std::size_t PeakRSSBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters {};
+	if ( !K32GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage {};
+	if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return static_cast<std::size_t>( usage.ru_maxrss ) * 1024;
+#endif
+#endif
+}
+
+// Flat bands with a little noise on top, compresses somewhat like painted artwork does
+static std::vector<vlByte> BandedRGBA( vlUInt size )
+{
+	std::vector<vlByte> rgba( static_cast<std::size_t>( size ) * size * 4 );
+	uint32_t seed = 0x9E3779B9;
+	for ( std::size_t i = 0; i < rgba.size(); i++ )
+	{
+		const std::size_t y = i / 4 / size;
+		seed = seed * 1664525u + 1013904223u;
+		const vlByte band = static_cast<vlByte>( ( y / 32 ) * 37 + ( i % 4 ) * 61 );
+		rgba[i] = ( seed >> 28 ) == 0 ? static_cast<vlByte>( seed >> 20 ) : band;
+	}
+	return rgba;
+}
+
+// Every byte random, nothing to compress
+static std::vector<vlByte> NoiseRGBA( vlUInt size )
+{
+	std::vector<vlByte> rgba( static_cast<std::size_t>( size ) * size * 4 );
+	uint32_t seed = 0x12345678;
+	for ( auto &value : rgba )
+	{
+		seed = seed * 1664525u + 1013904223u;
+		value = static_cast<vlByte>( seed >> 24 );
+	}
+	return rgba;
+}
+
+static void AppendU16( QByteArray &out, uint16_t value )
+{
+	out.append( static_cast<char>( value & 0xFF ) );
+	out.append( static_cast<char>( value >> 8 ) );
+}
+
+static void AppendU32( QByteArray &out, uint32_t value )
+{
+	AppendU16( out, static_cast<uint16_t>( value & 0xFFFF ) );
+	AppendU16( out, static_cast<uint16_t>( value >> 16 ) );
+}
+
+// TIFF compression tag values
+enum BenchTIFFCompression : uint16_t
+{
+	BENCH_TIFF_NONE = 1,
+	BENCH_TIFF_LZW = 5,
+	BENCH_TIFF_DEFLATE = 8,
+	BENCH_TIFF_PACKBITS = 32773,
+};
+
+static void PackBitsCompress( const vlByte *pData, std::size_t size, QByteArray &out )
+{
+	std::size_t i = 0;
+	while ( i < size )
+	{
+		// Three or more of the same byte are worth a repeat packet
+		std::size_t run = 1;
+		while ( i + run < size && run < 128 && pData[i + run] == pData[i] )
+			run++;
+		if ( run >= 3 )
+		{
+			out.append( static_cast<char>( 1 - static_cast<int>( run ) ) );
+			out.append( static_cast<char>( pData[i] ) );
+			i += run;
+			continue;
+		}
+
+		// Literals up to the next run
+		const std::size_t start = i;
+		while ( i < size && i - start < 128 && !( i + 2 < size && pData[i] == pData[i + 1] && pData[i] == pData[i + 2] ) )
+			i++;
+		out.append( static_cast<char>( i - start - 1 ) );
+		out.append( reinterpret_cast<const char *>( pData + start ), static_cast<qsizetype>( i - start ) );
+	}
+}
+
+// TIFF flavoured LZW, codes are MSB first and the code width grows one code early
+static void LZWCompress( const vlByte *pData, std::size_t size, QByteArray &out )
+{
+	constexpr uint32_t CLEAR_CODE = 256;
+	constexpr uint32_t END_OF_INFORMATION = 257;
+	constexpr uint32_t FIRST_CODE = 258;
+	constexpr uint32_t LAST_CODE = 4094;
+
+	uint32_t bits = 0;
+	int bitCount = 0;
+	int codeWidth = 9;
+	auto put = [&]( uint32_t code )
+	{
+		bits = ( bits << codeWidth ) | code;
+		bitCount += codeWidth;
+		while ( bitCount >= 8 )
+		{
+			bitCount -= 8;
+			out.append( static_cast<char>( ( bits >> bitCount ) & 0xFF ) );
+		}
+		bits &= ( 1u << bitCount ) - 1;
+	};
+
+	// Prefix code << 8 | byte -> code
+	std::unordered_map<uint32_t, uint32_t> table;
+	uint32_t nextCode = FIRST_CODE;
+	put( CLEAR_CODE );
+	uint32_t prefix = size > 0 ? pData[0] : END_OF_INFORMATION;
+	for ( std::size_t i = 1; i < size; i++ )
+	{
+		const uint32_t key = ( prefix << 8 ) | pData[i];
+		const auto it = table.find( key );
+		if ( it != table.end() )
+		{
+			prefix = it->second;
+			continue;
+		}
+
+		put( prefix );
+		table.emplace( key, nextCode++ );
+		if ( nextCode == LAST_CODE )
+		{
+			put( CLEAR_CODE );
+			table.clear();
+			nextCode = FIRST_CODE;
+			codeWidth = 9;
+		}
+		else if ( nextCode >= ( 1u << codeWidth ) )
+			codeWidth++;
+		prefix = pData[i];
+	}
+
+	// The reader adds a string for the last code as well, so the width may grow before the end code
+	if ( size > 0 )
+	{
+		put( prefix );
+		if ( ++nextCode >= ( 1u << codeWidth ) && codeWidth < 12 )
+			codeWidth++;
+	}
+	put( END_OF_INFORMATION );
+	if ( bitCount > 0 )
+		out.append( static_cast<char>( bits << ( 8 - bitCount ) ) );
+}
+
+// One strip of rows rows, with the horizontal predictor applied for LZW and Deflate like most writers do
+static QByteArray CompressStrip( const vlByte *pRows, std::size_t rowBytes, vlUInt rows, uint16_t compression )
+{
+	const std::size_t size = rowBytes * rows;
+	if ( compression == BENCH_TIFF_NONE )
+		return QByteArray( reinterpret_cast<const char *>( pRows ), static_cast<qsizetype>( size ) );
+
+	QByteArray out;
+	if ( compression == BENCH_TIFF_PACKBITS )
+	{
+		// Rows are packed on their own, as the spec asks
+		for ( vlUInt row = 0; row < rows; row++ )
+			PackBitsCompress( pRows + row * rowBytes, rowBytes, out );
+		return out;
+	}
+
+	std::vector<vlByte> predicted( pRows, pRows + size );
+	for ( vlUInt row = 0; row < rows; row++ )
+	{
+		vlByte *pRow = predicted.data() + row * rowBytes;
+		for ( std::size_t i = rowBytes; i-- > 4; )
+			pRow[i] -= pRow[i - 4];
+	}
+
+	if ( compression == BENCH_TIFF_LZW )
+	{
+		LZWCompress( predicted.data(), size, out );
+		return out;
+	}
+
+	// TIFF takes the zlib stream without the size qCompress puts in front
+	const QByteArray compressed = qCompress( predicted.data(), static_cast<qsizetype>( size ) );
+	return QByteArray( compressed.constData() + 4, compressed.size() - 4 );
+}
+
+// A little endian RGBA8888 TIFF with rowsPerStrip rows in every strip, only the tags TiffSupport needs
+static QByteArray MakeTIFF( const std::vector<vlByte> &rgba, vlUInt width, vlUInt height, vlUInt rowsPerStrip, uint16_t compression = BENCH_TIFF_NONE )
+{
+	const std::size_t rowBytes = static_cast<std::size_t>( width ) * 4;
+	std::vector<QByteArray> strips;
+	for ( vlUInt y = 0; y < height; y += rowsPerStrip )
+		strips.push_back( CompressStrip( rgba.data() + y * rowBytes, rowBytes, std::min( rowsPerStrip, height - y ), compression ) );
+
+	struct Entry
+	{
+		uint16_t tag;
+		uint16_t type; // 3 SHORT, 4 LONG
+		uint32_t count;
+		uint32_t value;
+	};
+	const uint32_t stripCount = static_cast<uint32_t>( strips.size() );
+	std::vector<Entry> entries = {
+		{ 256, 4, 1, width },
+		{ 257, 4, 1, height },
+		{ 258, 3, 4, 0 }, // Points at the bits per sample array
+		{ 259, 3, 1, compression },
+		{ 262, 3, 1, 2 },
+		{ 273, 4, stripCount, 0 }, // Points at the strip offsets
+		{ 277, 3, 1, 4 },
+		{ 278, 4, 1, rowsPerStrip },
+		{ 279, 4, stripCount, 0 }, // Points at the strip byte counts
+		{ 284, 3, 1, 1 },
+		{ 338, 3, 1, 2 }, // Unassociated alpha
+	};
+	if ( compression == BENCH_TIFF_LZW || compression == BENCH_TIFF_DEFLATE )
+		entries.insert( entries.end() - 1, { 317, 3, 1, 2 } ); // Horizontal predictor
+
+	// Header, directory, then the arrays and the strips
+	const uint32_t directorySize = static_cast<uint32_t>( 2 + entries.size() * 12 + 4 );
+	const uint32_t bitsOffset = 8 + directorySize;
+	const uint32_t offsetsOffset = bitsOffset + 8;
+	const uint32_t countsOffset = offsetsOffset + stripCount * 4;
+	uint32_t dataOffset = countsOffset + stripCount * 4;
+	for ( auto &entry : entries )
+	{
+		if ( entry.tag == 258 )
+			entry.value = bitsOffset;
+		else if ( entry.tag == 273 )
+			entry.value = stripCount == 1 ? dataOffset : offsetsOffset;
+		else if ( entry.tag == 279 )
+			entry.value = stripCount == 1 ? static_cast<uint32_t>( strips[0].size() ) : countsOffset;
+	}
+
+	QByteArray out( "II" );
+	AppendU16( out, 42 );
+	AppendU32( out, 8 );
+	AppendU16( out, static_cast<uint16_t>( entries.size() ) );
+	for ( const auto &entry : entries )
+	{
+		AppendU16( out, entry.tag );
+		AppendU16( out, entry.type );
+		AppendU32( out, entry.count );
+		// A single SHORT sits in the first two bytes of the value field
+		if ( entry.type == 3 && entry.count == 1 )
+		{
+			AppendU16( out, static_cast<uint16_t>( entry.value ) );
+			AppendU16( out, 0 );
+		}
+		else
+			AppendU32( out, entry.value );
+	}
+	AppendU32( out, 0 );
+
+	for ( int i = 0; i < 4; i++ )
+		AppendU16( out, 8 );
+	for ( const auto &strip : strips )
+	{
+		AppendU32( out, dataOffset );
+		dataOffset += static_cast<uint32_t>( strip.size() );
+	}
+	for ( const auto &strip : strips )
+		AppendU32( out, static_cast<uint32_t>( strip.size() ) );
+	for ( const auto &strip : strips )
+		out.append( strip );
+	return out;
+}
+
+// rgba as a top to bottom truecolour TGA of channels ( 3 or 4 ) channels.
+// RLE packets run across scanlines, like most writers do.
+static QByteArray MakeTGA( const std::vector<vlByte> &rgba, vlUInt size, std::size_t channels, bool rle )
+{
+	// TGA stores BGR( A )
+	const std::size_t pixelCount = static_cast<std::size_t>( size ) * size;
+	std::vector<vlByte> pixels( pixelCount * channels );
+	for ( std::size_t i = 0; i < pixelCount; i++ )
+	{
+		pixels[i * channels + 0] = rgba[i * 4 + 2];
+		pixels[i * channels + 1] = rgba[i * 4 + 1];
+		pixels[i * channels + 2] = rgba[i * 4 + 0];
+		if ( channels == 4 )
+			pixels[i * channels + 3] = rgba[i * 4 + 3];
+	}
+
+	QByteArray out;
+	out.append( static_cast<char>( 0 ) ); // No image ID
+	out.append( static_cast<char>( 0 ) ); // No colour map
+	out.append( static_cast<char>( rle ? 10 : 2 ) );
+	for ( int i = 0; i < 9; i++ )
+		out.append( static_cast<char>( 0 ) ); // Colour map spec and origin
+	AppendU16( out, static_cast<uint16_t>( size ) );
+	AppendU16( out, static_cast<uint16_t>( size ) );
+	out.append( static_cast<char>( channels * 8 ) );
+	out.append( static_cast<char>( ( channels == 4 ? 8 : 0 ) | 0x20 ) ); // Alpha bits, top to bottom
+
+	const auto pPixels = reinterpret_cast<const char *>( pixels.data() );
+	if ( !rle )
+	{
+		out.append( pPixels, static_cast<qsizetype>( pixels.size() ) );
+		return out;
+	}
+
+	auto same = [&]( std::size_t a, std::size_t b )
+	{ return std::memcmp( pPixels + a * channels, pPixels + b * channels, channels ) == 0; };
+
+	std::size_t i = 0;
+	while ( i < pixelCount )
+	{
+		std::size_t run = 1;
+		while ( i + run < pixelCount && run < 128 && same( i, i + run ) )
+			run++;
+		if ( run >= 2 )
+		{
+			out.append( static_cast<char>( 0x80 | ( run - 1 ) ) );
+			out.append( pPixels + i * channels, static_cast<qsizetype>( channels ) );
+			i += run;
+			continue;
+		}
+
+		// Raw packet up to the next run
+		const std::size_t start = i;
+		while ( i < pixelCount && i - start < 128 && !( i + 1 < pixelCount && same( i, i + 1 ) ) )
+			i++;
+		out.append( static_cast<char>( i - start - 1 ) );
+		out.append( pPixels + start * channels, static_cast<qsizetype>( ( i - start ) * channels ) );
+	}
+	return out;
+}
+
+struct BenchCase
+{
+	QString name;
+	QString input;
+	// What one iteration works through, for the throughput numbers
+	double pixels = 0;
+	double bytes = 0;
+};
+
+// Reaches into the import dialog the same way its tabs do, so GenerateVTF runs with the options set like a user would
+class VTFEBench
+{
+	int m_iterations;
+	QString m_filter;
+	QJsonArray m_results;
+
+public:
+	VTFEBench( int iterations, const QString &filter ) :
+		m_iterations( iterations ), m_filter( filter ) {}
+
+	const QJsonArray &Results() const
+	{
+		return m_results;
+	}
+
+	// Runs func m_iterations times after one warm up run, reports the median
+	template <class F>
+	void Run( const BenchCase &benchCase, F &&func )
+	{
+		if ( !m_filter.isEmpty() && !benchCase.name.contains( m_filter ) )
+			return;
+
+		// The peak only moves when a case needs more than every case before it, so report how far this one pushed it
+		const std::size_t peakBefore = PeakRSSBytes();
+		std::vector<double> seconds;
+		bool bOk = func();
+		for ( int i = 0; i < m_iterations && bOk; i++ )
+		{
+			QElapsedTimer timer;
+			timer.start();
+			bOk = func();
+			seconds.push_back( timer.nsecsElapsed() / 1e9 );
+		}
+
+		QJsonObject result;
+		result["name"] = benchCase.name;
+		result["input"] = benchCase.input;
+		result["ok"] = bOk;
+		if ( bOk )
+		{
+			std::sort( seconds.begin(), seconds.end() );
+			const double median = seconds[seconds.size() / 2];
+			result["iterations"] = static_cast<int>( seconds.size() );
+			result["medianMs"] = median * 1e3;
+			result["minMs"] = seconds.front() * 1e3;
+			if ( benchCase.pixels > 0 )
+				result["mpixPerSec"] = benchCase.pixels / 1e6 / median;
+			if ( benchCase.bytes > 0 )
+				result["mbPerSec"] = benchCase.bytes / ( 1024.0 * 1024.0 ) / median;
+		}
+		result["peakRssGrowthBytes"] = static_cast<qint64>( PeakRSSBytes() - peakBefore );
+		m_results.append( result );
+
+		std::cerr << benchCase.name.toStdString() << " " << benchCase.input.toStdString() << ": " << ( bOk ? "ok" : "FAILED" ) << std::endl;
+	}
+
+	// Format, alpha format, mipmaps, resize
+	struct GenerateOptions
+	{
+		const char *name;
+		VTFImageFormat format;
+		VTFImageFormat alphaFormat;
+		bool mipmaps;
+		bool resize;
+	};
+
+	static void ApplyOptions( VTFEImport *pImport, const GenerateOptions &options )
+	{
+		auto pGeneralTab = pImport->pGeneralTab;
+		pGeneralTab->pFormatCombo->setCurrentIndex( pGeneralTab->pFormatCombo->findData( options.format ) );
+		pGeneralTab->pAlphaDetectedFormatCombo->setCurrentIndex( pGeneralTab->pAlphaDetectedFormatCombo->findData( options.alphaFormat ) );
+		pGeneralTab->pGenerateMipmapsCheckbox->setChecked( options.mipmaps );
+		pGeneralTab->pResizeCheckbox->setChecked( options.resize );
+	}
+
+	void DecodeAndGenerate( const QString &imagePath )
+	{
+		const QFileInfo info( imagePath );
+		std::unique_ptr<VTFEImport> pImport( VTFEImport::Standalone( nullptr ) );
+
+		pImport->AddImage( imagePath );
+		if ( pImport->imageList.isEmpty() )
+		{
+			Run( { "AddImage", info.fileName() }, [] { return false; } );
+			return;
+		}
+		const double pixels = static_cast<double>( pImport->imageList[0]->getWidth() ) * pImport->imageList[0]->getHeight();
+
+		Run( { "AddImage", info.fileName(), pixels, static_cast<double>( info.size() ) }, [&]
+			 {
+				 pImport->clearImageList();
+				 pImport->AddImage( imagePath );
+				 return !pImport->imageList.isEmpty();
+			 } );
+
+		static constexpr GenerateOptions GENERATE_OPTIONS[] = {
+			{ "GenerateVTF/RGBA8888", IMAGE_FORMAT_RGB888, IMAGE_FORMAT_RGBA8888, false, false },
+			{ "GenerateVTF/DXT1_DXT5_Mips", IMAGE_FORMAT_DXT1, IMAGE_FORMAT_DXT5, true, true },
+			{ "GenerateVTF/RGBA16161616F_Mips", IMAGE_FORMAT_RGBA16161616F, IMAGE_FORMAT_RGBA16161616F, true, true },
+		};
+		for ( const auto &options : GENERATE_OPTIONS )
+		{
+			ApplyOptions( pImport.get(), options );
+			Run( { options.name, info.fileName(), pixels }, [&]
+				 {
+					 VTFErrorType err;
+					 std::unique_ptr<VTFLib::CVTFFile> pVTF( pImport->GenerateVTF( err ) );
+					 return err == SUCCESS && pVTF;
+				 } );
+		}
+	}
+
+	void SaveLoadConvert( const QString &vtfPath )
+	{
+		const QString name = QFileInfo( vtfPath ).fileName();
+
+		VTFLib::CVTFFile vtf;
+		if ( !vtf.Load( vtfPath.toUtf8().constData(), false ) )
+		{
+			Run( { "Load", name }, [] { return false; } );
+			return;
+		}
+
+		const double pixels = static_cast<double>( vtf.GetWidth() ) * vtf.GetHeight() * vtf.GetFrameCount() * vtf.GetFaceCount() * vtf.GetDepth();
+		std::vector<vlByte> buffer( vtf.GetSize() );
+		vlUInt savedSize = 0;
+
+		Run( { "Save", name, pixels, static_cast<double>( buffer.size() ) }, [&]
+			 { return vtf.Save( buffer.data(), static_cast<vlUInt>( buffer.size() ), savedSize ); } );
+
+		Run( { "Load", name, pixels, static_cast<double>( savedSize ) }, [&]
+			 {
+				 VTFLib::CVTFFile loaded;
+				 return loaded.Load( buffer.data(), savedSize, false );
+			 } );
+
+		const vlUInt width = vtf.GetWidth(), height = vtf.GetHeight();
+		const double surfaceBytes = VTFLib::CVTFFile::ComputeImageSize( width, height, 1, vtf.GetFormat() );
+		std::vector<vlByte> rgba( static_cast<std::size_t>( width ) * height * 4 );
+
+		Run( { "ConvertToRGBA8888/VTFLib", name, static_cast<double>( width ) * height, surfaceBytes }, [&]
+			 { return VTFLib::CVTFFile::ConvertToRGBA8888( vtf.GetData( 0, 0, 0, 0 ), rgba.data(), width, height, vtf.GetFormat() ); } );
+
+		Run( { "ConvertToRGBA8888/PixelConversion", name, static_cast<double>( width ) * height, surfaceBytes }, [&]
+			 { return PixelConversion::ToRGBA8888( vtf.GetData( 0, 0, 0, 0 ), rgba.data(), width, height, vtf.GetFormat() ); } );
+	}
+
+	// Load_TIFF on a many strip file in every compression it reads, once on one thread and once with the strips spread over all of them
+	void DecodeTIFF()
+	{
+		static constexpr vlUInt SIZE = 2048;
+		static constexpr vlUInt ROWS_PER_STRIP = 16;
+		static constexpr struct
+		{
+			const char *name;
+			uint16_t compression;
+		} COMPRESSIONS[] = {
+			{ "None", BENCH_TIFF_NONE },
+			{ "PackBits", BENCH_TIFF_PACKBITS },
+			{ "LZW", BENCH_TIFF_LZW },
+			{ "Deflate", BENCH_TIFF_DEFLATE },
+		};
+
+		const std::vector<vlByte> rgba = BandedRGBA( SIZE );
+		const QString input = QString( "%1x%1 RGBA8888, %2 strips" ).arg( SIZE ).arg( SIZE / ROWS_PER_STRIP );
+		const double pixels = static_cast<double>( SIZE ) * SIZE;
+
+		for ( const auto &compression : COMPRESSIONS )
+		{
+			const QString name = QString( "DecodeTIFF/" ) + compression.name;
+			const QByteArray tiff = MakeTIFF( rgba, SIZE, SIZE, ROWS_PER_STRIP, compression.compression );
+
+			TIFFFile decoded;
+			auto decode = [&]
+			{
+				return TiffSupport::Load_TIFF( reinterpret_cast<const uint8_t *>( tiff.constData() ), static_cast<std::size_t>( tiff.size() ), decoded ) && decoded.imageData.size() == rgba.size();
+			};
+
+			// Checked once up front, so the timings don't include the compare
+			if ( !decode() || std::memcmp( decoded.imageData.data(), rgba.data(), rgba.size() ) != 0 )
+			{
+				Run( { name, input }, [] { return false; } );
+				continue;
+			}
+
+			TiffSupport::SetThreadLimit( 1 );
+			Run( { name + "/1 thread", input, pixels, static_cast<double>( tiff.size() ) }, decode );
+			TiffSupport::SetThreadLimit( 0 );
+			Run( { name + "/all threads", input, pixels, static_cast<double>( tiff.size() ) }, decode );
+		}
+	}
+
+	// The native TGA reader next to stb, which is what TGAs went through before, on raw and RLE files
+	void DecodeTGA()
+	{
+		static constexpr vlUInt SIZE = 2048;
+		const struct
+		{
+			const char *name;
+			std::vector<vlByte> rgba;
+		} images[] = {
+			{ "banded", BandedRGBA( SIZE ) },
+			{ "noise", NoiseRGBA( SIZE ) },
+		};
+		const double pixels = static_cast<double>( SIZE ) * SIZE;
+
+		for ( const auto &image : images )
+		{
+			for ( const std::size_t channels : { 3, 4 } )
+			{
+				for ( const bool rle : { false, true } )
+				{
+					const QByteArray tga = MakeTGA( image.rgba, SIZE, channels, rle );
+					const auto pData = reinterpret_cast<const uint8_t *>( tga.constData() );
+					const std::size_t size = static_cast<std::size_t>( tga.size() );
+					const QString input = QString( "%1x%1 %2 %3 bit %4" ).arg( SIZE ).arg( image.name ).arg( channels * 8 ).arg( rle ? "RLE" : "raw" );
+
+					TGAFile decoded;
+					auto decodeNative = [&]
+					{ return TGASupport::Load_TGA( pData, size, decoded ) && decoded.channelCount == channels; };
+
+					// Checked once up front against the pixels that went in
+					bool bMatches = decodeNative() && decoded.imageData.size() == static_cast<std::size_t>( pixels ) * channels;
+					for ( std::size_t i = 0; bMatches && i < static_cast<std::size_t>( pixels ); i++ )
+					{
+						const auto pPixel = reinterpret_cast<const vlByte *>( decoded.imageData.data() ) + i * channels;
+						bMatches = pPixel[0] == image.rgba[i * 4 + 2] && pPixel[1] == image.rgba[i * 4 + 1] && pPixel[2] == image.rgba[i * 4 + 0] &&
+								   ( channels == 3 || pPixel[3] == image.rgba[i * 4 + 3] );
+					}
+					if ( !bMatches )
+					{
+						Run( { "DecodeTGA/native", input }, [] { return false; } );
+						continue;
+					}
+
+					Run( { "DecodeTGA/native", input, pixels, static_cast<double>( size ) }, decodeNative );
+					Run( { "DecodeTGA/stb", input, pixels, static_cast<double>( size ) }, [&]
+						 {
+							 int x, y, n;
+							 vlByte *pDecoded = stbi_load_from_memory( pData, static_cast<int>( size ), &x, &y, &n, 4 );
+							 stbi_image_free( pDecoded );
+							 return pDecoded != nullptr;
+						 } );
+				}
+			}
+		}
+	}
+
+	// The same per file call CMainWindow::foldersToVTF makes, without the dialogs
+	void FoldersToVTF( const QStringList &imagePaths, const QString &outputDir )
+	{
+		std::unique_ptr<VTFEImport> pImport( VTFEImport::Standalone( nullptr ) );
+
+		double pixels = 0, bytes = 0;
+		for ( const auto &path : imagePaths )
+		{
+			pImport->clearImageList();
+			pImport->AddImage( path );
+			if ( !pImport->imageList.isEmpty() )
+				pixels += static_cast<double>( pImport->imageList[0]->getWidth() ) * pImport->imageList[0]->getHeight();
+			bytes += QFileInfo( path ).size();
+		}
+
+		Run( { "FoldersToVTF", QString( "%1 files" ).arg( imagePaths.size() ), pixels, bytes }, [&]
+			 {
+				 for ( const auto &path : imagePaths )
+				 {
+					 VTFErrorType err;
+					 if ( !pImport->ConvertToVTF( { path }, QDir( outputDir ).filePath( QFileInfo( path ).baseName() + ".vtf" ), err ) )
+						 return false;
+				 }
+				 return true;
+			 } );
+	}
+};
+
+// Synthetic inputs: a smooth gradient with alpha compresses well, noise doesn't. HDR and 16 bit go through the float and short paths.
+static QStringList WriteSyntheticInputs( const QString &dir )
+{
+	static constexpr vlUInt SIZE = 2048;
+	const std::size_t pixelCount = static_cast<std::size_t>( SIZE ) * SIZE;
+
+	std::vector<vlByte> gradient( pixelCount * 4 ), noise( pixelCount * 4 );
+	std::vector<float> hdr( pixelCount * 4 );
+	std::vector<uint16_t> shorts( pixelCount * 4 );
+
+	uint32_t seed = 0x12345678;
+	for ( std::size_t i = 0; i < pixelCount; i++ )
+	{
+		const vlUInt x = i % SIZE, y = static_cast<vlUInt>( i / SIZE );
+		gradient[i * 4 + 0] = static_cast<vlByte>( x * 255 / SIZE );
+		gradient[i * 4 + 1] = static_cast<vlByte>( y * 255 / SIZE );
+		gradient[i * 4 + 2] = static_cast<vlByte>( ( x + y ) * 127 / SIZE );
+		gradient[i * 4 + 3] = static_cast<vlByte>( 255 - x * 255 / SIZE );
+
+		for ( std::size_t c = 0; c < 4; c++ )
+		{
+			seed = seed * 1664525u + 1013904223u;
+			noise[i * 4 + c] = static_cast<vlByte>( seed >> 24 );
+			hdr[i * 4 + c] = c == 3 ? 1.0f : std::exp2( ( x + y * c ) % 1024 / 64.0f - 8.0f );
+			shorts[i * 4 + c] = static_cast<uint16_t>( ( x * 31 + y * 17 * ( c + 1 ) ) & 0xFFFF );
+		}
+	}
+
+	QStringList paths;
+	auto write = [&paths, &dir]( const QString &name, const void *pData, VTFImageFormat format )
+	{
+		const QString path = QDir( dir ).filePath( name );
+		if ( ImageWriters::Write( path, static_cast<const vlByte *>( pData ), SIZE, SIZE, format ) )
+			paths.push_back( path );
+		else
+			std::cerr << "Could not write " << path.toStdString() << ", skipping it" << std::endl;
+	};
+
+	write( "gradient_2048.png", gradient.data(), IMAGE_FORMAT_RGBA8888 );
+	write( "noise_2048.png", noise.data(), IMAGE_FORMAT_RGBA8888 );
+	write( "noise_2048.jpg", noise.data(), IMAGE_FORMAT_RGBA8888 );
+	write( "hdr_2048.hdr", hdr.data(), IMAGE_FORMAT_RGBA32323232F );
+	write( "short_2048.tif", shorts.data(), IMAGE_FORMAT_RGBA16161616 );
+	return paths;
+}
+
+// The bundled VTFs go through the image paths as PNG as well
+static QStringList ExportBundled( const QStringList &vtfPaths, const QString &dir )
+{
+	QStringList paths;
+	for ( const auto &vtfPath : vtfPaths )
+	{
+		VTFLib::CVTFFile vtf;
+		if ( !vtf.Load( vtfPath.toUtf8().constData(), false ) )
+			continue;
+
+		const QString path = QDir( dir ).filePath( QFileInfo( vtfPath ).completeBaseName() + ".png" );
+		if ( ImageWriters::Write( path, vtf.GetData( 0, 0, 0, 0 ), vtf.GetWidth(), vtf.GetHeight(), vtf.GetFormat() ) )
+			paths.push_back( path );
+	}
+	return paths;
+}
+
+int main( int argc, char **argv )
+{
+	// The import dialog is a widget, but nothing is ever shown
+	if ( qEnvironmentVariableIsEmpty( "QT_QPA_PLATFORM" ) )
+		qputenv( "QT_QPA_PLATFORM", "offscreen" );
+
+	QApplication app( argc, argv );
+
+	QCommandLineParser parser;
+	parser.addHelpOption();
+	parser.addOption( { "iterations", "Timed runs per case, after one warm up run.", "count", "5" } );
+	parser.addOption( { "filter", "Only run cases whose name contains this.", "text" } );
+	parser.addOption( { "output", "Write the JSON here instead of stdout.", "file" } );
+	parser.addOption( { "data", "Directory with cake.vtf and white_concrete.vtf.", "dir", VTFE_BENCH_DATA_DIR } );
+	parser.process( app );
+
+	QTemporaryDir tempDir;
+	QSettings settings( tempDir.filePath( "bench.ini" ), QSettings::IniFormat );
+	settings.setValue( STR_OPEN_RECENT, QStringList() << QDir::currentPath() );
+	Options::setupOptions( settings );
+
+	const QDir dataDir( parser.value( "data" ) );
+	const QStringList vtfPaths = { dataDir.filePath( "cake.vtf" ), dataDir.filePath( "white_concrete.vtf" ) };
+
+	const QString inputDir = tempDir.filePath( "input" );
+	const QString outputDir = tempDir.filePath( "output" );
+	QDir().mkpath( inputDir );
+	QDir().mkpath( outputDir );
+
+	const QStringList imagePaths = ExportBundled( vtfPaths, inputDir ) + WriteSyntheticInputs( inputDir );
+
+	VTFEBench bench( std::max( 1, parser.value( "iterations" ).toInt() ), parser.value( "filter" ) );
+
+	for ( const auto &vtfPath : vtfPaths )
+		bench.SaveLoadConvert( vtfPath );
+
+	bench.DecodeTIFF();
+	bench.DecodeTGA();
+
+	for ( const auto &imagePath : imagePaths )
+		bench.DecodeAndGenerate( imagePath );
+
+	bench.FoldersToVTF( imagePaths, outputDir );
+
+	QJsonObject root;
+	root["threads"] = static_cast<int>( std::thread::hardware_concurrency() );
+	root["results"] = bench.Results();
+	root["processPeakRssBytes"] = static_cast<qint64>( PeakRSSBytes() );
+	const QByteArray json = QJsonDocument( root ).toJson();
+
+	if ( parser.isSet( "output" ) )
+	{
+		QFile file( parser.value( "output" ) );
+		if ( !file.open( QIODevice::WriteOnly ) || file.write( json ) != json.size() )
+		{
+			std::cerr << "Could not write " << parser.value( "output" ).toStdString() << std::endl;
+			return 1;
+		}
+	}
+	else
+		std::cout << json.toStdString();
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 #include "dialogs/VTFEdit.h"
 #include "src/MainWindow.h"
 #include "src/Options.h"
+#include "src/Trace.h"
 
 #include <QApplication>
 #include <QCommonStyle>
@@ -14,6 +15,12 @@ int main( int argc, char **argv )
 {
 	QApplication app( argc, argv );
 
+#ifdef TRACING
+	for ( int i = 1; i + 1 < argc; i++ )
+		if ( QString( argv[i] ) == "--trace" )
+			Trace::Begin( QString::fromLocal8Bit( argv[i + 1] ) );
+#endif
+
 	//	QSharedMemory mem = QSharedMemory( "VTFER_QT_SHAREMEM_INSTANCE", &app );
 	//
 	//	if ( mem.isAttached() )
@@ -85,5 +92,11 @@ int main( int argc, char **argv )
 	}
 
 	QApplication::setWindowIcon( QIcon( "vtf_edit_revitalised2.png" ).pixmap( 1080, 1080 ) );
-	return QApplication::exec();
+	const int result = QApplication::exec();
+
+#ifdef TRACING
+	if ( !Trace::End() )
+		qWarning( "Could not write the trace" );
+#endif
+	return result;
 }
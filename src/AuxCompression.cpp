@@ -0,0 +1,255 @@
+#include "AuxCompression.h"
+
+#include "MappedVTF.h"
+#include "Trace.h"
+#include "VTFLayout.h"
+#include "util.hpp"
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+// qCompress puts the uncompressed size in front of the zlib stream, the VTF keeps that in the resource instead
+static constexpr qsizetype QCOMPRESS_HEADER_SIZE = 4;
+
+bool AuxCompression::Save( VTFLib::CVTFFile &vtf, const char *fileName, QMutex *pVTFLibMutex )
+{
+	Q_ASSERT( pVTFLibMutex );
+#ifdef CHAOS_INITIATIVE
+	const int level = static_cast<int>( vtf.GetAuxCompressionLevel() );
+	if ( level > 0 && vtf.GetMinorVersion() >= 6 )
+	{
+		TRACE_ZONE( "AuxCompression::Save" );
+
+		// VTFLib only lays the file out, the deflating happens in Pack
+		std::vector<vlByte> uncompressed;
+		vlUInt size = 0;
+		bool saved;
+		{
+			QMutexLocker lock( pVTFLibMutex );
+			vtf.SetAuxCompressionLevel( 0 );
+			uncompressed.resize( vtf.GetSize() );
+			saved = vtf.Save( uncompressed.data(), static_cast<vlUInt>( uncompressed.size() ), size );
+			vtf.SetAuxCompressionLevel( level );
+		}
+
+		std::vector<vlByte> packed;
+		if ( saved )
+		{
+			uncompressed.resize( size );
+			if ( Pack( uncompressed, vtf, level, packed ) )
+			{
+				// Verify loads the whole image again, no need to hold a third copy
+				uncompressed = {};
+
+				bool written;
+				{
+					QFile file( QString::fromUtf8( fileName ) );
+					written = file.open( QIODevice::WriteOnly ) && file.write( reinterpret_cast<const char *>( packed.data() ), static_cast<qint64>( packed.size() ) ) == static_cast<qint64>( packed.size() );
+				}
+				if ( written && Verify( packed, fileName, vtf, pVTFLibMutex ) )
+					return true;
+			}
+		}
+	}
+#endif
+	// Also what overwrites a packed file that didn't read back right, VTFLib deflates it itself then
+	QMutexLocker lock( pVTFLibMutex );
+	return vtf.Save( fileName );
+}
+
+bool AuxCompression::Pack( const std::vector<vlByte> &uncompressed, const VTFLib::CVTFFile &vtf, int level, std::vector<vlByte> &packed )
+{
+	const std::size_t size = uncompressed.size();
+	const vlByte *pFile = uncompressed.data();
+	if ( size < RESOURCES_OFFSET )
+		return false;
+
+	const uint32_t resourceCount = ReadU32( pFile + RESOURCE_COUNT_OFFSET );
+	if ( RESOURCES_OFFSET + static_cast<std::size_t>( resourceCount ) * RESOURCE_ENTRY_SIZE > size )
+		return false;
+
+	// Every resource that has data, with where that data sits in the uncompressed file
+	struct Resource
+	{
+		uint32_t type;
+		uint32_t value;
+		std::size_t offset = 0;
+		std::size_t size = 0;
+	};
+	std::vector<Resource> resources;
+	std::size_t imageIndex = SIZE_MAX;
+	for ( uint32_t i = 0; i < resourceCount; i++ )
+	{
+		const vlByte *pEntry = pFile + RESOURCES_OFFSET + i * RESOURCE_ENTRY_SIZE;
+		Resource resource { ReadU32( pEntry ), ReadU32( pEntry + 4 ) };
+		const uint32_t id = resource.type & RESOURCE_ID_MASK;
+
+		// Written from scratch below
+		if ( id == RESOURCE_AUX_COMPRESSION )
+			continue;
+
+		if ( !( resource.type & RESOURCE_NO_DATA ) )
+		{
+			resource.offset = resource.value;
+			if ( id == RESOURCE_LOW_RES_IMAGE )
+			{
+				VTFImageFormat lowResFormat;
+				std::memcpy( &lowResFormat, pFile + LOW_RES_FORMAT_OFFSET, sizeof( lowResFormat ) );
+				if ( lowResFormat != IMAGE_FORMAT_NONE )
+					resource.size = VTFLib::CVTFFile::ComputeImageSize( pFile[LOW_RES_WIDTH_OFFSET], pFile[LOW_RES_HEIGHT_OFFSET], 1, lowResFormat );
+			}
+			else if ( id == RESOURCE_IMAGE )
+			{
+				for ( vlUInt mip = 0; mip < vtf.GetMipmapCount(); mip++ )
+					resource.size += static_cast<std::size_t>( VTFLib::CVTFFile::ComputeMipmapSize( vtf.GetWidth(), vtf.GetHeight(), vtf.GetDepth(), mip, vtf.GetFormat() ) ) * vtf.GetFrameCount() * vtf.GetFaceCount();
+			}
+			else if ( resource.offset + 4 <= size )
+				resource.size = 4 + ReadU32( pFile + resource.offset );
+
+			if ( resource.offset + resource.size > size )
+				return false;
+		}
+
+		if ( id == RESOURCE_IMAGE )
+			imageIndex = resources.size();
+		resources.push_back( resource );
+	}
+	if ( imageIndex == SIZE_MAX )
+		return false;
+
+	// One stream per mip, frame and face, slices stay together. Same order as the image data, smallest mip first.
+	const vlUInt mipCount = vtf.GetMipmapCount();
+	const vlUInt frameCount = vtf.GetFrameCount();
+	const vlUInt faceCount = vtf.GetFaceCount();
+	struct Chunk
+	{
+		std::size_t index;
+		const vlByte *pData;
+		qsizetype size;
+		QByteArray compressed;
+	};
+	std::vector<Chunk> chunks;
+	chunks.reserve( static_cast<std::size_t>( mipCount ) * frameCount * faceCount );
+	const vlByte *pImage = pFile + resources[imageIndex].offset;
+	for ( vlUInt mip = mipCount; mip-- > 0; )
+	{
+		const qsizetype chunkSize = VTFLib::CVTFFile::ComputeMipmapSize( vtf.GetWidth(), vtf.GetHeight(), vtf.GetDepth(), mip, vtf.GetFormat() );
+		for ( vlUInt frame = 0; frame < frameCount; frame++ )
+		{
+			for ( vlUInt face = 0; face < faceCount; face++ )
+			{
+				chunks.push_back( { ( static_cast<std::size_t>( mip ) * frameCount + frame ) * faceCount + face, pImage, chunkSize } );
+				pImage += chunkSize;
+			}
+		}
+	}
+
+	{
+		TRACE_ZONE( "AuxCompression::deflate" );
+		util::parallel_for( chunks.size(), [&chunks, level]( std::size_t i )
+							{
+								Chunk &chunk = chunks[i];
+								chunk.compressed = qCompress( chunk.pData, chunk.size, level );
+							} );
+	}
+
+	// The compressed sizes are looked up by chunk index, not by file order
+	std::vector<vlByte> auxInfo( 4 + AUX_INFO_HEADER_SIZE + chunks.size() * 4 );
+	WriteU32( auxInfo.data(), static_cast<uint32_t>( auxInfo.size() - 4 ) );
+	WriteU32( auxInfo.data() + 4, static_cast<uint32_t>( level ) );
+	for ( const auto &chunk : chunks )
+	{
+		if ( chunk.compressed.size() < QCOMPRESS_HEADER_SIZE )
+			return false;
+		WriteU32( auxInfo.data() + 4 + AUX_INFO_HEADER_SIZE + chunk.index * 4, static_cast<uint32_t>( chunk.compressed.size() - QCOMPRESS_HEADER_SIZE ) );
+	}
+
+	// The AXC entry goes in front of the image, its data right before the image data
+	resources.insert( resources.begin() + imageIndex, Resource { RESOURCE_AUX_COMPRESSION, 0 } );
+	imageIndex++;
+
+	// Data is written back in the order it had, the header grew by the AXC entry
+	std::vector<std::size_t> order;
+	for ( std::size_t i = 0; i < resources.size(); i++ )
+		if ( !( resources[i].type & RESOURCE_NO_DATA ) && i != imageIndex - 1 )
+			order.push_back( i );
+	std::stable_sort( order.begin(), order.end(), [&resources]( std::size_t a, std::size_t b )
+					  { return resources[a].offset < resources[b].offset; } );
+	order.insert( std::find( order.begin(), order.end(), imageIndex ), imageIndex - 1 );
+
+	const std::size_t headerSize = RESOURCES_OFFSET + resources.size() * RESOURCE_ENTRY_SIZE;
+	packed.assign( pFile, pFile + RESOURCES_OFFSET );
+	packed.resize( headerSize );
+	WriteU32( packed.data() + HEADER_SIZE_OFFSET, static_cast<uint32_t>( headerSize ) );
+	WriteU32( packed.data() + RESOURCE_COUNT_OFFSET, static_cast<uint32_t>( resources.size() ) );
+
+	for ( const std::size_t i : order )
+	{
+		resources[i].value = static_cast<uint32_t>( packed.size() );
+		if ( i == imageIndex - 1 )
+		{
+			packed.insert( packed.end(), auxInfo.begin(), auxInfo.end() );
+		}
+		else if ( i == imageIndex )
+		{
+			for ( const auto &chunk : chunks )
+				packed.insert( packed.end(), chunk.compressed.constBegin() + QCOMPRESS_HEADER_SIZE, chunk.compressed.constEnd() );
+		}
+		else
+		{
+			packed.insert( packed.end(), pFile + resources[i].offset, pFile + resources[i].offset + resources[i].size );
+		}
+	}
+
+	for ( std::size_t i = 0; i < resources.size(); i++ )
+	{
+		WriteU32( packed.data() + RESOURCES_OFFSET + i * RESOURCE_ENTRY_SIZE, resources[i].type );
+		WriteU32( packed.data() + RESOURCES_OFFSET + i * RESOURCE_ENTRY_SIZE + 4, resources[i].value );
+	}
+	return true;
+}
+
+bool AuxCompression::Verify( const std::vector<vlByte> &packed, const char *fileName, VTFLib::CVTFFile &vtf, QMutex *pVTFLibMutex )
+{
+	TRACE_ZONE( "AuxCompression::Verify" );
+
+	auto pLoaded = std::make_unique<VTFLib::CVTFFile>();
+	{
+		QMutexLocker lock( pVTFLibMutex );
+		if ( !pLoaded->Load( packed.data(), static_cast<vlUInt>( packed.size() ), false ) )
+			return false;
+	}
+
+	MappedVTF mapped;
+	if ( !mapped.Open( fileName, *pLoaded ) || !mapped.IsAuxCompressed() )
+		return false;
+
+	if ( pLoaded->GetWidth() != vtf.GetWidth() || pLoaded->GetHeight() != vtf.GetHeight() || pLoaded->GetDepth() != vtf.GetDepth() )
+		return false;
+	if ( pLoaded->GetFormat() != vtf.GetFormat() || pLoaded->GetMipmapCount() != vtf.GetMipmapCount() || pLoaded->GetFrameCount() != vtf.GetFrameCount() || pLoaded->GetFaceCount() != vtf.GetFaceCount() )
+		return false;
+
+	// Every chunk holds all slices of a mip, frame and face, same as what Pack deflated
+	const vlUInt frameCount = vtf.GetFrameCount();
+	const vlUInt faceCount = vtf.GetFaceCount();
+	std::atomic<bool> same = true;
+	util::parallel_for( static_cast<std::size_t>( vtf.GetMipmapCount() ) * frameCount * faceCount, [&vtf, &pLoaded, &mapped, &same, frameCount, faceCount]( std::size_t index )
+						{
+							const auto face = static_cast<vlUInt>( index % faceCount );
+							const auto frame = static_cast<vlUInt>( index / faceCount % frameCount );
+							const auto mip = static_cast<vlUInt>( index / faceCount / frameCount );
+							const std::size_t size = VTFLib::CVTFFile::ComputeMipmapSize( vtf.GetWidth(), vtf.GetHeight(), vtf.GetDepth(), mip, vtf.GetFormat() );
+
+							const vlByte *pOriginal = vtf.GetData( frame, face, 0, mip );
+							const vlByte *pLoadedData = pLoaded->GetData( frame, face, 0, mip );
+							const MappedVTF::Surface surface = mapped.GetData( frame, face, 0, mip );
+							if ( !pOriginal || !pLoadedData || !surface.Data() || std::memcmp( pOriginal, pLoadedData, size ) != 0 || std::memcmp( pOriginal, surface.Data(), size ) != 0 )
+								same = false;
+						} );
+	return same;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../libs/VTFLib/VTFLib/VTFLib.h"
+
+#include <vector>
+
+class QMutex;
+
+// Saves VTFs with aux compression, every mip, frame and face chunk is deflated on its own on all cores.
+// VTFLib deflates the whole image payload on one thread inside Save, which on big 7.6 files at level 9
+// takes longer than generating them. The file is saved uncompressed by VTFLib first and re-packed
+// into the same layout it would have written: an AXC resource with one compressed size per chunk and
+// the deflate streams back to back in image data order.
+class AuxCompression
+{
+public:
+	AuxCompression() = delete;
+
+	// Drop in for CVTFFile::Save, falls back to it when the file has no aux compression or the packed file doesn't read back the same.
+	// The aux compression level of vtf is set to 0 for the VTFLib save and put back after, so pVTFLibMutex is required
+	// and has to be the one every other user of vtf locks. It's held around the VTFLib calls only,
+	// so saves on several threads still deflate at the same time.
+	static bool Save( VTFLib::CVTFFile &vtf, const char *fileName, QMutex *pVTFLibMutex );
+
+	// uncompressed is a whole 7.3+ file as VTFLib saved it, vtf the file it was saved from
+	static bool Pack( const std::vector<vlByte> &uncompressed, const VTFLib::CVTFFile &vtf, int level, std::vector<vlByte> &packed );
+
+private:
+	// Reads the packed file back with VTFLib and with MappedVTF, both have to hand out the image data of vtf
+	static bool Verify( const std::vector<vlByte> &packed, const char *fileName, VTFLib::CVTFFile &vtf, QMutex *pVTFLibMutex );
+};
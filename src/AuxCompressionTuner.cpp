@@ -0,0 +1,294 @@
+#ifdef CHAOS_INITIATIVE
+
+#include "AuxCompressionTuner.h"
+
+#include "util.hpp"
+
+#include <QByteArray>
+#include <QCheckBox>
+#include <QDoubleSpinBox>
+#include <QElapsedTimer>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QTableWidget>
+#include <memory>
+#include <vector>
+
+// qCompress puts the uncompressed size in front of the zlib stream, the VTF keeps that in the resource instead
+static constexpr qint64 QCOMPRESS_HEADER_SIZE = 4;
+static constexpr int AUX_COMPRESSION_LEVEL_COUNT = 10;
+
+struct AuxCompressionChunk
+{
+	const vlByte *pData;
+	vlUInt size;
+};
+
+static void CollectChunks( VTFLib::CVTFFile *pVTF, bool sampleOnly, std::vector<AuxCompressionChunk> &chunks )
+{
+	const VTFImageFormat format = pVTF->GetFormat();
+
+	if ( sampleOnly )
+	{
+		chunks.push_back( { pVTF->GetData( 0, 0, 0, 0 ), VTFLib::CVTFFile::ComputeImageSize( pVTF->GetWidth(), pVTF->GetHeight(), 1, format ) } );
+		return;
+	}
+
+	// Slices are deflated together, see AuxCompression
+	for ( vlUInt mip = 0; mip < pVTF->GetMipmapCount(); mip++ )
+	{
+		const vlUInt size = VTFLib::CVTFFile::ComputeMipmapSize( pVTF->GetWidth(), pVTF->GetHeight(), pVTF->GetDepth(), mip, format );
+
+		for ( vlUInt frame = 0; frame < pVTF->GetFrameCount(); frame++ )
+			for ( vlUInt face = 0; face < pVTF->GetFaceCount(); face++ )
+				chunks.push_back( { pVTF->GetData( frame, face, 0, mip ), size } );
+	}
+}
+
+QList<AuxCompressionLevelStats> AuxCompressionTuner::Measure( const QStringList &vtfPaths, bool sampleOnly, const std::function<void( int )> &progress, const std::atomic<bool> *pCancel )
+{
+	auto cancelled = [pCancel]
+	{ return pCancel && pCancel->load( std::memory_order_relaxed ); };
+
+	std::vector<AuxCompressionLevelStats> stats( AUX_COMPRESSION_LEVEL_COUNT );
+	for ( int i = 0; i < AUX_COMPRESSION_LEVEL_COUNT; i++ )
+		stats[i].level = i;
+
+	bool measuredAny = false;
+	std::vector<AuxCompressionChunk> chunks;
+	for ( int file = 0; file < vtfPaths.size() && !cancelled(); file++ )
+	{
+		const QString &path = vtfPaths[file];
+		if ( progress )
+			progress( file );
+
+		auto pVTF = std::make_unique<VTFLib::CVTFFile>();
+		if ( !pVTF->Load( path.toUtf8().constData(), false ) )
+			continue;
+
+		chunks.clear();
+		CollectChunks( pVTF.get(), sampleOnly, chunks );
+
+		// One level per worker, every worker walks the same chunks so the timings stay comparable.
+		util::parallel_for( AUX_COMPRESSION_LEVEL_COUNT, [&chunks, &stats, &cancelled]( std::size_t level )
+							{
+								auto &levelStats = stats[level];
+								QElapsedTimer timer;
+								for ( const auto &chunk : chunks )
+								{
+									if ( !chunk.pData || chunk.size == 0 || cancelled() )
+										continue;
+
+									// Level 0 is saved raw without an AXC resource, it costs nothing
+									if ( level == 0 )
+									{
+										levelStats.uncompressedSize += chunk.size;
+										levelStats.compressedSize += chunk.size;
+										continue;
+									}
+
+									timer.start();
+									const QByteArray compressed = qCompress( chunk.pData, static_cast<qsizetype>( chunk.size ), static_cast<int>( level ) );
+									levelStats.encodeMilliseconds += timer.nsecsElapsed() / 1000000.0;
+
+									timer.start();
+									const QByteArray decompressed = qUncompress( compressed );
+									levelStats.decodeMilliseconds += timer.nsecsElapsed() / 1000000.0;
+
+									levelStats.uncompressedSize += chunk.size;
+									levelStats.compressedSize += compressed.size() - QCOMPRESS_HEADER_SIZE;
+								}
+							} );
+
+		measuredAny = measuredAny || !chunks.empty();
+	}
+
+	if ( progress )
+		progress( static_cast<int>( vtfPaths.size() ) );
+
+	if ( !measuredAny || cancelled() )
+		return {};
+
+	return QList<AuxCompressionLevelStats>( stats.begin(), stats.end() );
+}
+
+int AuxCompressionTuner::PickLevel( const QList<AuxCompressionLevelStats> &stats, double tolerancePercent )
+{
+	if ( stats.isEmpty() )
+		return -1;
+
+	qint64 smallest = stats[0].compressedSize;
+	for ( const auto &levelStats : stats )
+		smallest = std::min( smallest, levelStats.compressedSize );
+
+	const double limit = smallest * ( 1.0 + tolerancePercent / 100.0 );
+	for ( const auto &levelStats : stats )
+		if ( levelStats.compressedSize <= limit )
+			return levelStats.level;
+
+	return stats.last().level;
+}
+
+AuxCompressionTunerDialog::AuxCompressionTunerDialog( const QStringList &vtfPaths, QWidget *pParent ) :
+	QDialog( pParent ), m_vtfPaths( vtfPaths )
+{
+	this->setWindowTitle( "Aux Compression Dry Run" );
+
+	auto pLayout = new QGridLayout( this );
+
+	pSampleOnlyBox = new QCheckBox( "Only sample the largest mip of the first frame", this );
+	pSampleOnlyBox->setChecked( vtfPaths.size() > 1 );
+	pLayout->addWidget( pSampleOnlyBox, 0, 0, 1, 2 );
+
+	pLayout->addWidget( new QLabel( "Size Tolerance:", this ), 1, 0, Qt::AlignLeft );
+
+	pToleranceBox = new QDoubleSpinBox( this );
+	pToleranceBox->setRange( 0.0, 100.0 );
+	pToleranceBox->setDecimals( 2 );
+	pToleranceBox->setSingleStep( 0.25 );
+	pToleranceBox->setValue( 1.0 );
+	pToleranceBox->setSuffix( " %" );
+	pToleranceBox->setToolTip( "Pick the lowest level whose output is at most this much larger than the best level." );
+	pLayout->addWidget( pToleranceBox, 1, 1, Qt::AlignRight );
+
+	pResultTable = new QTableWidget( 0, 5, this );
+	pResultTable->setSelectionBehavior( QAbstractItemView::SelectRows );
+	pResultTable->setSelectionMode( QAbstractItemView::SingleSelection );
+	pResultTable->setEditTriggers( QAbstractItemView::NoEditTriggers );
+	pResultTable->verticalHeader()->hide();
+	pResultTable->horizontalHeader()->setStretchLastSection( true );
+	pResultTable->setHorizontalHeaderItem( 0, new QTableWidgetItem( "Level" ) );
+	pResultTable->setHorizontalHeaderItem( 1, new QTableWidgetItem( "Size" ) );
+	pResultTable->setHorizontalHeaderItem( 2, new QTableWidgetItem( "Ratio" ) );
+	pResultTable->setHorizontalHeaderItem( 3, new QTableWidgetItem( "Encode" ) );
+	pResultTable->setHorizontalHeaderItem( 4, new QTableWidgetItem( "Decode" ) );
+	pResultTable->setMinimumSize( 480, 340 );
+	pLayout->addWidget( pResultTable, 2, 0, 1, 2 );
+
+	pProgressBar = new QProgressBar( this );
+	pProgressBar->setRange( 0, static_cast<int>( vtfPaths.size() ) );
+	pProgressBar->setValue( 0 );
+	pProgressBar->setFormat( "%v / %m files" );
+	pProgressBar->hide();
+	pLayout->addWidget( pProgressBar, 3, 0, 1, 2 );
+
+	auto pButtonLayout = new QHBoxLayout();
+
+	pRunButton = new QPushButton( "Run", this );
+	pButtonLayout->addWidget( pRunButton, Qt::AlignCenter );
+
+	pUseLevelButton = new QPushButton( "Use Level", this );
+	pUseLevelButton->setDisabled( true );
+	pButtonLayout->addWidget( pUseLevelButton, Qt::AlignCenter );
+
+	auto pCancelButton = new QPushButton( "Cancel", this );
+	pButtonLayout->addWidget( pCancelButton, Qt::AlignCenter );
+
+	pLayout->addLayout( pButtonLayout, 4, 0, 1, 2 );
+
+	// Run turns into Stop while the dry run is going
+	connect( pRunButton, &QPushButton::pressed, this, [this]
+			 {
+				 if ( m_running )
+					 StopDryRun();
+				 else
+					 RunDryRun();
+			 } );
+	connect( pToleranceBox, &QDoubleSpinBox::valueChanged, this, &AuxCompressionTunerDialog::UpdateSelection );
+	connect( pResultTable, &QTableWidget::itemSelectionChanged, this, [this]
+			 {
+				 const auto selected = pResultTable->selectionModel()->selectedRows();
+				 m_selectedLevel = selected.isEmpty() ? -1 : m_stats[selected[0].row()].level;
+				 pUseLevelButton->setEnabled( m_selectedLevel >= 0 );
+			 } );
+	connect( pUseLevelButton, &QPushButton::pressed, this, &QDialog::accept );
+	connect( pCancelButton, &QPushButton::pressed, this, &QDialog::reject );
+}
+
+AuxCompressionTunerDialog::~AuxCompressionTunerDialog()
+{
+	// The worker reports back to us, it has to be gone first
+	m_cancel = true;
+	m_pool.waitForDone();
+}
+
+void AuxCompressionTunerDialog::RunDryRun()
+{
+	m_running = true;
+	m_cancel = false;
+	pRunButton->setText( "Stop" );
+	pSampleOnlyBox->setDisabled( true );
+	pUseLevelButton->setDisabled( true );
+	pProgressBar->setValue( 0 );
+	pProgressBar->show();
+
+	// Results and progress come back queued, they're dropped if the dialog is gone by then
+	m_pool.start( [this, vtfPaths = m_vtfPaths, sampleOnly = pSampleOnlyBox->isChecked()]
+				  {
+					  const auto stats = AuxCompressionTuner::Measure(
+						  vtfPaths, sampleOnly, [this]( int filesDone )
+						  { QMetaObject::invokeMethod( this, [this, filesDone] { pProgressBar->setValue( filesDone ); }, Qt::QueuedConnection ); },
+						  &m_cancel );
+					  QMetaObject::invokeMethod( this, [this, stats] { ShowResults( stats ); }, Qt::QueuedConnection );
+				  } );
+}
+
+void AuxCompressionTunerDialog::StopDryRun()
+{
+	// ShowResults puts the dialog back once the worker notices
+	m_cancel = true;
+	pRunButton->setDisabled( true );
+}
+
+void AuxCompressionTunerDialog::ShowResults( const QList<AuxCompressionLevelStats> &stats )
+{
+	m_running = false;
+	pRunButton->setText( "Run" );
+	pRunButton->setEnabled( true );
+	pSampleOnlyBox->setEnabled( true );
+	pProgressBar->hide();
+
+	// A stopped run keeps whatever the last finished one showed
+	if ( m_cancel )
+	{
+		pUseLevelButton->setEnabled( m_selectedLevel >= 0 );
+		return;
+	}
+
+	m_stats = stats;
+	pResultTable->setRowCount( 0 );
+	for ( const auto &levelStats : m_stats )
+	{
+		const int row = pResultTable->rowCount();
+		pResultTable->insertRow( row );
+
+		const double ratio = levelStats.uncompressedSize > 0 ? static_cast<double>( levelStats.compressedSize ) / levelStats.uncompressedSize : 1.0;
+		pResultTable->setItem( row, 0, new QTableWidgetItem( QString::number( levelStats.level ) ) );
+		pResultTable->setItem( row, 1, new QTableWidgetItem( QString( "%1 KiB" ).arg( levelStats.compressedSize / 1024.0, 0, 'f', 2 ) ) );
+		pResultTable->setItem( row, 2, new QTableWidgetItem( QString( "%1 %" ).arg( ratio * 100.0, 0, 'f', 2 ) ) );
+		pResultTable->setItem( row, 3, new QTableWidgetItem( QString( "%1 ms" ).arg( levelStats.encodeMilliseconds, 0, 'f', 2 ) ) );
+		pResultTable->setItem( row, 4, new QTableWidgetItem( QString( "%1 ms" ).arg( levelStats.decodeMilliseconds, 0, 'f', 2 ) ) );
+	}
+
+	UpdateSelection();
+}
+
+void AuxCompressionTunerDialog::UpdateSelection()
+{
+	const int level = AuxCompressionTuner::PickLevel( m_stats, pToleranceBox->value() );
+	if ( level < 0 )
+	{
+		pResultTable->clearSelection();
+		return;
+	}
+
+	for ( int row = 0; row < m_stats.size(); row++ )
+		if ( m_stats[row].level == level )
+			pResultTable->selectRow( row );
+}
+
+#endif
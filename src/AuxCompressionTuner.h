@@ -0,0 +1,83 @@
+#pragma once
+
+#ifdef CHAOS_INITIATIVE
+
+#include "../libs/VTFLib/VTFLib/VTFLib.h"
+
+#include <QDialog>
+#include <QList>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+
+class QCheckBox;
+class QDoubleSpinBox;
+class QProgressBar;
+class QPushButton;
+class QTableWidget;
+
+// What one aux compression level costs over the measured image data
+struct AuxCompressionLevelStats
+{
+	int level = 0;
+	qint64 uncompressedSize = 0;
+	qint64 compressedSize = 0;
+	double encodeMilliseconds = 0;
+	double decodeMilliseconds = 0;
+};
+
+// Dry run of the aux compression, nothing is written to disk.
+// Every mip, frame and face is deflated on its own like AuxCompression::Save does it,
+// the levels are measured in parallel with each other.
+class AuxCompressionTuner
+{
+public:
+	AuxCompressionTuner() = delete;
+
+	// When sampleOnly is set only the largest mip of the first frame, face and slice of each file is measured.
+	// progress gets the number of files done after each one, from the thread Measure runs on.
+	// Setting *pCancel stops the run, a cancelled run returns nothing.
+	static QList<AuxCompressionLevelStats> Measure( const QStringList &vtfPaths, bool sampleOnly, const std::function<void( int )> &progress = {}, const std::atomic<bool> *pCancel = nullptr );
+
+	// Lowest level whose size is within tolerancePercent of the smallest result, -1 if nothing was measured
+	static int PickLevel( const QList<AuxCompressionLevelStats> &stats, double tolerancePercent );
+};
+
+// Runs the tuner over a set of files and lets the user take the suggested level.
+// The dry run happens on a worker, a whole folder takes a while, the dialog shows progress and can stop it.
+class AuxCompressionTunerDialog : public QDialog
+{
+	Q_OBJECT
+
+	QStringList m_vtfPaths;
+	QList<AuxCompressionLevelStats> m_stats;
+	int m_selectedLevel = -1;
+
+	QCheckBox *pSampleOnlyBox;
+	QDoubleSpinBox *pToleranceBox;
+	QTableWidget *pResultTable;
+	QProgressBar *pProgressBar;
+	QPushButton *pRunButton;
+	QPushButton *pUseLevelButton;
+
+	QThreadPool m_pool;
+	std::atomic<bool> m_cancel = false;
+	bool m_running = false;
+
+	void RunDryRun();
+	void StopDryRun();
+	void ShowResults( const QList<AuxCompressionLevelStats> &stats );
+	void UpdateSelection();
+
+public:
+	AuxCompressionTunerDialog( const QStringList &vtfPaths, QWidget *pParent );
+	~AuxCompressionTunerDialog() override;
+
+	int GetSelectedLevel() const
+	{
+		return m_selectedLevel;
+	}
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "EntryTree.h"
+#include "Trace.h"
 
 #include "vpkedit/PackFile.h"
 #include "vpkedit/format/VPK.h"
@@ -143,10 +144,15 @@ TreeModel::TreeModel( QObject *parent ) :
 
 void TreeModel::fillItem( TreeItem *item )
 {
+	TRACE_ZONE( "TreeModel::fillItem" );
 	if ( item->childCount() > 0 )
 		return;
 
-	static QStringList supportedImageList { "bmp", "gif", "tif", "jpg", "jpeg", "png", "tga", "hdr" };
+	static QStringList supportedImageList { "bmp", "gif", "tif", "jpg", "jpeg", "png", "tga", "hdr", "dds",
+#ifdef EXR_SUPPORT
+											"exr",
+#endif
+	};
 
 	if ( item->getItemType() == TreeItem::VPK_FILE )
 	{
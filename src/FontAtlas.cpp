@@ -0,0 +1,607 @@
+#include "FontAtlas.h"
+
+#include "util.hpp"
+
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPainter>
+#include <QPushButton>
+#include <QSaveFile>
+#include <QSpinBox>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+static constexpr char32_t MAX_CODE_POINT = 0x10FFFF;
+
+// Bottom left skyline packer. The skyline is the top edge of everything placed so far, as segments from left to right.
+// Every rectangle goes where its bottom ends up highest, ties go to the narrower segment so wide gaps are kept for wide glyphs.
+class SkylinePacker
+{
+	struct Segment
+	{
+		int x;
+		int y;
+		int width;
+	};
+
+	std::vector<Segment> m_skyline;
+	int m_width;
+	int m_height;
+
+	// Top of a rectangle starting at segment index, -1 when it doesn't fit there
+	int Fit( std::size_t index, int width, int height ) const
+	{
+		if ( m_skyline[index].x + width > m_width )
+			return -1;
+
+		// The segments always cover the full width, so this can't run off the end
+		int y = 0;
+		for ( std::size_t i = index, remaining = width; remaining > 0; i++ )
+		{
+			y = std::max( y, m_skyline[i].y );
+			if ( y + height > m_height )
+				return -1;
+			remaining -= std::min<std::size_t>( remaining, m_skyline[i].width );
+		}
+		return y;
+	}
+
+public:
+	SkylinePacker( int width, int height ) :
+		m_skyline { { 0, 0, width } }, m_width( width ), m_height( height ) {}
+
+	bool Insert( int width, int height, int &x, int &y )
+	{
+		std::size_t best = SIZE_MAX;
+		int bestBottom = INT_MAX;
+		int bestWidth = INT_MAX;
+		for ( std::size_t i = 0; i < m_skyline.size(); i++ )
+		{
+			const int top = Fit( i, width, height );
+			if ( top < 0 )
+				continue;
+
+			if ( top + height < bestBottom || ( top + height == bestBottom && m_skyline[i].width < bestWidth ) )
+			{
+				best = i;
+				bestBottom = top + height;
+				bestWidth = m_skyline[i].width;
+			}
+		}
+
+		if ( best == SIZE_MAX )
+			return false;
+
+		x = m_skyline[best].x;
+		y = bestBottom - height;
+		m_skyline.insert( m_skyline.begin() + best, { x, bestBottom, width } );
+
+		// Cut away whatever the new segment now covers
+		for ( std::size_t i = best + 1; i < m_skyline.size(); )
+		{
+			const int covered = m_skyline[i - 1].x + m_skyline[i - 1].width - m_skyline[i].x;
+			if ( covered <= 0 )
+				break;
+
+			if ( m_skyline[i].width <= covered )
+			{
+				m_skyline.erase( m_skyline.begin() + i );
+				continue;
+			}
+
+			m_skyline[i].x += covered;
+			m_skyline[i].width -= covered;
+			break;
+		}
+
+		for ( std::size_t i = 0; i + 1 < m_skyline.size(); )
+		{
+			if ( m_skyline[i].y == m_skyline[i + 1].y )
+			{
+				m_skyline[i].width += m_skyline[i + 1].width;
+				m_skyline.erase( m_skyline.begin() + i + 1 );
+			}
+			else
+				i++;
+		}
+		return true;
+	}
+};
+
+static bool ParseCodePoint( QString text, char32_t &codePoint )
+{
+	text = text.trimmed();
+
+	int base = 10;
+	if ( text.startsWith( "0x", Qt::CaseInsensitive ) || text.startsWith( "U+", Qt::CaseInsensitive ) )
+	{
+		text = text.mid( 2 );
+		base = 16;
+	}
+
+	bool ok;
+	const uint value = text.toUInt( &ok, base );
+	if ( !ok || value > MAX_CODE_POINT )
+		return false;
+
+	codePoint = value;
+	return true;
+}
+
+bool FontAtlas::ParseCharset( const QString &text, QList<FontAtlasRange> &ranges )
+{
+	ranges.clear();
+	for ( const auto &part : text.split( ',', Qt::SkipEmptyParts ) )
+	{
+		if ( part.trimmed().isEmpty() )
+			continue;
+
+		const auto bounds = part.split( '-' );
+		FontAtlasRange range;
+		if ( bounds.size() > 2 || !ParseCodePoint( bounds[0], range.first ) )
+			return false;
+
+		range.last = range.first;
+		if ( bounds.size() == 2 && ( !ParseCodePoint( bounds[1], range.last ) || range.last < range.first ) )
+			return false;
+
+		ranges.append( range );
+	}
+	return !ranges.isEmpty();
+}
+
+// Glyph rectangle at atlas scale. Distance fields are measured on the large font and get the spread around them,
+// the rectangle is snapped so the pen origin lands on a whole atlas pixel.
+static FontAtlasGlyph MeasureGlyph( const QFontMetrics &metrics, char32_t codePoint, const FontAtlasOptions &options )
+{
+	const QString text = QString::fromUcs4( &codePoint, 1 );
+	// Covers every pixel the glyph touches when drawn at the origin
+	const QRect bounds = metrics.boundingRect( text );
+	const int advance = metrics.horizontalAdvance( text );
+
+	// Nothing to draw ( space ), only the advance matters
+	if ( bounds.isEmpty() )
+		return { codePoint, 0, 0, 0, 0, 0, 0, options.sdf ? static_cast<int>( std::lround( static_cast<double>( advance ) / options.sdfScale ) ) : advance };
+
+	if ( !options.sdf )
+		return { codePoint, 0, 0, bounds.width(), bounds.height(), bounds.left(), bounds.top(), advance };
+
+	const double scale = options.sdfScale;
+	const int left = static_cast<int>( std::floor( bounds.left() / scale ) );
+	const int top = static_cast<int>( std::floor( bounds.top() / scale ) );
+	const int right = static_cast<int>( std::ceil( ( bounds.left() + bounds.width() ) / scale ) );
+	const int bottom = static_cast<int>( std::ceil( ( bounds.top() + bounds.height() ) / scale ) );
+	const int spread = options.sdfSpread;
+	return { codePoint, 0, 0, right - left + spread * 2, bottom - top + spread * 2, left - spread, top - spread,
+			 static_cast<int>( std::lround( advance / scale ) ) };
+}
+
+// Squared euclidean distance transform along one line ( Felzenszwalb and Huttenlocher ).
+// f is 0 on the pixels distances are measured to and SDF_INF everywhere else, v and z are scratch.
+static constexpr double SDF_INF = 1e20;
+
+static void DistanceTransform1D( double *f, std::size_t stride, int n, double *d, int *v, double *z )
+{
+	int k = 0;
+	v[0] = 0;
+	z[0] = -SDF_INF;
+	z[1] = SDF_INF;
+	for ( int q = 1; q < n; q++ )
+	{
+		double s;
+		for ( ;; )
+		{
+			const int r = v[k];
+			s = ( ( f[q * stride] + static_cast<double>( q ) * q ) - ( f[r * stride] + static_cast<double>( r ) * r ) ) / ( 2.0 * q - 2.0 * r );
+			if ( s > z[k] || k == 0 )
+				break;
+			k--;
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = SDF_INF;
+	}
+
+	k = 0;
+	for ( int q = 0; q < n; q++ )
+	{
+		while ( z[k + 1] < q )
+			k++;
+		d[q] = static_cast<double>( q - v[k] ) * ( q - v[k] ) + f[v[k] * stride];
+	}
+
+	for ( int q = 0; q < n; q++ )
+		f[q * stride] = d[q];
+}
+
+static void DistanceTransform2D( std::vector<double> &grid, int width, int height )
+{
+	const std::size_t length = std::max( width, height );
+	std::vector<double> d( length ), z( length + 1 );
+	std::vector<int> v( length );
+
+	for ( int x = 0; x < width; x++ )
+		DistanceTransform1D( grid.data() + x, width, height, d.data(), v.data(), z.data() );
+	for ( int y = 0; y < height; y++ )
+		DistanceTransform1D( grid.data() + static_cast<std::size_t>( y ) * width, 1, width, d.data(), v.data(), z.data() );
+}
+
+// Renders one glyph sdfScale times larger, measures how far every pixel is from the edge and samples that
+// down into the glyph's spot in the atlas. Glyphs never overlap, so every one can run on its own thread.
+static void RenderSDFGlyph( const QFont &largeFont, const FontAtlasGlyph &glyph, const FontAtlasOptions &options, FontAtlasImage &atlas )
+{
+	const int scale = options.sdfScale;
+	const int width = glyph.width * scale;
+	const int height = glyph.height * scale;
+
+	QImage coverage( width, height, QImage::Format_Grayscale8 );
+	coverage.fill( 0 );
+
+	QPainter painter( &coverage );
+	painter.setFont( largeFont );
+	painter.setPen( QPen( Qt::white ) );
+	painter.drawText( QPoint( -glyph.bearingX * scale, -glyph.bearingY * scale ), QString::fromUcs4( &glyph.codePoint, 1 ) );
+	painter.end();
+
+	// Distance to the nearest inside pixel for everything outside, and the other way round
+	const std::size_t pixelCount = static_cast<std::size_t>( width ) * height;
+	std::vector<double> toInside( pixelCount ), toOutside( pixelCount );
+	for ( int y = 0; y < height; y++ )
+	{
+		const uchar *pRow = coverage.constScanLine( y );
+		for ( int x = 0; x < width; x++ )
+		{
+			const bool bInside = pRow[x] >= 128;
+			toInside[static_cast<std::size_t>( y ) * width + x] = bInside ? 0 : SDF_INF;
+			toOutside[static_cast<std::size_t>( y ) * width + x] = bInside ? SDF_INF : 0;
+		}
+	}
+	DistanceTransform2D( toInside, width, height );
+	DistanceTransform2D( toOutside, width, height );
+
+	// Sampled at the centre of every atlas pixel, the edge sits half way between an inside and an outside pixel
+	const double range = 2.0 * options.sdfSpread * scale;
+	for ( int y = 0; y < glyph.height; y++ )
+	{
+		vlByte *pOut = atlas.rgba.data() + ( static_cast<std::size_t>( glyph.y + y ) * atlas.width + glyph.x ) * 4;
+		for ( int x = 0; x < glyph.width; x++, pOut += 4 )
+		{
+			const std::size_t sample = static_cast<std::size_t>( y * scale + scale / 2 ) * width + x * scale + scale / 2;
+			const double distance = toOutside[sample] > 0 ? -( std::sqrt( toOutside[sample] ) - 0.5 ) : std::sqrt( toInside[sample] ) - 0.5;
+			const vlByte value = static_cast<vlByte>( std::lround( std::clamp( 0.5 - distance / range, 0.0, 1.0 ) * 255.0 ) );
+			pOut[0] = pOut[1] = pOut[2] = pOut[3] = value;
+		}
+	}
+}
+
+int FontAtlas::MaxSDFScale( int glyphSize, int sdfSpread )
+{
+	return std::max( 1, MAX_SDF_RENDER_SIZE / std::max( 1, glyphSize + sdfSpread * 2 ) );
+}
+
+bool FontAtlas::Build( const QString &fontPath, const FontAtlasOptions &requestedOptions, FontAtlasImage &atlas, QString &error )
+{
+	FontAtlasOptions options = requestedOptions;
+	options.sdfScale = std::clamp( options.sdfScale, 1, MaxSDFScale( options.glyphSize, options.sdfSpread ) );
+
+	const int id = QFontDatabase::addApplicationFont( fontPath );
+	const QStringList families = QFontDatabase::applicationFontFamilies( id );
+	if ( id < 0 || families.isEmpty() )
+	{
+		error = QObject::tr( "Could not load the font %1." ).arg( fontPath );
+		return false;
+	}
+
+	QFont font( families[0] );
+	font.setPixelSize( options.sdf ? options.glyphSize * options.sdfScale : options.glyphSize );
+	// Glyphs the font doesn't have would otherwise be drawn from some other font
+	font.setStyleStrategy( QFont::NoFontMerging );
+	const QFontMetrics metrics( font );
+
+	// Overlapping ranges shouldn't give the same glyph twice
+	std::vector<char32_t> codePoints;
+	for ( const auto &range : options.charset )
+		for ( char32_t codePoint = range.first; codePoint <= range.last; codePoint++ )
+			codePoints.push_back( codePoint );
+	std::sort( codePoints.begin(), codePoints.end() );
+	codePoints.erase( std::unique( codePoints.begin(), codePoints.end() ), codePoints.end() );
+
+	const double metricsScale = options.sdf ? options.sdfScale : 1;
+	atlas = FontAtlasImage();
+	atlas.family = families[0];
+	atlas.width = options.width;
+	atlas.height = options.height;
+	atlas.ascent = static_cast<int>( std::lround( metrics.ascent() / metricsScale ) );
+	atlas.descent = static_cast<int>( std::lround( metrics.descent() / metricsScale ) );
+	atlas.lineHeight = static_cast<int>( std::lround( metrics.lineSpacing() / metricsScale ) );
+
+	for ( const char32_t codePoint : codePoints )
+		if ( metrics.inFontUcs4( codePoint ) )
+			atlas.glyphs.push_back( MeasureGlyph( metrics, codePoint, options ) );
+
+	// Tallest first packs the tightest
+	std::vector<std::size_t> order( atlas.glyphs.size() );
+	for ( std::size_t i = 0; i < order.size(); i++ )
+		order[i] = i;
+	std::sort( order.begin(), order.end(), [&atlas]( std::size_t a, std::size_t b )
+			   {
+				   const auto &glyphA = atlas.glyphs[a];
+				   const auto &glyphB = atlas.glyphs[b];
+				   return glyphA.height != glyphB.height ? glyphA.height > glyphB.height : glyphA.width > glyphB.width;
+			   } );
+
+	SkylinePacker packer( options.width, options.height );
+	std::size_t packed = 0;
+	for ( const std::size_t index : order )
+	{
+		auto &glyph = atlas.glyphs[index];
+		if ( glyph.width <= 0 || glyph.height <= 0 )
+		{
+			packed++;
+			continue;
+		}
+
+		int x, y;
+		if ( !packer.Insert( glyph.width + options.padding * 2, glyph.height + options.padding * 2, x, y ) )
+			break;
+
+		glyph.x = x + options.padding;
+		glyph.y = y + options.padding;
+		packed++;
+	}
+
+	if ( packed < atlas.glyphs.size() )
+	{
+		error = QObject::tr( "Only %1 of %2 glyphs fit into %3x%4, make the atlas larger or the glyphs smaller." )
+					.arg( packed )
+					.arg( atlas.glyphs.size() )
+					.arg( options.width )
+					.arg( options.height );
+		QFontDatabase::removeApplicationFont( id );
+		return false;
+	}
+
+	atlas.rgba.assign( static_cast<std::size_t>( options.width ) * options.height * 4, 0 );
+
+	if ( options.sdf )
+	{
+		const auto renderGlyph = [&]( std::size_t i )
+		{
+			if ( atlas.glyphs[i].width > 0 && atlas.glyphs[i].height > 0 )
+				RenderSDFGlyph( font, atlas.glyphs[i], options, atlas );
+		};
+
+		// Some font engines can only draw text on the GUI thread
+		if ( QFontDatabase::supportsThreadedFontRendering() )
+			util::parallel_for( atlas.glyphs.size(), renderGlyph );
+		else
+			for ( std::size_t i = 0; i < atlas.glyphs.size(); i++ )
+				renderGlyph( i );
+	}
+	else
+	{
+		// The painter draws straight into the pixels that go to the import dialog
+		QImage image( atlas.rgba.data(), options.width, options.height, options.width * 4, QImage::Format_RGBA8888 );
+
+		QPainter painter( &image );
+		painter.setFont( font );
+		painter.setPen( QPen( Qt::white ) );
+		for ( const auto &glyph : atlas.glyphs )
+			if ( glyph.width > 0 && glyph.height > 0 )
+				painter.drawText( QPoint( glyph.x - glyph.bearingX, glyph.y - glyph.bearingY ), QString::fromUcs4( &glyph.codePoint, 1 ) );
+		painter.end();
+	}
+
+	QFontDatabase::removeApplicationFont( id );
+	return true;
+}
+
+bool FontAtlas::WriteMetrics( const QString &path, const FontAtlasImage &atlas, const FontAtlasOptions &options, QString &error )
+{
+	QJsonArray glyphs;
+	for ( const auto &glyph : atlas.glyphs )
+	{
+		QJsonObject entry;
+		entry["codePoint"] = static_cast<qint64>( glyph.codePoint );
+		entry["x"] = glyph.x;
+		entry["y"] = glyph.y;
+		entry["width"] = glyph.width;
+		entry["height"] = glyph.height;
+		entry["bearingX"] = glyph.bearingX;
+		entry["bearingY"] = glyph.bearingY;
+		entry["advance"] = glyph.advance;
+		glyphs.append( entry );
+	}
+
+	QJsonObject root;
+	root["family"] = atlas.family;
+	root["glyphSize"] = options.glyphSize;
+	root["width"] = atlas.width;
+	root["height"] = atlas.height;
+	root["ascent"] = atlas.ascent;
+	root["descent"] = atlas.descent;
+	root["lineHeight"] = atlas.lineHeight;
+	// Distance in atlas pixels that 0 and 255 stand for, 0 for plain coverage
+	root["sdfSpread"] = options.sdf ? options.sdfSpread : 0;
+	root["glyphs"] = glyphs;
+
+	QSaveFile file( path );
+	if ( !file.open( QIODevice::WriteOnly ) || file.write( QJsonDocument( root ).toJson() ) < 0 || !file.commit() )
+	{
+		error = QObject::tr( "Could not write the glyph metrics to %1." ).arg( path );
+		return false;
+	}
+	return true;
+}
+
+FontAtlasDialog::FontAtlasDialog( const QString &fontPath, QWidget *pParent ) :
+	QDialog( pParent )
+{
+	this->setWindowTitle( tr( "Font Atlas" ) );
+
+	auto pLayout = new QGridLayout( this );
+
+	pWidthCombo = new QComboBox( this );
+	pHeightCombo = new QComboBox( this );
+	for ( int size = 64; size <= 8192; size *= 2 )
+	{
+		pWidthCombo->addItem( QString::number( size ), size );
+		pHeightCombo->addItem( QString::number( size ), size );
+	}
+	pWidthCombo->setCurrentIndex( pWidthCombo->findData( 1024 ) );
+	pHeightCombo->setCurrentIndex( pHeightCombo->findData( 1024 ) );
+
+	pLayout->addWidget( new QLabel( tr( "Atlas Width:" ), this ), 0, 0, Qt::AlignLeft );
+	pLayout->addWidget( pWidthCombo, 0, 1, Qt::AlignRight );
+	pLayout->addWidget( new QLabel( tr( "Atlas Height:" ), this ), 1, 0, Qt::AlignLeft );
+	pLayout->addWidget( pHeightCombo, 1, 1, Qt::AlignRight );
+
+	pGlyphSizeBox = new QSpinBox( this );
+	pGlyphSizeBox->setRange( 4, 512 );
+	pGlyphSizeBox->setValue( 32 );
+	pGlyphSizeBox->setSuffix( " px" );
+	pLayout->addWidget( new QLabel( tr( "Glyph Size:" ), this ), 2, 0, Qt::AlignLeft );
+	pLayout->addWidget( pGlyphSizeBox, 2, 1, Qt::AlignRight );
+
+	pPaddingBox = new QSpinBox( this );
+	pPaddingBox->setRange( 0, 64 );
+	pPaddingBox->setValue( 2 );
+	pPaddingBox->setSuffix( " px" );
+	pLayout->addWidget( new QLabel( tr( "Padding:" ), this ), 3, 0, Qt::AlignLeft );
+	pLayout->addWidget( pPaddingBox, 3, 1, Qt::AlignRight );
+
+	pCharsetPresetCombo = new QComboBox( this );
+	pCharsetPresetCombo->addItem( tr( "Basic Latin" ), "0x20-0x7E" );
+	pCharsetPresetCombo->addItem( tr( "Latin-1" ), "0x20-0x7E, 0xA0-0xFF" );
+	pCharsetPresetCombo->addItem( tr( "European" ), "0x20-0x7E, 0xA0-0x17F, 0x370-0x3FF, 0x400-0x4FF" );
+	pCharsetPresetCombo->addItem( tr( "Japanese" ), "0x20-0x7E, 0x3000-0x30FF, 0x4E00-0x9FFF, 0xFF00-0xFFEF" );
+	pCharsetPresetCombo->addItem( tr( "Korean" ), "0x20-0x7E, 0x3130-0x318F, 0xAC00-0xD7A3" );
+	pLayout->addWidget( new QLabel( tr( "Charset:" ), this ), 4, 0, Qt::AlignLeft );
+	pLayout->addWidget( pCharsetPresetCombo, 4, 1, Qt::AlignRight );
+
+	pCharsetEdit = new QLineEdit( pCharsetPresetCombo->currentData().toString(), this );
+	pCharsetEdit->setToolTip( tr( "Comma separated code points or ranges, like 0x20-0x7E, U+0400-U+04FF." ) );
+	pCharsetEdit->setMinimumWidth( 320 );
+	pLayout->addWidget( pCharsetEdit, 5, 0, 1, 2 );
+
+	pModeCombo = new QComboBox( this );
+	pModeCombo->addItem( tr( "Bitmap" ), false );
+	pModeCombo->addItem( tr( "Signed Distance Field" ), true );
+	pModeCombo->setToolTip( tr( "A distance field atlas scales to any text size with a threshold in the shader." ) );
+	pLayout->addWidget( new QLabel( tr( "Mode:" ), this ), 6, 0, Qt::AlignLeft );
+	pLayout->addWidget( pModeCombo, 6, 1, Qt::AlignRight );
+
+	pSDFSpreadBox = new QSpinBox( this );
+	pSDFSpreadBox->setRange( 1, 32 );
+	pSDFSpreadBox->setValue( 4 );
+	pSDFSpreadBox->setSuffix( " px" );
+	pSDFSpreadBox->setToolTip( tr( "How far from the edge the distance is kept, in atlas pixels." ) );
+	pLayout->addWidget( new QLabel( tr( "Distance Spread:" ), this ), 7, 0, Qt::AlignLeft );
+	pLayout->addWidget( pSDFSpreadBox, 7, 1, Qt::AlignRight );
+
+	pSDFScaleBox = new QSpinBox( this );
+	pSDFScaleBox->setRange( 1, 32 );
+	pSDFScaleBox->setValue( 8 );
+	pSDFScaleBox->setSuffix( "x" );
+	pSDFScaleBox->setToolTip( tr( "Glyphs are rendered this much larger before the distance is measured." ) );
+	pLayout->addWidget( new QLabel( tr( "Oversampling:" ), this ), 8, 0, Qt::AlignLeft );
+	pLayout->addWidget( pSDFScaleBox, 8, 1, Qt::AlignRight );
+
+	// The distance is in every channel, so each of these carries it
+	pFormatCombo = new QComboBox( this );
+	pFormatCombo->addItem( "I8", IMAGE_FORMAT_I8 );
+	pFormatCombo->addItem( "IA88", IMAGE_FORMAT_IA88 );
+	pFormatCombo->addItem( "RGBA8888", IMAGE_FORMAT_RGBA8888 );
+	pLayout->addWidget( new QLabel( tr( "Distance Format:" ), this ), 9, 0, Qt::AlignLeft );
+	pLayout->addWidget( pFormatCombo, 9, 1, Qt::AlignRight );
+
+	pMetricsBox = new QCheckBox( tr( "Write glyph metrics" ), this );
+	pMetricsBox->setChecked( true );
+	pLayout->addWidget( pMetricsBox, 10, 0, 1, 2 );
+
+	const QFileInfo fontInfo( fontPath );
+	pMetricsPathEdit = new QLineEdit( fontInfo.dir().filePath( fontInfo.completeBaseName() + ".json" ), this );
+	auto pMetricsBrowseButton = new QPushButton( tr( "..." ), this );
+	auto pMetricsLayout = new QHBoxLayout();
+	pMetricsLayout->addWidget( pMetricsPathEdit );
+	pMetricsLayout->addWidget( pMetricsBrowseButton );
+	pLayout->addLayout( pMetricsLayout, 11, 0, 1, 2 );
+
+	auto pButtonLayout = new QHBoxLayout();
+
+	auto pOkButton = new QPushButton( tr( "Ok" ), this );
+	pButtonLayout->addWidget( pOkButton, Qt::AlignCenter );
+
+	auto pCancelButton = new QPushButton( tr( "Cancel" ), this );
+	pButtonLayout->addWidget( pCancelButton, Qt::AlignCenter );
+
+	pLayout->addLayout( pButtonLayout, 12, 0, 1, 2 );
+
+	auto updateEnabled = [this, pMetricsBrowseButton]
+	{
+		const bool bSDF = pModeCombo->currentData().toBool();
+		pSDFSpreadBox->setEnabled( bSDF );
+		pSDFScaleBox->setEnabled( bSDF );
+		pFormatCombo->setEnabled( bSDF );
+		pMetricsPathEdit->setEnabled( pMetricsBox->isChecked() );
+		pMetricsBrowseButton->setEnabled( pMetricsBox->isChecked() );
+	};
+	updateEnabled();
+
+	const auto updateScaleLimit = [this]
+	{
+		pSDFScaleBox->setMaximum( FontAtlas::MaxSDFScale( pGlyphSizeBox->value(), pSDFSpreadBox->value() ) );
+	};
+	updateScaleLimit();
+
+	connect( pCharsetPresetCombo, &QComboBox::activated, this, [this]
+			 {
+				 pCharsetEdit->setText( pCharsetPresetCombo->currentData().toString() );
+			 } );
+	connect( pCharsetEdit, &QLineEdit::textChanged, this, [this, pOkButton]( const QString &text )
+			 {
+				 QList<FontAtlasRange> ranges;
+				 pOkButton->setEnabled( FontAtlas::ParseCharset( text, ranges ) );
+			 } );
+	connect( pModeCombo, &QComboBox::currentIndexChanged, this, updateEnabled );
+	connect( pGlyphSizeBox, &QSpinBox::valueChanged, this, updateScaleLimit );
+	connect( pSDFSpreadBox, &QSpinBox::valueChanged, this, updateScaleLimit );
+	connect( pMetricsBox, &QCheckBox::toggled, this, updateEnabled );
+	connect( pMetricsBrowseButton, &QPushButton::pressed, this, [this]
+			 {
+				 const QString path = QFileDialog::getSaveFileName( this, tr( "Glyph Metrics" ), pMetricsPathEdit->text(), "*.json", nullptr, QFileDialog::Option::DontUseNativeDialog );
+				 if ( !path.isEmpty() )
+					 pMetricsPathEdit->setText( path );
+			 } );
+	connect( pOkButton, &QPushButton::pressed, this, &QDialog::accept );
+	connect( pCancelButton, &QPushButton::pressed, this, &QDialog::reject );
+}
+
+bool FontAtlasDialog::GetOptions( FontAtlasOptions &options ) const
+{
+	options.width = pWidthCombo->currentData().toInt();
+	options.height = pHeightCombo->currentData().toInt();
+	options.glyphSize = pGlyphSizeBox->value();
+	options.padding = pPaddingBox->value();
+	options.sdf = pModeCombo->currentData().toBool();
+	options.sdfSpread = pSDFSpreadBox->value();
+	options.sdfScale = pSDFScaleBox->value();
+	options.format = options.sdf ? static_cast<VTFImageFormat>( pFormatCombo->currentData().toInt() ) : IMAGE_FORMAT_NONE;
+	options.metricsPath = pMetricsBox->isChecked() ? pMetricsPathEdit->text() : QString();
+	return FontAtlas::ParseCharset( pCharsetEdit->text(), options.charset );
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../libs/VTFLib/VTFLib/VTFLib.h"
+
+#include <QDialog>
+#include <QList>
+#include <QString>
+#include <vector>
+
+class QCheckBox;
+class QComboBox;
+class QLineEdit;
+class QSpinBox;
+
+// Inclusive range of unicode code points
+struct FontAtlasRange
+{
+	char32_t first;
+	char32_t last;
+};
+
+struct FontAtlasOptions
+{
+	int width = 1024;
+	int height = 1024;
+	// Pixel size the font is rendered at
+	int glyphSize = 32;
+	// Empty pixels around every glyph, so filtering doesn't pull in the neighbours
+	int padding = 2;
+	QList<FontAtlasRange> charset = { { 0x20, 0x7E } };
+
+	// Signed distance field instead of plain coverage. Glyphs are rendered sdfScale times larger,
+	// the distance is kept for sdfSpread atlas pixels on either side of the edge.
+	bool sdf = false;
+	int sdfScale = 8;
+	int sdfSpread = 4;
+
+	// What the import dialog starts with, IMAGE_FORMAT_NONE leaves it on its defaults
+	VTFImageFormat format = IMAGE_FORMAT_NONE;
+
+	// The glyph metrics are written here as JSON when set
+	QString metricsPath;
+};
+
+// Where a glyph ended up, in atlas pixels.
+// The bearing goes from the pen position on the baseline to the top left of the rectangle, y pointing down.
+struct FontAtlasGlyph
+{
+	char32_t codePoint;
+	int x;
+	int y;
+	int width;
+	int height;
+	int bearingX;
+	int bearingY;
+	int advance;
+};
+
+struct FontAtlasImage
+{
+	QString family;
+	int width = 0;
+	int height = 0;
+	int ascent = 0;
+	int descent = 0;
+	int lineHeight = 0;
+
+	// RGBA8888, white glyphs on transparent, rows top to bottom.
+	// Distance fields have the distance in every channel, 255 inside fading to 0 outside with the edge at 128.
+	std::vector<vlByte> rgba;
+	std::vector<FontAtlasGlyph> glyphs;
+};
+
+// Renders the glyphs of a font straight into RGBA pixels for the import dialog.
+// Glyphs are packed tightly by their own size instead of into a fixed grid, so large charsets fit.
+class FontAtlas
+{
+public:
+	FontAtlas() = delete;
+
+	// Comma separated code points or ranges, "0x20-0x7E, U+0400-U+04FF, 8364". False when something doesn't parse.
+	static bool ParseCharset( const QString &text, QList<FontAtlasRange> &ranges );
+
+	// Code points the font has no glyph for are skipped. Fails with error set when the glyphs don't fit.
+	static bool Build( const QString &fontPath, const FontAtlasOptions &options, FontAtlasImage &atlas, QString &error );
+
+	static bool WriteMetrics( const QString &path, const FontAtlasImage &atlas, const FontAtlasOptions &options, QString &error );
+
+	// Distance fields never render a glyph larger than this, every worker holds two double grids of its size squared
+	static constexpr int MAX_SDF_RENDER_SIZE = 1024;
+
+	// Largest sdfScale that keeps a glyph and its spread under MAX_SDF_RENDER_SIZE, Build clamps to it
+	static int MaxSDFScale( int glyphSize, int sdfSpread );
+};
+
+// Atlas settings for FontToVTF
+class FontAtlasDialog : public QDialog
+{
+	Q_OBJECT
+
+	QComboBox *pWidthCombo;
+	QComboBox *pHeightCombo;
+	QSpinBox *pGlyphSizeBox;
+	QSpinBox *pPaddingBox;
+	QComboBox *pCharsetPresetCombo;
+	QLineEdit *pCharsetEdit;
+	QComboBox *pModeCombo;
+	QSpinBox *pSDFSpreadBox;
+	QSpinBox *pSDFScaleBox;
+	QComboBox *pFormatCombo;
+	QCheckBox *pMetricsBox;
+	QLineEdit *pMetricsPathEdit;
+
+public:
+	// The metrics sidecar goes next to the font unless picked otherwise
+	FontAtlasDialog( const QString &fontPath, QWidget *pParent );
+
+	// False when the charset doesn't parse
+	bool GetOptions( FontAtlasOptions &options ) const;
+};
@@ -0,0 +1,247 @@
+#include "ImageDecoders.h"
+
+#include "../libs/stb/stb_image.h"
+#include "PixelConversion.h"
+#include "supported_formats/DDSSupport.h"
+#include "supported_formats/EXRSupport.h"
+#include "supported_formats/TGASupport.h"
+#include "supported_formats/TiffSupport.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+// The VTF format a DDS block format goes into, IMAGE_FORMAT_NONE when this build can't store it
+static VTFImageFormat VTFFormatFromDDS( DDSBlockFormat format )
+{
+	switch ( format )
+	{
+		case DDSFORMAT_BC1:
+			return IMAGE_FORMAT_DXT1;
+		case DDSFORMAT_BC2:
+			return IMAGE_FORMAT_DXT3;
+		case DDSFORMAT_BC3:
+			return IMAGE_FORMAT_DXT5;
+		case DDSFORMAT_BC4:
+			return IMAGE_FORMAT_ATI1N;
+		case DDSFORMAT_BC5:
+			return IMAGE_FORMAT_ATI2N;
+#ifdef CHAOS_INITIATIVE
+		case DDSFORMAT_BC6H:
+			return IMAGE_FORMAT_BC6H;
+		case DDSFORMAT_BC7:
+			return IMAGE_FORMAT_BC7;
+#endif
+		default:
+			return IMAGE_FORMAT_NONE;
+	}
+}
+
+static bool ProbeDDS( const vlByte *pData, std::size_t size )
+{
+	return size >= 4 && std::memcmp( pData, "DDS ", 4 ) == 0;
+}
+
+static bool DecodeDDS( const vlByte *pData, std::size_t size, DecodedImages &out )
+{
+	DDSFile ddsFile;
+	if ( !DDSSupport::Load_DDS( pData, size, ddsFile ) || !ddsFile.isValid )
+		return false;
+
+	const VTFImageFormat format = VTFFormatFromDDS( ddsFile.format );
+	if ( format == IMAGE_FORMAT_NONE )
+		return false;
+
+	// Every face becomes its own image with the authored mips hanging off it
+	auto pBlocks = reinterpret_cast<vlByte *>( ddsFile.imageData.data() );
+	for ( uint32_t face = 0; face < ddsFile.faceCount; face++ )
+	{
+		auto pImage = new VTFEImageFormat( pBlocks + DDSSupport::ComputeSurfaceOffset( ddsFile, face, 0 ), ddsFile.width, ddsFile.height, 0, format );
+		for ( uint32_t mip = 1; mip < ddsFile.mipCount; mip++ )
+			pImage->addMipMap( new VTFEImageFormat( pBlocks + DDSSupport::ComputeSurfaceOffset( ddsFile, face, mip ),
+													std::max( 1u, ddsFile.width >> mip ), std::max( 1u, ddsFile.height >> mip ), 0, format ) );
+		out.images.push_back( pImage );
+	}
+
+	out.isCubemap = ddsFile.faceCount == 6;
+	out.isSRGB = ddsFile.isSRGB;
+	return true;
+}
+
+static bool ProbeTIFF( const vlByte *pData, std::size_t size )
+{
+	// Classic TIFF is 42, BigTIFF is 43
+	return size >= 4 && ( ( pData[0] == 'I' && pData[1] == 'I' && ( pData[2] == 42 || pData[2] == 43 ) && pData[3] == 0 ) ||
+						  ( pData[0] == 'M' && pData[1] == 'M' && pData[2] == 0 && ( pData[3] == 42 || pData[3] == 43 ) ) );
+}
+
+static bool DecodeTIFF( const vlByte *pData, std::size_t size, DecodedImages &out )
+{
+	TIFFFile tiffFile;
+	if ( !TiffSupport::Load_TIFF( pData, size, tiffFile ) || !tiffFile.isValid )
+		return false;
+
+	VTFImageFormat format = IMAGE_FORMAT_NONE;
+	switch ( tiffFile.type )
+	{
+		case 8:
+			format = tiffFile.hasAlpha ? IMAGE_FORMAT_RGBA8888 : IMAGE_FORMAT_RGB888;
+			break;
+		case 16:
+		{
+			format = IMAGE_FORMAT_RGBA16161616F;
+
+			// Half RGBA can be used as is
+			if ( tiffFile.sampleFormat == SAMPLEFORMAT_IEEEFP && tiffFile.channelCount == 4 )
+				break;
+
+			// RGBA16161616F is the only 16 bit format VTFLib takes, so everything else is widened to it
+			const std::size_t pixelCount = (std::size_t)tiffFile.width * tiffFile.height;
+			const std::size_t channelCount = tiffFile.channelCount;
+			const auto samples = reinterpret_cast<const uint16_t *>( tiffFile.imageData.data() );
+			std::vector<uint16_t> halfs( pixelCount * 4 );
+
+			if ( tiffFile.sampleFormat == SAMPLEFORMAT_IEEEFP )
+			{
+				// Half RGB, only the alpha is missing
+				for ( std::size_t i = 0; i < pixelCount; i++ )
+				{
+					memcpy( &halfs[i * 4], &samples[i * 3], 3 * sizeof( uint16_t ) );
+					halfs[i * 4 + 3] = 0x3C00; // 1.0
+				}
+			}
+			else
+			{
+				// Unsigned 16 bit, straight to half a scanline at a time so there's no float copy of the whole image
+				for ( uint32_t y = 0; y < tiffFile.height; y++ )
+				{
+					const std::size_t rowStart = (std::size_t)y * tiffFile.width;
+					PixelConversion::UNorm16ToHalf( samples + rowStart * channelCount, halfs.data() + rowStart * 4, tiffFile.width, channelCount );
+				}
+			}
+
+			out.images.push_back( new VTFEImageFormat( reinterpret_cast<vlByte *>( halfs.data() ), tiffFile.width, tiffFile.height, 0, format ) );
+			return true;
+		}
+		case 32:
+			format = tiffFile.hasAlpha ? IMAGE_FORMAT_RGBA32323232F : IMAGE_FORMAT_RGB323232F;
+			break;
+		default:
+			return false;
+	}
+
+	out.images.push_back( new VTFEImageFormat( reinterpret_cast<vlByte *>( tiffFile.imageData.data() ), tiffFile.width, tiffFile.height, 0, format ) );
+	return true;
+}
+
+#ifdef EXR_SUPPORT
+static bool DecodeEXR( const vlByte *pData, std::size_t size, DecodedImages &out )
+{
+	EXRFile exrFile;
+	if ( !EXRSupport::Load_EXR( pData, size, exrFile ) || !exrFile.isValid )
+		return false;
+
+	out.images.push_back( new VTFEImageFormat( reinterpret_cast<vlByte *>( exrFile.imageData.data() ), exrFile.width, exrFile.height, 0,
+											   exrFile.isHalf ? IMAGE_FORMAT_RGBA16161616F : IMAGE_FORMAT_RGBA32323232F ) );
+	return true;
+}
+#endif
+
+// TGA has no magic, check the header makes sense instead.
+// Anything the native reader doesn't take ( colour mapped, 16 bit ) gets through here and ends up with stb.
+static bool ProbeTGA( const vlByte *pData, std::size_t size )
+{
+	if ( size < 18 || pData[1] > 1 )
+		return false;
+
+	const vlByte nImageType = pData[2];
+	const vlByte nPixelDepth = pData[16];
+	return ( nImageType == 1 || nImageType == 2 || nImageType == 3 || nImageType == 9 || nImageType == 10 || nImageType == 11 ) &&
+		   ( nPixelDepth == 8 || nPixelDepth == 15 || nPixelDepth == 16 || nPixelDepth == 24 || nPixelDepth == 32 );
+}
+
+static bool DecodeTGA( const vlByte *pData, std::size_t size, DecodedImages &out )
+{
+	TGAFile tgaFile;
+	if ( !TGASupport::Load_TGA( pData, size, tgaFile ) || !tgaFile.isValid )
+		return false;
+
+	VTFImageFormat format = IMAGE_FORMAT_BGRA8888;
+	if ( tgaFile.channelCount == 3 )
+		format = IMAGE_FORMAT_BGR888;
+	else if ( tgaFile.channelCount == 1 )
+		format = IMAGE_FORMAT_I8;
+
+	out.images.push_back( new VTFEImageFormat( reinterpret_cast<vlByte *>( tgaFile.imageData.data() ), tgaFile.width, tgaFile.height, 0, format ) );
+	return true;
+}
+
+// stb takes whatever is left: PNG, JPEG, BMP, GIF, PSD, HDR and the TGAs the native reader turned down
+static bool ProbeSTB( const vlByte *pData, std::size_t size )
+{
+	int x, y, n;
+	return size <= INT_MAX && stbi_info_from_memory( pData, static_cast<int>( size ), &x, &y, &n );
+}
+
+static bool DecodeSTB( const vlByte *pData, std::size_t size, DecodedImages &out )
+{
+	int x, y, n;
+	const int nSize = static_cast<int>( size );
+
+	if ( !stbi_is_hdr_from_memory( pData, nSize ) )
+	{
+		vlByte *data = stbi_load_from_memory( pData, nSize, &x, &y, &n, 4 );
+
+		if ( !data )
+			return false;
+
+		out.images.push_back( new VTFEImageFormat( data, x, y, 0, IMAGE_FORMAT_RGBA8888 ) );
+
+		stbi_image_free( data );
+	}
+	else
+	{
+		float *data = stbi_loadf_from_memory( pData, nSize, &x, &y, &n, 0 );
+
+		if ( !data )
+			return false;
+
+		tagVTFImageFormat format = n > 3 ? IMAGE_FORMAT_RGBA32323232F : IMAGE_FORMAT_RGB323232F;
+
+		out.images.push_back( new VTFEImageFormat( reinterpret_cast<vlByte *>( data ), x, y, 0, format ) );
+
+		stbi_image_free( data );
+	}
+	return true;
+}
+
+// In priority order, formats with a real magic go first so the TGA header check can't steal them
+static const ImageDecoder IMAGE_DECODERS[] = {
+	{ "DDS", &ProbeDDS, &DecodeDDS },
+	{ "TIFF", &ProbeTIFF, &DecodeTIFF },
+#ifdef EXR_SUPPORT
+	{ "EXR", &EXRSupport::IsEXR, &DecodeEXR },
+#endif
+	{ "TGA", &ProbeTGA, &DecodeTGA },
+	{ "stb", &ProbeSTB, &DecodeSTB },
+};
+
+bool ImageDecoders::Decode( const vlByte *pData, std::size_t size, DecodedImages &out )
+{
+	if ( !pData || size == 0 )
+		return false;
+
+	for ( const auto &decoder : IMAGE_DECODERS )
+	{
+		if ( !decoder.Probe( pData, size ) )
+			continue;
+
+		DecodedImages decoded;
+		if ( decoder.Decode( pData, size, decoded ) )
+		{
+			out = std::move( decoded );
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "VTFEImageFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Everything a decoder hands back, the caller takes ownership of the images.
+// Block compressed DDS files give one image per face with their mips hanging off it, everything else gives one.
+struct DecodedImages
+{
+	std::vector<VTFEImageFormat *> images;
+	bool isCubemap = false;
+	bool isSRGB = false;
+};
+
+struct ImageDecoder
+{
+	const char *name;
+	// Looks at the magic bytes only, a match doesn't mean Decode will take the file
+	bool ( *Probe )( const vlByte *pData, std::size_t size );
+	bool ( *Decode )( const vlByte *pData, std::size_t size, DecodedImages &out );
+};
+
+// Picks a decoder by magic bytes instead of the file extension, so anything in memory ( VPK entries, the clipboard ) can be imported
+// without going through a temp file. The decoders live in a table in ImageDecoders.cpp, a faster decoder only needs an entry there.
+class ImageDecoders
+{
+public:
+	ImageDecoders() = delete;
+
+	// Every decoder whose probe matches is tried in table order, the first one that succeeds wins
+	static bool Decode( const vlByte *pData, std::size_t size, DecodedImages &out );
+};
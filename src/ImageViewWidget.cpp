@@ -1,6 +1,10 @@
 
 #include "ImageViewWidget.h"
 
+#include "MappedVTF.h"
+#include "PixelConversion.h"
+#include "Trace.h"
+
 #include <QColorSpace>
 #include <QPainter>
 #include <QStyleOption>
@@ -29,6 +33,8 @@ ImageViewWidget::ImageViewWidget( QWidget *pParent ) :
 
 {
 	setFocusPolicy( Qt::StrongFocus );
+	// One surface at a time, smallest first
+	loadPool_.setMaxThreadCount( 1 );
 }
 
 void ImageViewWidget::startAnimation( int fps )
@@ -45,9 +51,14 @@ void ImageViewWidget::stopAnimating()
 	}
 }
 
-void ImageViewWidget::set_vtf( VTFLib::CVTFFile *file )
+void ImageViewWidget::set_vtf( VTFLib::CVTFFile *file, const MappedVTF *pMapped )
 {
+	// The loader reads from the old mapping, it has to be gone before the caller drops it
+	stop_loading();
+
 	file_ = file;
+	mapped_ = pMapped;
+	clear_decoded_cache();
 	// Force refresh of data
 	currentFrame_ = -1;
 	currentFace_ = -1;
@@ -100,6 +111,7 @@ void ImageViewWidget::resizeGL( int w, int h )
 
 void ImageViewWidget::paintGL()
 {
+	TRACE_ZONE( "paintGL" );
 	// Draw the scene:
 	QStyleOption opt;
 	opt.initFrom( this );
@@ -178,20 +190,13 @@ void ImageViewWidget::paintGL()
 	glEnableVertexAttribArray( 2 );
 	glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof( float ), (void *)( 6 * sizeof( float ) ) );
 
-	if ( file_ )
+	const QImage image = file_ ? decoded_image( frame_, face_, mip_ ) : QImage();
+	if ( !image.isNull() )
 	{
-		GLuint width, height, whatever;
-		CVTFFile::ComputeMipmapDimensions( file_->GetWidth(), file_->GetHeight(), 1, mip_, width, height, whatever );
-		auto size = CVTFFile::ComputeImageSize( width, height, whatever, IMAGE_FORMAT_RGBA8888 );
-		auto imgData = new vlByte[size];
-		CVTFFile::ConvertToRGBA8888( file_->GetData( frame_, face_, 0, mip_ ), reinterpret_cast<vlByte *>( imgData ), width, height, file_->GetFormat() );
-
 		texture.create();
-		texture.setData( QImage( imgData, width, height, QImage::Format_RGBA8888 ) );
+		texture.setData( image );
 
 		texture.bind( 0 );
-
-		delete[] imgData;
 	}
 	else
 	{
@@ -350,6 +355,176 @@ void ImageViewWidget::zoom( float amount )
 	update_size();
 }
 
+QImage ImageViewWidget::decoded_image( int frame, int face, int mip )
+{
+	const QImage cached = cached_image( frame, face, mip );
+	if ( !cached.isNull() )
+		return cached;
+
+	if ( mapped_ )
+	{
+		if ( has_failed( frame, face, mip ) )
+			return error_image();
+
+		request_surface( frame, face, mip );
+
+		for ( int smaller = mip + 1; smaller < static_cast<int>( file_->GetMipmapCount() ); smaller++ )
+		{
+			const QImage preview = cached_image( frame, face, smaller );
+			if ( !preview.isNull() )
+				return preview;
+		}
+		return {};
+	}
+
+	vlUInt width, height, depth;
+	CVTFFile::ComputeMipmapDimensions( file_->GetWidth(), file_->GetHeight(), 1, mip, width, height, depth );
+
+	const QImage image = decode_surface( file_->GetData( frame, face, 0, mip ), width, height, file_->GetFormat() );
+	if ( !image.isNull() )
+		add_decoded( frame, face, mip, image );
+	return image;
+}
+
+QImage ImageViewWidget::cached_image( int frame, int face, int mip )
+{
+	for ( auto it = decodedCache_.begin(); it != decodedCache_.end(); ++it )
+	{
+		if ( it->frame != frame || it->face != face || it->mip != mip )
+			continue;
+
+		decodedCache_.splice( decodedCache_.begin(), decodedCache_, it );
+		return decodedCache_.front().image;
+	}
+	return {};
+}
+
+bool ImageViewWidget::is_cached( int frame, int face, int mip ) const
+{
+	for ( const auto &decoded : decodedCache_ )
+		if ( decoded.frame == frame && decoded.face == face && decoded.mip == mip )
+			return true;
+	return false;
+}
+
+bool ImageViewWidget::has_failed( int frame, int face, int mip ) const
+{
+	for ( const auto &failed : failedSurfaces_ )
+		if ( failed.frame == frame && failed.face == face && failed.mip == mip )
+			return true;
+	return false;
+}
+
+// Purple and black checkers, like the engine shows for a texture it can't load
+QImage ImageViewWidget::error_image()
+{
+	static const QImage image = []
+	{
+		QImage checkers( 64, 64, QImage::Format_RGBA8888 );
+		for ( int y = 0; y < checkers.height(); y++ )
+			for ( int x = 0; x < checkers.width(); x++ )
+				checkers.setPixel( x, y, ( ( x / 8 ) + ( y / 8 ) ) % 2 ? qRgb( 255, 0, 255 ) : qRgb( 0, 0, 0 ) );
+		return checkers;
+	}();
+	return image;
+}
+
+void ImageViewWidget::add_decoded( int frame, int face, int mip, const QImage &image )
+{
+	decodedCache_.push_front( { frame, face, mip, image } );
+	decodedCacheBytes_ += image.sizeInBytes();
+
+	// Always keep the image we just decoded, even when it alone is over budget.
+	while ( decodedCacheBytes_ > decodedCacheBudget_ && decodedCache_.size() > 1 )
+	{
+		decodedCacheBytes_ -= decodedCache_.back().image.sizeInBytes();
+		decodedCache_.pop_back();
+	}
+}
+
+void ImageViewWidget::clear_decoded_cache()
+{
+	decodedCache_.clear();
+	decodedCacheBytes_ = 0;
+	failedSurfaces_.clear();
+}
+
+QImage ImageViewWidget::decode_surface( const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format )
+{
+	if ( !pData )
+		return {};
+
+	// RGBA8888 scanlines are always 4 byte aligned, so the QImage memory is one tight block.
+	QImage image( width, height, QImage::Format_RGBA8888 );
+	if ( !PixelConversion::ToRGBA8888( pData, image.bits(), width, height, format ) )
+		return {};
+	return image;
+}
+
+void ImageViewWidget::request_surface( int frame, int face, int mip )
+{
+	if ( frame == loadFrame_ && face == loadFace_ && mip == loadMip_ )
+		return;
+
+	// Anything still loading is for a surface that isn't shown anymore
+	const int generation = ++loadGeneration_;
+	loadFrame_ = frame;
+	loadFace_ = face;
+	loadMip_ = mip;
+
+	std::vector<int> mips;
+	for ( int m = static_cast<int>( file_->GetMipmapCount() ) - 1; m >= mip; m-- )
+		if ( !is_cached( frame, face, m ) && !has_failed( frame, face, m ) )
+			mips.push_back( m );
+
+	// The loader never touches file_, the settings panel may edit it meanwhile
+	const MappedVTF *pMapped = mapped_;
+	const vlUInt width = file_->GetWidth();
+	const vlUInt height = file_->GetHeight();
+	const VTFImageFormat format = file_->GetFormat();
+
+	loadPool_.start( [this, pMapped, width, height, format, generation, frame, face, mips]
+					 {
+						 for ( const int m : mips )
+						 {
+							 if ( loadGeneration_ != generation )
+								 return;
+
+							 TRACE_ZONE( "ImageViewWidget::load mip" );
+							 vlUInt mipWidth, mipHeight, mipDepth;
+							 CVTFFile::ComputeMipmapDimensions( width, height, 1, m, mipWidth, mipHeight, mipDepth );
+							 const MappedVTF::Surface surface = pMapped->GetData( frame, face, 0, m );
+							 // A null image is a chunk that didn't inflate or a format that didn't decode, the bigger mips may still be fine
+							 const QImage image = decode_surface( surface.Data(), mipWidth, mipHeight, format );
+
+							 QMetaObject::invokeMethod(
+								 this, [this, generation, frame, face, m, image]
+								 {
+									 if ( loadGeneration_ != generation )
+										 return;
+
+									 if ( image.isNull() )
+										 failedSurfaces_.push_back( { frame, face, m } );
+									 else
+										 add_decoded( frame, face, m, image );
+									 // Done either way, so the surface is read again if the cache drops it later
+									 if ( m == loadMip_ )
+										 loadFrame_ = loadFace_ = loadMip_ = -1;
+									 update();
+								 },
+								 Qt::QueuedConnection );
+						 }
+					 } );
+}
+
+void ImageViewWidget::stop_loading()
+{
+	++loadGeneration_;
+	// At most the surface being read right now is waited on
+	loadPool_.waitForDone();
+	loadFrame_ = loadFace_ = loadMip_ = -1;
+}
+
 void ImageViewWidget::update_size()
 {
 	if ( !file_ )
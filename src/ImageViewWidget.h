@@ -1,6 +1,7 @@
 #pragma once
 #include "../libs/VTFLib/VTFLib/VTFLib.h"
 
+#include <QImage>
 #include <QOpenGLBuffer>
 #include <QOpenGLFunctions>
 #include <QOpenGLFunctions_4_5_Core>
@@ -8,7 +9,13 @@
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
 #include <QOpenGLWidget>
+#include <QThreadPool>
 #include <QWidget>
+#include <atomic>
+#include <list>
+#include <vector>
+
+class MappedVTF;
 
 enum ColorSelection
 {
@@ -41,7 +48,9 @@ public:
 
 	void timerEvent( QTimerEvent *event ) override;
 
-	void set_vtf( VTFLib::CVTFFile *file );
+	// pMapped serves the image data when the file was only loaded header only.
+	// Mapped files open progressively, see request_surface.
+	void set_vtf( VTFLib::CVTFFile *file, const MappedVTF *pMapped = nullptr );
 
 	void initializeGL() override;
 
@@ -163,9 +172,55 @@ public:
 private:
 	void update_size();
 
+	// Decoded RGBA8888 images keyed by frame, face and mip.
+	// Images are only decoded the first time they are shown, repaints and animation loops reuse them.
+	// The least recently shown image is dropped once the cache goes over its budget.
+	struct DecodedImage
+	{
+		int frame;
+		int face;
+		int mip;
+		QImage image;
+	};
+
+	static constexpr qsizetype decodedCacheBudget_ = 256 * 1024 * 1024;
+
+	std::list<DecodedImage> decodedCache_; // Most recently used first
+	qsizetype decodedCacheBytes_ = 0;
+
+	// Mapped surfaces that didn't read or decode, shown as the error texture instead of being asked for again
+	struct FailedSurface
+	{
+		int frame;
+		int face;
+		int mip;
+	};
+	std::vector<FailedSurface> failedSurfaces_;
+	bool has_failed( int frame, int face, int mip ) const;
+	static QImage error_image();
+
+	QImage decoded_image( int frame, int face, int mip );
+	QImage cached_image( int frame, int face, int mip );
+	bool is_cached( int frame, int face, int mip ) const;
+	void add_decoded( int frame, int face, int mip, const QImage &image );
+	void clear_decoded_cache();
+	static QImage decode_surface( const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format );
+
+	// Mapped files may sit on a slow disk or network share, so their surfaces are never read on the GUI thread.
+	// A missing surface is read on loadPool_ smallest mip first, every mip that comes in refines the view.
+	// Until the requested mip is in, the biggest smaller one is drawn stretched over the same quad.
+	void request_surface( int frame, int face, int mip );
+	void stop_loading();
+
+	std::atomic<int> loadGeneration_ = 0; // Bumped to drop whatever is still loading
+	int loadFrame_ = -1;
+	int loadFace_ = -1;
+	int loadMip_ = -1;
+
 	QOpenGLTexture texture { QOpenGLTexture::Target2D };
 	QOpenGLShaderProgram *shaderProgram;
 	VTFLib::CVTFFile *file_ = nullptr;
+	const MappedVTF *mapped_ = nullptr;
 
 	bool m_animating = false;
 
@@ -195,6 +250,10 @@ private:
 	int currentFace_ = 0;
 	int currentMip_ = 0;
 	bool requestColorChange = false;
+
+	// Last, so it's destroyed first and the loader is done before anything it touches goes away
+	QThreadPool loadPool_;
+
 	void Animate();
 signals:
 	void animated( int frame );
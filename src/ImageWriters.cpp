@@ -0,0 +1,213 @@
+#include "ImageWriters.h"
+
+#include "PixelConversion.h"
+#include "Trace.h"
+#include "supported_formats/EXRSupport.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+enum class SurfacePrecision
+{
+	BYTE,
+	SHORT,
+	FLOAT,
+};
+
+static SurfacePrecision PrecisionOf( VTFImageFormat format )
+{
+	switch ( format )
+	{
+		case IMAGE_FORMAT_RGBA16161616:
+			return SurfacePrecision::SHORT;
+		case IMAGE_FORMAT_RGBA16161616F:
+		case IMAGE_FORMAT_RGBA32323232F:
+		case IMAGE_FORMAT_RGB323232F:
+		case IMAGE_FORMAT_R32F:
+			return SurfacePrecision::FLOAT;
+		default:
+			return SurfacePrecision::BYTE;
+	}
+}
+
+// Reused by every surface a thread writes, they only ever grow
+static thread_local std::vector<vlByte> byteScratch;
+static thread_local std::vector<float> floatScratch;
+
+static vlByte *ByteScratch( std::size_t size )
+{
+	if ( byteScratch.size() < size )
+		byteScratch.resize( size );
+	return byteScratch.data();
+}
+
+static float *FloatScratch( std::size_t count )
+{
+	if ( floatScratch.size() < count )
+		floatScratch.resize( count );
+	return floatScratch.data();
+}
+
+// Any source as float RGBA, 8 bit sources come out as 0 - 1
+static const float *ToFloatRGBA( const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format )
+{
+	const std::size_t pixelCount = static_cast<std::size_t>( width ) * height;
+	if ( format == IMAGE_FORMAT_RGBA32323232F )
+		return reinterpret_cast<const float *>( pData );
+
+	float *pFloats = FloatScratch( pixelCount * 4 );
+	switch ( format )
+	{
+		case IMAGE_FORMAT_RGBA16161616F:
+			PixelConversion::HalfToFloat( reinterpret_cast<const uint16_t *>( pData ), pFloats, pixelCount * 4 );
+			break;
+		case IMAGE_FORMAT_RGB323232F:
+		case IMAGE_FORMAT_R32F:
+		{
+			const std::size_t channelCount = format == IMAGE_FORMAT_R32F ? 1 : 3;
+			const auto pSource = reinterpret_cast<const float *>( pData );
+			for ( std::size_t i = 0; i < pixelCount; i++ )
+			{
+				for ( std::size_t c = 0; c < 3; c++ )
+					pFloats[i * 4 + c] = pSource[i * channelCount + std::min( c, channelCount - 1 )];
+				pFloats[i * 4 + 3] = 1.0f;
+			}
+			break;
+		}
+		case IMAGE_FORMAT_RGBA16161616:
+		{
+			const auto pSource = reinterpret_cast<const uint16_t *>( pData );
+			for ( std::size_t i = 0; i < pixelCount * 4; i++ )
+				pFloats[i] = pSource[i] / 65535.0f;
+			break;
+		}
+		default:
+		{
+			vlByte *pBytes = ByteScratch( pixelCount * 4 );
+			if ( !PixelConversion::ToRGBA8888( pData, pBytes, width, height, format ) )
+				return nullptr;
+			for ( std::size_t i = 0; i < pixelCount * 4; i++ )
+				pFloats[i] = pBytes[i] / 255.0f;
+			break;
+		}
+	}
+	return pFloats;
+}
+
+#ifdef EXR_SUPPORT
+static bool WriteEXR( const QString &path, const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format )
+{
+	// Half stays half, everything else is written as float
+	const bool bHalf = format == IMAGE_FORMAT_RGBA16161616F;
+	const void *pPixels = bHalf ? static_cast<const void *>( pData ) : ToFloatRGBA( pData, width, height, format );
+	return pPixels && EXRSupport::Save_EXR( path.toUtf8().constData(), pPixels, width, height, bHalf );
+}
+#endif
+
+// Radiance RGBE with flat scanlines, the RLE is optional and every reader takes these
+static bool WriteHDR( const QString &path, const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format )
+{
+	const float *pFloats = ToFloatRGBA( pData, width, height, format );
+	if ( !pFloats )
+		return false;
+
+	QFile file( path );
+	if ( !file.open( QIODevice::WriteOnly ) )
+		return false;
+
+	const QByteArray header = QString( "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %1 +X %2\n" ).arg( height ).arg( width ).toLatin1();
+	if ( file.write( header ) != header.size() )
+		return false;
+
+	std::vector<vlByte> row( static_cast<std::size_t>( width ) * 4 );
+	for ( vlUInt y = 0; y < height; y++ )
+	{
+		for ( vlUInt x = 0; x < width; x++ )
+		{
+			const float *pPixel = pFloats + ( static_cast<std::size_t>( y ) * width + x ) * 4;
+			vlByte *pOut = row.data() + x * 4;
+
+			const float r = std::max( pPixel[0], 0.0f ), g = std::max( pPixel[1], 0.0f ), b = std::max( pPixel[2], 0.0f );
+			const float maxComponent = std::max( { r, g, b } );
+			if ( maxComponent < 1e-32f )
+			{
+				std::memset( pOut, 0, 4 );
+				continue;
+			}
+
+			int exponent;
+			const float scale = std::frexp( maxComponent, &exponent ) * 256.0f / maxComponent;
+			pOut[0] = static_cast<vlByte>( r * scale );
+			pOut[1] = static_cast<vlByte>( g * scale );
+			pOut[2] = static_cast<vlByte>( b * scale );
+			pOut[3] = static_cast<vlByte>( exponent + 128 );
+		}
+
+		if ( file.write( reinterpret_cast<const char *>( row.data() ), row.size() ) != static_cast<qint64>( row.size() ) )
+			return false;
+	}
+	return true;
+}
+
+// 16 bit per channel PNG / TIFF through Qt, float sources are clamped to 0 - 1
+static bool WriteRGBA64( const QString &path, const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format )
+{
+	const std::size_t sampleCount = static_cast<std::size_t>( width ) * height * 4;
+	const vlByte *pPixels = pData;
+	if ( format != IMAGE_FORMAT_RGBA16161616 )
+	{
+		const float *pFloats = ToFloatRGBA( pData, width, height, format );
+		if ( !pFloats )
+			return false;
+
+		auto pShorts = reinterpret_cast<uint16_t *>( ByteScratch( sampleCount * sizeof( uint16_t ) ) );
+		for ( std::size_t i = 0; i < sampleCount; i++ )
+			pShorts[i] = static_cast<uint16_t>( std::clamp( pFloats[i], 0.0f, 1.0f ) * 65535.0f + 0.5f );
+		pPixels = reinterpret_cast<const vlByte *>( pShorts );
+	}
+
+	return QImage( pPixels, width, height, width * 8, QImage::Format_RGBA64 ).save( path );
+}
+
+static bool WriteRGBA8888( const QString &path, const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format )
+{
+	vlByte *pPixels = ByteScratch( static_cast<std::size_t>( width ) * height * 4 );
+	if ( !PixelConversion::ToRGBA8888( pData, pPixels, width, height, format ) )
+		return false;
+
+	return QImage( pPixels, width, height, width * 4, QImage::Format_RGBA8888 ).save( path );
+}
+
+bool ImageWriters::Write( const QString &path, const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format )
+{
+	TRACE_ZONE( "ImageWriters::Write" );
+	if ( !pData || width == 0 || height == 0 )
+		return false;
+
+	const QString extension = QFileInfo( path ).suffix().toLower();
+#ifdef EXR_SUPPORT
+	if ( extension == "exr" )
+		return WriteEXR( path, pData, width, height, format );
+#endif
+	if ( extension == "hdr" )
+		return WriteHDR( path, pData, width, height, format );
+
+	if ( PrecisionOf( format ) != SurfacePrecision::BYTE && ( extension == "png" || extension == "tif" || extension == "tiff" ) )
+		return WriteRGBA64( path, pData, width, height, format );
+
+	return WriteRGBA8888( path, pData, width, height, format );
+}
+
+QStringList ImageWriters::Wildcards()
+{
+	return { "*.png", "*.tif", "*.tiff",
+#ifdef EXR_SUPPORT
+			 "*.exr",
+#endif
+			 "*.hdr", "*.bmp", "*.jpg", "*.jpeg" };
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../libs/VTFLib/VTFLib/VTFLib.h"
+
+#include <QString>
+#include <QStringList>
+
+// Writes a single VTF surface to an image file, picked by extension. The precision of the source is kept as far as the file can hold it:
+// float and half data go to EXR and HDR as float, 16 bit and float data go to PNG and TIFF as 16 bit, everything else goes through RGBA8888.
+// Can be called from any number of threads, the scratch buffers are kept per thread so exporting many frames doesn't allocate per frame.
+class ImageWriters
+{
+public:
+	ImageWriters() = delete;
+
+	static bool Write( const QString &path, const vlByte *pData, vlUInt width, vlUInt height, VTFImageFormat format );
+
+	// For the save dialog
+	static QStringList Wildcards();
+};
@@ -1,30 +1,44 @@
 #include "MainWindow.h"
 
-#include "../libs/stb/stb_image.h"
+#include "AuxCompression.h"
+#include "AuxCompressionTuner.h"
 #include "EntryTree.h"
+#include "FontAtlas.h"
+#include "ImageWriters.h"
 #include "Options.h"
+#include "Trace.h"
 #include "VTFEImport.h"
 
 #include <QApplication>
 #include <QBuffer>
+#include <QClipboard>
+#include <QDir>
 #include <QDirIterator>
+#include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
-#include <QFontDatabase>
 #include <QGridLayout>
+#include <QInputDialog>
 #include <QLabel>
 #include <QMessageBox>
 #include <QMimeData>
-#include <QPainter>
+#include <QMutex>
 #include <QProgressBar>
 #include <QPushButton>
 #include <QScrollBar>
+#include <QStatusBar>
 #include <QStyle>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
 
 using namespace ui;
 
 #define remap( value, low1, high1, low2, high2 ) ( low2 + ( value - low1 ) * ( high2 - low2 ) / ( high1 - low1 ) )
 
+// VTFs at least this big are mapped instead of loaded
+static constexpr qint64 MAPPED_LOAD_THRESHOLD = 64 * 1024 * 1024;
+
 CMainWindow::CMainWindow() :
 	QMainWindow()
 {
@@ -153,9 +167,20 @@ CMainWindow::CMainWindow() :
 						 {
 							 auto data = mainParent->pakFile()->readEntry( mainParent->pakFile()->findEntry( item->getEntry() ).value() );
 							 VTFLib::CVTFFile *file = new VTFLib::CVTFFile {};
-							 file->Load( data.value().data(), data.value().size(), false );
+							 {
+								 TRACE_ZONE( "Load" );
+								 file->Load( data.value().data(), data.value().size(), false );
+							 }
 							 addVTFToTab( file, item->getEntry().data() );
 						 }
+						 else if ( item->getDisplayType() == TreeItem::DISPLAY_IMAGE )
+						 {
+							 // Decoded straight out of the VPK, no temp file
+							 auto data = mainParent->pakFile()->readEntry( mainParent->pakFile()->findEntry( item->getEntry() ).value() );
+							 if ( data )
+								 generateVTFFromImage( reinterpret_cast<const vlByte *>( data.value().data() ), data.value().size(),
+													   QFileInfo( item->getEntry().c_str() ).fileName() );
+						 }
 					 }
 					 //					 model->fillItem( item );
 					 //					 QTreeView::rowsInserted( parent, 0, model->rowCount( parent ) );
@@ -228,12 +253,17 @@ CMainWindow::CMainWindow() :
 	//			 } );
 
 	setupMenuBar();
+
+	pMemoryLabel = new QLabel( this );
+	statusBar()->addPermanentWidget( pMemoryLabel );
+	updateMemoryInfo();
 	setSizePolicy( QSizePolicy::Expanding, QSizePolicy::Expanding );
 	adjustSize();
 }
 
 VTFLib::CVTFFile *CMainWindow::getVTFFromVTFFile( const char *path )
 {
+	TRACE_ZONE( "Load" );
 	auto vVTF = new VTFLib::CVTFFile();
 	if ( !vVTF->Load( path, false ) )
 		return nullptr;
@@ -244,6 +274,23 @@ void CMainWindow::addVTFFromPathToTab( const QString &path )
 {
 	QFileInfo fileInfo( path );
 
+	// Nothing but the header is read here, the rest is paged in as it's viewed.
+	// Aux compressed files are always mapped, so only the chunks that are looked at get inflated.
+	{
+		TRACE_ZONE( "Load mapped" );
+		auto pMappedVTF = new VTFLib::CVTFFile();
+		auto pMapped = std::make_unique<MappedTab>();
+		pMapped->path = fileInfo.filePath();
+		if ( pMappedVTF->Load( pMapped->path.toUtf8().constData(), true ) && pMapped->vtf.Open( pMapped->path.toUtf8().constData(), *pMappedVTF ) &&
+			 ( fileInfo.size() >= MAPPED_LOAD_THRESHOLD || pMapped->vtf.IsAuxCompressed() ) )
+		{
+			mappedTabs[reinterpret_cast<intptr_t>( pMappedVTF )] = std::move( pMapped );
+			addVTFToTab( pMappedVTF, fileInfo.fileName() );
+			return;
+		}
+		delete pMappedVTF;
+	}
+
 	auto pVTF = getVTFFromVTFFile( fileInfo.filePath().toUtf8().constData() );
 
 	addVTFToTab( pVTF, fileInfo.fileName() );
@@ -276,6 +323,9 @@ void CMainWindow::removeVTFTab( int index )
 	auto vtf = this->vtfWidgetList.value( key );
 
 	this->vtfWidgetList.remove( key );
+	tabUseOrder.removeAll( key );
+	if ( evictedTabs.contains( key ) )
+		QFile::remove( evictedTabs.take( key ) );
 
 	if ( pImageTabWidget->currentIndex() == index )
 	{
@@ -287,7 +337,9 @@ void CMainWindow::removeVTFTab( int index )
 
 	pImageTabWidget->removeTab( index );
 
+	mappedTabs.erase( key );
 	delete vtf;
+	updateMemoryInfo();
 }
 
 void CMainWindow::tabChanged( int index )
@@ -296,7 +348,15 @@ void CMainWindow::tabChanged( int index )
 
 	auto pVTF = this->vtfWidgetList.value( key );
 
-	pImageViewWidget->set_vtf( pVTF );
+	if ( pVTF )
+	{
+		restoreTab( key );
+		tabUseOrder.removeAll( key );
+		tabUseOrder.push_back( key );
+		enforceMemoryBudget();
+	}
+
+	pImageViewWidget->set_vtf( pVTF, mappedVTF( key ) );
 	pImageViewWidget->set_rgba( redBox->isChecked(), greenBox->isChecked(), blueBox->isChecked(), alphaBox->isChecked() );
 	pImageViewWidget->stopAnimating();
 	pResourceWidget->set_vtf( pVTF );
@@ -314,6 +374,144 @@ void CMainWindow::tabChanged( int index )
 	m_pVerticalScrollBar->setValue( 4096 / 2 );
 }
 
+const MappedVTF *CMainWindow::mappedVTF( intptr_t key ) const
+{
+	const auto it = mappedTabs.find( key );
+	return it != mappedTabs.end() ? &it->second->vtf : nullptr;
+}
+
+bool CMainWindow::unmapTab( intptr_t key )
+{
+	const auto it = mappedTabs.find( key );
+	if ( it == mappedTabs.end() )
+		return true;
+
+	// The settings panel edits the header only copy, those edits have to survive the load
+	auto pVTF = vtfWidgetList.value( key );
+	const vlUInt flags = pVTF->GetFlags();
+	const vlUInt startFrame = pVTF->GetStartFrame();
+
+	const QByteArray path = it->second->path.toUtf8();
+	const bool bLoaded = pVTF->Load( path.constData(), false );
+	if ( !bLoaded )
+		pVTF->Load( path.constData(), true );
+
+	pVTF->SetFlags( flags );
+	pVTF->SetStartFrame( startFrame );
+	if ( !bLoaded )
+		return false;
+
+	// The view still points into the mapping, switch it over before the mapping goes
+	if ( pImageTabWidget->tabData( pImageTabWidget->currentIndex() ).value<intptr_t>() == key )
+		pImageViewWidget->set_vtf( pVTF );
+
+	mappedTabs.erase( it );
+
+	updateMemoryInfo();
+	return true;
+}
+
+void CMainWindow::restoreTab( intptr_t key )
+{
+	if ( !evictedTabs.contains( key ) )
+		return;
+
+	auto pVTF = vtfWidgetList.value( key );
+	const QString spillPath = evictedTabs.value( key );
+	if ( !pVTF->Load( spillPath.toUtf8().constData(), false ) )
+	{
+		QMessageBox::warning( this, "Reload Failed", "The image data of this tab could not be loaded back from " + spillPath );
+		return;
+	}
+
+	evictedTabs.remove( key );
+	QFile::remove( spillPath );
+}
+
+void CMainWindow::enforceMemoryBudget()
+{
+	const qint64 budget = Options::get<qint64>( OPT_TAB_MEMORY_BUDGET ) * 1024 * 1024;
+
+	qint64 resident = 0;
+	for ( auto it = vtfWidgetList.cbegin(); it != vtfWidgetList.cend(); ++it )
+		if ( !evictedTabs.contains( it.key() ) && !mappedTabs.count( it.key() ) )
+			resident += it.value()->GetSize();
+
+	// Least recently shown first, the tab on screen always stays
+	const auto current = pImageTabWidget->tabData( pImageTabWidget->currentIndex() ).value<intptr_t>();
+	for ( int i = 0; i < tabUseOrder.size() && resident > budget && spillDir.isValid(); i++ )
+	{
+		const intptr_t key = tabUseOrder[i];
+		if ( key == current || evictedTabs.contains( key ) || mappedTabs.count( key ) )
+			continue;
+
+		// Saved as is, so the edits made in the tab come back with it
+		auto pVTF = vtfWidgetList.value( key );
+		const qint64 size = pVTF->GetSize();
+		const QString spillPath = spillDir.filePath( QString::number( key ) + ".vtf" );
+		if ( !pVTF->Save( spillPath.toUtf8().constData() ) )
+			continue;
+
+		// Only the header stays, enough for the info panel
+		pVTF->Load( spillPath.toUtf8().constData(), true );
+		evictedTabs.insert( key, spillPath );
+		resident -= size;
+	}
+
+	updateMemoryInfo();
+}
+
+void CMainWindow::updateMemoryInfo()
+{
+	qint64 resident = 0;
+	for ( int i = 0; i < pImageTabWidget->count(); i++ )
+	{
+		const auto key = pImageTabWidget->tabData( i ).value<intptr_t>();
+		auto pVTF = vtfWidgetList.value( key );
+		if ( !pVTF )
+			continue;
+
+		if ( evictedTabs.contains( key ) )
+		{
+			pImageTabWidget->setTabToolTip( i, tr( "Evicted, loads again when shown" ) );
+			continue;
+		}
+
+		// The OS pages these in and out on its own, inflated chunks stay under their own budget
+		if ( const auto it = mappedTabs.find( key ); it != mappedTabs.end() )
+		{
+			const MappedVTF &mapped = it->second->vtf;
+			if ( mapped.IsAuxCompressed() )
+				pImageTabWidget->setTabToolTip( i, tr( "Mapped from disk, %1 MiB inflated" ).arg( mapped.InflatedBytes() / ( 1024.0 * 1024.0 ), 0, 'f', 1 ) );
+			else
+				pImageTabWidget->setTabToolTip( i, tr( "Mapped from disk, only what is viewed is read" ) );
+			continue;
+		}
+
+		const qint64 size = pVTF->GetSize();
+		resident += size;
+		pImageTabWidget->setTabToolTip( i, tr( "%1 MiB in memory" ).arg( size / ( 1024.0 * 1024.0 ), 0, 'f', 1 ) );
+	}
+
+	pMemoryLabel->setText( tr( "Tabs: %1 / %2 MiB, %3 of %4 evicted" )
+							   .arg( resident / ( 1024.0 * 1024.0 ), 0, 'f', 1 )
+							   .arg( Options::get<qint64>( OPT_TAB_MEMORY_BUDGET ) )
+							   .arg( evictedTabs.size() )
+							   .arg( vtfWidgetList.size() ) );
+}
+
+void CMainWindow::setTabMemoryBudget()
+{
+	bool ok;
+	const int budget = QInputDialog::getInt( this, tr( "Tab Memory Budget" ), tr( "MiB the open tabs may use before the ones in the background are evicted:" ),
+											 Options::get<int>( OPT_TAB_MEMORY_BUDGET ), 64, 1024 * 1024, 256, &ok );
+	if ( !ok )
+		return;
+
+	Options::set( OPT_TAB_MEMORY_BUDGET, budget );
+	enforceMemoryBudget();
+}
+
 void CMainWindow::setupMenuBar()
 {
 	auto pFileMenuTab = m_pMainMenuBar->addMenu( tr( "File" ) );
@@ -321,6 +519,9 @@ void CMainWindow::setupMenuBar()
 	pFileMenuTab->addAction( tr( "Save" ), this, &CMainWindow::saveVTFToFile );
 	pFileMenuTab->addAction( tr( "Export" ), this, &CMainWindow::exportVTFToFile );
 	pFileMenuTab->addAction( tr( "Import..." ), this, &CMainWindow::importFromFile );
+	pFileMenuTab->addAction( tr( "Import From Clipboard" ), this, &CMainWindow::importFromClipboard );
+	pFileMenuTab->addSeparator();
+	pFileMenuTab->addAction( tr( "Tab Memory Budget..." ), this, &CMainWindow::setTabMemoryBudget );
 	pFileMenuTab->addSeparator();
 	pFileMenuTab->addAction( tr( "Exit" ), this, &CMainWindow::exitVTFE );
 
@@ -365,6 +566,114 @@ QAction *CMainWindow::createCheckableAction( const QString &name, QObject *paren
 	return maskBox;
 }
 
+#ifdef COMPRESSVTF
+struct VersionUpdateJob
+{
+	QString source;
+	QString destination;
+};
+
+struct VersionUpdateSettings
+{
+	int minorVersion = 0;
+	bool applyAuxCompression = false;
+	int auxCompressionLevel = 0;
+	bool recomputeReflectivity = false;
+	// Leave files that already have the requested version alone
+	bool skipUnchanged = true;
+};
+
+// VTFLib's LastError is process wide and reallocated on every failure, two workers failing at once would
+// free the same message. Everything that goes into VTFLib is serialized, only the deflating runs in parallel.
+static QMutex vtfLibMutex;
+
+// Returns an empty string on success, otherwise the reason the file failed.
+static QString UpdateVTFVersion( const VersionUpdateJob &job, const VersionUpdateSettings &settings )
+{
+	std::unique_ptr<VTFLib::CVTFFile> pVTF;
+	{
+		QMutexLocker lock( &vtfLibMutex );
+		pVTF.reset( CMainWindow::getVTFFromVTFFile( job.source.toUtf8().constData() ) );
+	}
+
+	if ( !pVTF || !pVTF->IsLoaded() )
+		return "The VTF is invalid.";
+
+	bool unchanged = pVTF->GetMinorVersion() == settings.minorVersion;
+#ifdef CHAOS_INITIATIVE
+	unchanged = unchanged && pVTF->GetAuxCompressionLevel() == settings.auxCompressionLevel;
+#endif
+	if ( unchanged && settings.skipUnchanged )
+		return {};
+
+	pVTF->SetVersion( 7, settings.minorVersion );
+
+#ifdef CHAOS_INITIATIVE
+	if ( settings.applyAuxCompression )
+		pVTF->SetAuxCompressionLevel( settings.auxCompressionLevel );
+#endif
+
+	if ( settings.recomputeReflectivity )
+		pVTF->ComputeReflectivity();
+
+	TRACE_ZONE( "Save" );
+	if ( !AuxCompression::Save( *pVTF, job.destination.toUtf8().constData(), &vtfLibMutex ) )
+		return "The VTF cannot be saved.";
+
+	return {};
+}
+
+// Several files are re-packed at once, and AuxCompression::Save deflates the chunks of each one on all cores too.
+// Every job owns its CVTFFile, the reasons are our own since LastError only holds whichever failure came last.
+// The UI thread keeps pumping events so the progress bar stays responsive, but no user input, the jobs point at our locals.
+// Returns "path: reason" for every file that failed.
+static QStringList UpdateVTFVersions( QWidget *pParent, const QList<VersionUpdateJob> &jobs, const VersionUpdateSettings &settings )
+{
+	QStringList failed;
+	if ( jobs.isEmpty() )
+		return failed;
+
+	QProgressBar frogressBar( pParent );
+	frogressBar.setMinimum( 0 );
+	frogressBar.setMaximum( jobs.size() );
+	frogressBar.setValue( 0 );
+	frogressBar.setTextVisible( true );
+	frogressBar.setFormat( "Updating VTFs: %v / %m" );
+	frogressBar.setMinimumSize( 512, 64 );
+	frogressBar.move( ( pParent->width() / 2 ) - 256, ( pParent->height() / 2 ) - 32 );
+	frogressBar.show();
+
+	QMutex failedMutex;
+	std::atomic<int> finished = 0;
+
+	QThreadPool pool;
+	for ( const auto &job : jobs )
+	{
+		pool.start( [&job, &settings, &failed, &failedMutex, &finished]
+					{
+						const QString error = UpdateVTFVersion( job, settings );
+						if ( !error.isEmpty() )
+						{
+							QMutexLocker lock( &failedMutex );
+							failed.push_back( job.source + ": " + error );
+						}
+						finished++;
+					} );
+	}
+
+	while ( !pool.waitForDone( 50 ) )
+	{
+		frogressBar.setValue( finished );
+		QApplication::processEvents( QEventLoop::ExcludeUserInputEvents );
+	}
+
+	frogressBar.close();
+
+	failed.sort();
+	return failed;
+}
+#endif
+
 void CMainWindow::compressVTFFile()
 {
 #ifdef COMPRESSVTF
@@ -408,6 +717,11 @@ void CMainWindow::compressVTFFile()
 	pAuxCompressionBox->setDisabled( true );
 	vBLayout->addWidget( pAuxCompressionBox, 1, 0, Qt::AlignLeft );
 
+	auto pDryRunButton = new QPushButton( "Dry Run...", pCompressionDialog );
+	pDryRunButton->setToolTip( "Measure every compression level on the selected files and suggest one." );
+	pDryRunButton->setDisabled( true );
+	vBLayout->addWidget( pDryRunButton, 1, 1, Qt::AlignRight );
+
 	auto label2 = new QLabel( "Aux Compression Level:", pCompressionDialog );
 	label2->setDisabled( true );
 
@@ -455,9 +769,10 @@ void CMainWindow::compressVTFFile()
 	bool compress = false;
 
 #ifdef CHAOS_INITIATIVE
-	connect( pVtfVersionBox, &QComboBox::currentTextChanged, pCompressionDialog, [&pVtfVersionBox, &pAuxCompressionBox]()
+	connect( pVtfVersionBox, &QComboBox::currentTextChanged, pCompressionDialog, [&pVtfVersionBox, &pAuxCompressionBox, &pDryRunButton]()
 			 {
 				 pAuxCompressionBox->setEnabled( pVtfVersionBox->currentData().toInt() >= 6 );
+				 pDryRunButton->setEnabled( pVtfVersionBox->currentData().toInt() >= 6 );
 				 pAuxCompressionBox->toggled( pVtfVersionBox->currentData().toInt() >= 6 && pAuxCompressionBox->isChecked() );
 			 } );
 
@@ -466,6 +781,15 @@ void CMainWindow::compressVTFFile()
 				 pAuxCompressionLevelBox->setEnabled( checked );
 				 label2->setEnabled( checked );
 			 } );
+
+	connect( pDryRunButton, &QPushButton::pressed, pCompressionDialog, [&pCompressionDialog, &pAuxCompressionBox, &pAuxCompressionLevelBox, &filePaths]
+			 {
+				 AuxCompressionTunerDialog tuner( filePaths, pCompressionDialog );
+				 if ( tuner.exec() != QDialog::Accepted || tuner.GetSelectedLevel() < 0 )
+					 return;
+				 pAuxCompressionBox->setChecked( true );
+				 pAuxCompressionLevelBox->setCurrentIndex( pAuxCompressionLevelBox->findData( tuner.GetSelectedLevel() ) );
+			 } );
 #endif
 
 	connect( pCustomDestination, &QCheckBox::toggled, pCompressionDialog, [&pDestinationLocation, &pSelectDestinationLocation]( bool checked )
@@ -512,45 +836,27 @@ void CMainWindow::compressVTFFile()
 		}
 	}
 
-	foreach( QString filePath, filePaths )
-	{
-		VTFLib::CVTFFile *pVTF = getVTFFromVTFFile( filePath.toUtf8().constData() );
-
-		if ( !pVTF )
-		{
-			QMessageBox::warning( this, "INVALID VTF", "The VTF is invalid.", QMessageBox::Ok );
-			return;
-		}
-
+	VersionUpdateSettings settings;
+	settings.minorVersion = pVtfVersionBox->currentData().toInt();
 #ifdef CHAOS_INITIATIVE
-		if ( pVTF->GetMinorVersion() == pVtfVersionBox->currentData().toInt() && pVTF->GetAuxCompressionLevel() == pAuxCompressionLevelBox->currentData().toInt() )
-			continue;
-#else
-		if ( pVTF->GetMinorVersion() == pVtfVersionBox->currentData().toInt() )
-			continue;
+	settings.applyAuxCompression = pAuxCompressionBox->isChecked();
+	settings.auxCompressionLevel = pAuxCompressionLevelBox->currentData().toInt();
 #endif
+	settings.recomputeReflectivity = pRecomputeReflectivity->isChecked();
+	settings.skipUnchanged = true;
 
-		pVTF->SetVersion( 7, pVtfVersionBox->currentData().toInt() );
-
-#ifdef CHAOS_INITIATIVE
-		if ( pAuxCompressionBox->isChecked() )
-		{
-			pVTF->SetAuxCompressionLevel( pAuxCompressionLevelBox->currentData().toInt() );
-		}
-#endif
-
-		if ( pRecomputeReflectivity->isChecked() )
-		{
-			pVTF->ComputeReflectivity();
-		}
-
+	QList<VersionUpdateJob> jobs;
+	foreach( QString filePath, filePaths )
+	{
 		if ( pathDirectory.isEmpty() )
-			pVTF->Save( filePath.toUtf8().constData() );
+			jobs.push_back( { filePath, filePath } );
 		else
-			pVTF->Save( ( pathDirectory + "/" + QFileInfo( filePath ).fileName() ).toUtf8().constData() );
-
-		delete pVTF;
+			jobs.push_back( { filePath, pathDirectory + "/" + QFileInfo( filePath ).fileName() } );
 	}
+
+	const QStringList failed = UpdateVTFVersions( this, jobs, settings );
+	if ( !failed.isEmpty() )
+		QMessageBox::warning( this, "Unable to update VTF", "The following VTFs could not be updated:\n" + failed.join( "\n" ), QMessageBox::Ok );
 #endif
 }
 
@@ -597,6 +903,11 @@ void CMainWindow::compressVTFFolder()
 	pAuxCompressionBox->setDisabled( true );
 	vBLayout->addWidget( pAuxCompressionBox, 1, 0, Qt::AlignLeft );
 
+	auto pDryRunButton = new QPushButton( "Dry Run...", pCompressionDialog );
+	pDryRunButton->setToolTip( "Measure every compression level on the selected files and suggest one." );
+	pDryRunButton->setDisabled( true );
+	vBLayout->addWidget( pDryRunButton, 1, 1, Qt::AlignRight );
+
 	auto label2 = new QLabel( "Aux Compression Level:", pCompressionDialog );
 	label2->setDisabled( true );
 
@@ -644,9 +955,10 @@ void CMainWindow::compressVTFFolder()
 	bool compress = false;
 
 #ifdef CHAOS_INITIATIVE
-	connect( pVtfVersionBox, &QComboBox::currentTextChanged, pCompressionDialog, [pVtfVersionBox, pAuxCompressionBox, pAuxCompressionLevelBox, label2]()
+	connect( pVtfVersionBox, &QComboBox::currentTextChanged, pCompressionDialog, [pVtfVersionBox, pAuxCompressionBox, pAuxCompressionLevelBox, label2, pDryRunButton]()
 			 {
 				 pAuxCompressionBox->setEnabled( pVtfVersionBox->currentData().toInt() >= 6 );
+				 pDryRunButton->setEnabled( pVtfVersionBox->currentData().toInt() >= 6 );
 				 pAuxCompressionBox->toggled( pVtfVersionBox->currentData().toInt() >= 6 && pAuxCompressionBox->isChecked() );
 			 } );
 
@@ -655,6 +967,20 @@ void CMainWindow::compressVTFFolder()
 				 pAuxCompressionLevelBox->setEnabled( checked );
 				 label2->setEnabled( checked );
 			 } );
+
+	connect( pDryRunButton, &QPushButton::pressed, pCompressionDialog, [pCompressionDialog, pAuxCompressionBox, pAuxCompressionLevelBox, dirPath]
+			 {
+				 QStringList vtfPaths;
+				 QDirIterator it( dirPath, QStringList() << "*.vtf", QDir::Files, QDirIterator::Subdirectories );
+				 while ( it.hasNext() )
+					 vtfPaths.push_back( it.next() );
+
+				 AuxCompressionTunerDialog tuner( vtfPaths, pCompressionDialog );
+				 if ( tuner.exec() != QDialog::Accepted || tuner.GetSelectedLevel() < 0 )
+					 return;
+				 pAuxCompressionBox->setChecked( true );
+				 pAuxCompressionLevelBox->setCurrentIndex( pAuxCompressionLevelBox->findData( tuner.GetSelectedLevel() ) );
+			 } );
 #endif
 
 	connect( pCustomDestination, &QCheckBox::toggled, pCompressionDialog, [pDestinationLocation, pSelectDestinationLocation]( bool checked )
@@ -701,9 +1027,17 @@ void CMainWindow::compressVTFFolder()
 		}
 	}
 
-	//	QString pathless;
+	VersionUpdateSettings settings;
+	settings.minorVersion = pVtfVersionBox->currentData().toInt();
+#ifdef CHAOS_INITIATIVE
+	settings.applyAuxCompression = pAuxCompressionBox->isChecked();
+	settings.auxCompressionLevel = pAuxCompressionLevelBox->currentData().toInt();
+#endif
+	settings.recomputeReflectivity = pRecomputeReflectivity->isChecked();
+	settings.skipUnchanged = pathDirectory.isEmpty();
 
-	QStringList VTFPaths;
+	// Directories are created up front, the workers only ever write files.
+	QList<VersionUpdateJob> jobs;
 	QDirIterator it( dirPath, QStringList() << "*.vtf", QDir::Files, QDirIterator::Subdirectories );
 	while ( it.hasNext() )
 	{
@@ -718,60 +1052,26 @@ void CMainWindow::compressVTFFolder()
 			temp2.pop_back();
 		}
 
-		if ( !pathDirectory.isEmpty() )
-		{
-			QString dirCreator = pathDirectory;
-			for ( const auto &tPath : temp2 )
-			{
-				dirCreator += "/" + tPath;
-				if ( !QDir().exists( dirCreator ) )
-					QDir().mkdir( dirCreator );
-			}
-		}
-
-		std::unique_ptr<VTFLib::CVTFFile> pVTF( getVTFFromVTFFile( path.toStdString().c_str() ) );
-
-		if ( !pVTF || !pVTF->IsLoaded() )
+		if ( pathDirectory.isEmpty() )
 		{
-			QMessageBox::warning( this, "INVALID VTF", "The VTF is invalid.\n" + dirPath, QMessageBox::Ok );
-			continue;
-		}
-#ifdef CHAOS_INITIATIVE
-		if ( pVTF->GetMinorVersion() == pVtfVersionBox->currentData().toInt() && pVTF->GetAuxCompressionLevel() == pAuxCompressionLevelBox->currentData().toInt() && pathDirectory.isEmpty() )
-			continue;
-#else
-		if ( pVTF->GetMinorVersion() == pVtfVersionBox->currentData().toInt() && pathDirectory.isEmpty() )
+			jobs.push_back( { path, path } );
 			continue;
-#endif
-		pVTF->SetVersion( 7, pVtfVersionBox->currentData().toInt() );
-
-#ifdef CHAOS_INITIATIVE
-		if ( pAuxCompressionBox->isChecked() )
-		{
-			pVTF->SetAuxCompressionLevel( pAuxCompressionLevelBox->currentData().toInt() );
 		}
-#endif
 
-		if ( pRecomputeReflectivity->isChecked() )
+		QString dirCreator = pathDirectory;
+		for ( const auto &tPath : temp2 )
 		{
-			pVTF->ComputeReflectivity();
+			dirCreator += "/" + tPath;
+			if ( !QDir().exists( dirCreator ) )
+				QDir().mkdir( dirCreator );
 		}
 
-		if ( pathDirectory.isEmpty() )
-		{
-			if ( !pVTF->Save( path.toUtf8().constData() ) )
-			{
-				QMessageBox::warning( this, "Unable to save VTF", "The VTF cannot be saved.\n" + dirPath, QMessageBox::Ok );
-			}
-		}
-		else
-		{
-			if ( !pVTF->Save( ( pathDirectory + "/" + temp.join( "" ) ).toUtf8().constData() ) )
-			{
-				QMessageBox::warning( this, "Unable to save VTF", "The VTF cannot be saved.\n" + dirPath, QMessageBox::Ok );
-			}
-		}
+		jobs.push_back( { path, pathDirectory + "/" + temp.join( "" ) } );
 	}
+
+	const QStringList failed = UpdateVTFVersions( this, jobs, settings );
+	if ( !failed.isEmpty() )
+		QMessageBox::warning( this, "Unable to update VTF", "The following VTFs could not be updated:\n" + failed.join( "\n" ), QMessageBox::Ok );
 #endif
 }
 
@@ -882,23 +1182,14 @@ void CMainWindow::foldersToVTF()
 			QString vtfFileName = ( fullpath + "/" + QFileInfo( second.paths[0] ).baseName() + ".vtf" );
 			frogressBar.setFormat( "Creating Animated VTF: " + vtfFileName );
 			frogressBar.setValue( 0 );
-			for ( const auto &file : second.paths )
-			{
-				pVTFImportWindow->AddImage( file );
-			}
-
 			VTFErrorType err;
-			auto vtf = pVTFImportWindow->GenerateVTF( err );
-			if ( err != SUCCESS )
+			if ( !pVTFImportWindow->ConvertToVTF( second.paths, vtfFileName, err ) )
 			{
-				QMessageBox::warning( this, "VTF Failed to generate.", QString( "The VTF failed to generate, reason: " ) + ( ( err == INVALID_IMAGE ) ? "Invalid Image" : "No Image Data" ) );
-				frogressBar.setValue( 1 );
-				frogressBar.close();
-				continue;
+				if ( err != SUCCESS )
+					QMessageBox::warning( this, "VTF Failed to generate.", QString( "The VTF failed to generate, reason: " ) + ( ( err == INVALID_IMAGE ) ? "Invalid Image" : "No Image Data" ) );
+				else
+					QMessageBox::warning( this, "VTF Failed to save.", QString( "The VTF failed to save, file: " ) + vtfFileName );
 			}
-			bool saved = vtf->Save( vtfFileName.toStdString().c_str() );
-			if ( !saved )
-				QMessageBox::warning( this, "VTF Failed to save.", QString( "The VTF failed to save, file: " ) + vtfFileName );
 
 			frogressBar.setValue( 1 );
 			frogressBar.close();
@@ -912,18 +1203,14 @@ void CMainWindow::foldersToVTF()
 			QString vtfFileName = ( fullpath + "/" + QFileInfo( file ).baseName() + ".vtf" );
 			frogressBar.setFormat( "Creating VTF: " + vtfFileName );
 			frogressBar.setValue( frogressBar.value() + 1 );
-			pVTFImportWindow->AddImage( file );
 			VTFErrorType err;
-			auto vtf = pVTFImportWindow->GenerateVTF( err );
+			if ( pVTFImportWindow->ConvertToVTF( { file }, vtfFileName, err ) )
+				continue;
+
 			if ( err != SUCCESS )
-			{
 				QMessageBox::warning( this, "VTF Failed to generate.", QString( "The VTF failed to generate, reason: " ) + ( ( err == INVALID_IMAGE ) ? "Invalid Image" : "No Image Data" ) );
-				continue;
-			}
-			bool saved = vtf->Save( vtfFileName.toStdString().c_str() );
-			if ( !saved )
-				QMessageBox::warning( this, "VTF Failed to save.", QString( "The VTF failed to save, file: " ) + vtfFileName.toStdString().c_str() );
-			pVTFImportWindow->clearImageList();
+			else
+				QMessageBox::warning( this, "VTF Failed to save.", QString( "The VTF failed to save, file: " ) + vtfFileName );
 		}
 		frogressBar.close();
 	}
@@ -1020,23 +1307,15 @@ void CMainWindow::generateVTFFromImage( const QString &filePath )
 
 	bool canRun;
 	auto newWindow = new VTFEImport( this, filePath, canRun );
+	runImportDialog( newWindow, canRun, QFileInfo( filePath ).fileName() );
+}
 
-	if ( !canRun )
-		return;
-
-	newWindow->exec();
-	if ( newWindow->IsCancelled() )
-		return;
-
-	VTFErrorType err;
-	auto pVTF = newWindow->GenerateVTF( err );
-	if ( err != SUCCESS )
-	{
-		QMessageBox::critical( this, "INVALID IMAGE", "The Image is invalid.", QMessageBox::Ok );
-		return;
-	}
-
-	addVTFToTab( pVTF, QFileInfo( filePath ).fileName() );
+bool CMainWindow::generateVTFFromImage( const vlByte *pData, std::size_t size, const QString &name )
+{
+	bool canRun;
+	auto newWindow = new VTFEImport( this, pData, size, canRun );
+	runImportDialog( newWindow, canRun, name );
+	return canRun;
 }
 
 void CMainWindow::generateVTFFromImages( QStringList filePaths )
@@ -1045,25 +1324,57 @@ void CMainWindow::generateVTFFromImages( QStringList filePaths )
 		return;
 	bool canRun;
 	auto newWindow = new VTFEImport( this, filePaths, canRun );
+	runImportDialog( newWindow, canRun, QFileInfo( filePaths[0] ).fileName() );
+}
 
+void CMainWindow::runImportDialog( VTFEImport *pImport, bool canRun, const QString &name )
+{
 	if ( !canRun )
 		return;
 
-	newWindow->exec();
+	pImport->exec();
 
-	if ( newWindow->IsCancelled() )
+	if ( pImport->IsCancelled() )
 		return;
 
 	VTFErrorType err;
-	auto pVTF = newWindow->GenerateVTF( err );
+	auto pVTF = pImport->GenerateVTF( err );
 	if ( err != SUCCESS )
 	{
 		QMessageBox::critical( this, "INVALID IMAGE", "The Image is invalid.", QMessageBox::Ok );
 		return;
 	}
 
-	QFileInfo fl( filePaths[0] );
-	addVTFToTab( pVTF, fl.fileName() );
+	addVTFToTab( pVTF, name );
+}
+
+void CMainWindow::importFromClipboard()
+{
+	const QMimeData *pMimeData = QApplication::clipboard()->mimeData();
+	if ( !pMimeData )
+		return;
+
+	// Encoded data first, that keeps HDR and 16 bit images as they are
+	for ( const auto &format : pMimeData->formats() )
+	{
+		if ( !format.startsWith( "image/" ) )
+			continue;
+
+		const QByteArray data = pMimeData->data( format );
+		if ( generateVTFFromImage( reinterpret_cast<const vlByte *>( data.constData() ), data.size(), tr( "Clipboard" ) ) )
+			return;
+	}
+
+	// Some platforms only hand out a QImage, put it through PNG in memory so it takes the same path
+	if ( pMimeData->hasImage() )
+	{
+		const QImage image = qvariant_cast<QImage>( pMimeData->imageData() );
+		QByteArray data;
+		QBuffer buffer( &data );
+		buffer.open( QIODevice::WriteOnly );
+		if ( image.save( &buffer, "PNG" ) )
+			generateVTFFromImage( reinterpret_cast<const vlByte *>( data.constData() ), data.size(), tr( "Clipboard" ) );
+	}
 }
 
 void CMainWindow::fontToVTF()
@@ -1086,54 +1397,28 @@ void CMainWindow::fontToVTF()
 
 void CMainWindow::generateVTFFromFont( const QString &filepath )
 {
-	int id = QFontDatabase::addApplicationFont( filepath );
-	QString family = QFontDatabase::applicationFontFamilies( id ).at( 0 );
-	QString charList = R"( !"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\]^_`abcdefghijklmnopqrstuvwxyz{|})";
-
-	QTextOption opts;
-
-	QBuffer buff;
-	QImage image( QSize( 1024, 1024 ), QImage::Format_RGBA8888 );
-
-	QPainter painter;
-	painter.begin( &image );
-	// This fixes a weird issue where background will become garbage data
-	// if not cleared first.
-	painter.setCompositionMode( QPainter::CompositionMode_Source );
-	painter.fillRect( QRect( 0, 0, 1024, 1024 ), QColor( 0, 0, 0, 0 ) );
-	painter.setCompositionMode( QPainter::CompositionMode_SourceOver );
-
-	painter.setBrush( Qt::transparent );
-	painter.setPen( QPen( Qt::white ) );
-	auto font = QFont( family );
-	auto offset = 32;
-	font.setPointSize( offset );
-	painter.setFont( font );
-
-	//	painter.drawRect( 0, 0, 1024, 1024 );
-	for ( int i = 0, j = 0, k = 0; k < charList.length(); i++, k++ )
-	{
-		if ( i > 15 )
-		{
-			j++;
-			i = 0;
-		}
-		painter.drawText( ( i * 64 ) + offset / 2, ( j * 64 ) + offset * 1.5, charList[k] );
-	}
-	painter.end();
-
-	QByteArray im;
-	QBuffer bufferrgb( &im );
-	bufferrgb.open( QIODevice::WriteOnly );
+	FontAtlasDialog atlasDialog( filepath, this );
+	FontAtlasOptions atlasOptions;
+	if ( atlasDialog.exec() != QDialog::Accepted || !atlasDialog.GetOptions( atlasOptions ) )
+		return;
 
-	image.save( &bufferrgb, "PNG" );
+	QApplication::setOverrideCursor( Qt::WaitCursor );
+	FontAtlasImage atlas;
+	QString error;
+	const bool bBuilt = FontAtlas::Build( filepath, atlasOptions, atlas, error );
+	QApplication::restoreOverrideCursor();
 
-	int x, y, n;
+	if ( !bBuilt )
+	{
+		QMessageBox::critical( this, "Font Atlas", error, QMessageBox::Ok );
+		return;
+	}
 
-	stbi_uc *data = stbi_load_from_memory( reinterpret_cast<const stbi_uc *>( bufferrgb.data().constData() ), bufferrgb.size(), &x, &y, &n, 4 );
-	QFontDatabase::removeApplicationFont( id );
+	// The atlas is still usable without the metrics
+	if ( !atlasOptions.metricsPath.isEmpty() && !FontAtlas::WriteMetrics( atlasOptions.metricsPath, atlas, atlasOptions, error ) )
+		QMessageBox::warning( this, "Font Atlas", error, QMessageBox::Ok );
 
-	auto newWindow = VTFEImport::FromFont( this, data, 1024, 1024 );
+	auto newWindow = VTFEImport::FromFont( this, atlas.rgba.data(), atlas.width, atlas.height, atlasOptions.format );
 
 	newWindow->exec();
 
@@ -1157,6 +1442,8 @@ void CMainWindow::exportVTFToFile()
 	const auto key = pImageTabWidget->tabData( pImageTabWidget->currentIndex() ).value<intptr_t>();
 
 	auto pVTF = this->vtfWidgetList.value( key );
+	// Mapped tabs are exported straight from the mapping
+	const MappedVTF *pMapped = mappedVTF( key );
 
 	if ( !pVTF )
 		return;
@@ -1178,7 +1465,7 @@ void CMainWindow::exportVTFToFile()
 
 	QString filePath = QFileDialog::getSaveFileName(
 		this, fImageAmount > 1 ? "Export to *" : "Export to _x*",
-		recentPaths.last(), supportedWildcardImageList.join( " " ), nullptr,
+		recentPaths.last(), ImageWriters::Wildcards().join( " " ), nullptr,
 		QFileDialog::Option::DontUseNativeDialog );
 
 	if ( filePath.isEmpty() )
@@ -1189,33 +1476,59 @@ void CMainWindow::exportVTFToFile()
 	recentPaths.push_back( filePath );
 	Options::set( STR_OPEN_RECENT, recentPaths );
 
+	QProgressBar frogressBar( this );
+	frogressBar.setMinimum( 0 );
+	frogressBar.setMaximum( fImageAmount );
+	frogressBar.setValue( 0 );
+	frogressBar.setTextVisible( true );
+	frogressBar.setFormat( "Exporting: %v / %m" );
+	frogressBar.setMinimumSize( 512, 64 );
+	frogressBar.move( ( width() / 2 ) - 256, ( height() / 2 ) - 32 );
+	if ( fImageAmount > 1 )
+		frogressBar.show();
+
+	// Every surface is written on its own, the workers only read from the VTF
+	QStringList failed;
+	QMutex failedMutex;
+	std::atomic<int> finished = 0;
+
+	// name_0.ext, name_1.ext, ... the suffix can be any length, .tiff and .jpeg included
+	const QFileInfo exportInfo( filePath );
+	const QString exportSuffix = exportInfo.suffix().isEmpty() ? QString() : "." + exportInfo.suffix();
+
+	QThreadPool pool;
 	for ( int i = 0; i < fImageAmount; i++ )
 	{
-		vlUInt frames = type == 0 ? i : 0;
-		vlUInt faces = type == 1 ? i : 0;
-		vlUInt slices = type == 2 ? i : 0;
-
-		auto size =
-			VTFLib::CVTFFile::ComputeImageSize( pVTF->GetWidth(), pVTF->GetHeight(), 1, IMAGE_FORMAT_RGBA8888 );
-		auto pDest = static_cast<vlByte *>( malloc( size ) );
-		VTFLib::CVTFFile::ConvertToRGBA8888(
-			pVTF->GetData( frames, faces, slices, 0 ), pDest, pVTF->GetWidth(), pVTF->GetHeight(),
-			pVTF->GetFormat() );
-		auto img = QImage( pDest, pVTF->GetWidth(), pVTF->GetHeight(), QImage::Format_RGBA8888 );
+		QString outputPath = filePath;
 		if ( fImageAmount > 1 )
-		{
-			QString nummedPath =
-				filePath.mid( 0, filePath.length() - 4 ) + "_" + QString::number( i ) +
-				filePath.mid( filePath.length() - 4, filePath.length() );
+			outputPath = exportInfo.dir().filePath( exportInfo.completeBaseName() + "_" + QString::number( i ) + exportSuffix );
+
+		// Fetched on the worker, aux compressed mapped tabs inflate the surface right there
+		pool.start( [pVTF, pMapped, frame = type == 0 ? i : 0, face = type == 1 ? i : 0, slice = type == 2 ? i : 0, outputPath, &failed, &failedMutex, &finished]
+					{
+						const MappedVTF::Surface surface = pMapped ? pMapped->GetData( frame, face, slice, 0 ) : MappedVTF::Surface( pVTF->GetData( frame, face, slice, 0 ) );
+						if ( !ImageWriters::Write( outputPath, surface.Data(), pVTF->GetWidth(), pVTF->GetHeight(), pVTF->GetFormat() ) )
+						{
+							QMutexLocker lock( &failedMutex );
+							failed.push_back( outputPath );
+						}
+						finished++;
+					} );
+	}
 
-			if ( !img.save( nummedPath ) )
-				QMessageBox::warning( this, "Failed to save image", "Failed to save: " + nummedPath, QMessageBox::Ok );
-			;
-		}
-		else if ( !img.save( filePath ) )
-			QMessageBox::warning( this, "Failed to save image", "Failed to save: " + filePath, QMessageBox::Ok );
+	// No user input while the workers read from the VTF, closing its tab would pull it out from under them
+	while ( !pool.waitForDone( 50 ) )
+	{
+		frogressBar.setValue( finished );
+		QApplication::processEvents( QEventLoop::ExcludeUserInputEvents );
+	}
 
-		free( pDest );
+	frogressBar.close();
+
+	if ( !failed.isEmpty() )
+	{
+		failed.sort();
+		QMessageBox::warning( this, "Failed to save image", "Failed to save: " + failed.join( "\n" ), QMessageBox::Ok );
 	}
 }
 
@@ -1246,7 +1559,15 @@ void CMainWindow::saveVTFToFile()
 	if ( !filePath.endsWith( ".vtf" ) )
 		filePath.append( ".vtf" );
 
-	pVTF->Save( filePath.toUtf8().constData() );
+	// VTFLib can only save what it holds, so a mapped tab gets its private copy now
+	if ( !unmapTab( key ) )
+	{
+		QMessageBox::warning( this, "VTF Failed to save.", "The image data could not be loaded from the original file." );
+		return;
+	}
+
+	TRACE_ZONE( "Save" );
+	AuxCompression::Save( *pVTF, filePath.toUtf8().constData(), &vtfLibMutex );
 }
 
 void CMainWindow::exitVTFE()
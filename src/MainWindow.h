@@ -2,6 +2,7 @@
 
 #include "ImageSettingsWidget.h"
 #include "InfoWidget.h"
+#include "MappedVTF.h"
 #include "ResourceWidget.h"
 
 #include <QDialog>
@@ -9,9 +10,14 @@
 #include <QMainWindow>
 #include <QMenuBar>
 #include <QScrollArea>
+#include <QTemporaryDir>
 #include <QWheelEvent>
+#include <memory>
+#include <unordered_map>
 
 class EntryTree;
+class QLabel;
+class VTFEImport;
 
 namespace ui
 {
@@ -22,15 +28,47 @@ namespace ui
 	{
 		Q_OBJECT
 
-		const QStringList supportedWildcardImageList = { "*.bmp", "*.gif", "*.tga", "*.png", "*.jpg", "*.jpeg", "*.tif", "*.tiff" };
-		const QStringList supportedImageList = { "bmp", "gif", "tga", "png", "jpg", "jpeg", "tif", "tiff" };
+		const QStringList supportedWildcardImageList = { "*.bmp", "*.gif", "*.tga", "*.png", "*.jpg", "*.jpeg", "*.tif", "*.tiff", "*.dds",
+#ifdef EXR_SUPPORT
+														 "*.exr",
+#endif
+		};
+		const QStringList supportedImageList = { "bmp", "gif", "tga", "png", "jpg", "jpeg", "tif", "tiff", "dds",
+#ifdef EXR_SUPPORT
+												 "exr",
+#endif
+		};
 
 		QHash<intptr_t, VTFLib::CVTFFile *> vtfWidgetList;
 
+		// Once the open tabs go over OPT_TAB_MEMORY_BUDGET, the least recently shown ones are saved to spillDir
+		// and loaded back header only. Showing the tab again loads the whole file back in, edits and all.
+		QTemporaryDir spillDir;
+		QHash<intptr_t, QString> evictedTabs;
+		QList<intptr_t> tabUseOrder; // Most recently shown last
+		QLabel *pMemoryLabel;
+		void restoreTab( intptr_t key );
+		void enforceMemoryBudget();
+		void updateMemoryInfo();
+		void setTabMemoryBudget();
+
+		// Big and aux compressed VTFs are loaded header only and their image data is read from a mapping of the file.
+		// unmapTab loads the whole file once something needs a private copy to change or save.
+		struct MappedTab
+		{
+			QString path;
+			MappedVTF vtf;
+		};
+		std::unordered_map<intptr_t, std::unique_ptr<MappedTab>> mappedTabs;
+		const MappedVTF *mappedVTF( intptr_t key ) const;
+		bool unmapTab( intptr_t key );
+
 	public:
 		CMainWindow();
 		~CMainWindow()
 		{
+			// Stops the view reading from a mapping that's about to go
+			pImageViewWidget->set_vtf( nullptr );
 			foreach( auto vtf, vtfWidgetList )
 				delete vtf;
 		}
@@ -51,8 +89,12 @@ namespace ui
 		void setupMenuBar();
 		void openVTF();
 		void importFromFile();
+		void importFromClipboard();
 		void generateVTFFromImage( const QString &filePath );
+		// False when nothing could decode the data
+		bool generateVTFFromImage( const vlByte *pData, std::size_t size, const QString &name );
 		void generateVTFFromImages( QStringList filePaths );
+		void runImportDialog( VTFEImport *pImport, bool canRun, const QString &name );
 		void addVTFToTab( VTFLib::CVTFFile *pVTF, const QString &name );
 		void NewVTFFromVTF( const QString &filePath );
 		void tabChanged( int index );
@@ -0,0 +1,114 @@
+#include "MappedFile.h"
+
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open( std::string_view fileName )
+{
+	Close();
+
+	// Windows wants the path as UTF-16
+	const int length = MultiByteToWideChar( CP_UTF8, 0, fileName.data(), static_cast<int>( fileName.size() ), nullptr, 0 );
+	std::wstring wideName( length, L'\0' );
+	MultiByteToWideChar( CP_UTF8, 0, fileName.data(), static_cast<int>( fileName.size() ), wideName.data(), length );
+
+	HANDLE hFile = CreateFileW( wideName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx( hFile, &size ) || size.QuadPart == 0 )
+	{
+		CloseHandle( hFile );
+		return false;
+	}
+
+	HANDLE hMapping = CreateFileMappingW( hFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if ( !hMapping )
+	{
+		CloseHandle( hFile );
+		return false;
+	}
+
+	void *pView = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+	if ( !pView )
+	{
+		CloseHandle( hMapping );
+		CloseHandle( hFile );
+		return false;
+	}
+
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_pData = static_cast<const uint8_t *>( pView );
+	m_nSize = static_cast<std::size_t>( size.QuadPart );
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if ( m_pData )
+		UnmapViewOfFile( m_pData );
+	if ( m_hMapping )
+		CloseHandle( m_hMapping );
+	if ( m_hFile )
+		CloseHandle( m_hFile );
+
+	m_pData = nullptr;
+	m_nSize = 0;
+	m_hMapping = nullptr;
+	m_hFile = nullptr;
+}
+#else
+bool MappedFile::Open( std::string_view fileName )
+{
+	Close();
+
+	const int fd = open( std::string( fileName ).c_str(), O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	struct stat info;
+	if ( fstat( fd, &info ) != 0 || info.st_size <= 0 )
+	{
+		close( fd );
+		return false;
+	}
+
+	void *pView = mmap( nullptr, static_cast<std::size_t>( info.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+	// The mapping keeps the file alive, we don't need the descriptor anymore
+	close( fd );
+
+	if ( pView == MAP_FAILED )
+		return false;
+
+	m_pData = static_cast<const uint8_t *>( pView );
+	m_nSize = static_cast<std::size_t>( info.st_size );
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if ( m_pData )
+		munmap( const_cast<uint8_t *>( m_pData ), m_nSize );
+
+	m_pData = nullptr;
+	m_nSize = 0;
+}
+#endif
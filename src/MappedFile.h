@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Read only view of a whole file through the OS page cache.
+// Nothing is copied up front, pages are only read in once they are touched,
+// so huge files can be parsed without first pulling them into our own buffers.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile( const MappedFile & ) = delete;
+	MappedFile &operator=( const MappedFile & ) = delete;
+
+	// fileName is UTF-8
+	bool Open( std::string_view fileName );
+	void Close();
+
+	bool IsOpen() const
+	{
+		return m_pData != nullptr;
+	}
+
+	const uint8_t *Data() const
+	{
+		return m_pData;
+	}
+
+	std::size_t Size() const
+	{
+		return m_nSize;
+	}
+
+private:
+	const uint8_t *m_pData = nullptr;
+	std::size_t m_nSize = 0;
+
+#ifdef _WIN32
+	void *m_hFile = nullptr;
+	void *m_hMapping = nullptr;
+#endif
+};
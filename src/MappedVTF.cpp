@@ -0,0 +1,232 @@
+#include "MappedVTF.h"
+
+#include "../libs/stb/stb_image.h"
+#include "Trace.h"
+#include "VTFLayout.h"
+
+#include <cstring>
+
+struct ImageLayout
+{
+	std::size_t imageOffset = 0; // 0 when it can't be found
+	const uint8_t *pAuxInfo = nullptr;
+	std::size_t auxInfoSize = 0;
+};
+
+// Where the high res image data starts, and the aux compression info when there is any
+static ImageLayout FindImageData( const uint8_t *pData, std::size_t size, const VTFLib::CVTFFile &header )
+{
+	ImageLayout layout;
+	if ( size < RESOURCES_OFFSET )
+		return layout;
+
+	// Before 7.3 the thumbnail comes right after the header, then the image
+	if ( header.GetMinorVersion() < 3 )
+	{
+		VTFImageFormat lowResFormat;
+		std::memcpy( &lowResFormat, pData + LOW_RES_FORMAT_OFFSET, sizeof( lowResFormat ) );
+
+		layout.imageOffset = ReadU32( pData + HEADER_SIZE_OFFSET );
+		if ( lowResFormat != IMAGE_FORMAT_NONE )
+			layout.imageOffset += VTFLib::CVTFFile::ComputeImageSize( pData[LOW_RES_WIDTH_OFFSET], pData[LOW_RES_HEIGHT_OFFSET], 1, lowResFormat );
+		return layout;
+	}
+
+	const uint32_t resourceCount = ReadU32( pData + RESOURCE_COUNT_OFFSET );
+	if ( RESOURCES_OFFSET + static_cast<std::size_t>( resourceCount ) * 8 > size )
+		return layout;
+
+	for ( uint32_t i = 0; i < resourceCount; i++ )
+	{
+		const uint8_t *pResource = pData + RESOURCES_OFFSET + i * 8;
+		const uint32_t type = ReadU32( pResource ) & RESOURCE_ID_MASK;
+
+		if ( type == RESOURCE_IMAGE )
+			layout.imageOffset = ReadU32( pResource + 4 );
+
+		// Resources with data point at a size followed by the data
+		if ( type == RESOURCE_AUX_COMPRESSION )
+		{
+			const std::size_t infoOffset = ReadU32( pResource + 4 );
+			if ( infoOffset + 4 > size || infoOffset + 4 + ReadU32( pData + infoOffset ) > size )
+				return {};
+			layout.pAuxInfo = pData + infoOffset + 4;
+			layout.auxInfoSize = ReadU32( pData + infoOffset );
+		}
+	}
+	return layout;
+}
+
+bool MappedVTF::Open( std::string_view fileName, const VTFLib::CVTFFile &header )
+{
+	Close();
+
+	if ( !m_File.Open( fileName ) )
+		return false;
+
+	const ImageLayout layout = FindImageData( m_File.Data(), m_File.Size(), header );
+	if ( layout.imageOffset == 0 )
+	{
+		Close();
+		return false;
+	}
+
+	m_uiWidth = header.GetWidth();
+	m_uiHeight = header.GetHeight();
+	m_uiDepth = header.GetDepth();
+	m_uiFrames = header.GetFrameCount();
+	m_uiFaces = header.GetFaceCount();
+	m_Format = header.GetFormat();
+
+	const vlUInt mipCount = header.GetMipmapCount();
+	if ( layout.pAuxInfo && !OpenAuxCompressed( layout.imageOffset, layout.pAuxInfo, layout.auxInfoSize, mipCount ) )
+	{
+		Close();
+		return false;
+	}
+	if ( IsAuxCompressed() )
+		return true;
+
+	// Every mip holds all frames, faces and slices, from the smallest mip up
+	m_MipOffsets.assign( mipCount, 0 );
+	std::size_t offset = layout.imageOffset;
+	for ( vlUInt mip = mipCount; mip-- > 0; )
+	{
+		m_MipOffsets[mip] = offset;
+		offset += static_cast<std::size_t>( VTFLib::CVTFFile::ComputeMipmapSize( m_uiWidth, m_uiHeight, m_uiDepth, mip, m_Format ) ) * m_uiFrames * m_uiFaces;
+	}
+
+	// A truncated file would hand out pointers past the end
+	if ( offset > m_File.Size() )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+// Level 0 means the image is stored as is and the regular offsets apply, m_AuxChunks stays empty then
+bool MappedVTF::OpenAuxCompressed( std::size_t imageOffset, const uint8_t *pAuxInfo, std::size_t auxInfoSize, vlUInt mipCount )
+{
+	if ( auxInfoSize < AUX_INFO_HEADER_SIZE )
+		return false;
+
+	const uint32_t info = ReadU32( pAuxInfo );
+	const auto level = static_cast<int16_t>( info & 0xFFFF );
+	const auto method = static_cast<uint16_t>( info >> 16 );
+	if ( level == 0 )
+		return true;
+	if ( method != 0 && method != AUX_COMPRESSION_METHOD_DEFLATE )
+		return false;
+
+	const std::size_t chunkCount = static_cast<std::size_t>( mipCount ) * m_uiFrames * m_uiFaces;
+	if ( AUX_INFO_HEADER_SIZE + chunkCount * 4 > auxInfoSize )
+		return false;
+
+	// The streams are stored back to back in image data order, smallest mip first
+	m_AuxChunks.assign( chunkCount, {} );
+	std::size_t offset = imageOffset;
+	for ( vlUInt mip = mipCount; mip-- > 0; )
+	{
+		for ( vlUInt frame = 0; frame < m_uiFrames; frame++ )
+		{
+			for ( vlUInt face = 0; face < m_uiFaces; face++ )
+			{
+				const std::size_t index = ( static_cast<std::size_t>( mip ) * m_uiFrames + frame ) * m_uiFaces + face;
+				AuxChunk &chunk = m_AuxChunks[index];
+				chunk.offset = offset;
+				chunk.compressedSize = ReadU32( pAuxInfo + AUX_INFO_HEADER_SIZE + index * 4 );
+				offset += chunk.compressedSize;
+			}
+		}
+	}
+
+	if ( offset > m_File.Size() )
+	{
+		m_AuxChunks.clear();
+		return false;
+	}
+	return true;
+}
+
+void MappedVTF::Close()
+{
+	m_File.Close();
+	m_MipOffsets.clear();
+	m_AuxChunks.clear();
+
+	std::scoped_lock lock( m_CacheMutex );
+	m_Inflated.clear();
+	m_nInflatedBytes = 0;
+}
+
+MappedVTF::Surface MappedVTF::GetData( vlUInt frame, vlUInt face, vlUInt slice, vlUInt mip ) const
+{
+	const std::size_t mipCount = IsAuxCompressed() ? m_AuxChunks.size() / ( static_cast<std::size_t>( m_uiFrames ) * m_uiFaces ) : m_MipOffsets.size();
+	if ( !IsOpen() || frame >= m_uiFrames || face >= m_uiFaces || mip >= mipCount )
+		return {};
+
+	vlUInt width, height, depth;
+	VTFLib::CVTFFile::ComputeMipmapDimensions( m_uiWidth, m_uiHeight, m_uiDepth, mip, width, height, depth );
+	if ( slice >= depth )
+		return {};
+
+	const std::size_t sliceSize = VTFLib::CVTFFile::ComputeImageSize( width, height, 1, m_Format );
+	if ( IsAuxCompressed() )
+	{
+		auto chunk = InflatedChunk( frame, face, mip );
+		if ( !chunk )
+			return {};
+		return { chunk->data() + slice * sliceSize, std::move( chunk ) };
+	}
+
+	return { m_File.Data() + m_MipOffsets[mip] + ( ( static_cast<std::size_t>( frame ) * m_uiFaces + face ) * depth + slice ) * sliceSize };
+}
+
+std::shared_ptr<const std::vector<vlByte>> MappedVTF::InflatedChunk( vlUInt frame, vlUInt face, vlUInt mip ) const
+{
+	const std::size_t index = ( static_cast<std::size_t>( mip ) * m_uiFrames + frame ) * m_uiFaces + face;
+	{
+		std::scoped_lock lock( m_CacheMutex );
+		for ( auto it = m_Inflated.begin(); it != m_Inflated.end(); ++it )
+		{
+			if ( it->index != index )
+				continue;
+
+			m_Inflated.splice( m_Inflated.begin(), m_Inflated, it );
+			return it->data;
+		}
+	}
+
+	// Inflated without the lock, other threads keep getting their cached chunks meanwhile
+	TRACE_ZONE( "MappedVTF::inflate" );
+	const AuxChunk &source = m_AuxChunks[index];
+	auto pChunk = std::make_shared<std::vector<vlByte>>( VTFLib::CVTFFile::ComputeMipmapSize( m_uiWidth, m_uiHeight, m_uiDepth, mip, m_Format ) );
+	const int inflatedSize = stbi_zlib_decode_buffer( reinterpret_cast<char *>( pChunk->data() ), static_cast<int>( pChunk->size() ),
+													  reinterpret_cast<const char *>( m_File.Data() + source.offset ), static_cast<int>( source.compressedSize ) );
+	if ( inflatedSize != static_cast<int>( pChunk->size() ) )
+		return nullptr;
+
+	std::scoped_lock lock( m_CacheMutex );
+	// Somebody else may have inflated the same chunk meanwhile, keep theirs
+	for ( const auto &cached : m_Inflated )
+		if ( cached.index == index )
+			return cached.data;
+
+	m_Inflated.push_front( { index, pChunk } );
+	m_nInflatedBytes += pChunk->size();
+
+	// Always keep the chunk we just inflated, even when it alone is over budget
+	while ( m_nInflatedBytes > INFLATED_BUDGET && m_Inflated.size() > 1 )
+	{
+		m_nInflatedBytes -= m_Inflated.back().data->size();
+		m_Inflated.pop_back();
+	}
+	return pChunk;
+}
+
+std::size_t MappedVTF::InflatedBytes() const
+{
+	std::scoped_lock lock( m_CacheMutex );
+	return m_nInflatedBytes;
+}
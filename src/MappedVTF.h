@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../libs/VTFLib/VTFLib/VTFLib.h"
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// A VTF whose image data is read straight out of a mapping of the file instead of being loaded to the heap.
+// Only the surfaces that are looked at get paged in, so opening a huge volume or animation is instant.
+// Sizes, formats and flags come from a header only CVTFFile of the same file, this only finds the image data.
+// Aux compressed 7.6 files are mapped too, every frame, face and mip chunk is inflated the first time it's asked for
+// and kept in a cache with a budget, so looking at one frame of an animation doesn't inflate all of them.
+class MappedVTF
+{
+public:
+	// A surface handed out by GetData. Holds on to the inflated chunk it points into,
+	// so the cache going over budget never frees it while a caller still reads from it.
+	class Surface
+	{
+	public:
+		Surface() = default;
+		Surface( const vlByte *pData, std::shared_ptr<const std::vector<vlByte>> chunk = nullptr ) :
+			m_pData( pData ), m_Chunk( std::move( chunk ) )
+		{
+		}
+
+		const vlByte *Data() const
+		{
+			return m_pData;
+		}
+
+	private:
+		const vlByte *m_pData = nullptr;
+		std::shared_ptr<const std::vector<vlByte>> m_Chunk;
+	};
+
+	static constexpr std::size_t INFLATED_BUDGET = 256 * 1024 * 1024;
+
+	MappedVTF() = default;
+
+	MappedVTF( const MappedVTF & ) = delete;
+	MappedVTF &operator=( const MappedVTF & ) = delete;
+
+	// fileName is UTF-8, header is the same file loaded header only. False when the image data can't be served from the mapping.
+	bool Open( std::string_view fileName, const VTFLib::CVTFFile &header );
+	void Close();
+
+	bool IsOpen() const
+	{
+		return m_File.IsOpen();
+	}
+
+	bool IsAuxCompressed() const
+	{
+		return !m_AuxChunks.empty();
+	}
+
+	// Same as CVTFFile::GetData, empty when out of range or when the chunk doesn't inflate.
+	// Safe to call from any thread.
+	Surface GetData( vlUInt frame, vlUInt face, vlUInt slice, vlUInt mip ) const;
+
+	// What the inflated chunks currently hold on to
+	std::size_t InflatedBytes() const;
+
+private:
+	bool OpenAuxCompressed( std::size_t imageOffset, const uint8_t *pAuxInfo, std::size_t auxInfoSize, vlUInt mipCount );
+	std::shared_ptr<const std::vector<vlByte>> InflatedChunk( vlUInt frame, vlUInt face, vlUInt mip ) const;
+
+	MappedFile m_File;
+
+	vlUInt m_uiWidth = 0;
+	vlUInt m_uiHeight = 0;
+	vlUInt m_uiDepth = 0;
+	vlUInt m_uiFrames = 0;
+	vlUInt m_uiFaces = 0;
+	VTFImageFormat m_Format = IMAGE_FORMAT_NONE;
+
+	// Where every mip starts in the file, the smallest mip comes first
+	std::vector<std::size_t> m_MipOffsets;
+
+	// One deflate stream per mip, frame and face with all slices in it, indexed ( mip * frames + frame ) * faces + face
+	struct AuxChunk
+	{
+		std::size_t offset;
+		uint32_t compressedSize;
+	};
+	std::vector<AuxChunk> m_AuxChunks;
+
+	struct CachedChunk
+	{
+		std::size_t index;
+		std::shared_ptr<const std::vector<vlByte>> data;
+	};
+	mutable std::mutex m_CacheMutex;
+	mutable std::list<CachedChunk> m_Inflated; // Most recently used first
+	mutable std::size_t m_nInflatedBytes = 0;
+};
@@ -22,6 +22,11 @@ void Options::setupOptions( QSettings &options )
 		options.setValue( OPT_START_MAXIMIZED, false );
 	}
 
+	if ( !options.contains( OPT_TAB_MEMORY_BUDGET ) )
+	{
+		options.setValue( OPT_TAB_MEMORY_BUDGET, 2048 );
+	}
+
 	if ( !options.contains( STR_OPEN_RECENT ) )
 	{
 		options.setValue( STR_OPEN_RECENT, QStringList {} );
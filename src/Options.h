@@ -5,6 +5,8 @@
 
 // Options
 constexpr std::string_view OPT_START_MAXIMIZED = "start_maximized";
+// MiB the open tabs may keep resident before the ones in the background are evicted
+constexpr std::string_view OPT_TAB_MEMORY_BUDGET = "tab_memory_budget";
 
 // Storage
 constexpr std::string_view STR_OPEN_RECENT = "open_recent";
@@ -0,0 +1,934 @@
+#include "PixelConversion.h"
+
+#include "util.hpp"
+
+#ifdef CHAOS_INITIATIVE
+#include "supported_formats/BCnSupport.h"
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __i386__ ) || defined( _M_IX86 )
+#define PIXELCONVERSION_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets us use any intrinsic without telling the compiler up front
+#define PIXELCONVERSION_TARGET_AVX2
+#else
+#define PIXELCONVERSION_TARGET_AVX2 __attribute__( ( target( "avx2,f16c" ) ) )
+#endif
+#endif
+
+// The kernels below are specialised on their formats at compile time, so every shift and shuffle mask is a constant.
+// Each kernel has a scalar version and, where it pays off, SSE2 and AVX2 versions.
+// The best one the CPU supports is picked once at runtime.
+// Anything that is not in the table goes through VTFLib like before.
+
+// Images smaller than this are not worth waking up the other threads for
+static constexpr std::size_t PARALLEL_PIXEL_THRESHOLD = 1024 * 1024;
+
+using KernelFunc = void ( * )( const vlByte *source, vlByte *dest, std::size_t pixelCount );
+
+//-----------------------------------------------------------------------------
+// Scalar helpers
+//-----------------------------------------------------------------------------
+
+static inline vlByte Expand5( uint32_t value )
+{
+	return static_cast<vlByte>( ( value << 3 ) | ( value >> 2 ) );
+}
+
+static inline vlByte Expand6( uint32_t value )
+{
+	return static_cast<vlByte>( ( value << 2 ) | ( value >> 4 ) );
+}
+
+static inline float HalfToFloat( uint16_t half )
+{
+	const uint32_t sign = ( half & 0x8000u ) << 16;
+	uint32_t exponent = ( half >> 10 ) & 0x1Fu;
+	uint32_t mantissa = half & 0x3FFu;
+
+	uint32_t bits;
+	if ( exponent == 0x1F )
+		bits = sign | 0x7F800000u | ( mantissa << 13 ); // Inf / NaN
+	else if ( exponent != 0 )
+		bits = sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 );
+	else if ( mantissa == 0 )
+		bits = sign; // Zero
+	else
+	{
+		// Denormal, normalise it
+		exponent = 113;
+		while ( !( mantissa & 0x400u ) )
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3FFu ) << 13 );
+	}
+
+	float result;
+	std::memcpy( &result, &bits, sizeof( result ) );
+	return result;
+}
+
+// Rounds to nearest even like F16C does, values too large for a half become infinity
+static inline uint16_t FloatToHalf( float value )
+{
+	uint32_t bits;
+	std::memcpy( &bits, &value, sizeof( bits ) );
+
+	const uint16_t sign = static_cast<uint16_t>( ( bits >> 16 ) & 0x8000u );
+	const uint32_t exponent = ( bits >> 23 ) & 0xFFu;
+	uint32_t mantissa = bits & 0x7FFFFFu;
+
+	if ( exponent == 0xFF )
+		return sign | 0x7C00u | ( mantissa ? 0x200u | ( mantissa >> 13 ) : 0 ); // Inf / NaN
+
+	const int halfExponent = static_cast<int>( exponent ) - 112;
+	if ( halfExponent >= 0x1F )
+		return sign | 0x7C00u;
+
+	if ( halfExponent <= 0 )
+	{
+		// Denormal or zero
+		if ( halfExponent < -10 )
+			return sign;
+		mantissa |= 0x800000u;
+		const uint32_t shift = static_cast<uint32_t>( 14 - halfExponent );
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ( ( 1u << shift ) - 1 );
+		const uint32_t halfway = 1u << ( shift - 1 );
+		if ( remainder > halfway || ( remainder == halfway && ( half & 1 ) ) )
+			half++;
+		return sign | static_cast<uint16_t>( half );
+	}
+
+	uint32_t half = ( static_cast<uint32_t>( halfExponent ) << 10 ) | ( mantissa >> 13 );
+	const uint32_t remainder = mantissa & 0x1FFFu;
+	if ( remainder > 0x1000u || ( remainder == 0x1000u && ( half & 1 ) ) )
+		half++; // May carry into the exponent, which rounds up to the next power of two or infinity as it should
+	return sign | static_cast<uint16_t>( half );
+}
+
+//-----------------------------------------------------------------------------
+// CPU detection
+//-----------------------------------------------------------------------------
+
+enum SIMDLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2,
+	SIMD_AVX2,
+};
+
+static SIMDLevel DetectSIMDLevel()
+{
+#ifdef PIXELCONVERSION_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 0 );
+	const int maxLeaf = info[0];
+
+	__cpuid( info, 1 );
+	const bool sse2 = info[3] & ( 1 << 26 );
+	const bool osxsave = info[2] & ( 1 << 27 );
+	const bool avx = info[2] & ( 1 << 28 );
+	const bool f16c = info[2] & ( 1 << 29 );
+
+	bool avx2 = false;
+	if ( maxLeaf >= 7 && osxsave && avx && f16c )
+	{
+		// The OS has to save the YMM registers for us
+		const bool ymmEnabled = ( _xgetbv( 0 ) & 0x6 ) == 0x6;
+		__cpuidex( info, 7, 0 );
+		avx2 = ymmEnabled && ( info[1] & ( 1 << 5 ) );
+	}
+
+	if ( avx2 )
+		return SIMD_AVX2;
+	return sse2 ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "f16c" ) )
+		return SIMD_AVX2;
+	return __builtin_cpu_supports( "sse2" ) ? SIMD_SSE2 : SIMD_SCALAR;
+#endif
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+// Set by SetLimits, only the benchmark changes them
+static std::atomic<int> simdLimit = SIMD_AVX2;
+static std::atomic<std::size_t> threadLimit = 0;
+
+static SIMDLevel CurrentSIMDLevel()
+{
+	static const SIMDLevel simdLevel = DetectSIMDLevel();
+	return std::min( simdLevel, static_cast<SIMDLevel>( simdLimit.load( std::memory_order_relaxed ) ) );
+}
+
+//-----------------------------------------------------------------------------
+// 4 byte -> 4 byte channel swizzles ( BGRA8888, ABGR8888, ARGB8888, BGRX8888 )
+// Dest channel N is read from source byte IndexN, an index of -1 writes 255.
+//-----------------------------------------------------------------------------
+
+template <int IndexR, int IndexG, int IndexB, int IndexA>
+struct Swizzle32Kernel
+{
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		for ( std::size_t i = 0; i < pixelCount; i++, source += 4, dest += 4 )
+		{
+			dest[0] = source[IndexR];
+			dest[1] = source[IndexG];
+			dest[2] = source[IndexB];
+			dest[3] = IndexA < 0 ? 255 : source[IndexA < 0 ? 0 : IndexA];
+		}
+	}
+
+#ifdef PIXELCONVERSION_X86
+	// SSE2 has no byte shuffle, so every channel is shifted into place inside its 32 bit lane.
+	template <int Index, int Channel>
+	static inline __m128i MoveChannel( __m128i pixels )
+	{
+		if constexpr ( Index < 0 )
+			return _mm_set1_epi32( static_cast<int>( 0xFFu << ( Channel * 8 ) ) );
+		else
+		{
+			const __m128i channel = _mm_and_si128( _mm_srli_epi32( pixels, Index * 8 ), _mm_set1_epi32( 0xFF ) );
+			return _mm_slli_epi32( channel, Channel * 8 );
+		}
+	}
+
+	static void SSE2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		std::size_t i = 0;
+		for ( ; i + 4 <= pixelCount; i += 4 )
+		{
+			const __m128i pixels = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i * 4 ) );
+			__m128i result = MoveChannel<IndexR, 0>( pixels );
+			result = _mm_or_si128( result, MoveChannel<IndexG, 1>( pixels ) );
+			result = _mm_or_si128( result, MoveChannel<IndexB, 2>( pixels ) );
+			result = _mm_or_si128( result, MoveChannel<IndexA, 3>( pixels ) );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( dest + i * 4 ), result );
+		}
+		Scalar( source + i * 4, dest + i * 4, pixelCount - i );
+	}
+
+	PIXELCONVERSION_TARGET_AVX2 static void AVX2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		// A -1 index becomes 0x80 which makes the shuffle write zero, the alpha is OR'd in afterwards
+		constexpr char r = IndexR < 0 ? char( 0x80 ) : char( IndexR );
+		constexpr char g = IndexG < 0 ? char( 0x80 ) : char( IndexG );
+		constexpr char b = IndexB < 0 ? char( 0x80 ) : char( IndexB );
+		constexpr char a = IndexA < 0 ? char( 0x80 ) : char( IndexA );
+		const __m256i mask = _mm256_setr_epi8(
+			r, g, b, a, r + 4, g + 4, b + 4, a + 4, r + 8, g + 8, b + 8, a + 8, r + 12, g + 12, b + 12, a + 12,
+			r, g, b, a, r + 4, g + 4, b + 4, a + 4, r + 8, g + 8, b + 8, a + 8, r + 12, g + 12, b + 12, a + 12 );
+		const __m256i opaque = _mm256_set1_epi32( IndexA < 0 ? static_cast<int>( 0xFF000000u ) : 0 );
+
+		std::size_t i = 0;
+		for ( ; i + 8 <= pixelCount; i += 8 )
+		{
+			const __m256i pixels = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( source + i * 4 ) );
+			const __m256i result = _mm256_or_si256( _mm256_shuffle_epi8( pixels, mask ), opaque );
+			_mm256_storeu_si256( reinterpret_cast<__m256i *>( dest + i * 4 ), result );
+		}
+		Scalar( source + i * 4, dest + i * 4, pixelCount - i );
+	}
+#endif
+};
+
+//-----------------------------------------------------------------------------
+// 3 byte -> RGBA8888 ( RGB888, BGR888 )
+//-----------------------------------------------------------------------------
+
+template <int IndexR, int IndexG, int IndexB>
+struct Swizzle24Kernel
+{
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		for ( std::size_t i = 0; i < pixelCount; i++, source += 3, dest += 4 )
+		{
+			dest[0] = source[IndexR];
+			dest[1] = source[IndexG];
+			dest[2] = source[IndexB];
+			dest[3] = 255;
+		}
+	}
+
+#ifdef PIXELCONVERSION_X86
+	PIXELCONVERSION_TARGET_AVX2 static void AVX2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		// 4 pixels per 128 bit half, the loads read 16 bytes but only use 12
+		const __m128i mask = _mm_setr_epi8(
+			IndexR, IndexG, IndexB, char( 0x80 ), IndexR + 3, IndexG + 3, IndexB + 3, char( 0x80 ),
+			IndexR + 6, IndexG + 6, IndexB + 6, char( 0x80 ), IndexR + 9, IndexG + 9, IndexB + 9, char( 0x80 ) );
+		const __m256i shuffle = _mm256_broadcastsi128_si256( mask );
+		const __m256i opaque = _mm256_set1_epi32( static_cast<int>( 0xFF000000u ) );
+
+		std::size_t i = 0;
+		// Stop early enough that the 16 byte load of the upper half stays inside the source
+		for ( ; i + 8 <= pixelCount && ( i + 4 ) * 3 + 16 <= pixelCount * 3; i += 8 )
+		{
+			const __m128i low = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i * 3 ) );
+			const __m128i high = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + ( i + 4 ) * 3 ) );
+			const __m256i pixels = _mm256_inserti128_si256( _mm256_castsi128_si256( low ), high, 1 );
+			const __m256i result = _mm256_or_si256( _mm256_shuffle_epi8( pixels, shuffle ), opaque );
+			_mm256_storeu_si256( reinterpret_cast<__m256i *>( dest + i * 4 ), result );
+		}
+		Scalar( source + i * 3, dest + i * 4, pixelCount - i );
+	}
+#endif
+};
+
+//-----------------------------------------------------------------------------
+// Luminance / alpha expansion ( I8, IA88, A8 )
+// I8 and IA88 copy the intensity into RGB, A8 leaves RGB black.
+//-----------------------------------------------------------------------------
+
+struct ExpandI8Kernel
+{
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		for ( std::size_t i = 0; i < pixelCount; i++, dest += 4 )
+		{
+			dest[0] = dest[1] = dest[2] = source[i];
+			dest[3] = 255;
+		}
+	}
+
+#ifdef PIXELCONVERSION_X86
+	static void SSE2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		const __m128i opaque = _mm_set1_epi8( char( 0xFF ) );
+		std::size_t i = 0;
+		for ( ; i + 16 <= pixelCount; i += 16 )
+		{
+			const __m128i intensity = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i ) );
+			const __m128i iiLow = _mm_unpacklo_epi8( intensity, intensity );
+			const __m128i iiHigh = _mm_unpackhi_epi8( intensity, intensity );
+			const __m128i iaLow = _mm_unpacklo_epi8( intensity, opaque );
+			const __m128i iaHigh = _mm_unpackhi_epi8( intensity, opaque );
+			__m128i *out = reinterpret_cast<__m128i *>( dest + i * 4 );
+			_mm_storeu_si128( out + 0, _mm_unpacklo_epi16( iiLow, iaLow ) );
+			_mm_storeu_si128( out + 1, _mm_unpackhi_epi16( iiLow, iaLow ) );
+			_mm_storeu_si128( out + 2, _mm_unpacklo_epi16( iiHigh, iaHigh ) );
+			_mm_storeu_si128( out + 3, _mm_unpackhi_epi16( iiHigh, iaHigh ) );
+		}
+		Scalar( source + i, dest + i * 4, pixelCount - i );
+	}
+#endif
+};
+
+struct ExpandIA88Kernel
+{
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		for ( std::size_t i = 0; i < pixelCount; i++, source += 2, dest += 4 )
+		{
+			dest[0] = dest[1] = dest[2] = source[0];
+			dest[3] = source[1];
+		}
+	}
+
+#ifdef PIXELCONVERSION_X86
+	static void SSE2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		std::size_t i = 0;
+		for ( ; i + 8 <= pixelCount; i += 8 )
+		{
+			// Every 16 bit lane is I | A << 8, turn it into I | I << 8 and interleave with the original
+			const __m128i ia = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i * 2 ) );
+			const __m128i intensity = _mm_and_si128( ia, _mm_set1_epi16( 0xFF ) );
+			const __m128i ii = _mm_or_si128( intensity, _mm_slli_epi16( intensity, 8 ) );
+			__m128i *out = reinterpret_cast<__m128i *>( dest + i * 4 );
+			_mm_storeu_si128( out + 0, _mm_unpacklo_epi16( ii, ia ) );
+			_mm_storeu_si128( out + 1, _mm_unpackhi_epi16( ii, ia ) );
+		}
+		Scalar( source + i * 2, dest + i * 4, pixelCount - i );
+	}
+#endif
+};
+
+struct ExpandA8Kernel
+{
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		for ( std::size_t i = 0; i < pixelCount; i++, dest += 4 )
+		{
+			dest[0] = dest[1] = dest[2] = 0;
+			dest[3] = source[i];
+		}
+	}
+
+#ifdef PIXELCONVERSION_X86
+	static void SSE2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		std::size_t i = 0;
+		for ( ; i + 16 <= pixelCount; i += 16 )
+		{
+			const __m128i alpha = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i ) );
+			const __m128i zaLow = _mm_unpacklo_epi8( zero, alpha );
+			const __m128i zaHigh = _mm_unpackhi_epi8( zero, alpha );
+			__m128i *out = reinterpret_cast<__m128i *>( dest + i * 4 );
+			_mm_storeu_si128( out + 0, _mm_unpacklo_epi16( zero, zaLow ) );
+			_mm_storeu_si128( out + 1, _mm_unpackhi_epi16( zero, zaLow ) );
+			_mm_storeu_si128( out + 2, _mm_unpacklo_epi16( zero, zaHigh ) );
+			_mm_storeu_si128( out + 3, _mm_unpackhi_epi16( zero, zaHigh ) );
+		}
+		Scalar( source + i, dest + i * 4, pixelCount - i );
+	}
+#endif
+};
+
+//-----------------------------------------------------------------------------
+// 16 bit 565 -> RGBA8888
+// VTFLib keeps the first named channel in the low bits, RGB565 has red at bit 0 and BGR565 has blue at bit 0.
+// Channels are widened by bit replication.
+//-----------------------------------------------------------------------------
+
+template <int ShiftR, int ShiftB>
+struct Expand565Kernel
+{
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		for ( std::size_t i = 0; i < pixelCount; i++, source += 2, dest += 4 )
+		{
+			const uint32_t value = source[0] | ( source[1] << 8 );
+			dest[0] = Expand5( ( value >> ShiftR ) & 0x1F );
+			dest[1] = Expand6( ( value >> 5 ) & 0x3F );
+			dest[2] = Expand5( ( value >> ShiftB ) & 0x1F );
+			dest[3] = 255;
+		}
+	}
+
+#ifdef PIXELCONVERSION_X86
+	static inline __m128i Expand5Lanes( __m128i value )
+	{
+		return _mm_or_si128( _mm_slli_epi16( value, 3 ), _mm_srli_epi16( value, 2 ) );
+	}
+
+	static void SSE2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		const __m128i mask5 = _mm_set1_epi16( 0x1F );
+		const __m128i mask6 = _mm_set1_epi16( 0x3F );
+		const __m128i opaque = _mm_set1_epi16( static_cast<short>( 0xFF00 ) );
+
+		std::size_t i = 0;
+		for ( ; i + 8 <= pixelCount; i += 8 )
+		{
+			const __m128i value = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i * 2 ) );
+			const __m128i r = Expand5Lanes( _mm_and_si128( _mm_srli_epi16( value, ShiftR ), mask5 ) );
+			const __m128i g6 = _mm_and_si128( _mm_srli_epi16( value, 5 ), mask6 );
+			const __m128i g = _mm_or_si128( _mm_slli_epi16( g6, 2 ), _mm_srli_epi16( g6, 4 ) );
+			const __m128i b = Expand5Lanes( _mm_and_si128( _mm_srli_epi16( value, ShiftB ), mask5 ) );
+
+			// r | g << 8 and b | 255 << 8, interleaving the two gives R G B A
+			const __m128i rg = _mm_or_si128( r, _mm_slli_epi16( g, 8 ) );
+			const __m128i ba = _mm_or_si128( b, opaque );
+			__m128i *out = reinterpret_cast<__m128i *>( dest + i * 4 );
+			_mm_storeu_si128( out + 0, _mm_unpacklo_epi16( rg, ba ) );
+			_mm_storeu_si128( out + 1, _mm_unpackhi_epi16( rg, ba ) );
+		}
+		Scalar( source + i * 2, dest + i * 4, pixelCount - i );
+	}
+#endif
+};
+
+//-----------------------------------------------------------------------------
+// Half <-> float
+// The element converters are shared by the kernels and the public HalfToFloat / FloatToHalf.
+//-----------------------------------------------------------------------------
+
+static void HalfToFloatScalar( const uint16_t *source, float *dest, std::size_t count )
+{
+	for ( std::size_t i = 0; i < count; i++ )
+		dest[i] = HalfToFloat( source[i] );
+}
+
+static void FloatToHalfScalar( const float *source, uint16_t *dest, std::size_t count )
+{
+	for ( std::size_t i = 0; i < count; i++ )
+		dest[i] = FloatToHalf( source[i] );
+}
+
+#ifdef PIXELCONVERSION_X86
+PIXELCONVERSION_TARGET_AVX2 static void HalfToFloatAVX2( const uint16_t *source, float *dest, std::size_t count )
+{
+	std::size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		const __m128i halfs = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i ) );
+		_mm256_storeu_ps( dest + i, _mm256_cvtph_ps( halfs ) );
+	}
+	HalfToFloatScalar( source + i, dest + i, count - i );
+}
+
+PIXELCONVERSION_TARGET_AVX2 static void FloatToHalfAVX2( const float *source, uint16_t *dest, std::size_t count )
+{
+	std::size_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		const __m256 floats = _mm256_loadu_ps( source + i );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dest + i ), _mm256_cvtps_ph( floats, _MM_FROUND_TO_NEAREST_INT ) );
+	}
+	FloatToHalfScalar( source + i, dest + i, count - i );
+}
+#endif
+
+static void UNorm16ToHalfScalar( const uint16_t *source, uint16_t *dest, std::size_t pixelCount, std::size_t channelCount )
+{
+	for ( std::size_t i = 0; i < pixelCount; i++ )
+	{
+		for ( std::size_t c = 0; c < 4; c++ )
+			dest[i * 4 + c] = c < channelCount ? FloatToHalf( source[i * channelCount + c] / 65535.0f ) : 0x3C00;
+	}
+}
+
+#ifdef PIXELCONVERSION_X86
+PIXELCONVERSION_TARGET_AVX2 static void UNorm16ToHalfAVX2( const uint16_t *source, uint16_t *dest, std::size_t pixelCount, std::size_t channelCount )
+{
+	std::size_t i = 0;
+	if ( channelCount == 4 )
+	{
+		// Two pixels at a time, widened to int, then float, then narrowed to half
+		const __m256 max = _mm256_set1_ps( 65535.0f );
+		for ( ; i + 2 <= pixelCount; i += 2 )
+		{
+			const __m256i samples = _mm256_cvtepu16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i * 4 ) ) );
+			const __m256 floats = _mm256_div_ps( _mm256_cvtepi32_ps( samples ), max );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( dest + i * 4 ), _mm256_cvtps_ph( floats, _MM_FROUND_TO_NEAREST_INT ) );
+		}
+	}
+	else if ( channelCount == 3 )
+	{
+		// One pixel at a time, the last pixel can't load 4 samples without reading past the end
+		const __m128 max = _mm_set1_ps( 65535.0f );
+		for ( ; i + 1 < pixelCount; i++ )
+		{
+			const __m128i samples = _mm_cvtepu16_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i *>( source + i * 3 ) ) );
+			const __m128 rgba = _mm_blend_ps( _mm_div_ps( _mm_cvtepi32_ps( samples ), max ), _mm_set1_ps( 1.0f ), 0x8 );
+			_mm_storel_epi64( reinterpret_cast<__m128i *>( dest + i * 4 ), _mm_cvtps_ph( rgba, _MM_FROUND_TO_NEAREST_INT ) );
+		}
+	}
+	UNorm16ToHalfScalar( source + i * channelCount, dest + i * 4, pixelCount - i, channelCount );
+}
+#endif
+
+struct HalfToFloatKernel
+{
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		HalfToFloatScalar( reinterpret_cast<const uint16_t *>( source ), reinterpret_cast<float *>( dest ), pixelCount * 4 );
+	}
+
+#ifdef PIXELCONVERSION_X86
+	static void AVX2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		HalfToFloatAVX2( reinterpret_cast<const uint16_t *>( source ), reinterpret_cast<float *>( dest ), pixelCount * 4 );
+	}
+#endif
+};
+
+// RGBA32323232F or RGB323232F -> RGBA16161616F, a missing alpha becomes 1.0
+template <int Channels>
+struct FloatToHalfKernel
+{
+	static constexpr uint16_t HALF_ONE = 0x3C00;
+
+	static void Scalar( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		const auto floats = reinterpret_cast<const float *>( source );
+		const auto halfs = reinterpret_cast<uint16_t *>( dest );
+		if constexpr ( Channels == 4 )
+			FloatToHalfScalar( floats, halfs, pixelCount * 4 );
+		else
+		{
+			for ( std::size_t i = 0; i < pixelCount; i++ )
+			{
+				halfs[i * 4 + 0] = FloatToHalf( floats[i * 3 + 0] );
+				halfs[i * 4 + 1] = FloatToHalf( floats[i * 3 + 1] );
+				halfs[i * 4 + 2] = FloatToHalf( floats[i * 3 + 2] );
+				halfs[i * 4 + 3] = HALF_ONE;
+			}
+		}
+	}
+
+#ifdef PIXELCONVERSION_X86
+	PIXELCONVERSION_TARGET_AVX2 static void AVX2( const vlByte *source, vlByte *dest, std::size_t pixelCount )
+	{
+		const auto floats = reinterpret_cast<const float *>( source );
+		const auto halfs = reinterpret_cast<uint16_t *>( dest );
+		if constexpr ( Channels == 4 )
+			FloatToHalfAVX2( floats, halfs, pixelCount * 4 );
+		else
+		{
+			// One pixel at a time, the last pixel can't load 4 floats without reading past the end
+			std::size_t i = 0;
+			for ( ; i + 1 < pixelCount; i++ )
+			{
+				const __m128 rgbx = _mm_loadu_ps( floats + i * 3 );
+				const __m128 rgba = _mm_blend_ps( rgbx, _mm_set1_ps( 1.0f ), 0x8 );
+				_mm_storel_epi64( reinterpret_cast<__m128i *>( halfs + i * 4 ), _mm_cvtps_ph( rgba, _MM_FROUND_TO_NEAREST_INT ) );
+			}
+			Scalar( source + i * 12, dest + i * 8, pixelCount - i );
+		}
+	}
+#endif
+};
+
+//-----------------------------------------------------------------------------
+// Kernel table
+//-----------------------------------------------------------------------------
+
+struct ConversionKernel
+{
+	VTFImageFormat sourceFormat;
+	VTFImageFormat destFormat;
+	vlUInt sourcePixelSize;
+	vlUInt destPixelSize;
+	KernelFunc scalar;
+	KernelFunc sse2;
+	KernelFunc avx2;
+};
+
+#ifdef PIXELCONVERSION_X86
+#define KERNEL_SSE2( kernel ) &kernel::SSE2
+#define KERNEL_AVX2( kernel ) &kernel::AVX2
+#else
+#define KERNEL_SSE2( kernel ) nullptr
+#define KERNEL_AVX2( kernel ) nullptr
+#endif
+
+using BGRA8888ToRGBA8888 = Swizzle32Kernel<2, 1, 0, 3>;
+using ABGR8888ToRGBA8888 = Swizzle32Kernel<3, 2, 1, 0>;
+// VTFLib's ARGB8888 isn't stored A, R, G, B: its channel table puts G, B, A, R in bytes 0 - 3
+using ARGB8888ToRGBA8888 = Swizzle32Kernel<3, 0, 1, 2>;
+using BGRX8888ToRGBA8888 = Swizzle32Kernel<2, 1, 0, -1>;
+using RGB888ToRGBA8888 = Swizzle24Kernel<0, 1, 2>;
+using BGR888ToRGBA8888 = Swizzle24Kernel<2, 1, 0>;
+using RGB565ToRGBA8888 = Expand565Kernel<0, 11>;
+using BGR565ToRGBA8888 = Expand565Kernel<11, 0>;
+
+static const ConversionKernel CONVERSION_KERNELS[] = {
+	{ IMAGE_FORMAT_BGRA8888, IMAGE_FORMAT_RGBA8888, 4, 4, &BGRA8888ToRGBA8888::Scalar, KERNEL_SSE2( BGRA8888ToRGBA8888 ), KERNEL_AVX2( BGRA8888ToRGBA8888 ) },
+	// The same swap turns RGBA back into BGRA
+	{ IMAGE_FORMAT_RGBA8888, IMAGE_FORMAT_BGRA8888, 4, 4, &BGRA8888ToRGBA8888::Scalar, KERNEL_SSE2( BGRA8888ToRGBA8888 ), KERNEL_AVX2( BGRA8888ToRGBA8888 ) },
+	{ IMAGE_FORMAT_ABGR8888, IMAGE_FORMAT_RGBA8888, 4, 4, &ABGR8888ToRGBA8888::Scalar, KERNEL_SSE2( ABGR8888ToRGBA8888 ), KERNEL_AVX2( ABGR8888ToRGBA8888 ) },
+	{ IMAGE_FORMAT_ARGB8888, IMAGE_FORMAT_RGBA8888, 4, 4, &ARGB8888ToRGBA8888::Scalar, KERNEL_SSE2( ARGB8888ToRGBA8888 ), KERNEL_AVX2( ARGB8888ToRGBA8888 ) },
+	{ IMAGE_FORMAT_BGRX8888, IMAGE_FORMAT_RGBA8888, 4, 4, &BGRX8888ToRGBA8888::Scalar, KERNEL_SSE2( BGRX8888ToRGBA8888 ), KERNEL_AVX2( BGRX8888ToRGBA8888 ) },
+	{ IMAGE_FORMAT_RGB888, IMAGE_FORMAT_RGBA8888, 3, 4, &RGB888ToRGBA8888::Scalar, nullptr, KERNEL_AVX2( RGB888ToRGBA8888 ) },
+	{ IMAGE_FORMAT_BGR888, IMAGE_FORMAT_RGBA8888, 3, 4, &BGR888ToRGBA8888::Scalar, nullptr, KERNEL_AVX2( BGR888ToRGBA8888 ) },
+	{ IMAGE_FORMAT_RGB565, IMAGE_FORMAT_RGBA8888, 2, 4, &RGB565ToRGBA8888::Scalar, KERNEL_SSE2( RGB565ToRGBA8888 ), nullptr },
+	{ IMAGE_FORMAT_BGR565, IMAGE_FORMAT_RGBA8888, 2, 4, &BGR565ToRGBA8888::Scalar, KERNEL_SSE2( BGR565ToRGBA8888 ), nullptr },
+	{ IMAGE_FORMAT_I8, IMAGE_FORMAT_RGBA8888, 1, 4, &ExpandI8Kernel::Scalar, KERNEL_SSE2( ExpandI8Kernel ), nullptr },
+	{ IMAGE_FORMAT_IA88, IMAGE_FORMAT_RGBA8888, 2, 4, &ExpandIA88Kernel::Scalar, KERNEL_SSE2( ExpandIA88Kernel ), nullptr },
+	{ IMAGE_FORMAT_A8, IMAGE_FORMAT_RGBA8888, 1, 4, &ExpandA8Kernel::Scalar, KERNEL_SSE2( ExpandA8Kernel ), nullptr },
+	{ IMAGE_FORMAT_RGBA16161616F, IMAGE_FORMAT_RGBA32323232F, 8, 16, &HalfToFloatKernel::Scalar, nullptr, KERNEL_AVX2( HalfToFloatKernel ) },
+	{ IMAGE_FORMAT_RGBA32323232F, IMAGE_FORMAT_RGBA16161616F, 16, 8, &FloatToHalfKernel<4>::Scalar, nullptr, KERNEL_AVX2( FloatToHalfKernel<4> ) },
+	{ IMAGE_FORMAT_RGB323232F, IMAGE_FORMAT_RGBA16161616F, 12, 8, &FloatToHalfKernel<3>::Scalar, nullptr, KERNEL_AVX2( FloatToHalfKernel<3> ) },
+};
+
+#undef KERNEL_SSE2
+#undef KERNEL_AVX2
+
+static KernelFunc FindKernel( VTFImageFormat sourceFormat, VTFImageFormat destFormat, vlUInt &sourcePixelSize, vlUInt &destPixelSize )
+{
+	const SIMDLevel simdLevel = CurrentSIMDLevel();
+
+	for ( const auto &kernel : CONVERSION_KERNELS )
+	{
+		if ( kernel.sourceFormat != sourceFormat || kernel.destFormat != destFormat )
+			continue;
+
+		sourcePixelSize = kernel.sourcePixelSize;
+		destPixelSize = kernel.destPixelSize;
+
+		// AVX2 machines still use the SSE2 kernel when there is no AVX2 one
+		if ( simdLevel >= SIMD_AVX2 && kernel.avx2 )
+			return kernel.avx2;
+		if ( simdLevel >= SIMD_SSE2 && kernel.sse2 )
+			return kernel.sse2;
+		return kernel.scalar;
+	}
+	return nullptr;
+}
+
+static bool RunKernel( const vlByte *source, vlByte *dest, vlUInt width, vlUInt height, VTFImageFormat sourceFormat, VTFImageFormat destFormat )
+{
+	vlUInt sourcePixelSize, destPixelSize;
+	const KernelFunc kernel = FindKernel( sourceFormat, destFormat, sourcePixelSize, destPixelSize );
+	if ( !kernel )
+		return false;
+
+	const std::size_t pixelCount = static_cast<std::size_t>( width ) * height;
+	if ( pixelCount < PARALLEL_PIXEL_THRESHOLD )
+	{
+		kernel( source, dest, pixelCount );
+		return true;
+	}
+
+	// Split big images into row bands, a single core can't keep up with the memory bus
+	const std::size_t bandRows = std::max<std::size_t>( 1, PARALLEL_PIXEL_THRESHOLD / 4 / width );
+	const std::size_t bandCount = ( height + bandRows - 1 ) / bandRows;
+	util::parallel_for( bandCount, [&]( std::size_t band )
+						{
+							const std::size_t firstRow = band * bandRows;
+							const std::size_t rows = std::min<std::size_t>( bandRows, height - firstRow );
+							const std::size_t firstPixel = firstRow * width;
+							kernel( source + firstPixel * sourcePixelSize, dest + firstPixel * destPixelSize, rows * width );
+						},
+						threadLimit.load( std::memory_order_relaxed ) );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// RGB + separate alpha plane -> RGBA, in place
+// The RGB data sits packed at the front of the buffer, we work from the back so nothing gets overwritten before it was read.
+//-----------------------------------------------------------------------------
+
+// Moves the pixels [first, end)
+static void InterleaveAlphaScalar( vlByte *image, const vlByte *alpha, std::size_t first, std::size_t end, std::size_t sampleSize )
+{
+	for ( std::size_t i = end; i-- > first; )
+	{
+		std::memmove( image + i * 4 * sampleSize, image + i * 3 * sampleSize, 3 * sampleSize );
+		std::memcpy( image + ( i * 4 + 3 ) * sampleSize, alpha + i * sampleSize, sampleSize );
+	}
+}
+
+#ifdef PIXELCONVERSION_X86
+// Byte shuffles for one 16 byte lane, 12 bytes of RGB go in and 16 bytes of RGBA come out
+// whatever the sample size is ( 4 pixels of 8 bit, 2 of 16 bit or 1 of 32 bit ).
+template <std::size_t SampleSize>
+struct InterleaveAlphaMasks
+{
+	alignas( 32 ) int8_t rgb[32];
+	alignas( 32 ) int8_t alpha[32];
+
+	constexpr InterleaveAlphaMasks() :
+		rgb {}, alpha {}
+	{
+		for ( std::size_t i = 0; i < 32; i++ )
+		{
+			const std::size_t byte = i % 16;
+			const std::size_t pixel = byte / ( 4 * SampleSize );
+			const std::size_t channel = byte % ( 4 * SampleSize ) / SampleSize;
+			const std::size_t sampleByte = byte % SampleSize;
+			rgb[i] = channel < 3 ? static_cast<int8_t>( pixel * 3 * SampleSize + channel * SampleSize + sampleByte ) : -1;
+			alpha[i] = channel < 3 ? -1 : static_cast<int8_t>( pixel * SampleSize + sampleByte );
+		}
+	}
+};
+
+// 32 bytes of RGBA per step. The RGB load reads 8 bytes past what it uses, which is always inside the
+// buffer ( it's a third larger than the RGB data ) and only ever touches bytes that haven't been moved yet.
+template <std::size_t SampleSize>
+PIXELCONVERSION_TARGET_AVX2 static void InterleaveAlphaAVX2( vlByte *image, const vlByte *alpha, std::size_t pixelCount )
+{
+	static constexpr InterleaveAlphaMasks<SampleSize> masks;
+	constexpr std::size_t stepPixels = 8 / SampleSize;
+
+	const std::size_t steps = pixelCount / stepPixels;
+	const std::size_t done = steps * stepPixels;
+	InterleaveAlphaScalar( image, alpha, done, pixelCount, SampleSize );
+
+	// Spread the 24 bytes of RGB over both lanes, 12 bytes each
+	const __m256i rgbSpread = _mm256_setr_epi32( 0, 1, 2, 2, 3, 4, 5, 5 );
+	const __m256i alphaSpread = _mm256_setr_epi32( 0, 0, 0, 0, 1, 1, 1, 1 );
+	const __m256i rgbMask = _mm256_load_si256( reinterpret_cast<const __m256i *>( masks.rgb ) );
+	const __m256i alphaMask = _mm256_load_si256( reinterpret_cast<const __m256i *>( masks.alpha ) );
+
+	for ( std::size_t step = steps; step-- > 0; )
+	{
+		const std::size_t pixel = step * stepPixels;
+		const __m256i rgb = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( image + pixel * 3 * SampleSize ) );
+		const __m256i a = _mm256_castsi128_si256( _mm_loadl_epi64( reinterpret_cast<const __m128i *>( alpha + pixel * SampleSize ) ) );
+
+		const __m256i rgbPart = _mm256_shuffle_epi8( _mm256_permutevar8x32_epi32( rgb, rgbSpread ), rgbMask );
+		const __m256i alphaPart = _mm256_shuffle_epi8( _mm256_permutevar8x32_epi32( a, alphaSpread ), alphaMask );
+		_mm256_storeu_si256( reinterpret_cast<__m256i *>( image + pixel * 4 * SampleSize ), _mm256_or_si256( rgbPart, alphaPart ) );
+	}
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Byte order swap of 16 or 32 bit samples, source and dest may be the same
+//-----------------------------------------------------------------------------
+
+static void ByteSwapScalar( const vlByte *source, vlByte *dest, std::size_t count, std::size_t sampleSize )
+{
+	for ( std::size_t i = 0; i < count; i++ )
+	{
+		vlByte sample[4];
+		std::memcpy( sample, source + i * sampleSize, sampleSize );
+		for ( std::size_t byte = 0; byte < sampleSize; byte++ )
+			dest[i * sampleSize + byte] = sample[sampleSize - 1 - byte];
+	}
+}
+
+#ifdef PIXELCONVERSION_X86
+static inline __m128i ByteSwap16SSE2( __m128i value )
+{
+	return _mm_or_si128( _mm_slli_epi16( value, 8 ), _mm_srli_epi16( value, 8 ) );
+}
+
+// Swapping the 16 bit halves of every 32 bit value, then the bytes inside them, is a full 32 bit swap
+static inline __m128i ByteSwap32SSE2( __m128i value )
+{
+	const __m128i halvesSwapped = _mm_shufflehi_epi16( _mm_shufflelo_epi16( value, _MM_SHUFFLE( 2, 3, 0, 1 ) ), _MM_SHUFFLE( 2, 3, 0, 1 ) );
+	return ByteSwap16SSE2( halvesSwapped );
+}
+
+static void ByteSwapSSE2( const vlByte *source, vlByte *dest, std::size_t count, std::size_t sampleSize )
+{
+	const std::size_t bytes = count * sampleSize;
+	std::size_t i = 0;
+	for ( ; i + 16 <= bytes; i += 16 )
+	{
+		const __m128i value = _mm_loadu_si128( reinterpret_cast<const __m128i *>( source + i ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dest + i ), sampleSize == 2 ? ByteSwap16SSE2( value ) : ByteSwap32SSE2( value ) );
+	}
+	ByteSwapScalar( source + i, dest + i, ( bytes - i ) / sampleSize, sampleSize );
+}
+
+PIXELCONVERSION_TARGET_AVX2 static void ByteSwapAVX2( const vlByte *source, vlByte *dest, std::size_t count, std::size_t sampleSize )
+{
+	const __m256i mask = sampleSize == 2 ?
+							 _mm256_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 ) :
+							 _mm256_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+
+	const std::size_t bytes = count * sampleSize;
+	std::size_t i = 0;
+	for ( ; i + 32 <= bytes; i += 32 )
+	{
+		const __m256i value = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( source + i ) );
+		_mm256_storeu_si256( reinterpret_cast<__m256i *>( dest + i ), _mm256_shuffle_epi8( value, mask ) );
+	}
+	ByteSwapScalar( source + i, dest + i, ( bytes - i ) / sampleSize, sampleSize );
+}
+#endif
+
+bool PixelConversion::ToRGBA8888( const vlByte *source, vlByte *dest, vlUInt width, vlUInt height, VTFImageFormat sourceFormat )
+{
+	if ( sourceFormat == IMAGE_FORMAT_RGBA8888 )
+	{
+		std::memcpy( dest, source, static_cast<std::size_t>( width ) * height * 4 );
+		return true;
+	}
+
+	if ( RunKernel( source, dest, width, height, sourceFormat, IMAGE_FORMAT_RGBA8888 ) )
+		return true;
+
+#ifdef CHAOS_INITIATIVE
+	if ( sourceFormat == IMAGE_FORMAT_BC7 )
+		return BCnSupport::Decode_BC7( source, width, height, dest );
+
+	if ( sourceFormat == IMAGE_FORMAT_BC6H )
+	{
+		// Decode to halfs so the HDR tonemapping in VTFLib still applies
+		std::vector<uint16_t> halfs( (std::size_t)width * height * 4 );
+		if ( !BCnSupport::Decode_BC6H( source, width, height, halfs.data() ) )
+			return false;
+		return VTFLib::CVTFFile::ConvertToRGBA8888( reinterpret_cast<vlByte *>( halfs.data() ), dest, width, height, IMAGE_FORMAT_RGBA16161616F );
+	}
+#endif
+
+	return VTFLib::CVTFFile::ConvertToRGBA8888( const_cast<vlByte *>( source ), dest, width, height, sourceFormat );
+}
+
+bool PixelConversion::Convert( const vlByte *source, vlByte *dest, vlUInt width, vlUInt height, VTFImageFormat sourceFormat, VTFImageFormat destFormat )
+{
+	if ( destFormat == IMAGE_FORMAT_RGBA8888 )
+		return ToRGBA8888( source, dest, width, height, sourceFormat );
+
+	if ( RunKernel( source, dest, width, height, sourceFormat, destFormat ) )
+		return true;
+
+	return VTFLib::CVTFFile::Convert( const_cast<vlByte *>( source ), dest, width, height, sourceFormat, destFormat );
+}
+
+void PixelConversion::HalfToFloat( const uint16_t *source, float *dest, std::size_t count )
+{
+#ifdef PIXELCONVERSION_X86
+	if ( CurrentSIMDLevel() >= SIMD_AVX2 )
+		return HalfToFloatAVX2( source, dest, count );
+#endif
+	HalfToFloatScalar( source, dest, count );
+}
+
+void PixelConversion::FloatToHalf( const float *source, uint16_t *dest, std::size_t count )
+{
+#ifdef PIXELCONVERSION_X86
+	if ( CurrentSIMDLevel() >= SIMD_AVX2 )
+		return FloatToHalfAVX2( source, dest, count );
+#endif
+	FloatToHalfScalar( source, dest, count );
+}
+
+void PixelConversion::UNorm16ToHalf( const uint16_t *source, uint16_t *dest, std::size_t pixelCount, std::size_t channelCount )
+{
+#ifdef PIXELCONVERSION_X86
+	if ( CurrentSIMDLevel() >= SIMD_AVX2 )
+		return UNorm16ToHalfAVX2( source, dest, pixelCount, channelCount );
+#endif
+	UNorm16ToHalfScalar( source, dest, pixelCount, channelCount );
+}
+
+void PixelConversion::InterleaveAlpha( vlByte *image, const vlByte *alpha, std::size_t pixelCount, std::size_t sampleSize )
+{
+#ifdef PIXELCONVERSION_X86
+	if ( CurrentSIMDLevel() >= SIMD_AVX2 )
+	{
+		switch ( sampleSize )
+		{
+			case 1:
+				return InterleaveAlphaAVX2<1>( image, alpha, pixelCount );
+			case 2:
+				return InterleaveAlphaAVX2<2>( image, alpha, pixelCount );
+			case 4:
+				return InterleaveAlphaAVX2<4>( image, alpha, pixelCount );
+		}
+	}
+#endif
+	InterleaveAlphaScalar( image, alpha, 0, pixelCount, sampleSize );
+}
+
+void PixelConversion::ByteSwap( const vlByte *source, vlByte *dest, std::size_t count, std::size_t sampleSize )
+{
+	if ( sampleSize != 2 && sampleSize != 4 )
+	{
+		if ( source != dest )
+			std::memcpy( dest, source, count * sampleSize );
+		return;
+	}
+
+#ifdef PIXELCONVERSION_X86
+	const SIMDLevel simdLevel = CurrentSIMDLevel();
+	if ( simdLevel >= SIMD_AVX2 )
+		return ByteSwapAVX2( source, dest, count, sampleSize );
+	if ( simdLevel >= SIMD_SSE2 )
+		return ByteSwapSSE2( source, dest, count, sampleSize );
+#endif
+	ByteSwapScalar( source, dest, count, sampleSize );
+}
+
+void PixelConversion::SetLimits( int maxSIMDLevel, std::size_t threads )
+{
+	simdLimit = std::clamp<int>( maxSIMDLevel, SIMD_SCALAR, SIMD_AVX2 );
+	threadLimit = threads;
+}
+
+int PixelConversion::ActiveSIMDLevel()
+{
+	return CurrentSIMDLevel();
+}
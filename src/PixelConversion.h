@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../libs/VTFLib/VTFLib/VTFLib.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Single place for turning VTF image data into pixels Qt can display or save.
+// Formats VTFLib can't decode on its own are handled here, so are the common conversions we have SIMD kernels for.
+// Everything else goes to VTFLib.
+class PixelConversion
+{
+public:
+	PixelConversion() = delete;
+	static bool ToRGBA8888( const vlByte *source, vlByte *dest, vlUInt width, vlUInt height, VTFImageFormat sourceFormat );
+	static bool Convert( const vlByte *source, vlByte *dest, vlUInt width, vlUInt height, VTFImageFormat sourceFormat, VTFImageFormat destFormat );
+
+	// Element wise half <-> float, uses F16C when the CPU has it
+	static void HalfToFloat( const uint16_t *source, float *dest, std::size_t count );
+	static void FloatToHalf( const float *source, uint16_t *dest, std::size_t count );
+
+	// pixelCount pixels of channelCount ( 1 - 4 ) unsigned 16 bit channels -> RGBA16161616F, normalised to 0 - 1.
+	// Channels the source doesn't have become 1.0. Uses F16C when the CPU has it.
+	static void UNorm16ToHalf( const uint16_t *source, uint16_t *dest, std::size_t pixelCount, std::size_t channelCount );
+
+	// image holds pixelCount RGB pixels at the front and has room for RGBA, the alpha plane is merged in place.
+	// sampleSize is the size of one channel in bytes ( 1, 2 or 4 ).
+	static void InterleaveAlpha( vlByte *image, const vlByte *alpha, std::size_t pixelCount, std::size_t sampleSize );
+
+	// Reverses the byte order of count samples of sampleSize bytes ( 2 or 4, anything else is copied as is ).
+	// source and dest may be the same buffer.
+	static void ByteSwap( const vlByte *source, vlByte *dest, std::size_t count, std::size_t sampleSize );
+
+	// For the kernel benchmark. Caps the kernels used ( 0 scalar, 1 SSE2, 2 AVX2 ) and the threads big images are split over, 0 for all of them.
+	// The scalar kernels are the reference the others are checked against. Don't change these while something is converting.
+	static void SetLimits( int maxSIMDLevel, std::size_t threads );
+	// What the kernels run with after the limit
+	static int ActiveSIMDLevel();
+};
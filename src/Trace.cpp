@@ -0,0 +1,120 @@
+#ifdef TRACING
+
+#include "Trace.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent
+{
+	const char *name;
+	int64_t start;
+	int64_t duration;
+};
+
+// Every thread appends to its own list, the lock is only ever contended while End writes
+struct ThreadEvents
+{
+	int id;
+	std::mutex mutex;
+	std::vector<TraceEvent> events;
+};
+
+static std::atomic<bool> recording = false;
+static QString tracePath;
+static std::chrono::steady_clock::time_point epoch;
+
+// Kept past the end of their thread, the pool threads come and go
+static std::mutex threadsMutex;
+static std::vector<std::shared_ptr<ThreadEvents>> threadEvents;
+
+static int64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - epoch ).count();
+}
+
+static ThreadEvents &CurrentThreadEvents()
+{
+	thread_local const std::shared_ptr<ThreadEvents> pEvents = []
+	{
+		std::lock_guard lock( threadsMutex );
+		auto pNew = std::make_shared<ThreadEvents>();
+		pNew->id = static_cast<int>( threadEvents.size() );
+		threadEvents.push_back( pNew );
+		return pNew;
+	}();
+	return *pEvents;
+}
+
+void Trace::Begin( const QString &path )
+{
+	tracePath = path;
+	epoch = std::chrono::steady_clock::now();
+	// Registers this thread first, so it's lane 0
+	CurrentThreadEvents();
+	recording = true;
+}
+
+bool Trace::End()
+{
+	if ( !recording.exchange( false ) )
+		return true;
+
+	QJsonArray events;
+	std::lock_guard threadsLock( threadsMutex );
+	for ( const auto &pThread : threadEvents )
+	{
+		std::lock_guard lock( pThread->mutex );
+		if ( pThread->events.empty() && pThread->id != 0 )
+			continue;
+
+		events.append( QJsonObject {
+			{ "name", "thread_name" },
+			{ "ph", "M" },
+			{ "pid", 1 },
+			{ "tid", pThread->id },
+			{ "args", QJsonObject { { "name", pThread->id == 0 ? QString( "Main" ) : QString( "Worker %1" ).arg( pThread->id ) } } } } );
+
+		// Chrome wants microseconds
+		for ( const auto &event : pThread->events )
+			events.append( QJsonObject {
+				{ "name", event.name },
+				{ "ph", "X" },
+				{ "pid", 1 },
+				{ "tid", pThread->id },
+				{ "ts", event.start / 1000.0 },
+				{ "dur", event.duration / 1000.0 } } );
+		pThread->events.clear();
+	}
+
+	QSaveFile file( tracePath );
+	if ( !file.open( QIODevice::WriteOnly ) )
+		return false;
+	file.write( QJsonDocument( QJsonObject { { "traceEvents", events }, { "displayTimeUnit", "ms" } } ).toJson( QJsonDocument::Compact ) );
+	return file.commit();
+}
+
+Trace::Zone::Zone( const char *name ) :
+	m_pName( name ), m_iStart( recording.load( std::memory_order_relaxed ) ? Now() : -1 )
+{
+}
+
+Trace::Zone::~Zone()
+{
+	if ( m_iStart < 0 )
+		return;
+
+	const int64_t end = Now();
+	auto &thread = CurrentThreadEvents();
+	std::lock_guard lock( thread.mutex );
+	thread.events.push_back( { m_pName, m_iStart, end - m_iStart } );
+}
+
+#endif
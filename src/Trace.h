@@ -0,0 +1,53 @@
+#pragma once
+
+// Scoped timing zones, written out as a Chrome trace ( chrome://tracing or ui.perfetto.dev ) with one lane per thread.
+// Only built with the TRACING option, otherwise TRACE_ZONE is empty and nothing here exists.
+//
+//   void Foo()
+//   {
+//       TRACE_ZONE( "Foo" );
+//       ...
+//   }
+
+#ifdef TRACING
+
+#include <QString>
+
+#include <cstdint>
+
+class Trace
+{
+public:
+	Trace() = delete;
+
+	// Starts recording, the calling thread gets the "Main" lane
+	static void Begin( const QString &path );
+	// Stops recording and writes everything to the path given to Begin. True when nothing was recording.
+	static bool End();
+
+	class Zone
+	{
+	public:
+		// name has to outlive the trace, use string literals
+		explicit Zone( const char *name );
+		~Zone();
+
+		Zone( const Zone & ) = delete;
+		Zone &operator=( const Zone & ) = delete;
+
+	private:
+		const char *m_pName;
+		// -1 when nothing is recording
+		int64_t m_iStart;
+	};
+};
+
+#define TRACE_CONCAT_INNER( a, b ) a##b
+#define TRACE_CONCAT( a, b ) TRACE_CONCAT_INNER( a, b )
+#define TRACE_ZONE( name ) const Trace::Zone TRACE_CONCAT( traceZone, __LINE__ )( name )
+
+#else
+
+#define TRACE_ZONE( name )
+
+#endif
@@ -15,6 +15,8 @@ public:
 	~VTFEImageFormat()
 	{
 		delete[] m_vImageData;
+		foreach( auto mipMap, m_vMipMapLevel )
+			delete mipMap;
 	}
 
 	VTFEImageFormat( vlByte *b, vlUInt width, vlUInt height, vlUInt depth, VTFImageFormat format )
@@ -72,4 +74,21 @@ public:
 	{
 		return !!m_vImageData;
 	}
+
+	// Mips that came with the source ( DDS ), level 1 is the first one below this image. Takes ownership.
+	void addMipMap( VTFEImageFormat *mipMap )
+	{
+		m_vMipMapLevel[m_vMipMapLevel.size() + 1] = mipMap;
+	}
+
+	// Including this image, so 1 when the source had no mips
+	int getMipMapCount()
+	{
+		return m_vMipMapLevel.size() + 1;
+	}
+
+	VTFEImageFormat *getMipMap( int level )
+	{
+		return level == 0 ? this : m_vMipMapLevel.value( level, nullptr );
+	}
 };
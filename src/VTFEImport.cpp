@@ -3,10 +3,16 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "../libs/stb/stb_image.h"
+#include "AuxCompression.h"
+#include "ImageDecoders.h"
 #include "ImageSettingsWidget.h"
 #include "MainWindow.h"
+#include "MappedFile.h"
+#include "PixelConversion.h"
+#include "Trace.h"
 #include "flagsandformats.hpp"
-#include "supported_formats/TiffSupport.h"
+#include "supported_formats/BCnSupport.h"
+#include "util.hpp"
 
 #include <QAction>
 #include <QApplication>
@@ -19,28 +25,195 @@
 #include <QGroupBox>
 #include <QLabel>
 #include <QMessageBox>
+#include <QMutex>
+#include <QProgressBar>
 #include <QPushButton>
 #include <QTabWidget>
+#include <QTimer>
+#include <algorithm>
 #include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Above this much decoded data a multi image import keeps its frames as paths and streams them into GenerateVTF
+static constexpr std::size_t LAZY_FRAME_BUDGET = 256 * 1024 * 1024;
+
+// Whether a format can be picked in the format combos
+static bool IsSelectableFormat( VTFImageFormat format )
+{
+#ifdef CHAOS_INITIATIVE
+	// Encoded by BCnSupport, not VTFLib
+	if ( format == IMAGE_FORMAT_BC7 || format == IMAGE_FORMAT_BC6H )
+		return true;
+#endif
+	return VTFLib::CVTFFile::GetImageFormatInfo( format ).bIsSupported;
+}
+
+// An empty file laid out like pSource with its settings copied over, for filling in one surface at a time
+static VTFLib::CVTFFile *CreateEmptyLike( VTFLib::CVTFFile *pSource, vlUInt frames, VTFImageFormat format, bool thumbnail )
+{
+	auto pFile = new VTFLib::CVTFFile;
+	if ( !pFile->Create( pSource->GetWidth(), pSource->GetHeight(), frames, pSource->GetFaceCount(), pSource->GetDepth(), format, thumbnail, pSource->GetMipmapCount() > 1, vlTrue ) )
+	{
+		delete pFile;
+		return nullptr;
+	}
+
+	pFile->SetVersion( pSource->GetMajorVersion(), pSource->GetMinorVersion() );
+	pFile->SetStartFrame( pSource->GetStartFrame() );
+	pFile->SetBumpmapScale( pSource->GetBumpmapScale() );
+
+	for ( vlUInt i = 0; i < 32; i++ )
+		if ( pSource->GetFlags() & ( 1u << i ) )
+			pFile->SetFlag( static_cast<VTFImageFlag>( 1u << i ), true );
+
+	return pFile;
+}
+
+#ifdef CHAOS_INITIATIVE
+// VTFLib can't encode BC7 / BC6H.
+// pSource is created as RGBA8888 ( BC7 ) or RGBA16161616F ( BC6H ) and every surface of it is encoded into a new file.
+static VTFLib::CVTFFile *EncodeBCn( VTFLib::CVTFFile *pSource, VTFImageFormat format, const BCnEncodeOptions &options )
+{
+	TRACE_ZONE( "GenerateVTF/compress" );
+	auto pFile = CreateEmptyLike( pSource, pSource->GetFrameCount(), format, pSource->GetHasThumbnail() );
+	if ( !pFile )
+		return nullptr;
+
+	vlSingle r, g, b;
+	pSource->GetReflectivity( r, g, b );
+	pFile->SetReflectivity( r, g, b );
+
+	if ( pSource->GetHasThumbnail() )
+		pFile->SetThumbnailData( pSource->GetThumbnailData() );
+
+	std::vector<uint8_t> blocks;
+	for ( vlUInt mip = 0; mip < pSource->GetMipmapCount(); mip++ )
+	{
+		vlUInt width, height, depth;
+		VTFLib::CVTFFile::ComputeMipmapDimensions( pSource->GetWidth(), pSource->GetHeight(), pSource->GetDepth(), mip, width, height, depth );
+		blocks.resize( BCnSupport::ComputeBlockDataSize( width, height ) );
+
+		for ( vlUInt frame = 0; frame < pSource->GetFrameCount(); frame++ )
+			for ( vlUInt face = 0; face < pSource->GetFaceCount(); face++ )
+				for ( vlUInt slice = 0; slice < depth; slice++ )
+				{
+					const vlByte *pData = pSource->GetData( frame, face, slice, mip );
+					const bool bEncoded = format == IMAGE_FORMAT_BC7 ? BCnSupport::Encode_BC7( pData, width, height, blocks.data(), options ) :
+																	   BCnSupport::Encode_BC6H( reinterpret_cast<const uint16_t *>( pData ), width, height, blocks.data(), options );
+					if ( !bEncoded )
+					{
+						delete pFile;
+						return nullptr;
+					}
+					pFile->SetData( frame, face, slice, mip, blocks.data() );
+				}
+	}
+
+	return pFile;
+}
+#endif
+
+static bool IsBlockCompressed( VTFImageFormat format )
+{
+#ifdef CHAOS_INITIATIVE
+	if ( format == IMAGE_FORMAT_BC7 || format == IMAGE_FORMAT_BC6H )
+		return true;
+#endif
+	return format != IMAGE_FORMAT_NONE && VTFLib::CVTFFile::GetImageFormatInfo( format ).bIsCompressed;
+}
+
+// Block compressed sources ( DDS ) that already are in the target format can be copied in as they are.
+// Only when nothing has to touch the pixels: no resize, no gamma correction and the source brings every mip we need.
+static bool CanCopyBlocks( const QMap<int, VTFEImageFormat *> &images, const SVTFCreateOptions &options, int slices )
+{
+	const VTFImageFormat format = options.ImageFormat;
+	if ( !IsBlockCompressed( format ) || options.bGammaCorrection || options.bSphereMap )
+		return false;
+
+	const vlUInt width = images[0]->getWidth();
+	const vlUInt height = images[0]->getHeight();
+	if ( options.bResize && !( VTFEImport::IsPowerOfTwo( width ) && VTFEImport::IsPowerOfTwo( height ) &&
+							   ( !options.bResizeClamp || ( width <= options.uiResizeClampWidth && height <= options.uiResizeClampHeight ) ) ) )
+		return false;
+
+	// Volume mips shrink in depth too, the per slice mips of the sources don't cover that
+	const int mipCount = options.bMipmaps ? VTFLib::CVTFFile::ComputeMipmapCount( width, height, 1 ) : 1;
+	if ( mipCount > 1 && slices > 1 )
+		return false;
+
+	for ( auto image : images )
+		if ( image->getFormat() != format || image->getWidth() != width || image->getHeight() != height || image->getMipMapCount() < mipCount )
+			return false;
+
+	return true;
+}
+
+static VTFLib::CVTFFile *CreateFromBlocks( const QMap<int, VTFEImageFormat *> &images, int frames, int faces, int slices, const SVTFCreateOptions &options )
+{
+	auto pFile = new VTFLib::CVTFFile;
+	if ( !pFile->Create( images[0]->getWidth(), images[0]->getHeight(), frames, faces, slices, options.ImageFormat, options.bThumbnail, options.bMipmaps, vlTrue ) )
+	{
+		delete pFile;
+		return nullptr;
+	}
+
+	// What Create sets from the options as well
+	pFile->SetVersion( options.uiVersion[0], options.uiVersion[1] );
+	pFile->SetStartFrame( options.uiStartFrame );
+	pFile->SetBumpmapScale( options.sBumpScale );
+	for ( vlUInt i = 0; i < 32; i++ )
+		if ( options.uiFlags & ( 1u << i ) )
+			pFile->SetFlag( static_cast<VTFImageFlag>( 1u << i ), true );
+
+	// Same mapping as the regular path, the images are frames, faces or slices depending on the type
+	for ( int i = 0; i < images.size(); i++ )
+		for ( vlUInt mip = 0; mip < pFile->GetMipmapCount(); mip++ )
+			pFile->SetData( frames > 1 ? i : 0, faces > 1 ? i : 0, slices > 1 ? i : 0, mip, images[i]->getMipMap( mip )->getData() );
+
+	if ( options.bReflectivity )
+		pFile->ComputeReflectivity();
+	else
+		pFile->SetReflectivity( options.sReflectivity[0], options.sReflectivity[1], options.sReflectivity[2] );
+
+	if ( options.bThumbnail )
+		pFile->GenerateThumbnail();
+
+	return pFile;
+}
 
 VTFEImport::VTFEImport( QWidget *pParent, const QString &filePath, bool &hasData ) :
 	QDialog( pParent )
 {
-	hasData = true;
-
 	AddImage( filePath );
+	InitializeSingleImage( hasData );
+}
 
-	if ( imageList.isEmpty() )
-	{
-		hasData = false;
+VTFEImport::VTFEImport( QWidget *pParent, const vlByte *pData, std::size_t size, bool &hasData ) :
+	QDialog( pParent )
+{
+	AddImage( pData, size );
+	InitializeSingleImage( hasData );
+}
+
+void VTFEImport::InitializeSingleImage( bool &hasData )
+{
+	hasData = !imageList.isEmpty();
+	if ( !hasData )
 		return;
-	}
 
 	SetDefaults();
 
 	InitializeWidgets();
 
 	pGeneralTab->pFormatCombo->setCurrentIndex( pGeneralTab->pFormatCombo->findData( imageList[0]->getFormat() ) );
+
+	// Keep block compressed sources in their format, with alpha or not, so they can be copied over as they are
+	if ( IsBlockCompressed( imageList[0]->getFormat() ) )
+		pGeneralTab->pAlphaDetectedFormatCombo->setCurrentIndex( pGeneralTab->pAlphaDetectedFormatCombo->findData( imageList[0]->getFormat() ) );
+
+	ApplySourceHints();
 }
 
 VTFEImport::VTFEImport( QWidget *pParent, const QStringList &filePaths, bool &hasData ) :
@@ -48,8 +221,20 @@ VTFEImport::VTFEImport( QWidget *pParent, const QStringList &filePaths, bool &ha
 {
 	hasData = true;
 
-	for ( int i = 0; i < filePaths.count(); i++ )
-		AddImage( filePaths[i] );
+	// The first image is decoded here so the widgets can be set up from it, everything after it decodes on the pool.
+	// Only when that one fails do we have to wait for the rest before the dialog can show.
+	if ( !filePaths.isEmpty() )
+		AddImage( filePaths[0] );
+
+	// Long animations would need gigabytes decoded, those frames stay as paths until GenerateVTF streams them in
+	if ( imageList.size() == 1 && !IsBlockCompressed( imageList[0]->getFormat() ) &&
+		 static_cast<std::size_t>( imageList[0]->getSize() ) * filePaths.size() > LAZY_FRAME_BUDGET )
+		frameSources = filePaths.mid( 1 );
+	else
+		StartDecoding( filePaths );
+
+	if ( imageList.isEmpty() )
+		FinishDecoding();
 
 	if ( imageList.isEmpty() )
 	{
@@ -63,6 +248,105 @@ VTFEImport::VTFEImport( QWidget *pParent, const QStringList &filePaths, bool &ha
 
 	pGeneralTab->pFormatCombo->setCurrentIndex( pGeneralTab->pFormatCombo->findData( imageList[0]->getFormat() ) );
 	pGeneralTab->pAlphaDetectedFormatCombo->setCurrentIndex( pGeneralTab->pAlphaDetectedFormatCombo->findData( imageList[0]->getFormat() ) );
+
+	ApplySourceHints();
+
+	if ( decodedCount < static_cast<int>( pendingImages.size() ) )
+		ShowDecodeProgress();
+}
+
+VTFEImport::~VTFEImport()
+{
+	// Workers write into pendingImages, they have to be gone first
+	decodePool.waitForDone();
+	for ( auto &decoded : pendingImages )
+		for ( auto pImage : decoded.images )
+			delete pImage;
+
+	foreach( auto imageFormat, imageList )
+		delete imageFormat;
+}
+
+static bool DecodeFile( const QString &filePath, DecodedImages &decoded )
+{
+	TRACE_ZONE( "DecodeFile" );
+	MappedFile file;
+	if ( !file.Open( filePath.toUtf8().constData() ) )
+		return false;
+
+	return ImageDecoders::Decode( file.Data(), file.Size(), decoded );
+}
+
+void VTFEImport::StartDecoding( const QStringList &filePaths )
+{
+	// Every file gets its own slot, so the frame order doesn't depend on which worker finishes first
+	pendingImages.resize( filePaths.size() );
+	decodedCount = filePaths.isEmpty() ? 0 : 1;
+
+	for ( int i = 1; i < filePaths.size(); i++ )
+	{
+		decodePool.start( [this, filePath = filePaths[i], &decoded = pendingImages[i]]
+						  {
+							  DecodeFile( filePath, decoded );
+							  decodedCount++;
+						  } );
+	}
+}
+
+void VTFEImport::FinishDecoding()
+{
+	if ( pendingImages.empty() )
+		return;
+
+	decodePool.waitForDone();
+
+	for ( auto &decoded : pendingImages )
+		AddDecodedImages( decoded );
+	pendingImages.clear();
+}
+
+void VTFEImport::ShowDecodeProgress()
+{
+	pDecodeProgress = new QProgressBar( this );
+	pDecodeProgress->setMinimum( 0 );
+	pDecodeProgress->setMaximum( static_cast<int>( pendingImages.size() ) );
+	pDecodeProgress->setValue( decodedCount );
+	pDecodeProgress->setTextVisible( true );
+	pDecodeProgress->setFormat( tr( "Decoding images: %v / %m" ) );
+	static_cast<QGridLayout *>( layout() )->addWidget( pDecodeProgress, 2, 0, 1, 2 );
+
+	// Nothing can be generated until every frame is in
+	pAcceptButton->setDisabled( true );
+	pPreviewButton->setDisabled( true );
+
+	auto pTimer = new QTimer( this );
+	connect( pTimer, &QTimer::timeout, this, [this, pTimer]
+			 {
+				 pDecodeProgress->setValue( decodedCount );
+				 if ( decodedCount < static_cast<int>( pendingImages.size() ) )
+					 return;
+
+				 pTimer->stop();
+				 pTimer->deleteLater();
+				 FinishDecoding();
+				 ApplySourceHints();
+				 pDecodeProgress->hide();
+				 pAcceptButton->setEnabled( true );
+				 pPreviewButton->setEnabled( true );
+			 } );
+	pTimer->start( 50 );
+}
+
+void VTFEImport::ApplySourceHints()
+{
+	if ( bSourceIsCubemap )
+	{
+		pGeneralTab->pTypeCombo->setCurrentIndex( 1 );
+		pGeneralTab->pTypeCombo->currentTextChanged( QString::number( 1 ) );
+	}
+
+	if ( bSourceIsSRGB )
+		pGeneralTab->pSRGBCheckbox->setChecked( true );
 }
 
 void VTFEImport::SetDefaults()
@@ -83,140 +367,133 @@ void VTFEImport::SetDefaults()
 
 void VTFEImport::AddImage( const QString &qString )
 {
-	const char *file = qString.toUtf8().constData();
-
-	if ( qString.endsWith( ".tif" ) || qString.endsWith( ".tiff" ) )
-	{
-		//		ImageData_t data;
-		//		memset( &data, 0, sizeof( ImageData_t ) );
-		//		TiffSupport::Load_TIFF( file, &data );
-		//
-		//		//		if ( !data.bValidImageData )
-		//		//			return;
-		//
-		//		tagVTFImageFormat format = IMAGE_FORMAT_NONE;
-		//		int totalDataSize = data.nImageWidth * data.nImageHeight * data.nBitCountPerChannel * data.nCountChannels;
-		//
-		//		auto dat = std::vector<std::byte> {};
-		//		dat.resize( totalDataSize );
-		//
-		//		switch ( data.nBitCountPerChannel )
-		//		{
-		//			case 8:
-		//				format = data.bHasAlpha ? IMAGE_FORMAT_RGBA8888 : IMAGE_FORMAT_RGB888;
-		//				memcpy( dat.data(), data.pImageData, totalDataSize );
-		//				break;
-		//			case 16:
-		//				format = IMAGE_FORMAT_RGBA16161616F;
-		//				if ( !data.bHasAlpha )
-		//				{
-		//					auto tempBuff = std::vector<uint16_t> {};
-		//					// RGB16F does not exist in source, we are forced to upgrade to RGBA16F.
-		//					for ( int i = 0; i < totalDataSize; i += 3 )
-		//					{
-		//						tempBuff.push_back( data.pImageData16f[i] );
-		//						tempBuff.push_back( data.pImageData16f[i + 1] );
-		//						tempBuff.push_back( data.pImageData16f[i + 2] );
-		//						tempBuff.push_back( 65535 ); // Alpha set to max.
-		//					}
-		//					memcpy( dat.data(), tempBuff.data(), totalDataSize );
-		//				}
-		//				else
-		//				{
-		//					memcpy( dat.data(), data.pImageData16f, totalDataSize );
-		//				}
-		//				break;
-		//			case 32:
-		//				format = data.bHasAlpha ? IMAGE_FORMAT_RGBA32323232F : IMAGE_FORMAT_RGB323232F;
-		//				memcpy( dat.data(), data.pImageData32f, totalDataSize );
-		//				break;
-		//			default:
-		//				return;
-		//		}
-
-		TIFFFile tiffFIle;
-
-		bool success = TiffSupport::Load_TIFF( file, tiffFIle );
-
-		if ( !success || !tiffFIle.isValid )
-			return;
-
-		tagVTFImageFormat format = IMAGE_FORMAT_NONE;
-		switch ( tiffFIle.type )
-		{
-			case 8:
-				format = tiffFIle.hasAlpha ? IMAGE_FORMAT_RGBA8888 : IMAGE_FORMAT_RGB888;
-				break;
-			case 16:
-				format = IMAGE_FORMAT_RGBA16161616F;
-				//				{
-				//					std::vector<short> tempSHRTData;
-				//					std::vector<short> tempSHRTAlphaData {};
-				//					//					tempSHRTData.resize( tiffFIle.imageData.size() );
-				//					int newsize = tiffFIle.imageData.size() * 1.3;
-				//					//					tempSHRTAlphaData.resize( newsize );
-				//
-				//					memcpy( tempSHRTData.data(), tiffFIle.imageData.data(), tiffFIle.imageData.size() );
-				//
-				//					for ( auto it = tempSHRTData.begin(); it != tempSHRTData.end(); it += 3 )
-				//					{
-				//						tempSHRTAlphaData.push_back( 32767 );
-				//						tempSHRTAlphaData.push_back( 32767 );
-				//						tempSHRTAlphaData.push_back( 32767 );
-				//						tempSHRTAlphaData.push_back( 32767 );
-				//					}
-				//
-				//					tiffFIle.imageData = std::vector<std::byte>();
-				//					tiffFIle.imageData.resize( newsize );
-				//					memcpy( tiffFIle.imageData.data(), tempSHRTAlphaData.data(), newsize );
-				//				}
-				break;
-			case 32:
-				format = tiffFIle.hasAlpha ? IMAGE_FORMAT_RGBA32323232F : IMAGE_FORMAT_RGB323232F;
-				break;
-			default:
-				return;
-		}
-
-		imageList[imageList.size()] = new VTFEImageFormat(
-			reinterpret_cast<vlByte *>( tiffFIle.imageData.data() ), tiffFIle.width, tiffFIle.height, 0, format );
-		return;
-	}
+	TRACE_ZONE( "AddImage" );
+	DecodedImages decoded;
+	if ( DecodeFile( qString, decoded ) )
+		AddDecodedImages( decoded );
+}
 
-	int x, y, n;
+void VTFEImport::AddImage( const vlByte *pData, std::size_t size )
+{
+	TRACE_ZONE( "AddImage" );
+	DecodedImages decoded;
+	if ( ImageDecoders::Decode( pData, size, decoded ) )
+		AddDecodedImages( decoded );
+}
 
-	if ( !stbi_is_hdr( file ) )
-	{
-		vlByte *data = stbi_load( file, &x, &y, &n, 4 );
+void VTFEImport::LoadFrameSources()
+{
+	for ( const auto &filePath : frameSources )
+		AddImage( filePath );
+	frameSources.clear();
+}
 
-		if ( !data )
-			return;
+void VTFEImport::AddDecodedImages( DecodedImages &decoded )
+{
+	for ( auto pImage : decoded.images )
+		imageList[imageList.size()] = pImage;
+	decoded.images.clear();
 
-		imageList[imageList.size()] = new VTFEImageFormat(
-			data, x, y, 0, IMAGE_FORMAT_RGBA8888 );
+	bSourceIsCubemap = bSourceIsCubemap || decoded.isCubemap;
+	bSourceIsSRGB = bSourceIsSRGB || decoded.isSRGB;
+}
 
-		stbi_image_free( data );
-	}
+// The copy of an image that goes to Create, in the format Create is told the data is in
+static vlByte *ConvertForCreate( VTFEImageFormat *pImage, VTFImageFormat format )
+{
+	TRACE_ZONE( "GenerateVTF/convert" );
+	auto pData = new vlByte[VTFLib::CVTFFile::ComputeImageSize( pImage->getWidth(), pImage->getHeight(), 1, format )];
+	if ( pImage->getFormat() == format )
+		memcpy( pData, pImage->getData(), pImage->getSize() );
 	else
+		PixelConversion::Convert( pImage->getData(), pData, pImage->getWidth(), pImage->getHeight(), pImage->getFormat(), format );
+	return pData;
+}
+
+// Long animations: the first frame is decoded already, the others are only paths.
+// They are decoded and converted a window at a time, every window goes through Create on its own and is copied into the output.
+// So next to the output there's never more than a window of frames in memory, however many there are.
+static VTFLib::CVTFFile *CreateFromFrameSources( VTFEImageFormat *pFirst, const QStringList &sources, SVTFCreateOptions options, VTFImageFormat createFormat )
+{
+	const vlUInt width = pFirst->getWidth();
+	const vlUInt height = pFirst->getHeight();
+	const std::size_t frameCount = sources.size() + 1;
+	const std::size_t windowSize = std::max( 1u, std::thread::hardware_concurrency() );
+
+	// These need every frame, they're done on the output at the end
+	const bool bThumbnail = options.bThumbnail;
+	const bool bReflectivity = options.bReflectivity;
+	options.bThumbnail = false;
+	options.bReflectivity = false;
+
+	VTFLib::CVTFFile *pFile = nullptr;
+	std::vector<vlByte *> window;
+	for ( std::size_t start = 0; start < frameCount; start += windowSize )
 	{
-		float *data = stbi_loadf( file, &x, &y, &n, 0 );
+		window.assign( std::min( windowSize, frameCount - start ), nullptr );
+		util::parallel_for( window.size(), [&]( std::size_t i )
+							{
+								if ( start + i == 0 )
+								{
+									window[i] = ConvertForCreate( pFirst, createFormat );
+									return;
+								}
+
+								// Create takes the frames as one block, they all have to be the size of the first one
+								DecodedImages decoded;
+								if ( DecodeFile( sources[static_cast<int>( start + i - 1 )], decoded ) && decoded.images.size() == 1 &&
+									 decoded.images[0]->getWidth() == width && decoded.images[0]->getHeight() == height )
+									window[i] = ConvertForCreate( decoded.images[0], createFormat );
+
+								for ( auto pImage : decoded.images )
+									delete pImage;
+							} );
+
+		TRACE_ZONE( "GenerateVTF/create window" );
+		auto pWindowFile = new VTFLib::CVTFFile;
+		bool bResult = std::find( window.begin(), window.end(), nullptr ) == window.end() &&
+					   pWindowFile->Create( width, height, static_cast<vlUInt>( window.size() ), 1, 1, window.data(), options, createFormat );
+
+		for ( auto pData : window )
+			delete[] pData;
+
+		// The first window decides the size, format and mips after resizing
+		if ( bResult && !pFile )
+			bResult = ( pFile = CreateEmptyLike( pWindowFile, static_cast<vlUInt>( frameCount ), pWindowFile->GetFormat(), bThumbnail ) ) != nullptr;
 
-		if ( !data )
-			return;
+		if ( !bResult )
+		{
+			delete pWindowFile;
+			delete pFile;
+			return nullptr;
+		}
 
-		auto convertedData = reinterpret_cast<vlByte *>( data );
+		for ( vlUInt frame = 0; frame < pWindowFile->GetFrameCount(); frame++ )
+			for ( vlUInt mip = 0; mip < pWindowFile->GetMipmapCount(); mip++ )
+				pFile->SetData( static_cast<vlUInt>( start ) + frame, 0, 0, mip, pWindowFile->GetData( frame, 0, 0, mip ) );
 
-		tagVTFImageFormat format = n > 3 ? IMAGE_FORMAT_RGBA32323232F : IMAGE_FORMAT_RGB323232F;
+		delete pWindowFile;
+	}
 
-		imageList[imageList.size()] = new VTFEImageFormat(
-			convertedData, x, y, 0, format );
+	// CreateEmptyLike doesn't carry the reflectivity over from the windows
+	if ( bReflectivity )
+		pFile->ComputeReflectivity();
+	else
+		pFile->SetReflectivity( options.sReflectivity[0], options.sReflectivity[1], options.sReflectivity[2] );
 
-		stbi_image_free( data );
-	}
+	if ( bThumbnail )
+		pFile->GenerateThumbnail();
+
+	return pFile;
 }
 
 VTFLib::CVTFFile *VTFEImport::GenerateVTF( VTFErrorType &err )
 {
+	TRACE_ZONE( "GenerateVTF" );
+
+	// Normally done already, the accept button waits for it
+	FinishDecoding();
+
 	if ( imageList.isEmpty() )
 	{
 		err = VTFErrorType::NO_DATA;
@@ -260,21 +537,39 @@ VTFLib::CVTFFile *VTFEImport::GenerateVTF( VTFErrorType &err )
 		VTFCreateOptions.uiFlags = vtfImageFlags;
 	}
 
-	auto pFFSArray = new vlByte *[imageList.size()];
+	// Lazy frames can only be streamed into an animation, anything else needs every image decoded up front
+	if ( !frameSources.isEmpty() && pGeneralTab->pTypeCombo->currentIndex() != 0 )
+		LoadFrameSources();
 
-	for ( int i = 0; i < imageList.size(); i++ )
+	int frames = pGeneralTab->pTypeCombo->currentIndex() == 0 ? imageList.size() + frameSources.size() : 1;
+	int faces = pGeneralTab->pTypeCombo->currentIndex() == 1 ? imageList.size() : 1;
+	int slices = pGeneralTab->pTypeCombo->currentIndex() == 2 ? imageList.size() : 1;
+
+	// No decode and re-encode for sources that already are what we want, it's faster and doesn't lose quality
+	const bool bCopyBlocks = CanCopyBlocks( imageList, VTFCreateOptions, slices );
+
+#ifdef CHAOS_INITIATIVE
+	// BC7 / BC6H are created uncompressed first and encoded by EncodeBCn after
+	const VTFImageFormat targetFormat = VTFCreateOptions.ImageFormat;
+	if ( !bCopyBlocks && targetFormat == IMAGE_FORMAT_BC7 )
+		VTFCreateOptions.ImageFormat = IMAGE_FORMAT_RGBA8888;
+	else if ( !bCopyBlocks && targetFormat == IMAGE_FORMAT_BC6H )
+		VTFCreateOptions.ImageFormat = IMAGE_FORMAT_RGBA16161616F;
+#endif
+
+	auto pFFSArray = new vlByte *[imageList.size()]();
+
+	// Float sources going to RGBA16161616F are narrowed to half here instead of one value at a time in VTFLib
+	const VTFImageFormat sourceFormat = imageList[0]->getFormat();
+	const bool bNarrowToHalf = VTFCreateOptions.ImageFormat == IMAGE_FORMAT_RGBA16161616F && ( sourceFormat == IMAGE_FORMAT_RGBA32323232F || sourceFormat == IMAGE_FORMAT_RGB323232F );
+	// Everything that isn't going to a float format is handed to VTFLib as RGBA8888
+	const bool bToRGBA8888 = !( VTFCreateOptions.ImageFormat == IMAGE_FORMAT_RGBA32323232F || VTFCreateOptions.ImageFormat == IMAGE_FORMAT_RGB323232F || VTFCreateOptions.ImageFormat == IMAGE_FORMAT_RGBA16161616F || VTFCreateOptions.ImageFormat == IMAGE_FORMAT_R32F );
+
+	const VTFImageFormat createFormat = bToRGBA8888 ? IMAGE_FORMAT_RGBA8888 : bNarrowToHalf ? IMAGE_FORMAT_RGBA16161616F : sourceFormat;
+
+	for ( int i = 0; i < imageList.size() && !bCopyBlocks && frameSources.isEmpty(); i++ )
 	{
-		vlByte *imgData;
-		if ( !( VTFCreateOptions.ImageFormat == IMAGE_FORMAT_RGBA32323232F || VTFCreateOptions.ImageFormat == IMAGE_FORMAT_RGB323232F || VTFCreateOptions.ImageFormat == IMAGE_FORMAT_RGBA16161616F || VTFCreateOptions.ImageFormat == IMAGE_FORMAT_R32F ) )
-		{
-			imgData = new vlByte[VTFLib::CVTFFile::ComputeImageSize( imageList[i]->getWidth(), imageList[i]->getHeight(), 1, IMAGE_FORMAT_RGBA8888 )];
-			VTFLib::CVTFFile::Convert( imageList[i]->getData(), imgData, imageList[i]->getWidth(), imageList[i]->getHeight(), imageList[i]->getFormat(), IMAGE_FORMAT_RGBA8888 );
-		}
-		else
-		{
-			imgData = new vlByte[imageList[i]->getSize()];
-			memcpy( imgData, imageList[i]->getData(), imageList[i]->getSize() );
-		}
+		vlByte *imgData = ConvertForCreate( imageList[i], createFormat );
 
 #ifdef COLOR_CORRECTION
 		for ( int s = 0; s < images_[i]->getSize(); s += 4 )
@@ -314,16 +609,38 @@ VTFLib::CVTFFile *VTFEImport::GenerateVTF( VTFErrorType &err )
 		pFFSArray[i] = const_cast<vlByte *>( imgData );
 	}
 
-	int frames = pGeneralTab->pTypeCombo->currentIndex() == 0 ? imageList.size() : 1;
-	int faces = pGeneralTab->pTypeCombo->currentIndex() == 1 ? imageList.size() : 1;
-	int slices = pGeneralTab->pTypeCombo->currentIndex() == 2 ? imageList.size() : 1;
-
-	if ( !vFile->Create( imageList[0]->getWidth(), imageList[0]->getHeight(), frames, faces, slices, pFFSArray, VTFCreateOptions, imageList[0]->getFormat() ) )
 	{
-		err = VTFErrorType::INVALID_IMAGE;
-		delete vFile;
-		return nullptr;
-	};
+		// VTFLib resizes, builds the mips and compresses all inside Create, so that's one zone
+		TRACE_ZONE( "GenerateVTF/create" );
+		if ( bCopyBlocks )
+		{
+			delete vFile;
+			vFile = CreateFromBlocks( imageList, frames, faces, slices, VTFCreateOptions );
+			if ( !vFile )
+			{
+				delete[] pFFSArray;
+				err = VTFErrorType::INVALID_IMAGE;
+				return nullptr;
+			}
+		}
+		else if ( !frameSources.isEmpty() )
+		{
+			delete vFile;
+			vFile = CreateFromFrameSources( imageList[0], frameSources, VTFCreateOptions, createFormat );
+			if ( !vFile )
+			{
+				delete[] pFFSArray;
+				err = VTFErrorType::INVALID_IMAGE;
+				return nullptr;
+			}
+		}
+		else if ( !vFile->Create( imageList[0]->getWidth(), imageList[0]->getHeight(), frames, faces, slices, pFFSArray, VTFCreateOptions, createFormat ) )
+		{
+			err = VTFErrorType::INVALID_IMAGE;
+			delete vFile;
+			return nullptr;
+		}
+	}
 
 	vFile->SetFlag( VTFImageFlag::TEXTUREFLAGS_SRGB, VTFCreateOptions.bSRGB );
 
@@ -334,8 +651,33 @@ VTFLib::CVTFFile *VTFEImport::GenerateVTF( VTFErrorType &err )
 		return nullptr;
 	}
 
+#ifdef CHAOS_INITIATIVE
+	if ( targetFormat != VTFCreateOptions.ImageFormat )
+	{
+		BCnEncodeOptions encodeOptions;
+		encodeOptions.speed = static_cast<BCnSpeedPreset>( pAdvancedTab->pBCnSpeedBox->currentData().toInt() );
+		encodeOptions.multithreaded = pAdvancedTab->pBCnMultithreadedCheckBox->isChecked();
+
+		auto pEncodedFile = EncodeBCn( vFile, targetFormat, encodeOptions );
+		delete vFile;
+		VTFCreateOptions.ImageFormat = targetFormat;
+
+		if ( !pEncodedFile )
+		{
+			for ( int i = 0; i < imageList.size(); i++ )
+				delete[] pFFSArray[i];
+			delete[] pFFSArray;
+
+			err = VTFErrorType::INVALID_IMAGE;
+			return nullptr;
+		}
+		vFile = pEncodedFile;
+	}
+#endif
+
 	if ( vFile->GetSupportsResources() )
 	{
+		TRACE_ZONE( "GenerateVTF/resources" );
 		bool bResult = true;
 
 		if ( pResourceTab->pLodControlResourceCheckBox->isChecked() )
@@ -421,7 +763,7 @@ VTFLib::CVTFFile *VTFEImport::GenerateVTF( VTFErrorType &err )
 			new vlByte[vFile->ComputeImageSize( vFile->GetWidth(), vFile->GetHeight(), 1, IMAGE_FORMAT_RGBA32323232F )];
 
 		// Get the frame's image data.
-		if ( !vFile->Convert(
+		if ( !PixelConversion::Convert(
 				 lpData, lpSource, vFile->GetWidth(), vFile->GetHeight(), vFile->GetFormat(),
 				 IMAGE_FORMAT_RGBA32323232F ) )
 		{
@@ -438,7 +780,7 @@ VTFLib::CVTFFile *VTFEImport::GenerateVTF( VTFErrorType &err )
 		// vFile->GetWidth(), vFile->GetHeight());
 
 		// Set the frame's image data.
-		if ( !vFile->Convert(
+		if ( !PixelConversion::Convert(
 				 lpSource /*lpDest*/, lpDest, vFile->GetWidth(), vFile->GetHeight(), IMAGE_FORMAT_RGBA32323232F,
 				 vFile->GetFormat() ) )
 		{
@@ -494,7 +836,7 @@ void VTFEImport::InitializeWidgets()
 	widget->addTab( pAdvancedTab, tr( "Advanced" ) );
 	widget->addTab( pResourceTab, tr( "Resource" ) );
 	vBLayout->addWidget( widget, 0, 0, 1, 2 );
-	auto pPreviewButton = new QPushButton( this );
+	pPreviewButton = new QPushButton( this );
 	pPreviewButton->setText( tr( "Preview" ) );
 	connect(
 		pPreviewButton, &QPushButton::pressed,
@@ -567,10 +909,10 @@ void VTFEImport::InitializeWidgets()
 	vBLayout->addWidget( pPreviewButton, 1, 0, Qt::AlignLeft );
 
 	auto blayoutBox = new QDialogButtonBox( this );
-	auto accept = blayoutBox->addButton( "Accept", QDialogButtonBox::AcceptRole );
+	pAcceptButton = blayoutBox->addButton( "Accept", QDialogButtonBox::AcceptRole );
 	auto cancelled = blayoutBox->addButton( "Cancel", QDialogButtonBox::RejectRole );
 	connect(
-		accept, &QPushButton::pressed,
+		pAcceptButton, &QPushButton::pressed,
 		[this]
 		{
 			isCancelled = false;
@@ -608,6 +950,25 @@ VTFEImport *VTFEImport::FromVTF( QWidget *pParent, VTFLib::CVTFFile *pFile )
 		vlUInt faces = type == 1 ? i : 0;
 		vlUInt slices = type == 2 ? i : 0;
 
+#ifdef CHAOS_INITIATIVE
+		// VTFLib can't convert from BC7 / BC6H, keep a decoded copy instead
+		if ( pFile->GetFormat() == IMAGE_FORMAT_BC7 || pFile->GetFormat() == IMAGE_FORMAT_BC6H )
+		{
+			const bool bIsHDR = pFile->GetFormat() == IMAGE_FORMAT_BC6H;
+			std::vector<uint16_t> decoded( (std::size_t)pFile->GetWidth() * pFile->GetHeight() * ( bIsHDR ? 4 : 2 ) );
+			auto pDecoded = reinterpret_cast<vlByte *>( decoded.data() );
+
+			if ( bIsHDR )
+				BCnSupport::Decode_BC6H( pFile->GetData( frames, faces, slices, 0 ), pFile->GetWidth(), pFile->GetHeight(), decoded.data() );
+			else
+				BCnSupport::Decode_BC7( pFile->GetData( frames, faces, slices, 0 ), pFile->GetWidth(), pFile->GetHeight(), pDecoded );
+
+			vVTFImport->imageList[vVTFImport->imageList.size()] =
+				new VTFEImageFormat( pDecoded, pFile->GetWidth(), pFile->GetHeight(), pFile->GetDepth(), bIsHDR ? IMAGE_FORMAT_RGBA16161616F : IMAGE_FORMAT_RGBA8888 );
+			continue;
+		}
+#endif
+
 		vVTFImport->imageList[vVTFImport->imageList.size()] =
 			new VTFEImageFormat( pFile->GetData( frames, faces, slices, 0 ), pFile->GetWidth(), pFile->GetHeight(), pFile->GetDepth(), pFile->GetFormat() );
 	}
@@ -656,7 +1017,7 @@ VTFEImport *VTFEImport::Standalone( QWidget *pParent )
 	return vVTFImport;
 }
 
-VTFEImport *VTFEImport::FromFont( QWidget *pParent, vlByte *buff, int width, int height )
+VTFEImport *VTFEImport::FromFont( QWidget *pParent, vlByte *buff, int width, int height, VTFImageFormat format )
 {
 	auto vVTFImport = new VTFEImport( pParent );
 
@@ -669,6 +1030,12 @@ VTFEImport *VTFEImport::FromFont( QWidget *pParent, vlByte *buff, int width, int
 
 	vVTFImport->pGeneralTab->vBoxResize->setDisabled( true );
 
+	if ( format != IMAGE_FORMAT_NONE )
+	{
+		vVTFImport->pGeneralTab->pFormatCombo->setCurrentIndex( vVTFImport->pGeneralTab->pFormatCombo->findData( format ) );
+		vVTFImport->pGeneralTab->pAlphaDetectedFormatCombo->setCurrentIndex( vVTFImport->pGeneralTab->pAlphaDetectedFormatCombo->findData( format ) );
+	}
+
 	return vVTFImport;
 }
 void VTFEImport::clearImageList()
@@ -679,6 +1046,24 @@ void VTFEImport::clearImageList()
 	}
 
 	imageList.clear();
+	frameSources.clear();
+}
+
+bool VTFEImport::ConvertToVTF( const QStringList &imagePaths, const QString &vtfPath, VTFErrorType &err )
+{
+	clearImageList();
+	for ( const auto &path : imagePaths )
+		AddImage( path );
+
+	std::unique_ptr<VTFLib::CVTFFile> pVTF( GenerateVTF( err ) );
+	clearImageList();
+	if ( err != SUCCESS || !pVTF )
+		return false;
+
+	// Nothing else sees pVTF, the mutex only has to satisfy Save
+	QMutex vtfMutex;
+	TRACE_ZONE( "Save" );
+	return AuxCompression::Save( *pVTF, vtfPath.toUtf8().constData(), &vtfMutex );
 }
 
 GeneralTab::GeneralTab( VTFEImport *parent ) :
@@ -705,7 +1090,7 @@ void GeneralTab::GeneralOptions()
 	pFormatCombo = new QComboBox( this );
 	for ( auto &fmt : IMAGE_FORMATS )
 	{
-		if ( VTFLib::CVTFFile::GetImageFormatInfo( fmt.format ).bIsSupported )
+		if ( IsSelectableFormat( fmt.format ) )
 			pFormatCombo->addItem( tr( fmt.name ), (int)fmt.format );
 	}
 	vBLayout->addWidget( pFormatCombo, 0, 1, Qt::AlignRight );
@@ -716,7 +1101,7 @@ void GeneralTab::GeneralOptions()
 	pAlphaDetectedFormatCombo = new QComboBox( this );
 	for ( auto &fmt : IMAGE_FORMATS )
 	{
-		if ( VTFLib::CVTFFile::GetImageFormatInfo( fmt.format ).bIsSupported )
+		if ( IsSelectableFormat( fmt.format ) )
 			pAlphaDetectedFormatCombo->addItem( tr( fmt.name ), (int)fmt.format );
 	}
 	vBLayout->addWidget( pAlphaDetectedFormatCombo, 1, 1, Qt::AlignRight );
@@ -1062,6 +1447,9 @@ AdvancedTab::AdvancedTab( VTFEImport *parent ) :
 	Miscellaneous();
 	// DTXCompression(); //doesn't seem to be used in modern VTFEdit or VTFLib.
 	LuminanceWeights();
+#ifdef CHAOS_INITIATIVE
+	BlockCompression();
+#endif
 #ifdef COLOR_CORRECTION
 	ColorCorrectionMenu();
 #endif
@@ -1226,6 +1614,33 @@ void AdvancedTab::LuminanceWeights()
 
 	pMainLayout->addWidget( vBoxDTXCompression, 0, 1 );
 }
+
+#ifdef CHAOS_INITIATIVE
+void AdvancedTab::BlockCompression()
+{
+	auto vBoxBlockCompression = new QGroupBox( tr( "BC7 / BC6H Compression" ), this );
+	auto vBLayout = new QGridLayout( vBoxBlockCompression );
+
+	auto label1 = new QLabel( this );
+	label1->setText( tr( "Speed:" ) );
+	vBLayout->addWidget( label1, 0, 0, Qt::AlignLeft );
+	pBCnSpeedBox = new QComboBox( this );
+	pBCnSpeedBox->addItem( tr( "Fast" ), (int)BCN_SPEED_FAST );
+	pBCnSpeedBox->addItem( tr( "Normal" ), (int)BCN_SPEED_NORMAL );
+	pBCnSpeedBox->addItem( tr( "Slow" ), (int)BCN_SPEED_SLOW );
+	pBCnSpeedBox->setCurrentIndex( 1 );
+	pBCnSpeedBox->setToolTip( tr( "Slower presets search more block partitions for higher quality." ) );
+	vBLayout->addWidget( pBCnSpeedBox, 0, 1, Qt::AlignRight );
+
+	pBCnMultithreadedCheckBox = new QCheckBox( this );
+	pBCnMultithreadedCheckBox->setText( tr( "Multithreaded" ) );
+	pBCnMultithreadedCheckBox->setChecked( true );
+	vBLayout->addWidget( pBCnMultithreadedCheckBox, 1, 0, Qt::AlignLeft );
+
+	pMainLayout->addWidget( vBoxBlockCompression, 1, 1 );
+}
+#endif
+
 #ifdef COLOR_CORRECTION
 void AdvancedTab::ColorCorrectionMenu()
 {
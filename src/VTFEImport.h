@@ -1,6 +1,7 @@
 #pragma once
 #include "../libs/QColorWheel/QtColorTriangle.h"
 #include "../libs/VTFLib/VTFLib/VTFLib.h"
+#include "ImageDecoders.h"
 #include "VTFEImageFormat.h"
 
 #include <QCheckBox>
@@ -10,6 +11,11 @@
 #include <QDoubleSpinBox>
 #include <QGridLayout>
 #include <QGroupBox>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QThreadPool>
+#include <atomic>
+#include <vector>
 
 enum VTFErrorType
 {
@@ -74,6 +80,9 @@ class AdvancedTab : public QDialog
 	void Miscellaneous();
 	void DTXCompression();
 	void LuminanceWeights();
+#ifdef CHAOS_INITIATIVE
+	void BlockCompression();
+#endif
 #ifdef COLOR_CORRECTION
 	void ColorCorrectionMenu();
 #endif
@@ -102,6 +111,11 @@ public:
 	QDoubleSpinBox *pLuminanceWeightRedBox;
 	QDoubleSpinBox *pLuminanceWeightGreenBox;
 	QDoubleSpinBox *pLuminanceWeightBlueBox;
+#ifdef CHAOS_INITIATIVE
+	// BlockCompression
+	QComboBox *pBCnSpeedBox;
+	QCheckBox *pBCnMultithreadedCheckBox;
+#endif
 	// UnsharpenMaskOptions
 	QDoubleSpinBox *pUnsharpenMaskRadiusBox;
 	QDoubleSpinBox *pUnsharpenMaskAmountBox;
@@ -150,6 +164,8 @@ class VTFEImport : public QDialog
 	friend class GeneralTab;
 	friend class AdvancedTab;
 	friend class ResourceTab;
+	// The benchmark drives GenerateVTF with its own option sets
+	friend class VTFEBench;
 
 	SVTFCreateOptions VTFCreateOptions {};
 	vlUInt vtfImageFlags = 0;
@@ -159,26 +175,52 @@ class VTFEImport : public QDialog
 	explicit VTFEImport( QWidget *pParent );
 	QMap<int, VTFEImageFormat *> imageList;
 	bool isCancelled = true;
+	// Set by sources that know what they are ( DDS ), applied once the widgets exist
+	bool bSourceIsCubemap = false;
+	bool bSourceIsSRGB = false;
+	QPushButton *pAcceptButton = nullptr;
+	QPushButton *pPreviewButton = nullptr;
 	void InitializeWidgets();
+	void InitializeSingleImage( bool &hasData );
+	void ApplySourceHints();
+	void AddDecodedImages( DecodedImages &decoded );
+
+	// Multi image imports decode on the pool while the dialog is already up.
+	// One slot per file keeps the frame order, FinishDecoding moves them into imageList.
+	QThreadPool decodePool;
+	std::vector<DecodedImages> pendingImages;
+	std::atomic<int> decodedCount = 0;
+	QProgressBar *pDecodeProgress = nullptr;
+	void StartDecoding( const QStringList &filePaths );
+	void FinishDecoding();
+	void ShowDecodeProgress();
+
+	// Frames after the first of a long animation, only decoded while the VTF is generated.
+	// LoadFrameSources decodes them into imageList for when they can't be streamed.
+	QStringList frameSources;
+	void LoadFrameSources();
 
 public:
 	VTFEImport( QWidget *pParent, const QString &filePath, bool &hasData );
+	// An image that's already in memory, a VPK entry or the clipboard. Any format ImageDecoders knows works.
+	VTFEImport( QWidget *pParent, const vlByte *pData, std::size_t size, bool &hasData );
 	VTFEImport( QWidget *pParent, const QStringList &filePaths, bool &hasData );
-	~VTFEImport()
-	{
-		foreach( auto imageFormat, imageList )
-			delete imageFormat;
-	}
+	~VTFEImport();
 	VTFLib::CVTFFile *GenerateVTF( VTFErrorType &err );
 	bool IsCancelled() const { return isCancelled; }
 
 	static vlBool
 	IsPowerOfTwo( vlUInt uiSize );
 	static VTFEImport *FromVTF( QWidget *pParent, VTFLib::CVTFFile *pFile );
-	static VTFEImport *FromFont( QWidget *pParent, vlByte *buff, int width, int height );
+	// buff is RGBA8888. format is what the format combos start on, IMAGE_FORMAT_NONE keeps the defaults.
+	static VTFEImport *FromFont( QWidget *pParent, vlByte *buff, int width, int height, VTFImageFormat format = IMAGE_FORMAT_NONE );
 	static VTFEImport *Standalone( QWidget *pParent );
 	void AddImage( const QString &qString );
+	void AddImage( const vlByte *pData, std::size_t size );
 	void clearImageList();
+	// One file of Folders to VTF: imagePaths become the frames of one VTF, generated with the current options and saved to vtfPath.
+	// err is what GenerateVTF said, false when generating or saving failed.
+	bool ConvertToVTF( const QStringList &imagePaths, const QString &vtfPath, VTFErrorType &err );
 	[[nodiscard]] const VTFEImageFormat *const grabFirst() const
 	{
 		if ( !imageList.size() < 1 )
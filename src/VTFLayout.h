@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// The parts of the on disk VTF layout that CVTFFile doesn't hand out, shared by the code that reads or re-packs files itself.
+
+// Offsets into the packed header
+static constexpr std::size_t HEADER_SIZE_OFFSET = 12;
+static constexpr std::size_t LOW_RES_FORMAT_OFFSET = 57;
+static constexpr std::size_t LOW_RES_WIDTH_OFFSET = 61;
+static constexpr std::size_t LOW_RES_HEIGHT_OFFSET = 62;
+static constexpr std::size_t RESOURCE_COUNT_OFFSET = 68;
+static constexpr std::size_t RESOURCES_OFFSET = 80;
+static constexpr std::size_t RESOURCE_ENTRY_SIZE = 8;
+
+// Resource types are 3 ID bytes and a flags byte
+static constexpr uint32_t RESOURCE_ID_MASK = 0x00FFFFFF;
+static constexpr uint32_t RESOURCE_NO_DATA = 0x02000000; // The value is stored in the entry itself
+static constexpr uint32_t RESOURCE_LOW_RES_IMAGE = 0x01;
+static constexpr uint32_t RESOURCE_IMAGE = 0x30;
+static constexpr uint32_t RESOURCE_AUX_COMPRESSION = 'A' | ( 'X' << 8 ) | ( 'C' << 16 );
+
+// The aux compression info is a level, with the method in the upper half on newer files, then one compressed size per chunk
+static constexpr std::size_t AUX_INFO_HEADER_SIZE = 4;
+static constexpr uint16_t AUX_COMPRESSION_METHOD_DEFLATE = 8;
+
+static inline uint32_t ReadU32( const uint8_t *pData )
+{
+	uint32_t value;
+	std::memcpy( &value, pData, sizeof( value ) );
+	return value;
+}
+
+static inline void WriteU32( uint8_t *pData, uint32_t value )
+{
+	std::memcpy( pData, &value, sizeof( value ) );
+}
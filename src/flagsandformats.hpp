@@ -94,6 +94,10 @@ static inline constexpr struct
 	{ IMAGE_FORMAT_NV_NULL, "NV_NULL" },
 	{ IMAGE_FORMAT_ATI2N, "ATI2N" },
 	{ IMAGE_FORMAT_ATI1N, "ATI1N" },
+#ifdef CHAOS_INITIATIVE
+	{ IMAGE_FORMAT_BC7, "BC7" },
+	{ IMAGE_FORMAT_BC6H, "BC6H" },
+#endif
 	//	{ IMAGE_FORMAT_ATI2N_OLD, "ATI2N Old" },
 	//	{ IMAGE_FORMAT_ATI1N_OLD, "ATI1N Old" },
 };
@@ -0,0 +1,1210 @@
+#include "BCnSupport.h"
+
+#include "../util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// Blocks are read and written least significant bit first
+class BlockBitReader
+{
+public:
+	explicit BlockBitReader( const uint8_t *block ) :
+		m_pBlock( block )
+	{
+	}
+
+	uint32_t Read( uint32_t count )
+	{
+		uint32_t value = 0;
+		for ( uint32_t i = 0; i < count; i++, m_uiPosition++ )
+			value |= ( ( m_pBlock[m_uiPosition >> 3] >> ( m_uiPosition & 7 ) ) & 1u ) << i;
+		return value;
+	}
+
+private:
+	const uint8_t *m_pBlock;
+	uint32_t m_uiPosition = 0;
+};
+
+class BlockBitWriter
+{
+public:
+	explicit BlockBitWriter( uint8_t *block ) :
+		m_pBlock( block )
+	{
+		memset( m_pBlock, 0, 16 );
+	}
+
+	void Write( uint32_t value, uint32_t count )
+	{
+		for ( uint32_t i = 0; i < count; i++, m_uiPosition++ )
+			m_pBlock[m_uiPosition >> 3] |= ( ( value >> i ) & 1u ) << ( m_uiPosition & 7 );
+	}
+
+private:
+	uint8_t *m_pBlock;
+	uint32_t m_uiPosition = 0;
+};
+
+/******************************
+ * Tables shared by BC6H and BC7
+ ******************************/
+
+// 2 subset partitions, bit n is the subset of pixel n
+static constexpr uint16_t PARTITIONS_2[64] = {
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22 };
+
+static constexpr uint8_t PARTITIONS_3[64][16] = {
+	{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 }, { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 }, { 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+	{ 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 }, { 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+	{ 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+	{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 }, { 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+	{ 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 }, { 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+	{ 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 }, { 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 }, { 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+	{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 }, { 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+	{ 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 }, { 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+	{ 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 }, { 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+	{ 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 }, { 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 }, { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+	{ 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 }, { 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 }, { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+	{ 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 }, { 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+	{ 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 }, { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 }, { 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 }, { 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 }, { 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 }, { 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+	{ 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 }, { 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+	{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 }, { 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+	{ 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+	{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+	{ 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 }, { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+	{ 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 }, { 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 }, { 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 } };
+
+// The anchor is the pixel of a subset whose index drops its most significant bit.
+// Subset 0 always anchors on pixel 0.
+static constexpr uint8_t ANCHORS_2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+	15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+	6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15 };
+
+static constexpr uint8_t ANCHORS_3_SUBSET1[64] = {
+	3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+	3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+	8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+	3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3 };
+
+static constexpr uint8_t ANCHORS_3_SUBSET2[64] = {
+	15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+	15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+	15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+	15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8 };
+
+static constexpr int WEIGHTS_2[4] = { 0, 21, 43, 64 };
+static constexpr int WEIGHTS_3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static constexpr int WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static const int *WeightTable( int indexBits )
+{
+	if ( indexBits == 2 )
+		return WEIGHTS_2;
+	if ( indexBits == 3 )
+		return WEIGHTS_3;
+	return WEIGHTS_4;
+}
+
+// How many least squares passes each preset spends on the endpoints
+static int RefinementPasses( BCnSpeedPreset speed )
+{
+	switch ( speed )
+	{
+		case BCN_SPEED_FAST:
+			return 1;
+		case BCN_SPEED_NORMAL:
+			return 2;
+		default:
+			return 4;
+	}
+}
+
+static int PartitionSubset( int subsets, int partition, int pixel )
+{
+	if ( subsets == 2 )
+		return ( PARTITIONS_2[partition] >> pixel ) & 1;
+	if ( subsets == 3 )
+		return PARTITIONS_3[partition][pixel];
+	return 0;
+}
+
+static int AnchorIndex( int subsets, int partition, int subset )
+{
+	if ( subset == 0 )
+		return 0;
+	if ( subsets == 2 )
+		return ANCHORS_2[partition];
+	return subset == 1 ? ANCHORS_3_SUBSET1[partition] : ANCHORS_3_SUBSET2[partition];
+}
+
+static int Interpolate( int e0, int e1, int weight )
+{
+	return ( ( 64 - weight ) * e0 + weight * e1 + 32 ) >> 6;
+}
+
+// Finds the direction of largest variance through a set of points with a few power iterations.
+// Returns the squared distance of the points from that line, which is what a single subset can't represent.
+static float PrincipalAxis( const float ( *points )[4], const int *members, int count, int channels, float mean[4], float axis[4] )
+{
+	float covariance[4][4] = {};
+	for ( int c = 0; c < 4; c++ )
+	{
+		mean[c] = 0;
+		axis[c] = 0;
+	}
+
+	for ( int i = 0; i < count; i++ )
+		for ( int c = 0; c < channels; c++ )
+			mean[c] += points[members[i]][c];
+	for ( int c = 0; c < channels; c++ )
+		mean[c] /= (float)count;
+
+	float total = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		float delta[4];
+		for ( int c = 0; c < channels; c++ )
+			delta[c] = points[members[i]][c] - mean[c];
+		for ( int c = 0; c < channels; c++ )
+		{
+			total += delta[c] * delta[c];
+			for ( int d = 0; d < channels; d++ )
+				covariance[c][d] += delta[c] * delta[d];
+		}
+	}
+
+	for ( int c = 0; c < channels; c++ )
+		axis[c] = covariance[c][c] + 1.0f;
+
+	for ( int iteration = 0; iteration < 8; iteration++ )
+	{
+		float next[4] = {};
+		for ( int c = 0; c < channels; c++ )
+			for ( int d = 0; d < channels; d++ )
+				next[c] += covariance[c][d] * axis[d];
+
+		float length = 0;
+		for ( int c = 0; c < channels; c++ )
+			length += next[c] * next[c];
+		if ( length <= 0 )
+			break;
+
+		length = 1.0f / std::sqrt( length );
+		for ( int c = 0; c < channels; c++ )
+			axis[c] = next[c] * length;
+	}
+
+	float length = 0;
+	for ( int c = 0; c < channels; c++ )
+		length += axis[c] * axis[c];
+	if ( length <= 0 )
+		return total;
+	length = 1.0f / std::sqrt( length );
+	for ( int c = 0; c < channels; c++ )
+		axis[c] *= length;
+
+	float explained = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		float t = 0;
+		for ( int c = 0; c < channels; c++ )
+			t += ( points[members[i]][c] - mean[c] ) * axis[c];
+		explained += t * t;
+	}
+
+	return std::max( total - explained, 0.0f );
+}
+
+// Projects the points on the principal axis and uses the extremes as the line endpoints
+static void FitLine( const float ( *points )[4], const int *members, int count, int channels, float low[4], float high[4] )
+{
+	float mean[4], axis[4];
+	PrincipalAxis( points, members, count, channels, mean, axis );
+
+	float tMin = std::numeric_limits<float>::max();
+	float tMax = std::numeric_limits<float>::lowest();
+	for ( int i = 0; i < count; i++ )
+	{
+		float t = 0;
+		for ( int c = 0; c < channels; c++ )
+			t += ( points[members[i]][c] - mean[c] ) * axis[c];
+		tMin = std::min( tMin, t );
+		tMax = std::max( tMax, t );
+	}
+
+	for ( int c = 0; c < 4; c++ )
+	{
+		low[c] = mean[c] + axis[c] * tMin;
+		high[c] = mean[c] + axis[c] * tMax;
+	}
+}
+
+// Least squares fit of both endpoints for a fixed set of indices
+static bool RefitLine( const float ( *points )[4], const int *members, int count, int channels, const uint8_t *indices, const int *weights, float low[4], float high[4] )
+{
+	float aa = 0, ab = 0, bb = 0;
+	float ax[4] = {}, bx[4] = {};
+	for ( int i = 0; i < count; i++ )
+	{
+		const float b = weights[indices[members[i]]] / 64.0f;
+		const float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for ( int c = 0; c < channels; c++ )
+		{
+			ax[c] += a * points[members[i]][c];
+			bx[c] += b * points[members[i]][c];
+		}
+	}
+
+	const float determinant = aa * bb - ab * ab;
+	if ( std::fabs( determinant ) < 1e-6f )
+		return false;
+
+	for ( int c = 0; c < channels; c++ )
+	{
+		low[c] = ( bb * ax[c] - ab * bx[c] ) / determinant;
+		high[c] = ( aa * bx[c] - ab * ax[c] ) / determinant;
+	}
+	return true;
+}
+
+/******************************
+ * BC7
+ ******************************/
+
+struct BC7ModeInfo
+{
+	int subsets;
+	int partitionBits;
+	int rotationBits;
+	int indexSelectionBits;
+	int colorBits;
+	int alphaBits;
+	int endpointPBits;
+	int sharedPBits;
+	int indexBits;
+	int indexBits2;
+};
+
+static constexpr BC7ModeInfo BC7_MODES[8] = {
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+// Expands an n bit endpoint to 8 bits by replicating the high bits
+static int ExpandBC7( int value, int bits )
+{
+	value <<= 8 - bits;
+	return value | ( value >> bits );
+}
+
+// Endpoint value including its p-bit ( if any ), expanded to 8 bits
+static int UnquantizeBC7( int value, int bits, int pBit )
+{
+	if ( pBit < 0 )
+		return ExpandBC7( value, bits );
+	return ExpandBC7( ( value << 1 ) | pBit, bits + 1 );
+}
+
+static int QuantizeBC7( float target, int bits, int pBit )
+{
+	target = std::clamp( target, 0.0f, 255.0f );
+	const int maxValue = ( 1 << bits ) - 1;
+	const int totalBits = bits + ( pBit < 0 ? 0 : 1 );
+	int estimate = (int)( target * ( ( 1 << totalBits ) - 1 ) / 255.0f + 0.5f );
+	if ( pBit >= 0 )
+		estimate = ( estimate - pBit ) >> 1;
+
+	int best = 0;
+	int bestError = std::numeric_limits<int>::max();
+	for ( int candidate = std::max( estimate - 1, 0 ); candidate <= std::min( estimate + 1, maxValue ); candidate++ )
+	{
+		const int error = std::abs( UnquantizeBC7( candidate, bits, pBit ) - (int)( target + 0.5f ) );
+		if ( error < bestError )
+		{
+			bestError = error;
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+struct BC7Subset
+{
+	int endpoints[2][4]; // Quantized, without the p-bit
+	int pBits[2];		 // -1 when the mode has no p-bits
+};
+
+static void BC7Palette( const BC7Subset &subset, const BC7ModeInfo &info, int palette[16][4] )
+{
+	int e0[4], e1[4];
+	for ( int c = 0; c < 3; c++ )
+	{
+		e0[c] = UnquantizeBC7( subset.endpoints[0][c], info.colorBits, subset.pBits[0] );
+		e1[c] = UnquantizeBC7( subset.endpoints[1][c], info.colorBits, subset.pBits[1] );
+	}
+	e0[3] = info.alphaBits ? UnquantizeBC7( subset.endpoints[0][3], info.alphaBits, subset.pBits[0] ) : 255;
+	e1[3] = info.alphaBits ? UnquantizeBC7( subset.endpoints[1][3], info.alphaBits, subset.pBits[1] ) : 255;
+
+	const int *weights = WeightTable( info.indexBits );
+	for ( int i = 0; i < ( 1 << info.indexBits ); i++ )
+		for ( int c = 0; c < 4; c++ )
+			palette[i][c] = Interpolate( e0[c], e1[c], weights[i] );
+}
+
+static uint32_t AssignBC7Indices( const float ( *points )[4], const int *members, int count, const BC7Subset &subset, const BC7ModeInfo &info, uint8_t *indices )
+{
+	int palette[16][4];
+	BC7Palette( subset, info, palette );
+
+	uint32_t total = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		const float *pixel = points[members[i]];
+		uint32_t bestError = std::numeric_limits<uint32_t>::max();
+		for ( int p = 0; p < ( 1 << info.indexBits ); p++ )
+		{
+			uint32_t error = 0;
+			for ( int c = 0; c < 4; c++ )
+			{
+				const int delta = palette[p][c] - (int)pixel[c];
+				error += delta * delta;
+			}
+			if ( error < bestError )
+			{
+				bestError = error;
+				indices[members[i]] = p;
+			}
+		}
+		total += bestError;
+	}
+	return total;
+}
+
+// Quantizes a float line for the mode, trying every p-bit combination the mode allows
+static uint32_t QuantizeBC7Subset( const float ( *points )[4], const int *members, int count, const BC7ModeInfo &info, const float low[4], const float high[4], BC7Subset &out, uint8_t *indices )
+{
+	int pBitCombinations = 1;
+	if ( info.endpointPBits )
+		pBitCombinations = 4;
+	else if ( info.sharedPBits )
+		pBitCombinations = 2;
+
+	uint32_t bestError = std::numeric_limits<uint32_t>::max();
+	uint8_t candidateIndices[16];
+	for ( int combination = 0; combination < pBitCombinations; combination++ )
+	{
+		BC7Subset candidate;
+		if ( info.endpointPBits )
+		{
+			candidate.pBits[0] = combination & 1;
+			candidate.pBits[1] = combination >> 1;
+		}
+		else if ( info.sharedPBits )
+			candidate.pBits[0] = candidate.pBits[1] = combination;
+		else
+			candidate.pBits[0] = candidate.pBits[1] = -1;
+
+		for ( int c = 0; c < 3; c++ )
+		{
+			candidate.endpoints[0][c] = QuantizeBC7( low[c], info.colorBits, candidate.pBits[0] );
+			candidate.endpoints[1][c] = QuantizeBC7( high[c], info.colorBits, candidate.pBits[1] );
+		}
+		candidate.endpoints[0][3] = info.alphaBits ? QuantizeBC7( low[3], info.alphaBits, candidate.pBits[0] ) : 0;
+		candidate.endpoints[1][3] = info.alphaBits ? QuantizeBC7( high[3], info.alphaBits, candidate.pBits[1] ) : 0;
+
+		const uint32_t error = AssignBC7Indices( points, members, count, candidate, info, candidateIndices );
+		if ( error < bestError )
+		{
+			bestError = error;
+			out = candidate;
+			for ( int i = 0; i < count; i++ )
+				indices[members[i]] = candidateIndices[members[i]];
+		}
+	}
+	return bestError;
+}
+
+static uint32_t FitBC7Subset( const float ( *points )[4], const int *members, int count, const BC7ModeInfo &info, int iterations, BC7Subset &out, uint8_t *indices )
+{
+	const int channels = info.alphaBits ? 4 : 3;
+
+	float low[4], high[4];
+	FitLine( points, members, count, channels, low, high );
+	if ( !info.alphaBits )
+		low[3] = high[3] = 255;
+
+	uint32_t bestError = QuantizeBC7Subset( points, members, count, info, low, high, out, indices );
+
+	uint8_t candidateIndices[16];
+	memcpy( candidateIndices, indices, 16 );
+	for ( int iteration = 0; iteration < iterations && bestError > 0; iteration++ )
+	{
+		if ( !RefitLine( points, members, count, channels, candidateIndices, WeightTable( info.indexBits ), low, high ) )
+			break;
+
+		BC7Subset candidate;
+		const uint32_t error = QuantizeBC7Subset( points, members, count, info, low, high, candidate, candidateIndices );
+		if ( error >= bestError )
+			break;
+
+		bestError = error;
+		out = candidate;
+		for ( int i = 0; i < count; i++ )
+			indices[members[i]] = candidateIndices[members[i]];
+	}
+	return bestError;
+}
+
+static void PackBC7Block( int mode, int partition, const BC7Subset *subsets, const uint8_t *indices, uint8_t *block )
+{
+	const BC7ModeInfo &info = BC7_MODES[mode];
+	BlockBitWriter bits( block );
+
+	bits.Write( 1u << mode, mode + 1 );
+	bits.Write( partition, info.partitionBits );
+
+	for ( int c = 0; c < 3; c++ )
+		for ( int s = 0; s < info.subsets; s++ )
+			for ( int e = 0; e < 2; e++ )
+				bits.Write( subsets[s].endpoints[e][c], info.colorBits );
+
+	if ( info.alphaBits )
+		for ( int s = 0; s < info.subsets; s++ )
+			for ( int e = 0; e < 2; e++ )
+				bits.Write( subsets[s].endpoints[e][3], info.alphaBits );
+
+	if ( info.endpointPBits )
+		for ( int s = 0; s < info.subsets; s++ )
+			for ( int e = 0; e < 2; e++ )
+				bits.Write( subsets[s].pBits[e], 1 );
+
+	if ( info.sharedPBits )
+		for ( int s = 0; s < info.subsets; s++ )
+			bits.Write( subsets[s].pBits[0], 1 );
+
+	for ( int i = 0; i < 16; i++ )
+	{
+		const int subset = PartitionSubset( info.subsets, partition, i );
+		const bool isAnchor = AnchorIndex( info.subsets, partition, subset ) == i;
+		bits.Write( indices[i], info.indexBits - isAnchor );
+	}
+}
+
+// Encodes the block in one mode / partition and returns the squared error
+static uint32_t EncodeBC7Candidate( const float ( *points )[4], int mode, int partition, int iterations, uint8_t *block )
+{
+	const BC7ModeInfo &info = BC7_MODES[mode];
+	BC7Subset subsets[3];
+	uint8_t indices[16] = {};
+	uint32_t error = 0;
+
+	for ( int s = 0; s < info.subsets; s++ )
+	{
+		int members[16];
+		int count = 0;
+		for ( int i = 0; i < 16; i++ )
+			if ( PartitionSubset( info.subsets, partition, i ) == s )
+				members[count++] = i;
+
+		error += FitBC7Subset( points, members, count, info, iterations, subsets[s], indices );
+
+		// The anchor index is stored without its top bit, swap the endpoints if it is set
+		const int highBit = 1 << ( info.indexBits - 1 );
+		if ( indices[AnchorIndex( info.subsets, partition, s )] & highBit )
+		{
+			std::swap( subsets[s].endpoints[0], subsets[s].endpoints[1] );
+			std::swap( subsets[s].pBits[0], subsets[s].pBits[1] );
+			for ( int i = 0; i < count; i++ )
+				indices[members[i]] = ( ( 1 << info.indexBits ) - 1 ) - indices[members[i]];
+		}
+	}
+
+	PackBC7Block( mode, partition, subsets, indices, block );
+	return error;
+}
+
+// Ranks partitions by how much of each subset falls off a single colour line
+static int RankPartitions( const float ( *points )[4], int partitionCount, int channels, int keep, int *best )
+{
+	float scores[64];
+	for ( int partition = 0; partition < partitionCount; partition++ )
+	{
+		scores[partition] = 0;
+		for ( int s = 0; s < 2; s++ )
+		{
+			int members[16];
+			int count = 0;
+			for ( int i = 0; i < 16; i++ )
+				if ( PartitionSubset( 2, partition, i ) == s )
+					members[count++] = i;
+
+			float mean[4], axis[4];
+			scores[partition] += PrincipalAxis( points, members, count, channels, mean, axis );
+		}
+	}
+
+	int order[64];
+	for ( int i = 0; i < partitionCount; i++ )
+		order[i] = i;
+	keep = std::min( keep, partitionCount );
+	std::partial_sort( order, order + keep, order + partitionCount, [&scores]( int a, int b )
+					   {
+						   return scores[a] < scores[b];
+					   } );
+	memcpy( best, order, keep * sizeof( int ) );
+	return keep;
+}
+
+static void EncodeBC7Block( const uint8_t pixels[16][4], const BCnEncodeOptions &options, uint8_t *block )
+{
+	float points[16][4];
+	bool isOpaque = true;
+	for ( int i = 0; i < 16; i++ )
+	{
+		for ( int c = 0; c < 4; c++ )
+			points[i][c] = pixels[i][c];
+		isOpaque &= pixels[i][3] == 255;
+	}
+
+	const int iterations = RefinementPasses( options.speed );
+
+	uint32_t bestError = EncodeBC7Candidate( points, 6, 0, iterations, block );
+	if ( options.speed == BCN_SPEED_FAST || bestError == 0 )
+		return;
+
+	// Opaque blocks get the higher precision RGB mode, anything with alpha the RGBA one
+	const int mode = isOpaque ? 1 : 7;
+	int partitions[64];
+	const int partitionCount = RankPartitions( points, 64, isOpaque ? 3 : 4, options.speed == BCN_SPEED_SLOW ? 64 : 8, partitions );
+
+	uint8_t candidate[16];
+	for ( int i = 0; i < partitionCount && bestError > 0; i++ )
+	{
+		const uint32_t error = EncodeBC7Candidate( points, mode, partitions[i], iterations, candidate );
+		if ( error < bestError )
+		{
+			bestError = error;
+			memcpy( block, candidate, 16 );
+		}
+	}
+}
+
+static void DecodeBC7Block( const uint8_t *block, uint8_t pixels[16][4] )
+{
+	BlockBitReader bits( block );
+
+	int mode = 0;
+	while ( mode < 8 && !bits.Read( 1 ) )
+		mode++;
+
+	// Reserved mode, decodes to transparent black
+	if ( mode == 8 )
+	{
+		memset( pixels, 0, 16 * 4 );
+		return;
+	}
+
+	const BC7ModeInfo &info = BC7_MODES[mode];
+	const int partition = bits.Read( info.partitionBits );
+	const int rotation = bits.Read( info.rotationBits );
+	const int indexSelection = bits.Read( info.indexSelectionBits );
+
+	int endpoints[3][2][4] = {};
+	for ( int c = 0; c < 3; c++ )
+		for ( int s = 0; s < info.subsets; s++ )
+			for ( int e = 0; e < 2; e++ )
+				endpoints[s][e][c] = bits.Read( info.colorBits );
+
+	if ( info.alphaBits )
+		for ( int s = 0; s < info.subsets; s++ )
+			for ( int e = 0; e < 2; e++ )
+				endpoints[s][e][3] = bits.Read( info.alphaBits );
+
+	int pBits[3][2];
+	for ( int s = 0; s < 3; s++ )
+		pBits[s][0] = pBits[s][1] = -1;
+
+	if ( info.endpointPBits )
+		for ( int s = 0; s < info.subsets; s++ )
+			for ( int e = 0; e < 2; e++ )
+				pBits[s][e] = bits.Read( 1 );
+
+	if ( info.sharedPBits )
+		for ( int s = 0; s < info.subsets; s++ )
+			pBits[s][0] = pBits[s][1] = bits.Read( 1 );
+
+	for ( int s = 0; s < info.subsets; s++ )
+	{
+		for ( int e = 0; e < 2; e++ )
+		{
+			for ( int c = 0; c < 3; c++ )
+				endpoints[s][e][c] = UnquantizeBC7( endpoints[s][e][c], info.colorBits, pBits[s][e] );
+			endpoints[s][e][3] = info.alphaBits ? UnquantizeBC7( endpoints[s][e][3], info.alphaBits, pBits[s][e] ) : 255;
+		}
+	}
+
+	uint8_t indices[16];
+	uint8_t indices2[16] = {};
+	for ( int i = 0; i < 16; i++ )
+	{
+		const int subset = PartitionSubset( info.subsets, partition, i );
+		const bool isAnchor = AnchorIndex( info.subsets, partition, subset ) == i;
+		indices[i] = bits.Read( info.indexBits - isAnchor );
+	}
+
+	if ( info.indexBits2 )
+		for ( int i = 0; i < 16; i++ )
+			indices2[i] = bits.Read( info.indexBits2 - ( i == 0 ) );
+
+	for ( int i = 0; i < 16; i++ )
+	{
+		const int subset = PartitionSubset( info.subsets, partition, i );
+		int colorIndex = indices[i];
+		int colorIndexBits = info.indexBits;
+		int alphaIndex = info.indexBits2 ? indices2[i] : indices[i];
+		int alphaIndexBits = info.indexBits2 ? info.indexBits2 : info.indexBits;
+		if ( indexSelection )
+		{
+			std::swap( colorIndex, alphaIndex );
+			std::swap( colorIndexBits, alphaIndexBits );
+		}
+
+		const int *e0 = endpoints[subset][0];
+		const int *e1 = endpoints[subset][1];
+		for ( int c = 0; c < 3; c++ )
+			pixels[i][c] = Interpolate( e0[c], e1[c], WeightTable( colorIndexBits )[colorIndex] );
+		pixels[i][3] = Interpolate( e0[3], e1[3], WeightTable( alphaIndexBits )[alphaIndex] );
+
+		if ( rotation )
+			std::swap( pixels[i][3], pixels[i][rotation - 1] );
+	}
+}
+
+/******************************
+ * BC6H
+ ******************************/
+
+// Endpoint fields as named by the spec, w / x are region 0 and y / z region 1
+enum BC6HField
+{
+	RW = 0,
+	GW,
+	BW,
+	RX,
+	GX,
+	BX,
+	RY,
+	GY,
+	BY,
+	RZ,
+	GZ,
+	BZ,
+	PD, // Partition index
+};
+
+// A run of bits in the block that belongs to a field, starting at bit lsb of that field
+struct BC6HSegment
+{
+	uint8_t field;
+	uint8_t lsb;
+	uint8_t count;
+};
+
+struct BC6HModeInfo
+{
+	int modeValue;
+	int modeBits;
+	bool transformed; // Endpoints other than w are stored as signed deltas from w
+	int endpointBits;
+	int deltaBits[3];
+	int regions;
+	const BC6HSegment *segments;
+	int segmentCount;
+};
+
+static constexpr BC6HSegment BC6H_MODE1[] = { { GY, 4, 1 }, { BY, 4, 1 }, { BZ, 4, 1 }, { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE2[] = { { GY, 5, 1 }, { GZ, 4, 1 }, { GZ, 5, 1 }, { RW, 0, 7 }, { BZ, 0, 1 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 7 }, { BY, 5, 1 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 7 }, { BZ, 3, 1 }, { BZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 }, { RY, 0, 6 }, { RZ, 0, 6 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE3[] = { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 5 }, { RW, 10, 1 }, { GY, 0, 4 }, { GX, 0, 4 }, { GW, 10, 1 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 4 }, { BW, 10, 1 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE4[] = { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 10, 1 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { GW, 10, 1 }, { GZ, 0, 4 }, { BX, 0, 4 }, { BW, 10, 1 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 4 }, { BZ, 0, 1 }, { BZ, 2, 1 }, { RZ, 0, 4 }, { GY, 4, 1 }, { BZ, 3, 1 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE5[] = { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 10, 1 }, { BY, 4, 1 }, { GY, 0, 4 }, { GX, 0, 4 }, { GW, 10, 1 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BW, 10, 1 }, { BY, 0, 4 }, { RY, 0, 4 }, { BZ, 1, 1 }, { BZ, 2, 1 }, { RZ, 0, 4 }, { BZ, 4, 1 }, { BZ, 3, 1 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE6[] = { { RW, 0, 9 }, { BY, 4, 1 }, { GW, 0, 9 }, { GY, 4, 1 }, { BW, 0, 9 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE7[] = { { RW, 0, 8 }, { GZ, 4, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 8 }, { BZ, 3, 1 }, { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 6 }, { RZ, 0, 6 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE8[] = { { RW, 0, 8 }, { BZ, 0, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { GY, 5, 1 }, { GY, 4, 1 }, { BW, 0, 8 }, { GZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 5 }, { BZ, 1, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 2, 1 }, { RZ, 0, 5 }, { BZ, 3, 1 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE9[] = { { RW, 0, 8 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 8 }, { BY, 5, 1 }, { GY, 4, 1 }, { BW, 0, 8 }, { BZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 5 }, { GZ, 4, 1 }, { GY, 0, 4 }, { GX, 0, 5 }, { BZ, 0, 1 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BZ, 2, 1 }, { BY, 0, 4 }, { RY, 0, 5 }, { BZ, 3, 1 }, { RZ, 0, 5 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE10[] = { { RW, 0, 6 }, { GZ, 4, 1 }, { BZ, 0, 1 }, { BZ, 1, 1 }, { BY, 4, 1 }, { GW, 0, 6 }, { GY, 5, 1 }, { BY, 5, 1 }, { BZ, 2, 1 }, { GY, 4, 1 }, { BW, 0, 6 }, { GZ, 5, 1 }, { BZ, 3, 1 }, { BZ, 5, 1 }, { BZ, 4, 1 }, { RX, 0, 6 }, { GY, 0, 4 }, { GX, 0, 6 }, { GZ, 0, 4 }, { BX, 0, 6 }, { BY, 0, 4 }, { RY, 0, 6 }, { RZ, 0, 6 }, { PD, 0, 5 } };
+static constexpr BC6HSegment BC6H_MODE11[] = { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 10 }, { GX, 0, 10 }, { BX, 0, 10 } };
+static constexpr BC6HSegment BC6H_MODE12[] = { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 9 }, { RW, 10, 1 }, { GX, 0, 9 }, { GW, 10, 1 }, { BX, 0, 9 }, { BW, 10, 1 } };
+// The high bits of w are stored reversed in modes 13 and 14
+static constexpr BC6HSegment BC6H_MODE13[] = { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 8 }, { RW, 11, 1 }, { RW, 10, 1 }, { GX, 0, 8 }, { GW, 11, 1 }, { GW, 10, 1 }, { BX, 0, 8 }, { BW, 11, 1 }, { BW, 10, 1 } };
+static constexpr BC6HSegment BC6H_MODE14[] = { { RW, 0, 10 }, { GW, 0, 10 }, { BW, 0, 10 }, { RX, 0, 4 }, { RW, 15, 1 }, { RW, 14, 1 }, { RW, 13, 1 }, { RW, 12, 1 }, { RW, 11, 1 }, { RW, 10, 1 }, { GX, 0, 4 }, { GW, 15, 1 }, { GW, 14, 1 }, { GW, 13, 1 }, { GW, 12, 1 }, { GW, 11, 1 }, { GW, 10, 1 }, { BX, 0, 4 }, { BW, 15, 1 }, { BW, 14, 1 }, { BW, 13, 1 }, { BW, 12, 1 }, { BW, 11, 1 }, { BW, 10, 1 } };
+
+#define BC6H_SEGMENTS( x ) x, (int)util::ArraySize( x )
+
+static constexpr BC6HModeInfo BC6H_MODES[14] = {
+	{ 0x00, 2, true, 10, { 5, 5, 5 }, 2, BC6H_SEGMENTS( BC6H_MODE1 ) },
+	{ 0x01, 2, true, 7, { 6, 6, 6 }, 2, BC6H_SEGMENTS( BC6H_MODE2 ) },
+	{ 0x02, 5, true, 11, { 5, 4, 4 }, 2, BC6H_SEGMENTS( BC6H_MODE3 ) },
+	{ 0x06, 5, true, 11, { 4, 5, 4 }, 2, BC6H_SEGMENTS( BC6H_MODE4 ) },
+	{ 0x0A, 5, true, 11, { 4, 4, 5 }, 2, BC6H_SEGMENTS( BC6H_MODE5 ) },
+	{ 0x0E, 5, true, 9, { 5, 5, 5 }, 2, BC6H_SEGMENTS( BC6H_MODE6 ) },
+	{ 0x12, 5, true, 8, { 6, 5, 5 }, 2, BC6H_SEGMENTS( BC6H_MODE7 ) },
+	{ 0x16, 5, true, 8, { 5, 6, 5 }, 2, BC6H_SEGMENTS( BC6H_MODE8 ) },
+	{ 0x1A, 5, true, 8, { 5, 5, 6 }, 2, BC6H_SEGMENTS( BC6H_MODE9 ) },
+	{ 0x1E, 5, false, 6, { 6, 6, 6 }, 2, BC6H_SEGMENTS( BC6H_MODE10 ) },
+	{ 0x03, 5, false, 10, { 10, 10, 10 }, 1, BC6H_SEGMENTS( BC6H_MODE11 ) },
+	{ 0x07, 5, true, 11, { 9, 9, 9 }, 1, BC6H_SEGMENTS( BC6H_MODE12 ) },
+	{ 0x0B, 5, true, 12, { 8, 8, 8 }, 1, BC6H_SEGMENTS( BC6H_MODE13 ) },
+	{ 0x0F, 5, true, 16, { 4, 4, 4 }, 1, BC6H_SEGMENTS( BC6H_MODE14 ) },
+};
+
+#undef BC6H_SEGMENTS
+
+// Indices into BC6H_MODES for the modes the encoder uses
+static constexpr int BC6H_ENCODE_MODE1 = 0;
+static constexpr int BC6H_ENCODE_MODE11 = 10;
+static constexpr int BC6H_ENCODE_MODE12 = 11;
+
+// Largest finite half, anything above is clamped on encode
+static constexpr int BC6H_MAX_HALF = 0x7BFF;
+
+static int SignExtend( int value, int bits )
+{
+	const int signBit = 1 << ( bits - 1 );
+	value &= ( 1 << bits ) - 1;
+	return ( value ^ signBit ) - signBit;
+}
+
+static int UnquantizeBC6H( int value, int bits )
+{
+	if ( bits >= 15 )
+		return value;
+	if ( value == 0 )
+		return 0;
+	if ( value == ( 1 << bits ) - 1 )
+		return 0xFFFF;
+	return ( ( value << 16 ) + 0x8000 ) >> bits;
+}
+
+// Scales the interpolated value back into the range of a half float
+static int FinishUnquantizeBC6H( int value )
+{
+	return ( value * 31 ) >> 6;
+}
+
+static int QuantizeBC6H( float target, int bits )
+{
+	const int half = (int)std::clamp( target + 0.5f, 0.0f, (float)BC6H_MAX_HALF );
+	const int maxValue = ( 1 << bits ) - 1;
+	const int estimate = (int)( ( (int64_t)( ( half * 64 + 30 ) / 31 ) << bits ) >> 16 );
+
+	int best = 0;
+	int bestError = std::numeric_limits<int>::max();
+	for ( int candidate = std::max( estimate - 1, 0 ); candidate <= std::min( estimate + 1, maxValue ); candidate++ )
+	{
+		const int error = std::abs( FinishUnquantizeBC6H( UnquantizeBC6H( candidate, bits ) ) - half );
+		if ( error < bestError )
+		{
+			bestError = error;
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+// Quantized endpoints of one region
+struct BC6HRegion
+{
+	int endpoints[2][3];
+};
+
+static void BC6HPalette( const BC6HRegion &region, int endpointBits, int indexBits, int palette[16][3] )
+{
+	const int *weights = WeightTable( indexBits );
+	for ( int c = 0; c < 3; c++ )
+	{
+		const int e0 = UnquantizeBC6H( region.endpoints[0][c], endpointBits );
+		const int e1 = UnquantizeBC6H( region.endpoints[1][c], endpointBits );
+		for ( int i = 0; i < ( 1 << indexBits ); i++ )
+			palette[i][c] = FinishUnquantizeBC6H( Interpolate( e0, e1, weights[i] ) );
+	}
+}
+
+static uint64_t AssignBC6HIndices( const float ( *points )[4], const int *members, int count, const BC6HRegion &region, int endpointBits, int indexBits, uint8_t *indices )
+{
+	int palette[16][3];
+	BC6HPalette( region, endpointBits, indexBits, palette );
+
+	uint64_t total = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		const float *pixel = points[members[i]];
+		uint64_t bestError = std::numeric_limits<uint64_t>::max();
+		for ( int p = 0; p < ( 1 << indexBits ); p++ )
+		{
+			uint64_t error = 0;
+			for ( int c = 0; c < 3; c++ )
+			{
+				const int64_t delta = palette[p][c] - (int)pixel[c];
+				error += delta * delta;
+			}
+			if ( error < bestError )
+			{
+				bestError = error;
+				indices[members[i]] = p;
+			}
+		}
+		total += bestError;
+	}
+	return total;
+}
+
+static uint64_t FitBC6HRegion( const float ( *points )[4], const int *members, int count, int endpointBits, int indexBits, int iterations, BC6HRegion &out, uint8_t *indices )
+{
+	float low[4], high[4];
+	FitLine( points, members, count, 3, low, high );
+
+	for ( int c = 0; c < 3; c++ )
+	{
+		out.endpoints[0][c] = QuantizeBC6H( low[c], endpointBits );
+		out.endpoints[1][c] = QuantizeBC6H( high[c], endpointBits );
+	}
+	uint64_t bestError = AssignBC6HIndices( points, members, count, out, endpointBits, indexBits, indices );
+
+	uint8_t candidateIndices[16];
+	memcpy( candidateIndices, indices, 16 );
+	for ( int iteration = 0; iteration < iterations && bestError > 0; iteration++ )
+	{
+		if ( !RefitLine( points, members, count, 3, candidateIndices, WeightTable( indexBits ), low, high ) )
+			break;
+
+		BC6HRegion candidate;
+		for ( int c = 0; c < 3; c++ )
+		{
+			candidate.endpoints[0][c] = QuantizeBC6H( low[c], endpointBits );
+			candidate.endpoints[1][c] = QuantizeBC6H( high[c], endpointBits );
+		}
+
+		const uint64_t error = AssignBC6HIndices( points, members, count, candidate, endpointBits, indexBits, candidateIndices );
+		if ( error >= bestError )
+			break;
+
+		bestError = error;
+		out = candidate;
+		for ( int i = 0; i < count; i++ )
+			indices[members[i]] = candidateIndices[members[i]];
+	}
+	return bestError;
+}
+
+// Encodes the block in one mode / partition, returns UINT64_MAX if the endpoints don't fit the mode's deltas
+static uint64_t EncodeBC6HCandidate( const float ( *points )[4], int modeIndex, int partition, int iterations, uint8_t *block )
+{
+	const BC6HModeInfo &info = BC6H_MODES[modeIndex];
+	const int indexBits = info.regions == 1 ? 4 : 3;
+
+	BC6HRegion regions[2];
+	uint8_t indices[16] = {};
+	uint64_t error = 0;
+
+	for ( int r = 0; r < info.regions; r++ )
+	{
+		int members[16];
+		int count = 0;
+		for ( int i = 0; i < 16; i++ )
+			if ( PartitionSubset( info.regions, partition, i ) == r )
+				members[count++] = i;
+
+		error += FitBC6HRegion( points, members, count, info.endpointBits, indexBits, iterations, regions[r], indices );
+
+		const int highBit = 1 << ( indexBits - 1 );
+		if ( indices[AnchorIndex( info.regions, partition, r )] & highBit )
+		{
+			std::swap( regions[r].endpoints[0], regions[r].endpoints[1] );
+			for ( int i = 0; i < count; i++ )
+				indices[members[i]] = ( ( 1 << indexBits ) - 1 ) - indices[members[i]];
+		}
+	}
+
+	int fields[13] = {};
+	for ( int c = 0; c < 3; c++ )
+	{
+		const int w = regions[0].endpoints[0][c];
+		const int others[3] = { regions[0].endpoints[1][c], regions[1].endpoints[0][c], regions[1].endpoints[1][c] };
+		fields[RW + c] = w;
+
+		for ( int e = 0; e < info.regions * 2 - 1; e++ )
+		{
+			int value = others[e];
+			if ( info.transformed )
+			{
+				value -= w;
+				const int limit = 1 << ( info.deltaBits[c] - 1 );
+				if ( value < -limit || value >= limit )
+					return std::numeric_limits<uint64_t>::max();
+				value &= ( 1 << info.deltaBits[c] ) - 1;
+			}
+			fields[RX + e * 3 + c] = value;
+		}
+	}
+	fields[PD] = partition;
+
+	BlockBitWriter bits( block );
+	bits.Write( info.modeValue, info.modeBits );
+	for ( int s = 0; s < info.segmentCount; s++ )
+	{
+		const BC6HSegment &segment = info.segments[s];
+		bits.Write( fields[segment.field] >> segment.lsb, segment.count );
+	}
+
+	for ( int i = 0; i < 16; i++ )
+	{
+		const int region = PartitionSubset( info.regions, partition, i );
+		const bool isAnchor = AnchorIndex( info.regions, partition, region ) == i;
+		bits.Write( indices[i], indexBits - isAnchor );
+	}
+
+	return error;
+}
+
+static void EncodeBC6HBlock( const uint16_t pixels[16][4], const BCnEncodeOptions &options, uint8_t *block )
+{
+	// The half bit pattern of positive numbers is monotonic, BC6H interpolates in that space
+	float points[16][4];
+	for ( int i = 0; i < 16; i++ )
+	{
+		for ( int c = 0; c < 3; c++ )
+			points[i][c] = ( pixels[i][c] & 0x8000 ) ? 0.0f : (float)std::min<int>( pixels[i][c], BC6H_MAX_HALF );
+		points[i][3] = 0;
+	}
+
+	const int iterations = RefinementPasses( options.speed );
+
+	uint64_t bestError = EncodeBC6HCandidate( points, BC6H_ENCODE_MODE11, 0, iterations, block );
+	if ( options.speed == BCN_SPEED_FAST || bestError == 0 )
+		return;
+
+	uint8_t candidate[16];
+	if ( options.speed == BCN_SPEED_SLOW )
+	{
+		const uint64_t error = EncodeBC6HCandidate( points, BC6H_ENCODE_MODE12, 0, iterations, candidate );
+		if ( error < bestError )
+		{
+			bestError = error;
+			memcpy( block, candidate, 16 );
+		}
+	}
+
+	// BC6H only uses the first 32 of the 2 subset partitions
+	int partitions[32];
+	const int partitionCount = RankPartitions( points, 32, 3, options.speed == BCN_SPEED_SLOW ? 32 : 8, partitions );
+	for ( int i = 0; i < partitionCount && bestError > 0; i++ )
+	{
+		const uint64_t error = EncodeBC6HCandidate( points, BC6H_ENCODE_MODE1, partitions[i], iterations, candidate );
+		if ( error < bestError )
+		{
+			bestError = error;
+			memcpy( block, candidate, 16 );
+		}
+	}
+}
+
+static void DecodeBC6HBlock( const uint8_t *block, uint16_t pixels[16][4] )
+{
+	BlockBitReader bits( block );
+
+	int modeValue = bits.Read( 2 );
+	if ( modeValue >= 2 )
+		modeValue |= bits.Read( 3 ) << 2;
+
+	const BC6HModeInfo *info = nullptr;
+	for ( const auto &mode : BC6H_MODES )
+		if ( mode.modeValue == modeValue )
+			info = &mode;
+
+	// Reserved modes decode to black
+	if ( !info )
+	{
+		for ( int i = 0; i < 16; i++ )
+		{
+			pixels[i][0] = pixels[i][1] = pixels[i][2] = 0;
+			pixels[i][3] = 0x3C00;
+		}
+		return;
+	}
+
+	int fields[13] = {};
+	for ( int s = 0; s < info->segmentCount; s++ )
+	{
+		const BC6HSegment &segment = info->segments[s];
+		fields[segment.field] |= bits.Read( segment.count ) << segment.lsb;
+	}
+
+	const int partition = fields[PD];
+	const int endpointCount = info->regions * 2;
+	const int endpointMask = ( 1 << info->endpointBits ) - 1;
+
+	int endpoints[4][3];
+	for ( int e = 0; e < endpointCount; e++ )
+	{
+		for ( int c = 0; c < 3; c++ )
+		{
+			int value = fields[e * 3 + c];
+			if ( e > 0 && info->transformed )
+				value = ( fields[RW + c] + SignExtend( value, info->deltaBits[c] ) ) & endpointMask;
+			endpoints[e][c] = UnquantizeBC6H( value, info->endpointBits );
+		}
+	}
+
+	const int indexBits = info->regions == 1 ? 4 : 3;
+	const int *weights = WeightTable( indexBits );
+	for ( int i = 0; i < 16; i++ )
+	{
+		const int region = PartitionSubset( info->regions, partition, i );
+		const bool isAnchor = AnchorIndex( info->regions, partition, region ) == i;
+		const int index = bits.Read( indexBits - isAnchor );
+
+		for ( int c = 0; c < 3; c++ )
+			pixels[i][c] = FinishUnquantizeBC6H( Interpolate( endpoints[region * 2][c], endpoints[region * 2 + 1][c], weights[index] ) );
+		pixels[i][3] = 0x3C00;
+	}
+}
+
+/******************************
+ * Image level
+ ******************************/
+
+std::size_t BCnSupport::ComputeBlockDataSize( uint32_t width, uint32_t height )
+{
+	return (std::size_t)std::max( 1u, ( width + 3 ) / 4 ) * std::max( 1u, ( height + 3 ) / 4 ) * 16;
+}
+
+// Walks every block row, gathering the source pixels ( edge pixels repeat for partial blocks ) before encoding
+template <class T, class F>
+static void EncodeBlocks( const T *pixels, uint32_t width, uint32_t height, uint8_t *blocks, bool multithreaded, const F &encodeBlock )
+{
+	const uint32_t blocksX = std::max( 1u, ( width + 3 ) / 4 );
+	const uint32_t blocksY = std::max( 1u, ( height + 3 ) / 4 );
+
+	util::parallel_for(
+		blocksY,
+		[&]( std::size_t by )
+		{
+			T block[16][4];
+			for ( uint32_t bx = 0; bx < blocksX; bx++ )
+			{
+				for ( uint32_t i = 0; i < 16; i++ )
+				{
+					const uint32_t x = std::min( bx * 4 + ( i & 3 ), width - 1 );
+					const uint32_t y = std::min<uint32_t>( by * 4 + ( i >> 2 ), height - 1 );
+					memcpy( block[i], pixels + ( (std::size_t)y * width + x ) * 4, sizeof( block[i] ) );
+				}
+				encodeBlock( block, blocks + ( by * blocksX + bx ) * 16 );
+			}
+		},
+		multithreaded ? 0 : 1 );
+}
+
+// Decodes every block and copies out the pixels that are inside the image
+template <class T, class F>
+static void DecodeBlocks( const uint8_t *blocks, uint32_t width, uint32_t height, T *pixels, const F &decodeBlock )
+{
+	const uint32_t blocksX = std::max( 1u, ( width + 3 ) / 4 );
+	const uint32_t blocksY = std::max( 1u, ( height + 3 ) / 4 );
+
+	// Spinning up threads costs more than decoding small mips
+	util::parallel_for(
+		blocksY,
+		[&]( std::size_t by )
+		{
+			T block[16][4];
+			for ( uint32_t bx = 0; bx < blocksX; bx++ )
+			{
+				decodeBlock( blocks + ( by * blocksX + bx ) * 16, block );
+				for ( uint32_t i = 0; i < 16; i++ )
+				{
+					const uint32_t x = bx * 4 + ( i & 3 );
+					const uint32_t y = by * 4 + ( i >> 2 );
+					if ( x < width && y < height )
+						memcpy( pixels + ( (std::size_t)y * width + x ) * 4, block[i], sizeof( block[i] ) );
+				}
+			}
+		},
+		blocksX * blocksY >= 4096 ? 0 : 1 );
+}
+
+bool BCnSupport::Encode_BC7( const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *blocks, const BCnEncodeOptions &options )
+{
+	if ( !rgba || !blocks || width == 0 || height == 0 )
+		return false;
+
+	EncodeBlocks( rgba, width, height, blocks, options.multithreaded, [&options]( const uint8_t pixels[16][4], uint8_t *block )
+				  {
+					  EncodeBC7Block( pixels, options, block );
+				  } );
+	return true;
+}
+
+bool BCnSupport::Decode_BC7( const uint8_t *blocks, uint32_t width, uint32_t height, uint8_t *rgba )
+{
+	if ( !blocks || !rgba || width == 0 || height == 0 )
+		return false;
+
+	DecodeBlocks( blocks, width, height, rgba, DecodeBC7Block );
+	return true;
+}
+
+bool BCnSupport::Encode_BC6H( const uint16_t *rgbaHalf, uint32_t width, uint32_t height, uint8_t *blocks, const BCnEncodeOptions &options )
+{
+	if ( !rgbaHalf || !blocks || width == 0 || height == 0 )
+		return false;
+
+	EncodeBlocks( rgbaHalf, width, height, blocks, options.multithreaded, [&options]( const uint16_t pixels[16][4], uint8_t *block )
+				  {
+					  EncodeBC6HBlock( pixels, options, block );
+				  } );
+	return true;
+}
+
+bool BCnSupport::Decode_BC6H( const uint8_t *blocks, uint32_t width, uint32_t height, uint16_t *rgbaHalf )
+{
+	if ( !blocks || !rgbaHalf || width == 0 || height == 0 )
+		return false;
+
+	DecodeBlocks( blocks, width, height, rgbaHalf, DecodeBC6HBlock );
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// BC7 and BC6H are 4x4 block formats, every block is 16 bytes.
+// BC7 stores RGBA8888 data in one of 8 modes, BC6H stores unsigned half float RGB in one of 14 modes.
+// Both formats split a block into up to 3 subsets ( "partitions" ) each with its own colour line.
+// The decoders handle every mode.
+// The encoders cover the modes that are worth searching for our content:
+//   BC7  - mode 6 ( single subset RGBA ), mode 1 ( 2 subsets RGB ) and mode 7 ( 2 subsets RGBA )
+//   BC6H - mode 11 ( single region, 10 bit ), mode 12 ( single region, 11 bit delta ) and mode 1 ( 2 regions, 10 bit delta )
+// The spec this was written against can be found at..
+// https://learn.microsoft.com/en-us/windows/win32/direct3d11/bc7-format-mode-reference
+// https://learn.microsoft.com/en-us/windows/win32/direct3d11/bc6h-format
+
+enum BCnSpeedPreset
+{
+	BCN_SPEED_FAST = 0, // Single subset modes only, one refinement pass
+	BCN_SPEED_NORMAL,	// Adds partitioned modes, only the most promising partitions are encoded
+	BCN_SPEED_SLOW,		// Encodes every partition and refines harder
+};
+
+struct BCnEncodeOptions
+{
+	BCnSpeedPreset speed = BCN_SPEED_NORMAL;
+
+	// Encode block rows on every hardware thread
+	bool multithreaded = true;
+};
+
+class BCnSupport
+{
+public:
+	BCnSupport() = delete;
+
+	// Size of the block data for an image, partial blocks are padded out to 4x4
+	static std::size_t ComputeBlockDataSize( uint32_t width, uint32_t height );
+
+	// rgba is width * height RGBA8888 pixels, blocks is ComputeBlockDataSize bytes
+	static bool Encode_BC7( const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *blocks, const BCnEncodeOptions &options );
+	static bool Decode_BC7( const uint8_t *blocks, uint32_t width, uint32_t height, uint8_t *rgba );
+
+	// rgbaHalf is width * height RGBA16161616F pixels, alpha is ignored on encode and written as 1.0 on decode
+	static bool Encode_BC6H( const uint16_t *rgbaHalf, uint32_t width, uint32_t height, uint8_t *blocks, const BCnEncodeOptions &options );
+	static bool Decode_BC6H( const uint8_t *blocks, uint32_t width, uint32_t height, uint16_t *rgbaHalf );
+};
@@ -0,0 +1,275 @@
+#include "DDSSupport.h"
+
+#include "../MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Ensure byte alignment, these are read straight out of the file
+#pragma pack( push, 1 )
+
+struct File_DDS_PixelFormat
+{
+	uint32_t nSize;
+	uint32_t nFlags;
+	uint32_t nFourCC;
+	uint32_t nRGBBitCount;
+	uint32_t nRBitMask;
+	uint32_t nGBitMask;
+	uint32_t nBBitMask;
+	uint32_t nABitMask;
+};
+
+struct File_DDS_Header
+{
+	uint32_t nSize; // Always 124
+	uint32_t nFlags;
+	uint32_t nHeight;
+	uint32_t nWidth;
+	uint32_t nPitchOrLinearSize;
+	uint32_t nDepth;
+	uint32_t nMipMapCount;
+	uint32_t nReserved1[11];
+	File_DDS_PixelFormat PixelFormat;
+	uint32_t nCaps;
+	uint32_t nCaps2;
+	uint32_t nCaps3;
+	uint32_t nCaps4;
+	uint32_t nReserved2;
+};
+
+struct File_DDS_HeaderDX10
+{
+	uint32_t nDXGIFormat;
+	uint32_t nResourceDimension;
+	uint32_t nMiscFlag;
+	uint32_t nArraySize;
+	uint32_t nMiscFlags2;
+};
+
+#pragma pack( pop )
+
+static constexpr uint32_t MakeFourCC( char a, char b, char c, char d )
+{
+	return static_cast<uint32_t>( static_cast<uint8_t>( a ) ) | ( static_cast<uint32_t>( static_cast<uint8_t>( b ) ) << 8 ) |
+		   ( static_cast<uint32_t>( static_cast<uint8_t>( c ) ) << 16 ) | ( static_cast<uint32_t>( static_cast<uint8_t>( d ) ) << 24 );
+}
+
+static constexpr uint32_t DDS_MAGIC = MakeFourCC( 'D', 'D', 'S', ' ' );
+
+static constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+static constexpr uint32_t DDPF_FOURCC = 0x4;
+static constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+static constexpr uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00;
+static constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+static constexpr uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+// The DXGI formats we take from DX10 headers
+enum DXGIFormat
+{
+	DXGI_FORMAT_BC1_UNORM = 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+	DXGI_FORMAT_BC2_UNORM = 74,
+	DXGI_FORMAT_BC2_UNORM_SRGB = 75,
+	DXGI_FORMAT_BC3_UNORM = 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+	DXGI_FORMAT_BC4_UNORM = 80,
+	DXGI_FORMAT_BC5_UNORM = 83,
+	DXGI_FORMAT_BC6H_UF16 = 95,
+	DXGI_FORMAT_BC7_UNORM = 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB = 99,
+};
+
+static bool FormatFromFourCC( uint32_t fourCC, DDSBlockFormat &format )
+{
+	switch ( fourCC )
+	{
+		case MakeFourCC( 'D', 'X', 'T', '1' ):
+			format = DDSFORMAT_BC1;
+			return true;
+		case MakeFourCC( 'D', 'X', 'T', '3' ):
+			format = DDSFORMAT_BC2;
+			return true;
+		case MakeFourCC( 'D', 'X', 'T', '5' ):
+			format = DDSFORMAT_BC3;
+			return true;
+		case MakeFourCC( 'A', 'T', 'I', '1' ):
+		case MakeFourCC( 'B', 'C', '4', 'U' ):
+			format = DDSFORMAT_BC4;
+			return true;
+		case MakeFourCC( 'A', 'T', 'I', '2' ):
+		case MakeFourCC( 'B', 'C', '5', 'U' ):
+			format = DDSFORMAT_BC5;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool FormatFromDXGI( uint32_t dxgiFormat, DDSBlockFormat &format, bool &isSRGB )
+{
+	isSRGB = dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB || dxgiFormat == DXGI_FORMAT_BC2_UNORM_SRGB ||
+			 dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB || dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB;
+
+	switch ( dxgiFormat )
+	{
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			format = DDSFORMAT_BC1;
+			return true;
+		case DXGI_FORMAT_BC2_UNORM:
+		case DXGI_FORMAT_BC2_UNORM_SRGB:
+			format = DDSFORMAT_BC2;
+			return true;
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			format = DDSFORMAT_BC3;
+			return true;
+		case DXGI_FORMAT_BC4_UNORM:
+			format = DDSFORMAT_BC4;
+			return true;
+		case DXGI_FORMAT_BC5_UNORM:
+			format = DDSFORMAT_BC5;
+			return true;
+		case DXGI_FORMAT_BC6H_UF16:
+			format = DDSFORMAT_BC6H;
+			return true;
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			format = DDSFORMAT_BC7;
+			return true;
+		default:
+			return false;
+	}
+}
+
+std::size_t DDSSupport::ComputeBlockSize( DDSBlockFormat format )
+{
+	return format == DDSFORMAT_BC1 || format == DDSFORMAT_BC4 ? 8 : 16;
+}
+
+std::size_t DDSSupport::ComputeSurfaceSize( uint32_t width, uint32_t height, DDSBlockFormat format )
+{
+	const std::size_t blocksWide = std::max<std::size_t>( 1, ( static_cast<std::size_t>( width ) + 3 ) / 4 );
+	const std::size_t blocksHigh = std::max<std::size_t>( 1, ( static_cast<std::size_t>( height ) + 3 ) / 4 );
+	return blocksWide * blocksHigh * ComputeBlockSize( format );
+}
+
+static std::size_t ComputeMipChainSize( uint32_t width, uint32_t height, uint32_t mipCount, DDSBlockFormat format, uint32_t lastMip )
+{
+	std::size_t size = 0;
+	for ( uint32_t mip = 0; mip < std::min( mipCount, lastMip ); mip++ )
+		size += DDSSupport::ComputeSurfaceSize( std::max( 1u, width >> mip ), std::max( 1u, height >> mip ), format );
+	return size;
+}
+
+std::size_t DDSSupport::ComputeSurfaceOffset( const DDSFile &buff, uint32_t face, uint32_t mip )
+{
+	const std::size_t faceSize = ComputeMipChainSize( buff.width, buff.height, buff.mipCount, buff.format, buff.mipCount );
+	return face * faceSize + ComputeMipChainSize( buff.width, buff.height, buff.mipCount, buff.format, mip );
+}
+
+static bool LoadDDS( const uint8_t *pData, std::size_t nSize, std::string_view fileName, DDSFile &buff )
+{
+	buff.isValid = false;
+	buff.isSRGB = false;
+
+	uint32_t nMagic = 0;
+	File_DDS_Header Header {};
+	if ( nSize < sizeof( nMagic ) + sizeof( File_DDS_Header ) )
+	{
+		std::cout << "Could not load " << fileName << ". Not a DDS file." << std::endl;
+		return false;
+	}
+	std::memcpy( &nMagic, pData, sizeof( nMagic ) );
+	std::memcpy( &Header, pData + sizeof( nMagic ), sizeof( File_DDS_Header ) );
+
+	if ( nMagic != DDS_MAGIC || Header.nSize != sizeof( File_DDS_Header ) || Header.nWidth == 0 || Header.nHeight == 0 )
+	{
+		std::cout << "Could not load " << fileName << ". Not a DDS file." << std::endl;
+		return false;
+	}
+
+	if ( Header.nCaps2 & DDSCAPS2_VOLUME )
+	{
+		std::cout << "Could not load " << fileName << ". Volume DDS files are not supported." << std::endl;
+		return false;
+	}
+
+	std::size_t nDataOffset = sizeof( nMagic ) + sizeof( File_DDS_Header );
+	bool bCubemap = ( Header.nCaps2 & DDSCAPS2_CUBEMAP ) != 0;
+
+	// Partial cubemaps can't become a VTF environment map
+	if ( bCubemap && ( Header.nCaps2 & DDSCAPS2_CUBEMAP_ALLFACES ) != DDSCAPS2_CUBEMAP_ALLFACES )
+	{
+		std::cout << "Could not load " << fileName << ". Cubemaps need all 6 faces." << std::endl;
+		return false;
+	}
+
+	bool bKnownFormat = false;
+	if ( ( Header.PixelFormat.nFlags & DDPF_FOURCC ) && Header.PixelFormat.nFourCC == MakeFourCC( 'D', 'X', '1', '0' ) )
+	{
+		File_DDS_HeaderDX10 HeaderDX10 {};
+		if ( nSize < nDataOffset + sizeof( File_DDS_HeaderDX10 ) )
+			return false;
+		std::memcpy( &HeaderDX10, pData + nDataOffset, sizeof( File_DDS_HeaderDX10 ) );
+		nDataOffset += sizeof( File_DDS_HeaderDX10 );
+
+		if ( HeaderDX10.nArraySize > 1 )
+		{
+			std::cout << "Could not load " << fileName << ". Texture arrays are not supported." << std::endl;
+			return false;
+		}
+
+		bCubemap = bCubemap || ( HeaderDX10.nMiscFlag & DDS_RESOURCE_MISC_TEXTURECUBE );
+		bKnownFormat = FormatFromDXGI( HeaderDX10.nDXGIFormat, buff.format, buff.isSRGB );
+	}
+	else if ( Header.PixelFormat.nFlags & DDPF_FOURCC )
+		bKnownFormat = FormatFromFourCC( Header.PixelFormat.nFourCC, buff.format );
+
+	if ( !bKnownFormat )
+	{
+		std::cout << "Could not load " << fileName << ". Only block compressed DDS files are supported." << std::endl;
+		return false;
+	}
+
+	buff.width = Header.nWidth;
+	buff.height = Header.nHeight;
+	buff.faceCount = bCubemap ? 6 : 1;
+
+	// A mip count past the 1x1 mip is nonsense, cap it
+	uint32_t nMaxMipCount = 1;
+	while ( ( std::max( buff.width, buff.height ) >> nMaxMipCount ) > 0 )
+		nMaxMipCount++;
+	buff.mipCount = ( Header.nFlags & DDSD_MIPMAPCOUNT ) ? std::clamp( Header.nMipMapCount, 1u, nMaxMipCount ) : 1;
+
+	const std::size_t nImageSize = DDSSupport::ComputeSurfaceOffset( buff, buff.faceCount, 0 );
+	if ( nSize - nDataOffset < nImageSize )
+	{
+		std::cout << "Could not load " << fileName << ". The file is truncated." << std::endl;
+		return false;
+	}
+
+	buff.imageData.resize( nImageSize );
+	std::memcpy( buff.imageData.data(), pData + nDataOffset, nImageSize );
+
+	buff.isValid = true;
+	return true;
+}
+
+bool DDSSupport::Load_DDS( std::string_view fileName, DDSFile &buff )
+{
+	buff.isValid = false;
+
+	MappedFile file;
+	if ( !file.Open( fileName ) )
+		return false;
+
+	return LoadDDS( file.Data(), file.Size(), fileName, buff );
+}
+
+bool DDSSupport::Load_DDS( const uint8_t *pData, std::size_t size, DDSFile &buff )
+{
+	return LoadDDS( pData, size, "DDS in memory", buff );
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// DDS is a 4 byte magic ( "DDS " ), a 124 byte header and then the surfaces.
+// When the pixel format FourCC is "DX10" another 20 byte header follows with a DXGI format.
+// Surfaces are stored face by face, each face has its mips from largest to smallest.
+// The layout was taken from..
+// https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+// https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header-dxt10
+
+// We only take the block compressed formats, those can go straight into a VTF without being re-encoded.
+enum DDSBlockFormat
+{
+	DDSFORMAT_BC1 = 0, // DXT1
+	DDSFORMAT_BC2,	   // DXT3
+	DDSFORMAT_BC3,	   // DXT5
+	DDSFORMAT_BC4,	   // ATI1N
+	DDSFORMAT_BC5,	   // ATI2N
+	DDSFORMAT_BC6H,
+	DDSFORMAT_BC7,
+};
+
+struct DDSFile
+{
+	bool isValid;
+	uint32_t width;
+	uint32_t height;
+
+	// Always at least 1
+	uint32_t mipCount;
+
+	// 6 for cubemaps, 1 otherwise
+	uint32_t faceCount;
+
+	DDSBlockFormat format;
+
+	// Only the DX10 header can tell us this
+	bool isSRGB;
+
+	// Block data exactly as it was in the file, see DDSSupport::ComputeSurfaceOffset
+	std::vector<std::byte> imageData;
+};
+
+class DDSSupport
+{
+public:
+	DDSSupport() = delete;
+	static bool Load_DDS( std::string_view fileName, DDSFile &buff );
+	static bool Load_DDS( const uint8_t *pData, std::size_t size, DDSFile &buff );
+
+	// 8 bytes for BC1 and BC4, 16 for everything else
+	static std::size_t ComputeBlockSize( DDSBlockFormat format );
+
+	// Size of one mip of one face, partial blocks are padded out to 4x4
+	static std::size_t ComputeSurfaceSize( uint32_t width, uint32_t height, DDSBlockFormat format );
+
+	// Where a face / mip pair starts in buff.imageData
+	static std::size_t ComputeSurfaceOffset( const DDSFile &buff, uint32_t face, uint32_t mip );
+};
@@ -0,0 +1,225 @@
+#ifdef EXR_SUPPORT
+
+#include "EXRSupport.h"
+
+#include "../MappedFile.h"
+
+#include <Iex.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfIO.h>
+#include <ImfInputFile.h>
+#include <ImfOutputFile.h>
+#include <ImfThreading.h>
+#include <ImfTiledInputFile.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+static constexpr const char *EXR_CHANNEL_NAMES[] = { "R", "G", "B", "A" };
+
+static constexpr uint8_t EXR_MAGIC[] = { 0x76, 0x2F, 0x31, 0x01 };
+// Set in the version field when a single part file is tiled
+static constexpr uint32_t EXR_VERSION_TILED = 0x200;
+
+// Lets OpenEXR read straight out of a mapped file or a buffer, memory mapped reads don't copy at all
+class EXRMemoryStream : public Imf::IStream
+{
+public:
+	EXRMemoryStream( const uint8_t *pData, std::size_t size, const char *pName ) :
+		Imf::IStream( pName ), m_pData( pData ), m_nSize( size ) {}
+
+	bool isMemoryMapped() const override { return true; }
+
+	bool read( char c[], int n ) override
+	{
+		std::memcpy( c, Take( n ), n );
+		return m_nPosition < m_nSize;
+	}
+
+	char *readMemoryMapped( int n ) override { return const_cast<char *>( reinterpret_cast<const char *>( Take( n ) ) ); }
+
+	uint64_t tellg() override { return m_nPosition; }
+	void seekg( uint64_t pos ) override { m_nPosition = pos; }
+
+private:
+	const uint8_t *Take( int n )
+	{
+		if ( n < 0 || m_nPosition > m_nSize || m_nSize - m_nPosition < static_cast<uint64_t>( n ) )
+			throw Iex::InputExc( "Unexpected end of file." );
+
+		const uint8_t *pChunk = m_pData + m_nPosition;
+		m_nPosition += n;
+		return pChunk;
+	}
+
+	const uint8_t *m_pData;
+	uint64_t m_nSize;
+	uint64_t m_nPosition = 0;
+};
+
+// OpenEXR decodes line buffers and tiles on its global pool, size it once for the whole program
+static int EXRThreadCount()
+{
+	static std::once_flag once;
+	std::call_once( once, []
+					{ Imf::setGlobalThreadCount( static_cast<int>( std::max( 1u, std::thread::hardware_concurrency() ) ) ); } );
+	return Imf::globalThreadCount();
+}
+
+static bool SetupBuffer( const Imf::Header &header, EXRFile &buff, std::string_view fileName )
+{
+	const Imath::Box2i &dataWindow = header.dataWindow();
+	const int64_t nWidth = static_cast<int64_t>( dataWindow.max.x ) - dataWindow.min.x + 1;
+	const int64_t nHeight = static_cast<int64_t>( dataWindow.max.y ) - dataWindow.min.y + 1;
+
+	// VTF dimensions are 16 bit
+	if ( nWidth <= 0 || nHeight <= 0 || nWidth > UINT16_MAX || nHeight > UINT16_MAX )
+	{
+		std::cout << "Could not load " << fileName << ". Bad data window." << std::endl;
+		return false;
+	}
+
+	// Stay half only if everything we read is half, otherwise float loses nothing
+	bool bHasColor = false;
+	buff.isHalf = true;
+	for ( const char *pName : EXR_CHANNEL_NAMES )
+	{
+		const Imf::Channel *pChannel = header.channels().findChannel( pName );
+		if ( !pChannel )
+			continue;
+
+		bHasColor = bHasColor || pName[0] != 'A';
+		buff.isHalf = buff.isHalf && pChannel->type == Imf::HALF;
+	}
+
+	if ( !bHasColor )
+	{
+		std::cout << "Could not load " << fileName << ". No R, G or B channels." << std::endl;
+		return false;
+	}
+
+	buff.width = static_cast<uint32_t>( nWidth );
+	buff.height = static_cast<uint32_t>( nHeight );
+	buff.imageData.resize( static_cast<std::size_t>( nWidth ) * nHeight * 4 * ( buff.isHalf ? 2 : 4 ) );
+	return true;
+}
+
+// Every channel gets a slice pointing straight at its spot in the interleaved buffer,
+// OpenEXR converts the pixel type and fills in whatever the file doesn't have.
+static Imf::FrameBuffer MakeFrameBuffer( EXRFile &buff, const Imath::Box2i &dataWindow )
+{
+	const Imf::PixelType type = buff.isHalf ? Imf::HALF : Imf::FLOAT;
+	const std::size_t nSampleSize = buff.isHalf ? 2 : 4;
+	const std::size_t nPixelSize = nSampleSize * 4;
+
+	Imf::FrameBuffer frameBuffer;
+	for ( std::size_t c = 0; c < 4; c++ )
+		frameBuffer.insert( EXR_CHANNEL_NAMES[c], Imf::Slice::Make( type, buff.imageData.data() + c * nSampleSize, dataWindow, nPixelSize, nPixelSize * buff.width, 1, 1, c == 3 ? 1.0 : 0.0 ) );
+	return frameBuffer;
+}
+
+bool EXRSupport::IsEXR( const uint8_t *pData, std::size_t size )
+{
+	return size >= sizeof( EXR_MAGIC ) && std::memcmp( pData, EXR_MAGIC, sizeof( EXR_MAGIC ) ) == 0;
+}
+
+static bool LoadEXR( const uint8_t *pData, std::size_t nSize, std::string_view fileName, EXRFile &buff )
+{
+	buff.isValid = false;
+
+	uint32_t nVersion = 0;
+	if ( !EXRSupport::IsEXR( pData, nSize ) || nSize < sizeof( EXR_MAGIC ) + sizeof( nVersion ) )
+	{
+		std::cout << "Could not load " << fileName << ". Not an EXR file." << std::endl;
+		return false;
+	}
+	std::memcpy( &nVersion, pData + sizeof( EXR_MAGIC ), sizeof( nVersion ) );
+
+	const std::string name( fileName );
+	EXRMemoryStream stream( pData, nSize, name.c_str() );
+
+	try
+	{
+		if ( nVersion & EXR_VERSION_TILED )
+		{
+			Imf::TiledInputFile file( stream, EXRThreadCount() );
+			if ( !SetupBuffer( file.header(), buff, fileName ) )
+				return false;
+
+			// Only the top level, VTFLib builds its own mips
+			file.setFrameBuffer( MakeFrameBuffer( buff, file.header().dataWindow() ) );
+			file.readTiles( 0, file.numXTiles( 0 ) - 1, 0, file.numYTiles( 0 ) - 1, 0 );
+		}
+		else
+		{
+			Imf::InputFile file( stream, EXRThreadCount() );
+			if ( !SetupBuffer( file.header(), buff, fileName ) )
+				return false;
+
+			const Imath::Box2i &dataWindow = file.header().dataWindow();
+			file.setFrameBuffer( MakeFrameBuffer( buff, dataWindow ) );
+			file.readPixels( dataWindow.min.y, dataWindow.max.y );
+		}
+	}
+	catch ( const std::exception &e )
+	{
+		std::cout << "Could not load " << fileName << ". " << e.what() << std::endl;
+		return false;
+	}
+
+	buff.isValid = true;
+	return true;
+}
+
+bool EXRSupport::Load_EXR( std::string_view fileName, EXRFile &buff )
+{
+	buff.isValid = false;
+
+	MappedFile file;
+	if ( !file.Open( fileName ) )
+		return false;
+
+	return LoadEXR( file.Data(), file.Size(), fileName, buff );
+}
+
+bool EXRSupport::Load_EXR( const uint8_t *pData, std::size_t size, EXRFile &buff )
+{
+	return LoadEXR( pData, size, "EXR in memory", buff );
+}
+
+bool EXRSupport::Save_EXR( std::string_view fileName, const void *pData, uint32_t width, uint32_t height, bool isHalf )
+{
+	const Imf::PixelType type = isHalf ? Imf::HALF : Imf::FLOAT;
+	const std::size_t nSampleSize = isHalf ? 2 : 4;
+	const std::size_t nPixelSize = nSampleSize * 4;
+	const std::string name( fileName );
+
+	try
+	{
+		Imf::Header header( static_cast<int>( width ), static_cast<int>( height ) );
+		Imf::FrameBuffer frameBuffer;
+		auto pBase = static_cast<char *>( const_cast<void *>( pData ) );
+		for ( std::size_t c = 0; c < 4; c++ )
+		{
+			header.channels().insert( EXR_CHANNEL_NAMES[c], Imf::Channel( type ) );
+			frameBuffer.insert( EXR_CHANNEL_NAMES[c], Imf::Slice( type, pBase + c * nSampleSize, nPixelSize, nPixelSize * width ) );
+		}
+
+		Imf::OutputFile file( name.c_str(), header, EXRThreadCount() );
+		file.setFrameBuffer( frameBuffer );
+		file.writePixels( static_cast<int>( height ) );
+	}
+	catch ( const std::exception &e )
+	{
+		std::cout << "Could not save " << fileName << ". " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+#ifdef EXR_SUPPORT
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// EXR goes through OpenEXR, reading from a mapped file or a buffer. The decoding is left to its thread pool.
+// Only the R, G, B and A channels of the first part are read, a missing alpha comes out as 1.0.
+// Half files stay half, float and uint files come out as float. Saving writes RGBA with ZIP compression.
+struct EXRFile
+{
+	bool isValid;
+	uint32_t width;
+	uint32_t height;
+
+	// RGBA16161616F when set, RGBA32323232F otherwise
+	bool isHalf;
+
+	// Interleaved RGBA, rows top to bottom
+	std::vector<std::byte> imageData;
+};
+
+class EXRSupport
+{
+public:
+	EXRSupport() = delete;
+	static bool Load_EXR( std::string_view fileName, EXRFile &buff );
+	static bool Load_EXR( const uint8_t *pData, std::size_t size, EXRFile &buff );
+
+	// pData is interleaved RGBA, half when isHalf is set and float otherwise, rows top to bottom
+	static bool Save_EXR( std::string_view fileName, const void *pData, uint32_t width, uint32_t height, bool isHalf );
+
+	// Checks the 4 byte magic only
+	static bool IsEXR( const uint8_t *pData, std::size_t size );
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include "TGASupport.h"
+
+#include "../MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Ensure byte alignment, this is read straight out of the file
+#pragma pack( push, 1 )
+
+struct File_TGA_Header
+{
+	uint8_t nIDLength;
+	uint8_t nColorMapType;
+	uint8_t nImageType;
+	uint16_t nColorMapFirstEntry;
+	uint16_t nColorMapLength;
+	uint8_t nColorMapEntrySize;
+	uint16_t nXOrigin;
+	uint16_t nYOrigin;
+	uint16_t nWidth;
+	uint16_t nHeight;
+	uint8_t nPixelDepth;
+	uint8_t nImageDescriptor;
+};
+
+#pragma pack( pop )
+
+enum TGAImageType
+{
+	TGATYPE_TRUECOLOR = 2,
+	TGATYPE_GRAYSCALE = 3,
+	TGATYPE_RLE_TRUECOLOR = 10,
+	TGATYPE_RLE_GRAYSCALE = 11,
+};
+
+static constexpr uint8_t TGA_DESCRIPTOR_RIGHT_TO_LEFT = 0x10;
+static constexpr uint8_t TGA_DESCRIPTOR_TOP_TO_BOTTOM = 0x20;
+static constexpr uint8_t TGA_RLE_RUN_PACKET = 0x80;
+
+// Bottom to top files get their rows written straight into place, so there's no flip pass afterwards
+static uint8_t *RowPointer( uint8_t *pDst, std::size_t row, std::size_t rowCount, std::size_t rowSize, bool flip )
+{
+	return pDst + ( flip ? rowCount - 1 - row : row ) * rowSize;
+}
+
+// The pixel size is a template argument so the copies in the loop below turn into plain moves.
+template <std::size_t PixelSize>
+static bool DecodeRLE( const uint8_t *pSrc, const uint8_t *pSrcEnd, uint8_t *pDst, std::size_t width, std::size_t height, bool flip )
+{
+	const std::size_t nRowSize = width * PixelSize;
+	std::size_t nRow = 0;
+	std::size_t nColumn = 0;
+	uint8_t *pRow = RowPointer( pDst, 0, height, nRowSize, flip );
+
+	while ( nRow < height )
+	{
+		if ( pSrc >= pSrcEnd )
+			return false;
+
+		const uint8_t nPacket = *pSrc++;
+		const bool bRun = nPacket & TGA_RLE_RUN_PACKET;
+		std::size_t nCount = ( nPacket & 0x7F ) + 1;
+
+		uint8_t pixel[PixelSize] {};
+		if ( bRun )
+		{
+			if ( static_cast<std::size_t>( pSrcEnd - pSrc ) < PixelSize )
+				return false;
+			std::memcpy( pixel, pSrc, PixelSize );
+			pSrc += PixelSize;
+		}
+		else if ( static_cast<std::size_t>( pSrcEnd - pSrc ) < nCount * PixelSize )
+			return false;
+
+		// Packets may run over the end of a scanline, a packet running past the last row is just cut off
+		while ( nCount > 0 && nRow < height )
+		{
+			const std::size_t nPixels = std::min( nCount, width - nColumn );
+			uint8_t *pOut = pRow + nColumn * PixelSize;
+
+			if ( bRun )
+			{
+				for ( std::size_t i = 0; i < nPixels; i++, pOut += PixelSize )
+					std::memcpy( pOut, pixel, PixelSize );
+			}
+			else
+			{
+				std::memcpy( pOut, pSrc, nPixels * PixelSize );
+				pSrc += nPixels * PixelSize;
+			}
+
+			nCount -= nPixels;
+			nColumn += nPixels;
+			if ( nColumn == width )
+			{
+				nColumn = 0;
+				if ( ++nRow < height )
+					pRow = RowPointer( pDst, nRow, height, nRowSize, flip );
+			}
+		}
+	}
+	return true;
+}
+
+static bool DecodeRLE( const uint8_t *pSrc, const uint8_t *pSrcEnd, uint8_t *pDst, std::size_t width, std::size_t height, std::size_t pixelSize, bool flip )
+{
+	switch ( pixelSize )
+	{
+		case 1:
+			return DecodeRLE<1>( pSrc, pSrcEnd, pDst, width, height, flip );
+		case 3:
+			return DecodeRLE<3>( pSrc, pSrcEnd, pDst, width, height, flip );
+		case 4:
+			return DecodeRLE<4>( pSrc, pSrcEnd, pDst, width, height, flip );
+		default:
+			return false;
+	}
+}
+
+static bool LoadTGA( const uint8_t *pData, std::size_t nSize, std::string_view fileName, TGAFile &buff )
+{
+	buff.isValid = false;
+
+	File_TGA_Header Header {};
+	if ( nSize < sizeof( File_TGA_Header ) )
+	{
+		std::cout << "Could not load " << fileName << ". Not a TGA file." << std::endl;
+		return false;
+	}
+	std::memcpy( &Header, pData, sizeof( File_TGA_Header ) );
+
+	const bool bRLE = Header.nImageType == TGATYPE_RLE_TRUECOLOR || Header.nImageType == TGATYPE_RLE_GRAYSCALE;
+	const bool bGrayscale = Header.nImageType == TGATYPE_GRAYSCALE || Header.nImageType == TGATYPE_RLE_GRAYSCALE;
+	const bool bTrueColor = Header.nImageType == TGATYPE_TRUECOLOR || Header.nImageType == TGATYPE_RLE_TRUECOLOR;
+
+	if ( Header.nWidth == 0 || Header.nHeight == 0 || Header.nColorMapType != 0 || !( bTrueColor || bGrayscale ) ||
+		 ( bTrueColor && Header.nPixelDepth != 24 && Header.nPixelDepth != 32 ) || ( bGrayscale && Header.nPixelDepth != 8 ) ||
+		 ( Header.nImageDescriptor & TGA_DESCRIPTOR_RIGHT_TO_LEFT ) )
+		return false;
+
+	const std::size_t nPixelSize = Header.nPixelDepth / 8;
+	const std::size_t nPixelCount = static_cast<std::size_t>( Header.nWidth ) * Header.nHeight;
+	const std::size_t nDataOffset = sizeof( File_TGA_Header ) + Header.nIDLength;
+
+	if ( nSize < nDataOffset )
+	{
+		std::cout << "Could not load " << fileName << ". The file is truncated." << std::endl;
+		return false;
+	}
+
+	buff.width = Header.nWidth;
+	buff.height = Header.nHeight;
+	buff.channelCount = static_cast<uint32_t>( nPixelSize );
+	buff.imageData.resize( nPixelCount * nPixelSize );
+
+	// Bottom to top is the default
+	const bool bFlip = !( Header.nImageDescriptor & TGA_DESCRIPTOR_TOP_TO_BOTTOM );
+	const std::size_t nRowSize = buff.width * nPixelSize;
+
+	auto pDst = reinterpret_cast<uint8_t *>( buff.imageData.data() );
+	if ( bRLE )
+	{
+		if ( !DecodeRLE( pData + nDataOffset, pData + nSize, pDst, buff.width, buff.height, nPixelSize, bFlip ) )
+		{
+			std::cout << "Could not load " << fileName << ". The RLE data is truncated." << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		if ( nSize - nDataOffset < buff.imageData.size() )
+		{
+			std::cout << "Could not load " << fileName << ". The file is truncated." << std::endl;
+			return false;
+		}
+
+		if ( bFlip )
+		{
+			for ( std::size_t y = 0; y < buff.height; y++ )
+				std::memcpy( RowPointer( pDst, y, buff.height, nRowSize, true ), pData + nDataOffset + y * nRowSize, nRowSize );
+		}
+		else
+			std::memcpy( pDst, pData + nDataOffset, buff.imageData.size() );
+	}
+
+	buff.isValid = true;
+	return true;
+}
+
+bool TGASupport::Load_TGA( std::string_view fileName, TGAFile &buff )
+{
+	buff.isValid = false;
+
+	MappedFile file;
+	if ( !file.Open( fileName ) )
+		return false;
+
+	return LoadTGA( file.Data(), file.Size(), fileName, buff );
+}
+
+bool TGASupport::Load_TGA( const uint8_t *pData, std::size_t size, TGAFile &buff )
+{
+	return LoadTGA( pData, size, "TGA in memory", buff );
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// TGA is an 18 byte header, an optional image ID, an optional colour map and then the pixels.
+// Truecolour pixels are stored as BGR / BGRA, which is exactly what IMAGE_FORMAT_BGR888 / BGRA8888 want.
+// RLE packets are a 1 byte header, the top bit picks run ( one pixel repeated ) or raw ( literal pixels ),
+// the low 7 bits are the pixel count - 1. Packets may cross scanlines.
+// The layout was taken from the Truevision TGA File Format Specification, version 2.0.
+
+// Colour mapped and 16 bit files aren't handled here, stb takes those.
+struct TGAFile
+{
+	bool isValid;
+	uint32_t width;
+	uint32_t height;
+
+	// 1 ( I8 ), 3 ( BGR888 ) or 4 ( BGRA8888 )
+	uint32_t channelCount;
+
+	// Rows are always top to bottom, whatever the file said
+	std::vector<std::byte> imageData;
+};
+
+class TGASupport
+{
+public:
+	TGASupport() = delete;
+	static bool Load_TGA( std::string_view fileName, TGAFile &buff );
+	static bool Load_TGA( const uint8_t *pData, std::size_t size, TGAFile &buff );
+};
@@ -1,374 +1,851 @@
-
 #include "TiffSupport.h"
 
+#include "../../libs/stb/stb_image.h"
+#include "../MappedFile.h"
+#include "../PixelConversion.h"
+#include "../util.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <new>
 #include <vector>
 
-bool TiffSupport::Load_TIFF( std::string_view fileName, TIFFFile &buff )
+// TIFF field types we read values of
+enum TIFFFieldType
 {
-	buff.isValid = false;
+	FIELDTYPE_BYTE = 1,
+	FIELDTYPE_SHORT = 3,
+	FIELDTYPE_LONG = 4,
+	FIELDTYPE_LONG8 = 16, // BigTIFF only
+};
+
+// Classic TIFF has 42 in the header, BigTIFF has 43 and 64 bit offsets everywhere
+static constexpr uint16_t TIFF_MAGIC = 42;
+static constexpr uint16_t BIGTIFF_MAGIC = 43;
+
+// The tags the loader cares about
+enum TIFFTag
+{
+	TAG_IMAGE_WIDTH = 256,
+	TAG_IMAGE_LENGTH = 257,
+	TAG_BITS_PER_SAMPLE = 258,
+	TAG_COMPRESSION = 259,
+	TAG_PHOTOMETRIC_INTERPRETATION = 262,
+	TAG_STRIP_OFFSETS = 273,
+	TAG_SAMPLES_PER_PIXEL = 277,
+	TAG_ROWS_PER_STRIP = 278,
+	TAG_STRIP_BYTE_COUNTS = 279,
+	TAG_PLANAR_CONFIGURATION = 284,
+	TAG_PREDICTOR = 317,
+	TAG_TILE_WIDTH = 322,
+	TAG_TILE_LENGTH = 323,
+	TAG_TILE_OFFSETS = 324,
+	TAG_TILE_BYTE_COUNTS = 325,
+	TAG_EXTRA_SAMPLES = 338,
+	TAG_SAMPLE_FORMAT = 339,
+};
+
+// Compression tag values as they are stored in the file, File_TIFF_CompressionScheme doesn't line up with these
+enum TIFFCompressionTag
+{
+	TIFF_COMPRESSION_NONE = 1,
+	TIFF_COMPRESSION_LZW = 5,
+	TIFF_COMPRESSION_ADOBE_DEFLATE = 8,
+	TIFF_COMPRESSION_PACKBITS = 32773,
+	TIFF_COMPRESSION_DEFLATE = 32946,
+};
+
+enum TIFFPredictor
+{
+	PREDICTOR_NONE = 1,
+	PREDICTOR_HORIZONTAL = 2,
+	PREDICTOR_FLOATING_POINT = 3,
+};
 
-	std::ifstream TIFF_File( fileName.data(), std::ios::binary );
+// Photometric interpretation 4 is what the old loader treated as a separate alpha plane
+static constexpr uint16_t PHOTOMETRIC_MASK = 4;
 
-	if ( !TIFF_File.is_open() )
-		return false;
+// Deflate can't do better than about 1032:1, a segment claiming to unpack to more than that is corrupt
+static constexpr uint64_t MAX_COMPRESSION_RATIO = 1032;
 
-	File_TIFF_Signature Header {};
-	TIFF_File.read( reinterpret_cast<char *>( &Header ), sizeof( File_TIFF_Signature ) );
+// Set by SetThreadLimit, only the benchmark changes it
+static std::atomic<std::size_t> threadLimit = 0;
+
+// Bounds checked reads out of the mapped file, a broken offset fails the load instead of crashing.
+// Values are swapped into native order when the file is big-endian.
+struct TIFFReader
+{
+	const uint8_t *pData;
+	std::size_t nSize;
+	bool bBigEndian = false;
+	bool bBigTIFF = false;
 
-	if ( Header.nMagicNumber != 42 )
+	bool InBounds( uint64_t offset, uint64_t size ) const
 	{
-		std::cout << "Could not load " << fileName << ". Not a TIFF file." << std::endl;
-		TIFF_File.close();
-		return false;
+		return offset <= nSize && size <= nSize - offset;
 	}
 
-	if ( Header.nEndian[0] != 'I' || Header.nEndian[1] != 'I' )
+	template <typename T>
+	bool Read( uint64_t offset, T &value ) const
 	{
-		std::cout << "Could not load " << fileName << ". Only little-endian TIFF files are supported." << std::endl;
-		TIFF_File.close();
-		return false;
+		if ( !InBounds( offset, sizeof( value ) ) )
+			return false;
+
+		// Assemble from the bytes, works for either file byte order on any host
+		uint64_t assembled = 0;
+		for ( std::size_t i = 0; i < sizeof( value ); i++ )
+		{
+			const std::size_t shift = bBigEndian ? sizeof( value ) - 1 - i : i;
+			assembled |= static_cast<uint64_t>( pData[offset + i] ) << ( shift * 8 );
+		}
+		value = static_cast<T>( assembled );
+		return true;
+	}
+
+	bool Read16( uint64_t offset, uint16_t &value ) const
+	{
+		return Read( offset, value );
 	}
 
-	std::vector<File_TIFF_IFD> IFDs;
-	std::vector<uint32_t> nOffsetToIFDs;
-	int nIFDs = 0; // Keeps track of the number of IFD's
+	bool Read32( uint64_t offset, uint32_t &value ) const
+	{
+		return Read( offset, value );
+	}
 
-	uint32_t nOffsetNextIFD = Header.nOffsetIFD;
-	while ( nOffsetNextIFD != 0 )
+	bool Read64( uint64_t offset, uint64_t &value ) const
 	{
-		TIFF_File.seekg( nOffsetNextIFD, std::ios::beg );
-		File_TIFF_IFD CurrentIFD;
+		return Read( offset, value );
+	}
 
-		TIFF_File.read( reinterpret_cast<char *>( &CurrentIFD.nEntryCount ), sizeof( uint16_t ) );
+	// Offsets are 32 bit in classic TIFF and 64 bit in BigTIFF
+	bool ReadOffset( uint64_t offset, uint64_t &value ) const
+	{
+		if ( bBigTIFF )
+			return Read64( offset, value );
 
-		TIFF_File.seekg( nOffsetNextIFD + sizeof( uint16_t ), std::ios::beg );
+		uint32_t value32;
+		if ( !Read32( offset, value32 ) )
+			return false;
+		value = value32;
+		return true;
+	}
 
-		CurrentIFD.aIFD.resize( CurrentIFD.nEntryCount );
+	// BigTIFF entries are tag, type, 8 byte count and an 8 byte value field
+	uint64_t EntrySize() const
+	{
+		return bBigTIFF ? 20 : sizeof( File_TIFF_IFD_Entry );
+	}
 
-		TIFF_File.read( reinterpret_cast<char *>( CurrentIFD.aIFD.data() ), CurrentIFD.nEntryCount * sizeof( File_TIFF_IFD_Entry ) );
+	uint64_t ValueFieldSize() const
+	{
+		return bBigTIFF ? 8 : 4;
+	}
+};
 
-		TIFF_File.read( reinterpret_cast<char *>( &CurrentIFD.nNextIFD ), sizeof( uint32_t ) );
+// One IFD, resolved into what we need to decode it
+struct TIFFDirectory
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint16_t bitsPerSample = 0;
+	uint16_t samplesPerPixel = 1;
+	uint16_t photometric = 0;
+	uint16_t compression = 1;
+	uint16_t planarConfiguration = 1;
+	uint16_t predictor = PREDICTOR_NONE;
+	uint16_t sampleFormat = SAMPLEFORMAT_UINT;
+	uint16_t extraSamples = 0;
+
+	uint32_t rowsPerStrip = UINT32_MAX;
+	uint32_t tileWidth = 0;
+	uint32_t tileLength = 0;
+
+	// Either the strip or the tile arrays, depending on the layout
+	std::vector<uint64_t> segmentOffsets;
+	std::vector<uint64_t> segmentByteCounts;
+
+	bool IsTiled() const
+	{
+		return tileWidth != 0 && tileLength != 0;
+	}
+};
 
-		CurrentIFD.aIFD.push_back( {} );
+// Reads every value of an entry, no matter if it is stored inline or somewhere else in the file
+static bool ReadTagValues( const TIFFReader &reader, uint64_t entryOffset, std::vector<uint64_t> &values )
+{
+	uint16_t fieldType;
+	uint64_t count;
+	if ( !reader.Read16( entryOffset + 2, fieldType ) || !reader.ReadOffset( entryOffset + 4, count ) )
+		return false;
 
-		IFDs.push_back( CurrentIFD );
-		nOffsetToIFDs.push_back( nOffsetNextIFD );
+	uint32_t valueSize;
+	switch ( fieldType )
+	{
+		case FIELDTYPE_BYTE:
+			valueSize = 1;
+			break;
+		case FIELDTYPE_SHORT:
+			valueSize = 2;
+			break;
+		case FIELDTYPE_LONG:
+			valueSize = 4;
+			break;
+		case FIELDTYPE_LONG8:
+			valueSize = 8;
+			break;
+		default:
+			return false;
+	}
 
-		nOffsetNextIFD = CurrentIFD.nNextIFD;
-		nIFDs++;
+	// Values that fit in the value field are stored right there
+	const uint64_t valueField = entryOffset + ( reader.bBigTIFF ? 12 : 8 );
+	uint64_t valueOffset = valueField;
+	if ( count > reader.ValueFieldSize() / valueSize )
+	{
+		if ( !reader.ReadOffset( valueField, valueOffset ) )
+			return false;
 	}
 
-	uint16_t nPhotometricInterpretation;
+	// Checking count on its own first keeps count * valueSize from overflowing
+	if ( count > reader.nSize || !reader.InBounds( valueOffset, count * valueSize ) )
+		return false;
 
-	for ( int i = 0; i < nIFDs; i++ )
-		for ( int j = 0; j < IFDs[i].nEntryCount; j++ )
+	values.resize( count );
+	for ( uint64_t i = 0; i < count; i++ )
+	{
+		const uint64_t offset = valueOffset + i * valueSize;
+		if ( valueSize == 1 )
+			values[i] = reader.pData[offset];
+		else if ( valueSize == 2 )
 		{
-			// All the tags we check
-			// 256 - Width
-			// 257 - Height
-			// 258 - BitsPerSample
-			// 259 - Compression Scheme used on the image
-			// 262 - Photometric Interpretation
-			// All the fieldtypes we ever need
-			// 3 - SHORT
-			uint16_t Tag = IFDs[i].aIFD[j].nTag;
-			uint16_t FieldType = IFDs[i].aIFD[j].nFieldType;
-			uint32_t Count = IFDs[i].aIFD[j].nCount;
-			uint32_t Value = IFDs[i].aIFD[j].nOffsetOrValue;
-
-			if ( Tag == 256 && FieldType == 3 && Count == 1 )
-			{
-				buff.width = (unsigned int)static_cast<uint32_t>( Value );
-			}
-			// Height
-			else if ( Tag == 257 && FieldType == 3 && Count == 1 )
-			{
-				buff.height = (unsigned int)static_cast<uint32_t>( Value );
-			}
-			// Bits Per Sample
-			else if ( Tag == 258 && FieldType == 3 && Count > 0 )
-			{
-				// BitsPerSample tag (Tag 258), FieldType 3 (SHORT), Count > 0
-				TIFF_File.seekg( IFDs[i].aIFD[j].nOffsetOrValue, std::ios::beg );
-				std::vector<uint16_t> nBitsPerSample( IFDs[i].aIFD[j].nCount );
-				TIFF_File.read( reinterpret_cast<char *>( nBitsPerSample.data() ), IFDs[i].aIFD[j].nCount * sizeof( uint16_t ) );
+			uint16_t value = 0;
+			reader.Read16( offset, value );
+			values[i] = value;
+		}
+		else if ( valueSize == 4 )
+		{
+			uint32_t value = 0;
+			reader.Read32( offset, value );
+			values[i] = value;
+		}
+		else
+			reader.Read64( offset, values[i] );
+	}
+	return true;
+}
 
-				std::cout << "BitsPerSample values: ";
-				for ( uint16_t value : nBitsPerSample )
-				{
-					std::cout << value << " ";
-				}
-				std::cout << std::endl;
+static bool ReadDirectory( const TIFFReader &reader, uint64_t directoryOffset, TIFFDirectory &directory, uint64_t &nextDirectoryOffset )
+{
+	uint64_t entryCount;
+	if ( reader.bBigTIFF )
+	{
+		if ( !reader.Read64( directoryOffset, entryCount ) )
+			return false;
+	}
+	else
+	{
+		uint16_t entryCount16;
+		if ( !reader.Read16( directoryOffset, entryCount16 ) )
+			return false;
+		entryCount = entryCount16;
+	}
 
-				if ( !nBitsPerSample.empty() )
-				{
-					// bits per sample refers to the number of bits used to
-					// represent the intensity of color information in a single channel
-					// In other words, bits per channel
-					//					nBitsPerChannel = static_cast<int>( nBitsPerSample[0] );
-					switch ( static_cast<int>( nBitsPerSample[0] ) )
-					{
-						case U8:
-						case FP16:
-						case FP32:
-							buff.type = static_cast<TIFFImageType>( nBitsPerSample[0] );
-							break;
-						default:
-							return false;
-					}
-				}
-			}
-			// Compression Scheme
-			else if ( Tag == 259 && FieldType == 3 && Count == 1 )
-			{
-				switch ( IFDs[i].aIFD[j].nOffsetOrValue )
-				{
-					case 1:
-						buff.compression = COMPRESSION_NONE;
-						break;
+	const uint64_t entrySize = reader.EntrySize();
+	const uint64_t firstEntry = directoryOffset + ( reader.bBigTIFF ? sizeof( uint64_t ) : sizeof( uint16_t ) );
+	if ( !reader.InBounds( firstEntry, entryCount * entrySize ) )
+		return false;
 
-					case 2:
-						buff.compression = COMPRESSION_CCITT_GROUP3_1D;
-						break;
+	std::vector<uint64_t> stripOffsets, stripByteCounts, tileOffsets, tileByteCounts;
+	std::vector<uint64_t> values;
+	for ( uint64_t i = 0; i < entryCount; i++ )
+	{
+		const uint64_t entryOffset = firstEntry + i * entrySize;
+
+		uint16_t tag;
+		if ( !reader.Read16( entryOffset, tag ) )
+			return false;
 
-					case 3:
-						buff.compression = COMPRESSION_CCITT_GROUP3_2D;
-						break;
+		// Tags we don't know may use field types we can't read, just skip them
+		if ( !ReadTagValues( reader, entryOffset, values ) || values.empty() )
+			continue;
 
-					case4:
-						buff.compression = COMPRESSION_CCITT_GROUP3_4D;
-						break;
+		// Per sample tags ( BitsPerSample, SampleFormat ) must be the same for every sample, we use the first value
+		switch ( tag )
+		{
+			case TAG_IMAGE_WIDTH:
+				directory.width = static_cast<uint32_t>( values[0] );
+				break;
+			case TAG_IMAGE_LENGTH:
+				directory.height = static_cast<uint32_t>( values[0] );
+				break;
+			case TAG_BITS_PER_SAMPLE:
+				directory.bitsPerSample = static_cast<uint16_t>( values[0] );
+				break;
+			case TAG_COMPRESSION:
+				directory.compression = static_cast<uint16_t>( values[0] );
+				break;
+			case TAG_PHOTOMETRIC_INTERPRETATION:
+				directory.photometric = static_cast<uint16_t>( values[0] );
+				break;
+			case TAG_STRIP_OFFSETS:
+				stripOffsets = values;
+				break;
+			case TAG_SAMPLES_PER_PIXEL:
+				directory.samplesPerPixel = static_cast<uint16_t>( values[0] );
+				break;
+			case TAG_ROWS_PER_STRIP:
+				directory.rowsPerStrip = static_cast<uint32_t>( values[0] );
+				break;
+			case TAG_STRIP_BYTE_COUNTS:
+				stripByteCounts = values;
+				break;
+			case TAG_PLANAR_CONFIGURATION:
+				directory.planarConfiguration = static_cast<uint16_t>( values[0] );
+				break;
+			case TAG_PREDICTOR:
+				directory.predictor = static_cast<uint16_t>( values[0] );
+				break;
+			case TAG_TILE_WIDTH:
+				directory.tileWidth = static_cast<uint32_t>( values[0] );
+				break;
+			case TAG_TILE_LENGTH:
+				directory.tileLength = static_cast<uint32_t>( values[0] );
+				break;
+			case TAG_TILE_OFFSETS:
+				tileOffsets = values;
+				break;
+			case TAG_TILE_BYTE_COUNTS:
+				tileByteCounts = values;
+				break;
+			case TAG_EXTRA_SAMPLES:
+				directory.extraSamples = static_cast<uint16_t>( values.size() );
+				break;
+			case TAG_SAMPLE_FORMAT:
+				directory.sampleFormat = static_cast<uint16_t>( values[0] );
+				break;
+		}
+	}
 
-					case 5:
-						buff.compression = COMPRESSION_LZW;
-						break;
+	if ( directory.IsTiled() )
+	{
+		directory.segmentOffsets = std::move( tileOffsets );
+		directory.segmentByteCounts = std::move( tileByteCounts );
+	}
+	else
+	{
+		directory.segmentOffsets = std::move( stripOffsets );
+		directory.segmentByteCounts = std::move( stripByteCounts );
+	}
 
-					case 6:
-						buff.compression = COMPRESSION_JPEG_OLD;
-						break;
+	if ( !reader.ReadOffset( firstEntry + entryCount * entrySize, nextDirectoryOffset ) )
+		nextDirectoryOffset = 0;
+	return true;
+}
 
-					case 7:
-						buff.compression = COMPRESSION_JPEG;
-						break;
+// TIFF flavoured LZW, codes are MSB first and the code width grows one code early.
+// Returns the amount of bytes written, output that doesn't fit into pDest is dropped.
+static std::size_t DecodeLZW( const uint8_t *pSource, std::size_t sourceSize, uint8_t *pDest, std::size_t destSize )
+{
+	constexpr uint16_t CLEAR_CODE = 256;
+	constexpr uint16_t END_OF_INFORMATION = 257;
+	constexpr uint16_t FIRST_CODE = 258;
+	constexpr uint16_t NO_CODE = 0xFFFF;
 
-					case 8:
-						buff.compression = COMPRESSION_DEFLATE;
-						break;
+	// Every string is its prefix string plus one byte, so we only keep the last byte and walk the prefixes backwards
+	struct LZWEntry
+	{
+		uint16_t prefix;
+		uint16_t length;
+		uint8_t first;
+		uint8_t last;
+	};
+
+	std::array<LZWEntry, 4096> table;
+	for ( uint16_t i = 0; i < 256; i++ )
+		table[i] = { NO_CODE, 1, static_cast<uint8_t>( i ), static_cast<uint8_t>( i ) };
+
+	std::size_t written = 0;
+	std::size_t bitPosition = 0;
+	const std::size_t bitCount = sourceSize * 8;
+	uint16_t codeWidth = 9;
+	uint16_t nextCode = FIRST_CODE;
+	uint16_t previousCode = NO_CODE;
+
+	while ( bitPosition + codeWidth <= bitCount && written < destSize )
+	{
+		// Codes are at most 12 bits, so three bytes always cover one
+		uint32_t bits = 0;
+		const std::size_t byte = bitPosition / 8;
+		for ( std::size_t i = 0; i < 3; i++ )
+			bits = ( bits << 8 ) | ( byte + i < sourceSize ? pSource[byte + i] : 0 );
+		const uint16_t code = ( bits >> ( 24 - codeWidth - bitPosition % 8 ) ) & ( ( 1u << codeWidth ) - 1 );
+		bitPosition += codeWidth;
+
+		if ( code == END_OF_INFORMATION )
+			break;
+
+		if ( code == CLEAR_CODE )
+		{
+			codeWidth = 9;
+			nextCode = FIRST_CODE;
+			previousCode = NO_CODE;
+			continue;
+		}
 
-					case 32946:
-						buff.compression = COMPRESSION_DEFLATE_ITK_GDCM;
-						break;
+		if ( previousCode == NO_CODE )
+		{
+			if ( code > 255 )
+				break;
+			pDest[written++] = static_cast<uint8_t>( code );
+			previousCode = code;
+			continue;
+		}
 
-					case 32773:
-						buff.compression = COMPRESSION_PACKBITS;
-						break;
-				}
-			}
-			// Photometric interpretation
-			else if ( Tag == 262 && FieldType == 3 && Count == 1 )
-			{
-				bool bStore;
-				if ( nPhotometricInterpretation == 2 )
-					bStore = true;
-
-				// TODO: This code makes no sense but it should work
-				// Like what, read something as uint16 regardless?
-				// If the value fits in the offset, use it directly
-				if ( Count * sizeof( uint16_t ) <= sizeof( Value ) )
-				{
-					nPhotometricInterpretation = static_cast<uint16_t>( Value );
-				}
-				else
-				{
-					// Seek to the offset and read the value
-					TIFF_File.seekg( Value, std::ios::beg );
-					TIFF_File.read( reinterpret_cast<char *>( &nPhotometricInterpretation ), sizeof( uint16_t ) );
-				}
+		if ( code > nextCode || ( code == nextCode && nextCode >= table.size() ) )
+			break;
+
+		// The code after the newest one is the previous string plus its own first byte
+		const LZWEntry &previous = table[previousCode];
+		const uint8_t appended = code == nextCode ? previous.first : table[code].first;
+		if ( nextCode < table.size() )
+			table[nextCode++] = { previousCode, static_cast<uint16_t>( previous.length + 1 ), previous.first, appended };
+
+		const LZWEntry &entry = table[code];
+		std::size_t position = written + entry.length;
+		for ( uint16_t current = code; current != NO_CODE; current = table[current].prefix )
+			if ( --position < destSize )
+				pDest[position] = table[current].last;
+		written = std::min( written + entry.length, destSize );
+
+		if ( nextCode + 1u >= ( 1u << codeWidth ) && codeWidth < 12 )
+			codeWidth++;
+		previousCode = code;
+	}
 
-				if ( nPhotometricInterpretation == 4 )
-					buff.hasAlpha = true;
+	return written;
+}
 
-				if ( bStore )
-					nPhotometricInterpretation = 2;
-			}
+static std::size_t DecodePackBits( const uint8_t *pSource, std::size_t sourceSize, uint8_t *pDest, std::size_t destSize )
+{
+	std::size_t read = 0;
+	std::size_t written = 0;
+	while ( read < sourceSize && written < destSize )
+	{
+		const int8_t header = static_cast<int8_t>( pSource[read++] );
+		if ( header >= 0 )
+		{
+			// Literal run
+			const std::size_t count = std::min<std::size_t>( { static_cast<std::size_t>( header ) + 1, sourceSize - read, destSize - written } );
+			std::memcpy( pDest + written, pSource + read, count );
+			read += count;
+			written += count;
+		}
+		else if ( header != -128 && read < sourceSize )
+		{
+			// Repeated byte, -128 is a no-op
+			const std::size_t count = std::min<std::size_t>( 1 - header, destSize - written );
+			std::memset( pDest + written, pSource[read++], count );
+			written += count;
 		}
+	}
+	return written;
+}
+
+static bool IsSupportedCompression( uint16_t compression )
+{
+	switch ( compression )
+	{
+		case TIFF_COMPRESSION_NONE:
+		case TIFF_COMPRESSION_LZW:
+		case TIFF_COMPRESSION_ADOBE_DEFLATE:
+		case TIFF_COMPRESSION_PACKBITS:
+		case TIFF_COMPRESSION_DEFLATE:
+			return true;
+		default:
+			return false;
+	}
+}
 
-	int nCountChannels = buff.hasAlpha ? 4 : 3;
+// Decompresses one strip or tile, a short segment leaves the rest of pDest as it is
+static bool DecompressSegment( uint16_t compression, const uint8_t *pSource, std::size_t sourceSize, uint8_t *pDest, std::size_t destSize )
+{
+	switch ( compression )
+	{
+		case TIFF_COMPRESSION_LZW:
+			return DecodeLZW( pSource, sourceSize, pDest, destSize ) > 0;
+		case TIFF_COMPRESSION_PACKBITS:
+			return DecodePackBits( pSource, sourceSize, pDest, destSize ) > 0;
+		case TIFF_COMPRESSION_ADOBE_DEFLATE:
+		case TIFF_COMPRESSION_DEFLATE:
+			// Both deflate flavours are a zlib stream
+			if ( sourceSize > INT32_MAX || destSize > INT32_MAX )
+				return false;
+			return stbi_zlib_decode_buffer( reinterpret_cast<char *>( pDest ), static_cast<int>( destSize ), reinterpret_cast<const char *>( pSource ), static_cast<int>( sourceSize ) ) > 0;
+		default:
+			return false;
+	}
+}
 
-	buff.channelCount = nCountChannels;
+// Every sample is stored as the difference to the same sample of the pixel to its left
+template <typename T>
+static void UndoHorizontalPredictor( uint8_t *pRow, std::size_t sampleCount, std::size_t samplesPerPixel )
+{
+	auto pSamples = reinterpret_cast<T *>( pRow );
+	for ( std::size_t i = samplesPerPixel; i < sampleCount; i++ )
+		pSamples[i] = static_cast<T>( pSamples[i] + pSamples[i - samplesPerPixel] );
+}
 
-	unsigned int bufferSize = buff.width * buff.height * ( buff.type / 8 ) * nCountChannels;
+// Floats are split into byte planes ( most significant first ) and then byte-wise differenced
+static void UndoFloatingPointPredictor( uint8_t *pRow, std::size_t sampleCount, std::size_t samplesPerPixel, std::size_t sampleSize, std::vector<uint8_t> &scratch )
+{
+	const std::size_t rowBytes = sampleCount * sampleSize;
+	for ( std::size_t i = samplesPerPixel; i < rowBytes; i++ )
+		pRow[i] = static_cast<uint8_t>( pRow[i] + pRow[i - samplesPerPixel] );
+
+	scratch.assign( pRow, pRow + rowBytes );
+	for ( std::size_t sample = 0; sample < sampleCount; sample++ )
+		for ( std::size_t byte = 0; byte < sampleSize; byte++ )
+			pRow[sample * sampleSize + byte] = scratch[( sampleSize - byte - 1 ) * sampleCount + sample];
+}
 
-	buff.imageData.resize( bufferSize );
+static void UndoPredictor( const TIFFDirectory &directory, uint8_t *pSegment, std::size_t rowBytes, uint32_t rows )
+{
+	const std::size_t sampleSize = directory.bitsPerSample / 8;
+	const std::size_t sampleCount = rowBytes / sampleSize;
 
-	bool bReadRGB = false;
-	bool bReadAlpha = false;
-	uint16_t TextureType = 0;
+	std::vector<uint8_t> scratch;
+	for ( uint32_t row = 0; row < rows; row++ )
+	{
+		uint8_t *pRow = pSegment + row * rowBytes;
+		if ( directory.predictor == PREDICTOR_FLOATING_POINT )
+			UndoFloatingPointPredictor( pRow, sampleCount, directory.samplesPerPixel, sampleSize, scratch );
+		else if ( sampleSize == 1 )
+			UndoHorizontalPredictor<uint8_t>( pRow, sampleCount, directory.samplesPerPixel );
+		else if ( sampleSize == 2 )
+			UndoHorizontalPredictor<uint16_t>( pRow, sampleCount, directory.samplesPerPixel );
+		else
+			UndoHorizontalPredictor<uint32_t>( pRow, sampleCount, directory.samplesPerPixel );
+	}
+}
 
-	std::vector<std::byte> tempAlphaBuffer;
-	std::vector<std::byte> tempRGBBuffer;
+// Decodes every strip or tile of a directory straight into pDest, which is width * height * pixelSize bytes.
+// Segments don't overlap in the output so they are decoded in parallel, compressed ones included.
+static bool DecodeDirectory( const TIFFReader &reader, const TIFFDirectory &directory, uint8_t *pDest )
+{
+	if ( !IsSupportedCompression( directory.compression ) )
+	{
+		std::cout << "TIFF compression scheme " << directory.compression << " is not supported." << std::endl;
+		return false;
+	}
 
-	for ( int i = 0; i < nIFDs; i++ )
+	if ( directory.predictor != PREDICTOR_NONE && directory.predictor != PREDICTOR_HORIZONTAL && directory.predictor != PREDICTOR_FLOATING_POINT )
 	{
-		bool bHasData;
-		bool bIsAlpha;
+		std::cout << "TIFF predictor " << directory.predictor << " is not supported." << std::endl;
+		return false;
+	}
 
-		// Check for StripOffsets and StripByteCounts Tags
-		// Each IFD may only have one
-		uint32_t nStripOffsets = 0;
-		uint32_t nStripBytes = 0;
+	if ( directory.planarConfiguration != 1 )
+	{
+		std::cout << "Planar TIFF files are not supported." << std::endl;
+		return false;
+	}
 
-		// For each IFD Entry
-		for ( int j = 0; j < IFDs[i].nEntryCount; j++ )
-		{
-			// Convert to easier to read format
-			uint16_t Tag = IFDs[i].aIFD[j].nTag;
-			uint16_t FieldType = IFDs[i].aIFD[j].nFieldType;
-			uint32_t Count = IFDs[i].aIFD[j].nCount;
-			uint32_t Value = IFDs[i].aIFD[j].nOffsetOrValue;
+	const std::size_t sampleSize = directory.bitsPerSample / 8;
+	const std::size_t pixelSize = directory.samplesPerPixel * sampleSize;
+	const uint32_t segmentWidth = directory.IsTiled() ? directory.tileWidth : directory.width;
+	const uint32_t segmentHeight = directory.IsTiled() ? directory.tileLength : std::min( directory.rowsPerStrip, directory.height );
+	const uint32_t segmentsAcross = ( directory.width + segmentWidth - 1 ) / segmentWidth;
+	const uint32_t segmentsDown = ( directory.height + segmentHeight - 1 ) / segmentHeight;
 
-			if ( Tag == 262 && FieldType == 3 && Count == 1 )
-			{
-				// This IFD contains image data
-				bHasData = true;
+	const std::size_t segmentCount = static_cast<std::size_t>( segmentsAcross ) * segmentsDown;
+	if ( directory.segmentOffsets.size() < segmentCount || directory.segmentByteCounts.size() < segmentCount )
+	{
+		std::cout << "TIFF file is missing strip or tile offsets." << std::endl;
+		return false;
+	}
 
-				// TODO: This code makes no sense but it should work
-				// Like what, read something as uint16 regardless?
-				// If the value fits in the offset, use it directly
-				if ( Count * sizeof( uint16_t ) <= sizeof( Value ) )
-				{
-					TextureType = static_cast<uint16_t>( Value );
-				}
-				else
-				{
-					// Seek to the offset and read the value
-					TIFF_File.seekg( Value, std::ios::beg );
-					TIFF_File.read( reinterpret_cast<char *>( &TextureType ), sizeof( uint16_t ) );
-				}
+	// Every worker allocates a whole segment, tiles that size are a corrupt header and not a real file
+	if ( static_cast<uint64_t>( segmentWidth ) * segmentHeight > UINT32_MAX )
+	{
+		std::cout << "TIFF strips or tiles are too large." << std::endl;
+		return false;
+	}
 
-				// This IFD has Alpha Information? Yes:No
-				bIsAlpha = TextureType == 4 ? true : false;
-			}
-			else if ( Tag == 273 )
-			{
-				nStripOffsets = Value;
-			}
-			else if ( Tag == 279 )
-			{
-				nStripBytes = Value;
-			}
-		}
+	// Big-endian samples are swapped as part of the copy into place, so there's no extra pass over the image.
+	// The horizontal predictor works on native values and needs them swapped before it runs,
+	// the floating point one is byte order independent and already hands back native floats.
+	const bool bSwap = reader.bBigEndian && sampleSize > 1;
+	const bool bSwapBeforePredictor = bSwap && directory.predictor == PREDICTOR_HORIZONTAL;
+	const bool bSwapOnCopy = bSwap && directory.predictor == PREDICTOR_NONE;
+
+	std::atomic<bool> bFailed = false;
+	util::parallel_for( segmentCount, [&]( std::size_t segment )
+						{
+							const uint32_t x = static_cast<uint32_t>( segment % segmentsAcross ) * segmentWidth;
+							const uint32_t y = static_cast<uint32_t>( segment / segmentsAcross ) * segmentHeight;
+
+							// Tiles are padded out to the full tile size, strips are only as tall as the rows that are left
+							const uint32_t rows = std::min( segmentHeight, directory.height - y );
+							const uint32_t storedRows = directory.IsTiled() ? segmentHeight : rows;
+							const std::size_t copyBytes = std::min( segmentWidth, directory.width - x ) * pixelSize;
+							const std::size_t rowBytes = segmentWidth * pixelSize;
+							const std::size_t segmentBytes = rowBytes * storedRows;
+
+							const uint64_t offset = directory.segmentOffsets[segment];
+							const uint64_t byteCount = directory.segmentByteCounts[segment];
+							const bool bCompressed = directory.compression != TIFF_COMPRESSION_NONE;
+							if ( !reader.InBounds( offset, bCompressed ? byteCount : segmentBytes ) || ( !bCompressed && byteCount < segmentBytes ) ||
+								 ( bCompressed && segmentBytes / MAX_COMPRESSION_RATIO > byteCount ) )
+							{
+								bFailed = true;
+								return;
+							}
+
+							// Uncompressed segments are copied straight out of the mapping,
+							// everything else is decoded into a buffer owned by this segment first
+							const uint8_t *pSource = reader.pData + offset;
+							std::vector<uint8_t> decoded;
+							if ( bCompressed )
+							{
+								try
+								{
+									decoded.resize( segmentBytes );
+								}
+								catch ( const std::bad_alloc & )
+								{
+									bFailed = true;
+									return;
+								}
+								if ( !DecompressSegment( directory.compression, pSource, byteCount, decoded.data(), segmentBytes ) )
+								{
+									bFailed = true;
+									return;
+								}
+							}
+							else if ( directory.predictor != PREDICTOR_NONE )
+								decoded.assign( pSource, pSource + segmentBytes );
+
+							if ( bSwapBeforePredictor )
+								PixelConversion::ByteSwap( decoded.data(), decoded.data(), rows * rowBytes / sampleSize, sampleSize );
+
+							if ( directory.predictor != PREDICTOR_NONE )
+								UndoPredictor( directory, decoded.data(), rowBytes, rows );
+
+							if ( !decoded.empty() )
+								pSource = decoded.data();
+
+							for ( uint32_t row = 0; row < rows; row++ )
+							{
+								uint8_t *pRow = pDest + ( ( static_cast<std::size_t>( y ) + row ) * directory.width + x ) * pixelSize;
+								if ( bSwapOnCopy )
+									PixelConversion::ByteSwap( pSource + row * rowBytes, pRow, copyBytes / sampleSize, sampleSize );
+								else
+									std::memcpy( pRow, pSource + row * rowBytes, copyBytes );
+							}
+						},
+						threadLimit.load( std::memory_order_relaxed ) );
+
+	if ( bFailed )
+		std::cout << "TIFF file has strips or tiles that are out of bounds or could not be decompressed." << std::endl;
+	return !bFailed;
+}
 
-		// We know where the image data is now and can read it
-		if ( ( nStripOffsets != 0 ) && ( nStripBytes != 0 ) && bHasData )
-		{
-			// Move there first otherwise we read from random parts of the file
-			TIFF_File.seekg( nStripOffsets, std::ios::beg );
+// Whether the strips or tiles of a directory can hold the imageBytes its header claims.
+// Checked before allocating, a corrupt or truncated header can claim gigabytes.
+static bool SegmentsCoverImage( const TIFFReader &reader, const TIFFDirectory &directory, uint64_t imageBytes )
+{
+	// No segment can be bigger than the file, so the sum stays well inside 64 bits
+	uint64_t segmentBytes = 0;
+	for ( const uint64_t byteCount : directory.segmentByteCounts )
+		segmentBytes += std::min<uint64_t>( byteCount, reader.nSize );
+
+	if ( directory.compression == TIFF_COMPRESSION_NONE )
+		return segmentBytes >= imageBytes;
+	return segmentBytes >= imageBytes / MAX_COMPRESSION_RATIO;
+}
 
-			if ( bIsAlpha && !bReadAlpha )
-			{
-				// Debugging only
-				if ( !buff.hasAlpha )
-				{
-					std::cout << "Found Alpha Strip without finding photometric interpretation for it. Something is wrong." << std::endl;
-					continue;
-				}
+static bool LoadTIFF( const uint8_t *pData, std::size_t nSize, std::string_view fileName, TIFFFile &buff )
+{
+	buff.isValid = false;
+	buff.hasAlpha = false;
+	buff.compression = COMPRESSION_NONE;
+	// Unsigned integer is the default when the tag is missing
+	buff.sampleFormat = SAMPLEFORMAT_UINT;
 
-				// We will write the alpha after the rgb data. That way we don't have to mix the two dynamically
-				// We can just fish it out again later when we need it. You just need to account for this when the input format is TIFF
-
-				// 8f, 16f, 32f
-				//				if ( buff.type == 8 )
-				//					TIFF_File.read( reinterpret_cast<char *>( ImageInMemory->pImageData + RGBSizeOffset * sizeof( char ) ), nStripBytes );
-				//				else if ( ImageInMemory->nBitCountPerChannel == 16 )
-				//					TIFF_File.read( reinterpret_cast<char *>( ImageInMemory->pImageData16f + RGBSizeOffset * sizeof( uint16_t ) ), nStripBytes );
-				//				else if ( ImageInMemory->nBitCountPerChannel == 32 )
-				//					TIFF_File.read( reinterpret_cast<char *>( ImageInMemory->pImageData32f + RGBSizeOffset * sizeof( float ) ), nStripBytes );
-				tempAlphaBuffer.resize( nStripBytes );
-				TIFF_File.read( reinterpret_cast<char *>( tempAlphaBuffer.data() ), nStripBytes );
-
-				// We now have the data stop checking again
-				bReadAlpha = true;
-			}
-			else if ( !bReadRGB ) // RGB Data
-			{
-				// 8f, 16f, 32f
-				//				if ( ImageInMemory->nBitCountPerChannel == 8 )
-				//					TIFF_File.read( reinterpret_cast<char *>( ImageInMemory->pImageData ), nStripBytes );
-				//				else if ( ImageInMemory->nBitCountPerChannel == 16 )
-				//					TIFF_File.read( reinterpret_cast<char *>( ImageInMemory->pImageData16f ), nStripBytes );
-				//				else if ( ImageInMemory->nBitCountPerChannel == 32 )
-				//					TIFF_File.read( reinterpret_cast<char *>( ImageInMemory->pImageData32f ), nStripBytes );
-				tempRGBBuffer.resize( nStripBytes );
-				TIFF_File.read( reinterpret_cast<char *>( tempRGBBuffer.data() ), nStripBytes );
-
-				std::cout << "successfully found rgb image data in tif file" << std::endl;
-
-				// We now have the data stop checking again
-				bReadRGB = true;
-			}
-		}
+	TIFFReader reader { pData, nSize };
+
+	File_TIFF_Signature Header {};
+	if ( !reader.InBounds( 0, sizeof( File_TIFF_Signature ) ) )
+		return false;
+	std::memcpy( &Header.nEndian, reader.pData, sizeof( Header.nEndian ) );
+
+	if ( Header.nEndian[0] == 'M' && Header.nEndian[1] == 'M' )
+		reader.bBigEndian = true;
+	else if ( Header.nEndian[0] != 'I' || Header.nEndian[1] != 'I' )
+	{
+		std::cout << "Could not load " << fileName << ". Not a TIFF file." << std::endl;
+		return false;
 	}
 
-	if ( tempRGBBuffer.empty() )
+	reader.Read16( 2, Header.nMagicNumber );
+	reader.bBigTIFF = Header.nMagicNumber == BIGTIFF_MAGIC;
+
+	// BigTIFF has the offset size ( always 8 ) and a reserved 0 before the 64 bit offset of the first IFD
+	uint64_t nOffsetNextIFD = 0;
+	uint16_t nOffsetSize = 0;
+	if ( Header.nMagicNumber == TIFF_MAGIC )
+		reader.ReadOffset( 4, nOffsetNextIFD );
+	else if ( !reader.bBigTIFF || !reader.Read16( 4, nOffsetSize ) || nOffsetSize != 8 || !reader.Read64( 8, nOffsetNextIFD ) )
+	{
+		std::cout << "Could not load " << fileName << ". Not a TIFF file." << std::endl;
 		return false;
+	}
 
-	if ( !buff.hasAlpha )
+	// The first directory holding an image is the colour data.
+	// Some writers put the alpha into its own directory as a mask, we pick that up too.
+	std::vector<TIFFDirectory> directories;
+	while ( nOffsetNextIFD != 0 && directories.size() < 1024 )
 	{
-		//		if ( buff.type != FP16 )
+		TIFFDirectory directory;
+		if ( !ReadDirectory( reader, nOffsetNextIFD, directory, nOffsetNextIFD ) )
+			break;
+		directories.push_back( std::move( directory ) );
+	}
+
+	const TIFFDirectory *pColour = nullptr;
+	const TIFFDirectory *pMask = nullptr;
+	for ( const auto &directory : directories )
+	{
+		if ( directory.segmentOffsets.empty() )
+			continue;
+		if ( directory.photometric == PHOTOMETRIC_MASK )
 		{
-			buff.imageData = tempRGBBuffer;
-			buff.isValid = true;
-			return true;
+			if ( !pMask )
+				pMask = &directory;
 		}
+		else if ( !pColour )
+			pColour = &directory;
+	}
 
-		//		struct sh_t
-		//		{
-		//			short dat = 32767;
-		//
-		//			union
-		//			{
-		//				std::byte one;
-		//				std::byte two;
-		//			};
-		//		};
-		//
-		//		sh_t sh;
-
-		//		for ( int i = 0; i < tempRGBBuffer.size(); i += sizeof( short ) * 3 )
-		//		{
-		//			buff.imageData.push_back( tempRGBBuffer[i] );
-		//			buff.imageData.push_back( tempRGBBuffer[i + 1] );
-		//			buff.imageData.push_back( tempRGBBuffer[i + 2] );
-		//			buff.imageData.push_back( tempRGBBuffer[i + 3] );
-		//			buff.imageData.push_back( tempRGBBuffer[i + 4] );
-		//			buff.imageData.push_back( tempRGBBuffer[i + 5] );
-		//			buff.imageData.push_back( sh.one );
-		//			buff.imageData.push_back( sh.two );
-		//		}
-
-		buff.isValid = true;
-		return true;
+	if ( !pColour || pColour->width == 0 || pColour->height == 0 )
+	{
+		std::cout << "Could not load " << fileName << ". No image data found." << std::endl;
+		return false;
+	}
+
+	switch ( pColour->bitsPerSample )
+	{
+		case U8:
+		case FP16:
+		case FP32:
+			buff.type = static_cast<TIFFImageType>( pColour->bitsPerSample );
+			break;
+		default:
+			std::cout << "Could not load " << fileName << ". " << pColour->bitsPerSample << " bits per sample is not supported." << std::endl;
+			return false;
+	}
+
+	if ( pColour->samplesPerPixel != 3 && pColour->samplesPerPixel != 4 )
+	{
+		std::cout << "Could not load " << fileName << ". Only RGB and RGBA TIFF files are supported." << std::endl;
+		return false;
+	}
+
+	// A mask plane only counts when it lines up with the colour data
+	if ( pMask && ( pColour->samplesPerPixel != 3 || pMask->samplesPerPixel != 1 || pMask->bitsPerSample != pColour->bitsPerSample ||
+					pMask->width != pColour->width || pMask->height != pColour->height ) )
+		pMask = nullptr;
+
+	buff.width = pColour->width;
+	buff.height = pColour->height;
+	switch ( pColour->compression )
+	{
+		case TIFF_COMPRESSION_LZW:
+			buff.compression = COMPRESSION_LZW;
+			break;
+		case TIFF_COMPRESSION_ADOBE_DEFLATE:
+		case TIFF_COMPRESSION_DEFLATE:
+			buff.compression = COMPRESSION_DEFLATE;
+			break;
+		case TIFF_COMPRESSION_PACKBITS:
+			buff.compression = COMPRESSION_PACKBITS;
+			break;
+	}
+	buff.sampleFormat = static_cast<TIFFSampleFormat>( pColour->sampleFormat );
+	buff.hasAlpha = pColour->samplesPerPixel == 4 || pMask;
+	buff.channelCount = buff.hasAlpha ? 4 : 3;
+
+	const std::size_t sampleSize = buff.type / 8;
+	const uint64_t pixelCount = static_cast<uint64_t>( buff.width ) * buff.height;
+	const uint64_t maxPixels = std::min<uint64_t>( UINT64_MAX, SIZE_MAX ) / ( buff.channelCount * sampleSize );
+	if ( pixelCount > maxPixels || !SegmentsCoverImage( reader, *pColour, pixelCount * pColour->samplesPerPixel * sampleSize ) ||
+		 ( pMask && !SegmentsCoverImage( reader, *pMask, pixelCount * sampleSize ) ) )
+	{
+		std::cout << "Could not load " << fileName << ". The image is bigger than the data in the file." << std::endl;
+		return false;
 	}
 
-	for ( int i = 0, k = 0; i < tempAlphaBuffer.size(); i += ( buff.type / 8 ), k += 3 * ( buff.type / 8 ) )
+	try
+	{
+		buff.imageData.resize( pixelCount * buff.channelCount * sampleSize );
+	}
+	catch ( const std::bad_alloc & )
 	{
-		for ( int j = 0; j < ( buff.type / 8 ) * 3; j++ )
+		std::cout << "Could not load " << fileName << ". Out of memory." << std::endl;
+		return false;
+	}
+
+	// The colour data is decoded into the front of the final buffer, the mask then gets interleaved in place
+	auto pImage = reinterpret_cast<uint8_t *>( buff.imageData.data() );
+	if ( !DecodeDirectory( reader, *pColour, pImage ) )
+		return false;
+
+	if ( pMask )
+	{
+		std::vector<uint8_t> alpha;
+		try
 		{
-			buff.imageData.push_back( tempRGBBuffer[k + j] );
+			alpha.resize( pixelCount * sampleSize );
 		}
-		for ( int j = 0; j < ( buff.type / 8 ); j++ )
+		catch ( const std::bad_alloc & )
 		{
-			buff.imageData.push_back( tempAlphaBuffer[i + j] );
+			std::cout << "Could not load " << fileName << ". Out of memory." << std::endl;
+			return false;
 		}
+		if ( !DecodeDirectory( reader, *pMask, alpha.data() ) )
+			return false;
+		PixelConversion::InterleaveAlpha( pImage, alpha.data(), pixelCount, sampleSize );
 	}
 
 	buff.isValid = true;
 	return true;
 }
 
+bool TiffSupport::Load_TIFF( std::string_view fileName, TIFFFile &buff )
+{
+	buff.isValid = false;
+
+	MappedFile file;
+	if ( !file.Open( fileName ) )
+		return false;
+
+	return LoadTIFF( file.Data(), file.Size(), fileName, buff );
+}
+
+bool TiffSupport::Load_TIFF( const uint8_t *pData, std::size_t size, TIFFFile &buff )
+{
+	return LoadTIFF( pData, size, "TIFF in memory", buff );
+}
+
+void TiffSupport::SetThreadLimit( std::size_t threads )
+{
+	threadLimit = threads;
+}
+
 bool TiffSupport::Load_TIFF( const char *ccFileName, ImageData_t *ImageInMemory )
 {
 	// Load the file from the disk
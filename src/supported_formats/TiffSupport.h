@@ -169,6 +169,14 @@ enum TIFFImageType
 
 };
 
+// SampleFormat ( tag 339 ), how the bits of each sample are interpreted
+enum TIFFSampleFormat
+{
+	SAMPLEFORMAT_UINT = 1,
+	SAMPLEFORMAT_INT = 2,
+	SAMPLEFORMAT_IEEEFP = 3,
+};
+
 struct TIFFFile
 {
 	bool isValid;
@@ -176,6 +184,7 @@ struct TIFFFile
 	uint32_t height;
 	uint32_t channelCount;
 	TIFFImageType type;
+	TIFFSampleFormat sampleFormat;
 	File_TIFF_CompressionScheme compression;
 	bool hasAlpha;
 
@@ -191,5 +200,11 @@ class TiffSupport
 public:
 	TiffSupport() = delete;
 	static bool Load_TIFF( const char *cFileName, ImageData_t *ImageInMemory );
+	// Memory maps the file, every strip or tile is decoded in parallel straight into buff.imageData
 	static bool Load_TIFF( std::string_view fileName, TIFFFile &buff );
+	// Same as above, for a file that's already in memory
+	static bool Load_TIFF( const uint8_t *pData, std::size_t size, TIFFFile &buff );
+
+	// For the benchmark. Caps the threads strips and tiles are decoded on, 0 for all of them.
+	static void SetThreadLimit( std::size_t threads );
 };
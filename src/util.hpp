@@ -3,10 +3,14 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 /******************************/
 namespace util
@@ -61,4 +65,40 @@ namespace util
 	{
 		return N;
 	}
+
+	/**
+	 * Runs func( i ) for every i in [0, count) across worker threads.
+	 * Work items are handed out one at a time, so uneven items still balance.
+	 * Blocks until every item is done. threads == 0 uses every hardware thread.
+	 */
+	template <class F>
+	void parallel_for( std::size_t count, const F &func, std::size_t threads = 0 )
+	{
+		if ( threads == 0 )
+			threads = std::max( 1u, std::thread::hardware_concurrency() );
+		threads = std::min( threads, count );
+
+		if ( threads <= 1 )
+		{
+			for ( std::size_t i = 0; i < count; i++ )
+				func( i );
+			return;
+		}
+
+		std::atomic<std::size_t> next = 0;
+		auto worker = [&]()
+		{
+			for ( std::size_t i = next++; i < count; i = next++ )
+				func( i );
+		};
+
+		std::vector<std::thread> workers;
+		workers.reserve( threads - 1 );
+		for ( std::size_t i = 1; i < threads; i++ )
+			workers.emplace_back( worker );
+		worker();
+
+		for ( auto &thread : workers )
+			thread.join();
+	}
 } // namespace util